@@ -0,0 +1,1060 @@
+#include "Qudp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <map>
+#include <random>
+
+using namespace std::chrono;
+
+struct SignalData
+{
+	SignalData(double value, double timeStamp) :mValue(value), mTimeStamp_sec(timeStamp) {}
+	SignalData() : mValue(0), mTimeStamp_sec(0) {};
+
+	double mValue;
+	double mTimeStamp_sec;
+};
+
+/// <summary>
+/// Drops a fixed percentage of producer to consumer datagrams, acks are
+/// never lost so the numbers only reflect repair of the data direction.
+/// </summary>
+class LossyNetwork : public IdealNetwork
+{
+	std::mt19937 mRandom{ 31415 };
+	std::uniform_real_distribution<double> mPercent{ 0.0, 100.0 };
+	double mLossPercent;
+	std::atomic<size_t> mDataLost{ 0 };
+
+public:
+	LossyNetwork(double lossPercent) :mLossPercent(lossPercent) {}
+
+	void ProducerEnQ(const std::vector<uint8_t>& data) override
+	{
+		if (mPercent(mRandom) < mLossPercent)
+		{
+			Frame<SignalData> frame(data);
+			if (frame.mHeader.mType == FrameType::Data)
+			{
+				++mDataLost;
+			}
+			return;
+		}
+		IdealNetwork::ProducerEnQ(data);
+	}
+
+	size_t DataLost() { return mDataLost; }
+};
+
+void BenchFec()
+{
+	constexpr int frames = 500;
+	const std::vector<FecConfig> configs{ {0, 0}, {8, 1}, {4, 1}, {8, 2}, {4, 2} };
+
+	printf("\nFEC recovery, %d frames per run\n", frames);
+	printf("%6s %6s %9s %6s %10s %10s %10s %10s\n",
+		"loss%", "N+K", "overhead%", "lost", "recovered", "recovered%", "resent", "elapsed_ms");
+	for (double loss : { 1.0, 5.0, 10.0, 20.0 })
+	{
+		for (auto& fec : configs)
+		{
+			auto lossy = std::make_shared<LossyNetwork>(loss);
+			std::shared_ptr<INetwork> network = lossy;
+			auto consumer = std::make_unique<QConsumer<SignalData>>(network);
+			auto producer = std::make_unique<QProducer<SignalData>>(network, ProducerConfig{ 8, fec });
+
+			auto start = steady_clock::now();
+			for (int i = 0; i < frames; ++i)
+			{
+				producer->EnQ(SignalData(i, i));
+			}
+			for (int i = 0; i < frames; ++i)
+			{
+				SignalData data;
+				consumer->DeQ(data);
+			}
+			auto elapsed = duration_cast<milliseconds>(steady_clock::now() - start);
+			consumer->Stop();
+			producer->Stop();
+
+			const auto lost = lossy->DataLost();
+			const auto recovered = consumer->FecRecoveredFrames();
+			printf("%6.1f %3d+%-2d %9.1f %6zu %10zu %10.1f %10zu %10lld\n",
+				loss, fec.mDataFrames, fec.mParityFrames,
+				fec.Enabled() ? 100.0 * fec.mParityFrames / fec.mDataFrames : 0.0,
+				lost, recovered, lost ? 100.0 * recovered / lost : 100.0,
+				producer->ResentFrames(), static_cast<long long>(elapsed.count()));
+		}
+	}
+}
+
+/// <summary>
+/// A link that serialises one datagram per mPerFrame behind a queue only
+/// mDepth datagrams deep; anything arriving at a full queue is dropped, much
+/// like a burst into a small socket receive buffer. Acks are not limited.
+/// </summary>
+class BottleneckNetwork : public INetwork
+{
+	using Clock = steady_clock;
+
+	std::mutex mMux;
+	std::condition_variable mArrival;
+	std::deque<std::pair<Clock::time_point, std::vector<uint8_t>>> mInFlight;
+	Clock::time_point mLinkFree{ Clock::now() };
+	nanoseconds mPerFrame;
+	size_t mDepth;
+	std::atomic<size_t> mDropped{ 0 };
+	BlockingQ<std::vector<uint8_t>> mAcks;
+
+public:
+	BottleneckNetwork(double framesPerSec, size_t depth) :
+		mPerFrame(static_cast<long long>(1e9 / framesPerSec)), mDepth(depth)
+	{}
+
+	void ProducerEnQ(const std::vector<uint8_t>& data) override
+	{
+		std::lock_guard<std::mutex> lock(mMux);
+		const auto now = Clock::now();
+		size_t queued = 0;
+		for (auto frame = mInFlight.rbegin(); frame != mInFlight.rend() && frame->first > now; ++frame)
+		{
+			++queued;
+		}
+		if (queued >= mDepth)
+		{
+			++mDropped;
+			return;
+		}
+		mLinkFree = (std::max)(now, mLinkFree) + mPerFrame;
+		mInFlight.emplace_back(mLinkFree, data);
+		mArrival.notify_one();
+	}
+
+	bool ConsumeDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override
+	{
+		std::unique_lock<std::mutex> lock(mMux);
+		const auto giveUp = Clock::now() + timeOut;
+		while (mInFlight.empty() || mInFlight.front().first > Clock::now())
+		{
+			auto until = mInFlight.empty() ? giveUp : (std::min)(giveUp, mInFlight.front().first);
+			if (mArrival.wait_until(lock, until) == std::cv_status::timeout && Clock::now() >= giveUp)
+			{
+				return false;
+			}
+		}
+		data = std::move(mInFlight.front().second);
+		mInFlight.pop_front();
+		return true;
+	}
+
+	void ConsumerEnQ(const std::vector<uint8_t>& data) override { mAcks.EnQ(data); }
+	bool ProducerDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override
+	{
+		return mAcks.DeQ(data, timeOut);
+	}
+	size_t ProducerToConsumerSize() override { return 0; }
+	size_t ConsumerToProducerSize() override { return mAcks.Size(); }
+
+	size_t Dropped() { return mDropped; }
+};
+
+void BenchPacing()
+{
+	constexpr int frames = 1000;
+	constexpr double linkRate = 5000;
+	constexpr size_t queueDepth = 8;
+	constexpr uint32_t window = 64;
+	const std::vector<std::pair<const char*, PacingConfig>> configs{
+		{ "unpaced", PacingConfig{} },
+		{ "rtt", PacingConfig{ true, 0.0, 2.0 } },
+		{ "rtt+cap", PacingConfig{ true, linkRate * 0.9, 2.0 } },
+	};
+
+	printf("\nPacing into a %.0f frames/s link with a %zu frame queue, window %u, %d frames\n",
+		linkRate, queueDepth, window, frames);
+	printf("%10s %10s %10s %10s %12s %10s\n", "pacing", "dropped", "resent", "srtt_us", "goodput/s", "elapsed_ms");
+	for (auto& config : configs)
+	{
+		auto bottleneck = std::make_shared<BottleneckNetwork>(linkRate, queueDepth);
+		std::shared_ptr<INetwork> network = bottleneck;
+		auto consumer = std::make_unique<QConsumer<SignalData>>(network);
+		ProducerConfig producerConfig;
+		producerConfig.mMaxPendingFrames = window;
+		producerConfig.mPacing = config.second;
+		auto producer = std::make_unique<QProducer<SignalData>>(network, producerConfig);
+
+		auto start = steady_clock::now();
+		for (int i = 0; i < frames; ++i)
+		{
+			producer->EnQ(SignalData(i, i));
+		}
+		for (int i = 0; i < frames; ++i)
+		{
+			SignalData data;
+			consumer->DeQ(data);
+		}
+		auto elapsed = duration_cast<microseconds>(steady_clock::now() - start);
+		consumer->Stop();
+		producer->Stop();
+
+		printf("%10s %10zu %10zu %10lld %12.0f %10lld\n", config.first, bottleneck->Dropped(), producer->ResentFrames(),
+			static_cast<long long>(duration_cast<microseconds>(producer->SmoothedRtt()).count()),
+			frames / (elapsed.count() / 1e6), static_cast<long long>(elapsed.count() / 1000));
+	}
+}
+
+/// <summary>
+/// One frame in flight at a time over loopback UDP so each sample is the
+/// full EnQ to DeQ latency rather than a queueing delay.
+/// </summary>
+void BenchSocket()
+{
+	constexpr int samples = 2000;
+	UdpNetworkOptions busyPoll;
+	busyPoll.mWait = WaitConfig{ WaitStrategy::SpinThenPark, 200 };
+	UdpNetworkOptions pinned = busyPoll;
+	pinned.mProducerCpu = 0;
+	pinned.mConsumerCpu = 1;
+	pinned.mWorkerPriority = THREAD_PRIORITY_HIGHEST;
+	const std::vector<std::pair<const char*, UdpNetworkOptions>> configs{
+		{ "default", UdpNetworkOptions{} },
+		{ "busypoll", busyPoll },
+		{ "busypoll+pin", pinned },
+	};
+
+	// busy polling only pays off with a core to spare for each spinning worker
+	printf("\nLoopback UDP latency, %d frames sent one at a time, %u cores\n", samples, std::thread::hardware_concurrency());
+	printf("%14s %10s %10s %10s %10s\n", "options", "p50_us", "p90_us", "p99_us", "max_us");
+	for (auto& config : configs)
+	{
+		std::shared_ptr<INetwork> network(new UdpNetwork(config.second));
+		auto consumer = std::make_unique<QConsumer<SignalData>>(network);
+		auto producer = std::make_unique<QProducer<SignalData>>(network);
+
+		std::vector<double> latencies_us;
+		for (int i = 0; i < samples; ++i)
+		{
+			const auto sent = steady_clock::now();
+			producer->EnQ(SignalData(i, duration<double>(sent.time_since_epoch()).count()));
+			SignalData data;
+			consumer->DeQ(data);
+			const auto received = duration<double>(steady_clock::now().time_since_epoch()).count();
+			latencies_us.push_back((received - data.mTimeStamp_sec) * 1e6);
+		}
+		consumer->Stop();
+		producer->Stop();
+
+		std::sort(latencies_us.begin(), latencies_us.end());
+		auto percentile = [&](double p) { return latencies_us[static_cast<size_t>(p * (latencies_us.size() - 1))]; };
+		printf("%14s %10.1f %10.1f %10.1f %10.1f\n", config.first,
+			percentile(0.5), percentile(0.9), percentile(0.99), latencies_us.back());
+	}
+}
+
+/// <summary>
+/// Receive throughput of one host taking frames from many loopback
+/// producers, as the consumer is spread over more shards. Scaling needs a
+/// core per shard as well as cores for the producers.
+/// </summary>
+void BenchSharded()
+{
+	constexpr int producers = 8;
+	constexpr int samples = 20000;  // per producer
+	printf("\nSharded consumer, %d loopback producers x %d samples, window 256, %u cores\n",
+		producers, samples, std::thread::hardware_concurrency());
+	printf("%8s %12s %10s\n", "shards", "samples/s", "elapsed_ms");
+	for (size_t shards : { 1, 2, 4 })
+	{
+		ShardedConsumerConfig config;
+		config.mShards = shards;
+		config.mFirstCpu = shards < std::thread::hardware_concurrency() ? 0 : -1;
+		config.mSocket.mReceiveBufferBytes = 4 * 1024 * 1024;
+
+		auto start = steady_clock::now();
+		{
+			QShardedConsumer<SignalData> consumer(config);
+			std::vector<std::unique_ptr<QProducer<SignalData>>> senders;
+			for (int producer = 0; producer < producers; ++producer)
+			{
+				std::shared_ptr<INetwork> network(new UdpNetwork("127.0.0.1", config.ShardPort(producer)));
+				senders.push_back(std::make_unique<QProducer<SignalData>>(network, ProducerConfig{ 256 }));
+			}
+			auto sending = std::async(std::launch::async, [&]()
+				{
+					std::vector<SignalData> block(64);
+					for (int sent = 0; sent < samples; sent += static_cast<int>(block.size()))
+					{
+						for (auto& sender : senders)
+						{
+							sender->EnQ(&block[0], block.size());
+						}
+					}
+				});
+
+			std::vector<SignalData> in;
+			std::chrono::duration<int, std::milli> timeOut(1);
+			for (size_t received = 0; received < static_cast<size_t>(producers) * samples;)
+			{
+				for (size_t flow = 0; flow < consumer.Flows(); ++flow)
+				{
+					received += consumer.Flow(flow).DeQAll(in, timeOut);
+					in.clear();
+				}
+			}
+			sending.get();
+			for (auto& sender : senders)
+			{
+				sender->Stop();
+			}
+			consumer.Stop();
+		}
+		auto elapsed = duration_cast<microseconds>(steady_clock::now() - start);
+		printf("%8zu %12.0f %10lld\n", shards, producers * samples / (elapsed.count() / 1e6),
+			static_cast<long long>(elapsed.count() / 1000));
+	}
+}
+
+/// <summary>
+/// Same host transports compared, latency one frame at a time then
+/// throughput with a full window.
+/// </summary>
+void BenchSharedMemory()
+{
+	constexpr int latencySamples = 2000;
+	constexpr int throughputSamples = 20000;
+	SharedMemoryOptions spinning;
+	spinning.mWait = WaitConfig{ WaitStrategy::SpinThenPark, 200 };
+	const std::vector<std::pair<const char*, std::function<std::shared_ptr<INetwork>()>>> networks{
+		{ "udp loopback", []() { return std::shared_ptr<INetwork>(new UdpNetwork()); } },
+		{ "shm", []() { return std::shared_ptr<INetwork>(new SharedMemoryNetwork("QBench")); } },
+		{ "shm+spin", [&]() { return std::shared_ptr<INetwork>(new SharedMemoryNetwork("QBench", spinning)); } },
+	};
+
+	printf("\nSame host transports, %d frames one at a time then %d with window 256, %u cores\n",
+		latencySamples, throughputSamples, std::thread::hardware_concurrency());
+	printf("%14s %10s %10s %10s %12s\n", "network", "p50_us", "p99_us", "max_us", "samples/s");
+	for (auto& network : networks)
+	{
+		std::vector<double> latencies_us;
+		{
+			auto transport = network.second();
+			auto consumer = std::make_unique<QConsumer<SignalData>>(transport);
+			auto producer = std::make_unique<QProducer<SignalData>>(transport);
+			for (int i = 0; i < latencySamples; ++i)
+			{
+				const auto sent = steady_clock::now();
+				producer->EnQ(SignalData(i, duration<double>(sent.time_since_epoch()).count()));
+				SignalData data;
+				consumer->DeQ(data);
+				const auto received = duration<double>(steady_clock::now().time_since_epoch()).count();
+				latencies_us.push_back((received - data.mTimeStamp_sec) * 1e6);
+			}
+			consumer->Stop();
+			producer->Stop();
+		}
+		std::sort(latencies_us.begin(), latencies_us.end());
+
+		double perSec = 0;
+		{
+			ReliableQ<SignalData> q(network.second(), ProducerConfig{ 256 });
+			std::vector<SignalData> out(64);
+			std::vector<SignalData> in(64);
+			std::chrono::duration<int, std::milli> timeOut(1000);
+			auto start = steady_clock::now();
+			auto producer = std::async(std::launch::async, [&]()
+				{
+					for (int sent = 0; sent < throughputSamples; sent += static_cast<int>(out.size()))
+					{
+						q.EnQ(&out[0], out.size());
+					}
+				});
+			for (int received = 0; received < throughputSamples;)
+			{
+				received += static_cast<int>(q.DeQ(&in[0], in.size(), timeOut));
+			}
+			producer.get();
+			perSec = throughputSamples / duration<double>(steady_clock::now() - start).count();
+		}
+
+		printf("%14s %10.1f %10.1f %10.1f %12.0f\n", network.first,
+			latencies_us[latencies_us.size() / 2], latencies_us[latencies_us.size() * 99 / 100], latencies_us.back(), perSec);
+	}
+}
+
+/// <summary>
+/// Datagrams per second through the bare transports with both ends and the
+/// RIO dispatcher sharing one core, then a full window through ReliableQ.
+/// Blast counts what was sent and what arrived, the difference is what the
+/// socket or the send slots dropped.
+/// </summary>
+void BenchRio()
+{
+	constexpr int blastFrames = 200000;
+	constexpr int throughputSamples = 20000;
+	UdpNetworkOptions socket;
+	socket.mProducerCpu = 0;
+	socket.mConsumerCpu = 0;
+	socket.mReceiveBufferBytes = 4 << 20;
+	RioOptions rio;
+	rio.mSocket = socket;
+	const std::vector<std::pair<const char*, std::function<std::shared_ptr<INetwork>()>>> networks{
+		{ "udp select", [&]() { return std::shared_ptr<INetwork>(new UdpNetwork(socket)); } },
+		{ "rio", [&]() { return std::shared_ptr<INetwork>(new RioUdpNetwork(rio)); } },
+	};
+
+	printf("\nLoopback datagrams on one core, %d %zu byte frames blasted then %d through ReliableQ\n",
+		blastFrames, sizeof(SignalData) + sizeof(Header), throughputSamples);
+	printf("%14s %12s %12s %12s\n", "network", "sent/s", "received/s", "samples/s");
+	for (auto& network : networks)
+	{
+		double sentPerSec = 0;
+		double receivedPerSec = 0;
+		{
+			auto transport = network.second();
+			const std::vector<uint8_t> frame(sizeof(SignalData) + sizeof(Header), 0x5a);
+			std::atomic<bool> done{ false };
+			auto start = steady_clock::now();
+			auto producer = std::async(std::launch::async, [&]()
+				{
+					transport->ConfigureProducerThread();
+					for (int i = 0; i < blastFrames; ++i)
+					{
+						transport->ProducerEnQ(frame);
+					}
+					sentPerSec = blastFrames / duration<double>(steady_clock::now() - start).count();
+					done = true;
+				});
+
+			transport->ConfigureConsumerThread();
+			std::vector<uint8_t> data;
+			std::chrono::duration<int, std::milli> timeOut(100);
+			int received = 0;
+			auto lastArrival = start;
+			while (received < blastFrames)
+			{
+				if (transport->ConsumeDeQ(data, timeOut))
+				{
+					++received;
+					lastArrival = steady_clock::now();
+				}
+				else if (done)
+				{
+					break;  // the rest were dropped
+				}
+			}
+			producer.get();
+			receivedPerSec = received / duration<double>(lastArrival - start).count();
+		}
+
+		double perSec = 0;
+		{
+			ReliableQ<SignalData> q(network.second(), ProducerConfig{ 256 });
+			std::vector<SignalData> out(64);
+			std::vector<SignalData> in(64);
+			std::chrono::duration<int, std::milli> timeOut(1000);
+			auto start = steady_clock::now();
+			auto producer = std::async(std::launch::async, [&]()
+				{
+					for (int sent = 0; sent < throughputSamples; sent += static_cast<int>(out.size()))
+					{
+						q.EnQ(&out[0], out.size());
+					}
+				});
+			for (int received = 0; received < throughputSamples;)
+			{
+				received += static_cast<int>(q.DeQ(&in[0], in.size(), timeOut));
+			}
+			producer.get();
+			perSec = throughputSamples / duration<double>(steady_clock::now() - start).count();
+		}
+
+		printf("%14s %12.0f %12.0f %12.0f\n", network.first, sentPerSec, receivedPerSec, perSec);
+	}
+}
+
+/// <summary>
+/// Latency of urgent samples sent every 5ms while a bulk stream runs over a
+/// 1% lossy network, with the urgent samples queued behind the bulk ones in
+/// one ReliableQ, or on their own lane. In one queue an urgent sample also
+/// waits for every lost bulk frame ahead of it to be repaired.
+/// </summary>
+void BenchLanes()
+{
+	constexpr int urgentSamples = 400;
+	constexpr int bulkPerMs = 2;
+	const ProducerConfig config{ 256 };
+	const std::vector<std::pair<const char*, std::unique_ptr<PriorityConfig>>> configs = [] {
+		std::vector<std::pair<const char*, std::unique_ptr<PriorityConfig>>> c;
+		c.emplace_back("one queue", nullptr);
+		c.emplace_back("strict", std::make_unique<PriorityConfig>(PriorityConfig{ LaneScheduling::Strict, { 1, 1 } }));
+		c.emplace_back("weighted 1:8", std::make_unique<PriorityConfig>(PriorityConfig{ LaneScheduling::Weighted, { 1, 8 } }));
+		return c;
+	}();
+
+	printf("\nUrgent latency, %d samples every 5ms beside %d bulk frames/s, 1%% loss, window %u\n",
+		urgentSamples, bulkPerMs * 1000, config.mMaxPendingFrames);
+	printf("%14s %10s %10s %10s %10s\n", "lanes", "p50_us", "p90_us", "p99_us", "max_us");
+	for (auto& lanes : configs)
+	{
+		std::unique_ptr<ReliableQ<SignalData>> one;
+		std::unique_ptr<PriorityReliableQ<SignalData>> prioritised;
+		if (lanes.second)
+		{
+			prioritised = std::make_unique<PriorityReliableQ<SignalData>>(std::make_shared<LossyNetwork>(1.0), *lanes.second, config);
+		}
+		else
+		{
+			one = std::make_unique<ReliableQ<SignalData>>(std::make_shared<LossyNetwork>(1.0), config);
+		}
+
+		// bulk samples have value 0, urgent ones 1
+		std::atomic<bool> stop{ false };
+		auto bulk = std::async(std::launch::async, [&]()
+			{
+				std::vector<SignalData> batch(bulkPerMs);
+				while (!stop)
+				{
+					if (one)
+					{
+						one->EnQ(&batch[0], batch.size());
+					}
+					else
+					{
+						prioritised->EnQ(1, &batch[0], batch.size());
+					}
+					std::this_thread::sleep_for(milliseconds(1));
+				}
+			});
+		auto bulkDrain = std::async(std::launch::async, [&]()
+			{
+				std::vector<SignalData> in(64);
+				std::chrono::duration<int, std::milli> timeOut(100);
+				while (!stop && prioritised)
+				{
+					prioritised->DeQ(1, &in[0], in.size(), timeOut);
+				}
+			});
+		auto urgent = std::async(std::launch::async, [&]()
+			{
+				for (int i = 0; i < urgentSamples; ++i)
+				{
+					const SignalData sample(1, duration<double>(steady_clock::now().time_since_epoch()).count());
+					if (one)
+					{
+						one->EnQ(&sample, 1);
+					}
+					else
+					{
+						prioritised->EnQ(0, sample);
+					}
+					std::this_thread::sleep_for(milliseconds(5));
+				}
+			});
+
+		std::vector<double> latencies_us;
+		std::vector<SignalData> in(64);
+		std::chrono::duration<int, std::milli> timeOut(1000);
+		while (latencies_us.size() < urgentSamples)
+		{
+			const size_t count = one ? one->DeQ(&in[0], in.size(), timeOut) : prioritised->DeQ(0, &in[0], in.size(), timeOut);
+			const auto received = duration<double>(steady_clock::now().time_since_epoch()).count();
+			for (size_t i = 0; i < count; ++i)
+			{
+				if (in[i].mValue == 1)
+				{
+					latencies_us.push_back((received - in[i].mTimeStamp_sec) * 1e6);
+				}
+			}
+		}
+		urgent.get();
+		stop = true;
+		bulk.get();
+		bulkDrain.get();
+
+		std::sort(latencies_us.begin(), latencies_us.end());
+		auto percentile = [&](double p) { return latencies_us[static_cast<size_t>(p * (latencies_us.size() - 1))]; };
+		printf("%14s %10.1f %10.1f %10.1f %10.1f\n", lanes.first,
+			percentile(0.5), percentile(0.9), percentile(0.99), latencies_us.back());
+	}
+}
+
+/// <summary>
+/// Round trips between two threads through a pair of BlockingQs, the hop
+/// every frame takes between the application and the workers.
+/// </summary>
+void BenchWait()
+{
+	constexpr int samples = 2000;
+	const std::vector<std::pair<const char*, WaitConfig>> configs{
+		{ "block", WaitConfig{ WaitStrategy::Block } },
+		{ "spin+park", WaitConfig{ WaitStrategy::SpinThenPark, 50 } },
+		{ "spin+yield", WaitConfig{ WaitStrategy::SpinThenYield, 50 } },
+		{ "busyspin", WaitConfig{ WaitStrategy::BusySpin } },
+	};
+
+	printf("\nBlockingQ round trip, %d samples, %u cores\n", samples, std::thread::hardware_concurrency());
+	printf("%12s %10s %10s %10s %10s\n", "strategy", "p50_us", "p90_us", "p99_us", "max_us");
+	for (auto& config : configs)
+	{
+		BlockingQ<int> ping(config.second);
+		BlockingQ<int> pong(config.second);
+		auto echo = std::async(std::launch::async, [&]()
+			{
+				for (int i = 0; i < samples; ++i)
+				{
+					int value;
+					ping.DeQ(value);
+					pong.EnQ(value);
+				}
+			});
+
+		std::vector<double> roundTrips_us;
+		for (int i = 0; i < samples; ++i)
+		{
+			const auto sent = steady_clock::now();
+			ping.EnQ(i);
+			int value;
+			pong.DeQ(value);
+			roundTrips_us.push_back(duration<double, std::micro>(steady_clock::now() - sent).count());
+		}
+		echo.get();
+
+		std::sort(roundTrips_us.begin(), roundTrips_us.end());
+		auto percentile = [&](double p) { return roundTrips_us[static_cast<size_t>(p * (roundTrips_us.size() - 1))]; };
+		printf("%12s %10.1f %10.1f %10.1f %10.1f\n", config.first,
+			percentile(0.5), percentile(0.9), percentile(0.99), roundTrips_us.back());
+	}
+}
+
+/// <summary>
+/// End to end throughput over the ideal network moving one sample per call
+/// against moving blocks of samples per call.
+/// </summary>
+void BenchBulk()
+{
+	constexpr int samples = 20000;
+	printf("\nReliableQ throughput over IdealNetwork, %d samples, window 256\n", samples);
+	printf("%8s %12s %10s\n", "block", "samples/s", "elapsed_ms");
+	for (size_t block : { 1, 16, 64, 256 })
+	{
+		ReliableQ<SignalData> q(std::shared_ptr<INetwork>(new IdealNetwork()), ProducerConfig{ 256 });
+		std::vector<SignalData> out(block);
+		std::vector<SignalData> in(block);
+		std::chrono::duration<int, std::milli> timeOut(1000);
+
+		auto start = steady_clock::now();
+		auto producer = std::async(std::launch::async, [&]()
+			{
+				for (int sent = 0; sent < samples; sent += static_cast<int>(block))
+				{
+					if (block == 1)
+					{
+						q.EnQ(out[0]);
+					}
+					else
+					{
+						q.EnQ(&out[0], block);
+					}
+				}
+			});
+		for (int received = 0; received < samples;)
+		{
+			if (block == 1)
+			{
+				q.DeQ(in[0]);
+				++received;
+			}
+			else
+			{
+				received += static_cast<int>(q.DeQ(&in[0], block, timeOut));
+			}
+		}
+		producer.get();
+		auto elapsed = duration_cast<microseconds>(steady_clock::now() - start);
+		printf("%8zu %12.0f %10lld\n", block, samples / (elapsed.count() / 1e6),
+			static_cast<long long>(elapsed.count() / 1000));
+	}
+}
+
+static void RemoveLogFiles(const std::string& directory)
+{
+	WIN32_FIND_DATAA found;
+	HANDLE search = FindFirstFileA((directory + "\\*.qlog").c_str(), &found);
+	if (search != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			DeleteFileA((directory + "\\" + found.cFileName).c_str());
+		} while (FindNextFileA(search, &found));
+		FindClose(search);
+	}
+}
+
+/// <summary>
+/// Delivery to the application by DeQ, which hands each frame to another
+/// thread through the delivered queue, against callbacks run on the
+/// consumer's worker.
+/// </summary>
+void BenchDelivery()
+{
+	constexpr int samples = 200000;
+	printf("\nReliableQ delivery over IdealNetwork, %d samples, window 256, block 64\n", samples);
+	printf("%10s %12s %10s\n", "delivery", "samples/s", "elapsed_ms");
+	for (int mode = 0; mode < 3; ++mode)
+	{
+		std::atomic<int> received{ 0 };
+		std::atomic<double> sum{ 0 };  // keeps the reads from being optimised away
+		DeliveryCallbacks<SignalData> callbacks;
+		if (mode == 1)
+		{
+			callbacks.mOnDeliver = [&](const SignalData& data) { sum = sum + data.mValue; ++received; };
+		}
+		else if (mode == 2)
+		{
+			callbacks.mOnDeliverBatch = [&](const SignalData* data, size_t count)
+			{
+				double batchSum = 0;
+				for (size_t i = 0; i < count; ++i)
+				{
+					batchSum += data[i].mValue;
+				}
+				sum = sum + batchSum;
+				received += static_cast<int>(count);
+			};
+		}
+
+		std::vector<SignalData> out(64, SignalData(1, 0));
+		std::vector<SignalData> in(64);
+		std::chrono::duration<int, std::milli> timeOut(1000);
+		auto start = steady_clock::now();
+		{
+			ReliableQ<SignalData> q(std::shared_ptr<INetwork>(new IdealNetwork()), ProducerConfig{ 256 }, ConsumerConfig(), callbacks);
+			auto producer = std::async(std::launch::async, [&]()
+				{
+					for (int sent = 0; sent < samples; sent += static_cast<int>(out.size()))
+					{
+						q.EnQ(&out[0], out.size());
+					}
+				});
+			while (received < samples)
+			{
+				if (mode == 0)
+				{
+					const size_t count = q.DeQ(&in[0], in.size(), timeOut);
+					for (size_t i = 0; i < count; ++i)
+					{
+						sum = sum + in[i].mValue;
+					}
+					received += static_cast<int>(count);
+				}
+				else
+				{
+					std::this_thread::sleep_for(milliseconds(1));
+				}
+			}
+			producer.get();
+		}
+		auto elapsed = duration_cast<microseconds>(steady_clock::now() - start);
+		const char* names[] = { "DeQ", "OnDeliver", "batch" };
+		printf("%10s %12.0f %10lld\n", names[mode], samples / (elapsed.count() / 1e6),
+			static_cast<long long>(elapsed.count() / 1000));
+	}
+}
+
+/// <summary>
+/// Bytes on the wire per SignalData frame and the cost of coding them, for
+/// a few shapes of signal. Each frame is coded against the one before, as
+/// over a link without loss.
+/// </summary>
+void BenchCodec()
+{
+	constexpr int samples = 100000;
+	const double pi = 3.14159265358979;
+	const std::vector<std::pair<const char*, std::function<SignalData(int)>>> signals{
+		{ "constant", [](int i) { return SignalData(1.5, 1700000000.0 + i * 0.001); } },
+		{ "adc12", [](int i) { return SignalData(std::floor(2048 + 40 * std::sin(i / 500.0)) * 5.0 / 4096, 1700000000.0 + i * 0.001); } },
+		{ "sine", [&](int i) { return SignalData(std::sin(2 * pi * i / 1000.0), 1700000000.0 + i * 0.001); } },
+	};
+
+	printf("\nFrame codec, SignalData, %d samples, raw frame %zu bytes\n", samples, sizeof(Header) + sizeof(SignalData));
+	printf("%10s %8s %14s %8s %12s %12s\n", "signal", "body", "bytes/sample", "ratio", "encode_ns", "decode_ns");
+	for (auto& signal : signals)
+	{
+		for (bool xorBodies : { false, true })
+		{
+			CodecConfig config;
+			if (xorBodies)
+			{
+				config.mBodyCodec = std::make_shared<XorBodyCodec>();
+			}
+			std::vector<std::vector<uint8_t>> frames;
+			for (int i = 0; i < samples; ++i)
+			{
+				frames.push_back(Frame<SignalData>(Header(static_cast<SeqNo>(i + 1)), signal.second(i)).mBytes);
+			}
+
+			FrameEncoder encoder(config);
+			std::vector<std::vector<uint8_t>> wires(samples);
+			size_t wireBytes = 0;
+			auto start = steady_clock::now();
+			for (int i = 0; i < samples; ++i)
+			{
+				encoder.Encode(frames[i], wires[i]);
+			}
+			const double encode_ns = duration<double, std::nano>(steady_clock::now() - start).count() / samples;
+
+			FrameDecoder decoder(config);
+			std::deque<std::vector<uint8_t>> decoded;
+			start = steady_clock::now();
+			for (int i = 0; i < samples; ++i)
+			{
+				decoder.Decode(wires[i], decoded);
+				decoded.pop_front();
+			}
+			const double decode_ns = duration<double, std::nano>(steady_clock::now() - start).count() / samples;
+
+			for (auto& wire : wires)
+			{
+				wireBytes += wire.size();
+			}
+			const double bytes = static_cast<double>(wireBytes) / samples;
+			printf("%10s %8s %14.2f %8.2f %12.1f %12.1f\n", signal.first, xorBodies ? "xor" : "raw", bytes,
+				frames[0].size() / bytes, encode_ns, decode_ns);
+		}
+	}
+}
+
+/// <summary>
+/// Nanoseconds to checksum one frame, with the SSE4.2 instruction and with
+/// the table the library falls back to, for a SignalData frame, a mid size
+/// frame and a full Ethernet datagram.
+/// </summary>
+void BenchCrc()
+{
+	constexpr int rounds = 200000;
+	printf("\nCRC32C per frame, %d rounds, hardware %s\n", rounds, Crc32c::HasHardwareSupport() ? "yes" : "no");
+	printf("%8s %12s %12s %10s\n", "bytes", "hardware_ns", "portable_ns", "GB/s");
+	for (size_t size : { sizeof(Header) + sizeof(SignalData), size_t(256), size_t(1472) })
+	{
+		std::vector<uint8_t> frame(size);
+		for (size_t i = 0; i < size; ++i)
+		{
+			frame[i] = static_cast<uint8_t>(i * 131 + 17);
+		}
+
+		uint32_t crc = 0;
+		auto start = steady_clock::now();
+		for (int i = 0; i < rounds; ++i)
+		{
+			crc = Crc32c::Compute(frame.data(), frame.size(), crc);
+		}
+		const double hardware_ns = duration<double, std::nano>(steady_clock::now() - start).count() / rounds;
+
+		start = steady_clock::now();
+		for (int i = 0; i < rounds; ++i)
+		{
+			crc = Crc32c::ComputePortable(frame.data(), frame.size(), crc);
+		}
+		const double portable_ns = duration<double, std::nano>(steady_clock::now() - start).count() / rounds;
+
+		// printing the crc keeps the loops from being optimised away
+		printf("%8zu %12.1f %12.1f %10.2f  (%08x)\n", size, hardware_ns, portable_ns, size / hardware_ns, crc);
+	}
+}
+
+/// <summary>
+/// What the send log costs end to end over the ideal network. The log is
+/// flushed once per send batch, so the cost falls as more is queued per call.
+/// </summary>
+void BenchDurable()
+{
+	constexpr int samples = 20000;
+	const std::string directory = "QBenchSendLog";
+	CreateDirectoryA(directory.c_str(), NULL); // the consumer starts first and keeps its checkpoint here
+	printf("\nReliableQ throughput over IdealNetwork, %d samples, window 256\n", samples);
+	printf("%10s %8s %12s %10s\n", "log", "block", "samples/s", "elapsed_ms");
+	for (bool durable : { false, true })
+	{
+		for (size_t block : { 1, 64 })
+		{
+			RemoveLogFiles(directory);
+			ProducerConfig config{ 256 };
+			ConsumerConfig consumerConfig;
+			if (durable)
+			{
+				config.mLog.mDirectory = directory;
+				consumerConfig.mCheckpointFile = directory + "\\consumer.qlog";
+			}
+			std::vector<SignalData> out(block);
+			std::vector<SignalData> in(block);
+			std::chrono::duration<int, std::milli> timeOut(1000);
+
+			auto start = steady_clock::now();
+			{
+				ReliableQ<SignalData> q(std::shared_ptr<INetwork>(new IdealNetwork()), config, consumerConfig);
+				auto producer = std::async(std::launch::async, [&]()
+					{
+						for (int sent = 0; sent < samples; sent += static_cast<int>(block))
+						{
+							q.EnQ(&out[0], block);
+						}
+					});
+				for (int received = 0; received < samples;)
+				{
+					received += static_cast<int>(q.DeQ(&in[0], block, timeOut));
+				}
+				producer.get();
+			}
+			auto elapsed = duration_cast<microseconds>(steady_clock::now() - start);
+			printf("%10s %8zu %12.0f %10lld\n", durable ? "mapped" : "none", block, samples / (elapsed.count() / 1e6),
+				static_cast<long long>(elapsed.count() / 1000));
+		}
+	}
+	RemoveLogFiles(directory);
+}
+
+/// <summary>
+/// Nanoseconds to record one trace event, then ReliableQ throughput with
+/// tracing off, sampling every 64th message and tracing every message.
+/// </summary>
+void BenchTrace()
+{
+	constexpr int rounds = 1000000;
+	MessageTracer tracer(TraceConfig{ 1, rounds + 1 });
+	tracer.Record(TraceStage::Queued, 0);  // this thread's buffer is made on its first event
+	auto start = steady_clock::now();
+	for (int i = 0; i < rounds; ++i)
+	{
+		tracer.Record(TraceStage::Sent, static_cast<SeqNo>(i));
+	}
+	const double record_ns = duration<double, std::nano>(steady_clock::now() - start).count() / rounds;
+	printf("\nTrace events, %d recorded, %.1f ns each\n", rounds, record_ns);
+
+	constexpr int samples = 200000;
+	printf("\nReliableQ throughput over IdealNetwork, %d samples, window 256, block 64\n", samples);
+	printf("%10s %12s %10s %8s\n", "sampling", "samples/s", "elapsed_ms", "events");
+	for (uint32_t every : { 0u, 64u, 1u })
+	{
+		std::shared_ptr<MessageTracer> traced;
+		ProducerConfig config{ 256 };
+		ConsumerConfig consumerConfig;
+		if (every != 0)
+		{
+			traced = std::make_shared<MessageTracer>(TraceConfig{ every, samples * 4 });
+			config.mTracer = traced;
+			consumerConfig.mTracer = traced;
+		}
+		std::vector<SignalData> out(64);
+		std::vector<SignalData> in(64);
+		std::chrono::duration<int, std::milli> timeOut(1000);
+		start = steady_clock::now();
+		{
+			ReliableQ<SignalData> q(std::shared_ptr<INetwork>(new IdealNetwork()), config, consumerConfig);
+			auto producer = std::async(std::launch::async, [&]()
+				{
+					for (int sent = 0; sent < samples; sent += static_cast<int>(out.size()))
+					{
+						q.EnQ(&out[0], out.size());
+					}
+				});
+			for (int received = 0; received < samples;)
+			{
+				received += static_cast<int>(q.DeQ(&in[0], in.size(), timeOut));
+			}
+			producer.get();
+		}
+		auto elapsed = duration_cast<microseconds>(steady_clock::now() - start);
+		printf("%10s %12.0f %10lld %8zu\n", every == 0 ? "off" : every == 1 ? "all" : "1 in 64",
+			samples / (elapsed.count() / 1e6), static_cast<long long>(elapsed.count() / 1000),
+			traced ? traced->Events().size() : 0);
+	}
+}
+
+/// <summary>
+/// Captures a run over a network losing 2% of the data, then replays what
+/// its consumer received into a new consumer at the recorded speed and
+/// faster, the way a capture taken in production would be benchmarked.
+/// </summary>
+void BenchReplay()
+{
+	constexpr int samples = 2000;
+	const std::string path = "QBenchReplay.qcap";
+	size_t records = 0;
+	{
+		auto capture = std::make_shared<CaptureNetwork>(std::make_shared<LossyNetwork>(2.0), path);
+		std::shared_ptr<INetwork> network = capture;
+		auto consumer = std::make_unique<QConsumer<SignalData>>(network);
+		auto producer = std::make_unique<QProducer<SignalData>>(network, ProducerConfig{ 256 });
+		for (int i = 0; i < samples; ++i)
+		{
+			producer->EnQ(SignalData(i, i));
+		}
+		for (int i = 0; i < samples; ++i)
+		{
+			SignalData data;
+			consumer->DeQ(data);
+		}
+		consumer->Stop();
+		producer->Stop();
+		capture->Flush();
+		records = capture->Records();
+	}
+	const auto captured = CaptureNetwork::Read(path);
+	const auto recorded = captured.empty() ? 0 : captured.back().mTime_ns / 1000000;
+	printf("\nReplay of a %d sample run with 2%% loss, %zu datagrams over %lld ms\n", samples, records,
+		static_cast<long long>(recorded));
+	printf("%8s %12s %10s %10s\n", "speed", "samples/s", "elapsed_ms", "acks");
+	for (double speed : { 1.0, 10.0, 0.0 })
+	{
+		auto replay = std::make_shared<ReplayNetwork>(captured, ReplayConfig{ speed });
+		std::shared_ptr<INetwork> network = replay;
+		auto consumer = std::make_unique<QConsumer<SignalData>>(network);
+		auto start = steady_clock::now();
+		for (int i = 0; i < samples; ++i)
+		{
+			SignalData data;
+			consumer->DeQ(data);
+		}
+		auto elapsed = duration_cast<microseconds>(steady_clock::now() - start);
+		consumer->Stop();
+
+		char name[16];
+		snprintf(name, sizeof(name), speed == 0 ? "max" : "%.0fx", speed);
+		printf("%8s %12.0f %10lld %10zu\n", name, samples / (elapsed.count() / 1e6),
+			static_cast<long long>(elapsed.count() / 1000), replay->ConsumerSentFrames());
+	}
+	DeleteFileA(path.c_str());
+}
+
+int main(int argc, char* argv[])
+{
+	const std::map<std::string, std::function<void()>> benchmarks{
+		{ "bulk", BenchBulk },
+		{ "codec", BenchCodec },
+		{ "crc", BenchCrc },
+		{ "delivery", BenchDelivery },
+		{ "durable", BenchDurable },
+		{ "fec", BenchFec },
+		{ "lanes", BenchLanes },
+		{ "pacing", BenchPacing },
+		{ "replay", BenchReplay },
+		{ "rio", BenchRio },
+		{ "sharded", BenchSharded },
+		{ "shm", BenchSharedMemory },
+		{ "socket", BenchSocket },
+		{ "trace", BenchTrace },
+		{ "wait", BenchWait },
+	};
+
+	std::string selected = argc > 1 ? argv[1] : "";
+	for (auto& benchmark : benchmarks)
+	{
+		if (selected.empty() || selected == benchmark.first)
+		{
+			benchmark.second();
+		}
+	}
+}
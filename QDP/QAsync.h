@@ -0,0 +1,141 @@
+#pragma once
+// awaitable queues need C++20 coroutines (/std:c++20), without them this
+// header is empty
+#if defined(__cpp_impl_coroutine)
+#define QUDP_COROUTINES
+#include <coroutine>
+#include "QProducer.h"
+#include "QConsumer.h"
+
+/// <summary>
+/// Where a suspended await resumes. Post is called on QUDP's worker
+/// threads, so it should only queue the work for the application's own.
+/// </summary>
+class IExecutor
+{
+public:
+	virtual ~IExecutor() {}
+	virtual void Post(std::function<void()> work) = 0;
+};
+
+/// <summary>
+/// Work posted here runs on whichever threads call RunOne, so a handful of
+/// threads can serve the awaits of any number of queues.
+/// </summary>
+class WorkQueueExecutor : public IExecutor
+{
+private:
+	BlockingQ<std::function<void()>> mWork;
+
+public:
+	explicit WorkQueueExecutor(const WaitConfig& wait = WaitConfig()) :mWork(wait) {}
+
+	void Post(std::function<void()> work) override
+	{
+		mWork.EnQ(std::move(work));
+	}
+
+	// runs one piece of work, false if none was posted within timeOut
+	bool RunOne(std::chrono::duration<int, std::milli> timeOut)
+	{
+		std::function<void()> work;
+		if (!mWork.DeQ(work, timeOut))
+		{
+			return false;
+		}
+		work();
+		return true;
+	}
+};
+
+/// <summary>
+/// co_await gives up to maxCount delivered frames in data and how many there
+/// were, at least one, or 0 once the consumer has stopped. It suspends while
+/// there are none, without holding a thread, and resumes on the executor.
+/// Any number of awaits may wait on one consumer. The consumer must outlive
+/// the await.
+/// </summary>
+template <class T> class DeQAwaiter
+{
+private:
+	QConsumer<T>& mConsumer;
+	T* mData;
+	size_t mMaxCount;
+	IExecutor& mExecutor;
+	size_t mCount{ 0 };
+	std::coroutine_handle<> mHandle;
+
+	void Wait()
+	{
+		mConsumer.WhenDelivered([this]() { mExecutor.Post([this]() { Retry(); }); });
+	}
+
+	// another reader may have taken the frames that woke this one
+	void Retry()
+	{
+		mCount = mConsumer.TryDeQ(mData, mMaxCount);
+		if (mCount == 0 && !mConsumer.Stopped())
+		{
+			Wait();
+			return;
+		}
+		mHandle.resume();
+	}
+
+public:
+	DeQAwaiter(QConsumer<T>& consumer, T* data, size_t maxCount, IExecutor& executor) :
+		mConsumer(consumer), mData(data), mMaxCount(maxCount), mExecutor(executor)
+	{}
+
+	bool await_ready()
+	{
+		mCount = mConsumer.TryDeQ(mData, mMaxCount);
+		return mCount > 0 || mConsumer.Stopped();
+	}
+
+	void await_suspend(std::coroutine_handle<> handle)
+	{
+		mHandle = handle;
+		Wait();
+	}
+
+	size_t await_resume() { return mCount; }
+};
+
+/// <summary>
+/// co_await finishes once every frame queued before it is acked, or given up
+/// on, or with Nack repair sent, resuming on the executor if it had to wait.
+/// It gives false if the producer was stopped first. The producer must
+/// outlive the await.
+/// </summary>
+template <class T> class FlushAwaiter
+{
+private:
+	QProducer<T>& mProducer;
+	IExecutor& mExecutor;
+	uint64_t mQueuedFrames{ 0 };
+	bool mFlushed{ true };
+
+public:
+	FlushAwaiter(QProducer<T>& producer, IExecutor& executor) :mProducer(producer), mExecutor(executor) {}
+
+	bool await_ready()
+	{
+		mQueuedFrames = mProducer.QueuedFrames();
+		return mProducer.SettledFrames() >= mQueuedFrames;
+	}
+
+	void await_suspend(std::coroutine_handle<> handle)
+	{
+		auto& executor = mExecutor;
+		bool& flushed = mFlushed;
+		mProducer.WhenFlushed(mQueuedFrames, [&executor, &flushed, handle](bool settled)
+			{
+				flushed = settled;
+				executor.Post([handle]() { handle.resume(); });
+			});
+	}
+
+	bool await_resume() { return mFlushed; }
+};
+#endif
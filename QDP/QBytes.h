@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// little endian, so files and trailers read the same on any host
+
+inline void PutLe32(std::vector<uint8_t>& out, uint32_t value)
+{
+	for (int shift = 0; shift < 32; shift += 8)
+	{
+		out.push_back(static_cast<uint8_t>(value >> shift));
+	}
+}
+
+inline uint32_t LoadLe32(const uint8_t* p)
+{
+	return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+		(static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
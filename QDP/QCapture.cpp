@@ -0,0 +1,207 @@
+#include "pch.h"
+#include "QCapture.h"
+#include "QBytes.h"
+#include "QCodec.h"
+#include <iterator>
+#include <thread>
+
+namespace
+{
+	constexpr uint32_t cCaptureMagic = 0x50435751;  // "QWCP"
+	constexpr uint32_t cCaptureVersion = 1;
+	constexpr size_t cWriteBlockBytes = 1 << 16;
+}
+
+CaptureNetwork::CaptureNetwork(std::shared_ptr<INetwork> network, const std::string& path) :
+	mNetwork(network), mFile(path, std::ios::binary | std::ios::trunc)
+{
+	if (!mFile)
+	{
+		Log("CaptureNetwork - cannot create %s", path.c_str());
+		exit(1);
+	}
+	mPending.reserve(cWriteBlockBytes * 2);
+	mWriting.reserve(cWriteBlockBytes * 2);
+	PutLe32(mPending, cCaptureMagic);
+	PutLe32(mPending, cCaptureVersion);
+}
+
+CaptureNetwork::~CaptureNetwork()
+{
+	Flush();
+}
+
+void CaptureNetwork::Record(CaptureEvent event, const std::vector<uint8_t>& data)
+{
+	std::unique_lock<std::mutex> lock(mMux);
+	// timed under the lock so the deltas never go backwards
+	const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - mStart).count();
+	Varint::Put(static_cast<uint64_t>(now - mLastTime_ns), mPending);
+	mLastTime_ns = now;
+	Varint::Put(data.size(), mPending);
+	mPending.push_back(static_cast<uint8_t>(event));
+	mPending.insert(mPending.end(), data.begin(), data.end());
+	++mRecords;
+	if (mPending.size() >= cWriteBlockBytes)
+	{
+		WritePending(lock);
+	}
+}
+
+void CaptureNetwork::WritePending(std::unique_lock<std::mutex>& lock)
+{
+	// the file lock is taken before lock is let go, so blocks are written in
+	// the order they filled while the other thread goes on recording
+	std::lock_guard<std::mutex> fileLock(mFileMux);
+	mWriting.swap(mPending);
+	lock.unlock();
+	const bool wasGood = mFile.good();
+	mFile.write(reinterpret_cast<const char*>(mWriting.data()), mWriting.size());
+	if (wasGood && !mFile)
+	{
+		Log("CaptureNetwork - writing %zu bytes failed, the capture ends here", mWriting.size());
+	}
+	mWriting.clear();
+}
+
+void CaptureNetwork::Flush()
+{
+	std::unique_lock<std::mutex> lock(mMux);
+	WritePending(lock);
+	std::lock_guard<std::mutex> fileLock(mFileMux);
+	const bool wasGood = mFile.good();
+	mFile.flush();
+	if (wasGood && !mFile)
+	{
+		Log("CaptureNetwork - flushing failed, the capture ends here");
+	}
+}
+
+void CaptureNetwork::ProducerEnQ(const std::vector<uint8_t>& data)
+{
+	Record(CaptureEvent::ProducerSent, data);
+	mNetwork->ProducerEnQ(data);
+}
+
+bool CaptureNetwork::ProducerDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut)
+{
+	if (!mNetwork->ProducerDeQ(data, timeOut))
+	{
+		return false;
+	}
+	Record(CaptureEvent::ProducerReceived, data);
+	return true;
+}
+
+void CaptureNetwork::ConsumerEnQ(const std::vector<uint8_t>& data)
+{
+	Record(CaptureEvent::ConsumerSent, data);
+	mNetwork->ConsumerEnQ(data);
+}
+
+bool CaptureNetwork::ConsumeDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut)
+{
+	if (!mNetwork->ConsumeDeQ(data, timeOut))
+	{
+		return false;
+	}
+	Record(CaptureEvent::ConsumerReceived, data);
+	return true;
+}
+
+std::vector<CaptureRecord> CaptureNetwork::Read(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	const std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if (!file.is_open() || bytes.size() < 8 || LoadLe32(&bytes[0]) != cCaptureMagic)
+	{
+		Log("CaptureNetwork - %s is not a capture", path.c_str());
+		exit(1);
+	}
+	if (LoadLe32(&bytes[4]) != cCaptureVersion)
+	{
+		Log("CaptureNetwork - %s is capture version %u, expected %u", path.c_str(), LoadLe32(&bytes[4]), cCaptureVersion);
+		exit(1);
+	}
+
+	std::vector<CaptureRecord> records;
+	const uint8_t* p = &bytes[8];
+	const uint8_t* end = bytes.data() + bytes.size();
+	int64_t time_ns = 0;
+	while (p < end)
+	{
+		uint64_t delta;
+		uint64_t size;
+		if (!Varint::Get(p, end, delta) || !Varint::Get(p, end, size) || p == end ||
+			*p > static_cast<uint8_t>(CaptureEvent::ConsumerReceived) || size > static_cast<uint64_t>(end - p - 1))
+		{
+			Log("CaptureNetwork - %s ends in a partial record after %zu", path.c_str(), records.size());
+			break;
+		}
+		time_ns += static_cast<int64_t>(delta);
+		const auto event = static_cast<CaptureEvent>(*p++);
+		records.push_back(CaptureRecord{ time_ns, event, std::vector<uint8_t>(p, p + size) });
+		p += size;
+	}
+	return records;
+}
+
+ReplayNetwork::ReplayNetwork(const std::vector<CaptureRecord>& records, const ReplayConfig& config) :
+	mSpeed(config.mSpeed)
+{
+	for (auto& record : records)
+	{
+		if (record.mEvent == CaptureEvent::ConsumerReceived)
+		{
+			mToConsumer.mRecords.push_back(record);
+		}
+		else if (record.mEvent == CaptureEvent::ProducerReceived)
+		{
+			mToProducer.mRecords.push_back(record);
+		}
+	}
+}
+
+bool ReplayNetwork::DeQ(Stream& stream, std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut)
+{
+	std::call_once(mStarted, [this]() { mStart = Clock::now(); });
+	const size_t next = stream.mNext.load(std::memory_order_relaxed);
+	const auto giveUp = Clock::now() + timeOut;
+	if (next == stream.mRecords.size())
+	{
+		std::this_thread::sleep_until(giveUp);
+		return false;
+	}
+
+	const CaptureRecord& record = stream.mRecords[next];
+	auto due = mStart;
+	if (mSpeed > 0)
+	{
+		due += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::nano>(record.mTime_ns / mSpeed));
+	}
+	if (due > giveUp)
+	{
+		std::this_thread::sleep_until(giveUp);
+		return false;
+	}
+	std::this_thread::sleep_until(due);
+	data = record.mData;
+	stream.mNext.store(next + 1, std::memory_order_release);
+	return true;
+}
+
+bool ReplayNetwork::ProducerDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut)
+{
+	return DeQ(mToProducer, data, timeOut);
+}
+
+bool ReplayNetwork::ConsumeDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut)
+{
+	return DeQ(mToConsumer, data, timeOut);
+}
+
+bool ReplayNetwork::Finished()
+{
+	return mToConsumer.mNext.load(std::memory_order_acquire) == mToConsumer.mRecords.size() &&
+		mToProducer.mNext.load(std::memory_order_acquire) == mToProducer.mRecords.size();
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "QNetwork.h"
+
+// which side of the network saw a datagram, and which way it was going
+enum class CaptureEvent : uint8_t
+{
+	ProducerSent,      // ProducerEnQ, towards the consumer
+	ConsumerSent,      // ConsumerEnQ, feedback towards the producer
+	ProducerReceived,  // ProducerDeQ returned it
+	ConsumerReceived   // ConsumeDeQ returned it
+};
+
+struct CaptureRecord
+{
+	int64_t mTime_ns;  // since the capture started
+	CaptureEvent mEvent;
+	std::vector<uint8_t> mData;
+};
+
+/// <summary>
+/// Records every datagram crossing another network, either way and on
+/// either side, with when it happened, so the traffic a run really saw -
+/// its timing, loss and reordering - can be replayed later by ReplayNetwork.
+/// The file is a header then one record per datagram: the nanoseconds since
+/// the previous record and the length as varints, the event, then the
+/// bytes. Records are buffered and written in large blocks, Flush or the
+/// destructor writes out the rest.
+/// </summary>
+class CaptureNetwork : public INetwork
+{
+private:
+	using Clock = std::chrono::steady_clock;
+
+	std::shared_ptr<INetwork> mNetwork;
+	std::ofstream mFile;
+	const Clock::time_point mStart{ Clock::now() };
+
+	std::mutex mMux;  // both worker threads record
+	std::vector<uint8_t> mPending;
+	int64_t mLastTime_ns{ 0 };
+	std::atomic<size_t> mRecords{ 0 };
+	std::mutex mFileMux;  // mFile and mWriting, taken while holding mMux or alone
+	std::vector<uint8_t> mWriting;
+
+	void Record(CaptureEvent event, const std::vector<uint8_t>& data);
+	// writes mPending outside lock, which holds mMux and is released
+	void WritePending(std::unique_lock<std::mutex>& lock);
+
+public:
+	// an existing file is replaced, failing to create it is fatal
+	CaptureNetwork(std::shared_ptr<INetwork> network, const std::string& path);
+	~CaptureNetwork();
+	CaptureNetwork(const CaptureNetwork&) = delete;
+
+	void ConfigureProducerThread() override { mNetwork->ConfigureProducerThread(); }
+	void ConfigureConsumerThread() override { mNetwork->ConfigureConsumerThread(); }
+	void ProducerEnQ(const std::vector<uint8_t>& data) override;
+	bool ProducerDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override;
+	void ConsumerEnQ(const std::vector<uint8_t>& data) override;
+	bool ConsumeDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override;
+	size_t ProducerToConsumerSize() override { return mNetwork->ProducerToConsumerSize(); }
+	size_t ConsumerToProducerSize() override { return mNetwork->ConsumerToProducerSize(); }
+	size_t MaxDatagramBytes() override { return mNetwork->MaxDatagramBytes(); }
+
+	// writes everything recorded so far to the file
+	void Flush();
+
+	size_t Records() { return mRecords; }
+
+	/// <summary>
+	/// Every record in a capture file, oldest first. A record cut short,
+	/// by a process that died mid write, ends the capture. A missing file
+	/// or one that is not a capture is fatal.
+	/// </summary>
+	static std::vector<CaptureRecord> Read(const std::string& path);
+};
+
+struct ReplayConfig
+{
+	// 1 keeps the recorded gaps, 10 plays ten times as fast, 0 hands each
+	// datagram over as soon as it is asked for
+	double mSpeed{ 1.0 };
+};
+
+/// <summary>
+/// Plays a capture back as a network: ConsumeDeQ returns what the captured
+/// consumer received and ProducerDeQ what the captured producer received,
+/// each at its recorded time from the first DeQ on either side, so a new
+/// QConsumer or QProducer sees the same arrivals, gaps and losses. What
+/// they send goes nowhere and is only counted, wrap this in a
+/// CaptureNetwork to keep it for comparison. Once a side has played out it
+/// stays silent.
+/// </summary>
+class ReplayNetwork : public INetwork
+{
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct Stream
+	{
+		std::vector<CaptureRecord> mRecords;
+		std::atomic<size_t> mNext{ 0 };  // only its DeQ thread moves it
+	};
+
+	const double mSpeed;
+	Stream mToConsumer;
+	Stream mToProducer;
+	std::once_flag mStarted;
+	Clock::time_point mStart;
+	std::atomic<size_t> mProducerSent{ 0 };
+	std::atomic<size_t> mConsumerSent{ 0 };
+
+	bool DeQ(Stream& stream, std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut);
+
+public:
+	ReplayNetwork(const std::vector<CaptureRecord>& records, const ReplayConfig& config = ReplayConfig());
+
+	void ProducerEnQ(const std::vector<uint8_t>&) override { ++mProducerSent; }
+	bool ProducerDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override;
+	void ConsumerEnQ(const std::vector<uint8_t>&) override { ++mConsumerSent; }
+	bool ConsumeDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override;
+	size_t ProducerToConsumerSize() override { return 0; }
+	size_t ConsumerToProducerSize() override { return 0; }
+
+	// both sides have been handed every datagram captured for them
+	bool Finished();
+
+	// datagrams the replayed producer and consumer sent
+	size_t ProducerSentFrames() { return mProducerSent; }
+	size_t ConsumerSentFrames() { return mConsumerSent; }
+};
@@ -0,0 +1,198 @@
+#include "pch.h"
+#include "QChecksum.h"
+#include "QBytes.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define QUDP_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define QUDP_TARGET_SSE42
+#else
+#define QUDP_TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+#endif
+
+namespace
+{
+	struct CrcTables
+	{
+		uint32_t mSlice[8][256];
+		bool mHasSse42{ false };
+
+		CrcTables()
+		{
+			for (uint32_t i = 0; i < 256; ++i)
+			{
+				uint32_t crc = i;
+				for (int bit = 0; bit < 8; ++bit)
+				{
+					crc = (crc >> 1) ^ ((crc & 1) ? 0x82f63b78 : 0);
+				}
+				mSlice[0][i] = crc;
+			}
+			// slice k is the crc of a byte followed by k zero bytes
+			for (int k = 1; k < 8; ++k)
+			{
+				for (int i = 0; i < 256; ++i)
+				{
+					const uint32_t previous = mSlice[k - 1][i];
+					mSlice[k][i] = (previous >> 8) ^ mSlice[0][previous & 0xff];
+				}
+			}
+
+#ifdef QUDP_X86
+#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 1);
+			mHasSse42 = (info[2] & (1 << 20)) != 0;
+#else
+			mHasSse42 = __builtin_cpu_supports("sse4.2");
+#endif
+#endif
+		}
+	};
+
+	const CrcTables& Tables()
+	{
+		static const CrcTables tables;
+		return tables;
+	}
+
+	// crc is already inverted
+	uint32_t UpdatePortable(const uint32_t(&slice)[8][256], const uint8_t* data, size_t size, uint32_t crc)
+	{
+		for (; size >= 8; size -= 8, data += 8)
+		{
+			const uint32_t low = crc ^ LoadLe32(data);
+			const uint32_t high = LoadLe32(data + 4);
+			crc = slice[7][low & 0xff] ^ slice[6][(low >> 8) & 0xff] ^ slice[5][(low >> 16) & 0xff] ^ slice[4][low >> 24] ^
+				slice[3][high & 0xff] ^ slice[2][(high >> 8) & 0xff] ^ slice[1][(high >> 16) & 0xff] ^ slice[0][high >> 24];
+		}
+		for (; size > 0; --size, ++data)
+		{
+			crc = slice[0][(crc ^ *data) & 0xff] ^ (crc >> 8);
+		}
+		return crc;
+	}
+
+#ifdef QUDP_X86
+	QUDP_TARGET_SSE42 uint32_t UpdateSse42(const uint8_t* data, size_t size, uint32_t crc)
+	{
+#if defined(_M_X64) || defined(__x86_64__)
+		uint64_t crc64 = crc;
+		for (; size >= 8; size -= 8, data += 8)
+		{
+			uint64_t word;
+			memcpy(&word, data, sizeof(word));
+			crc64 = _mm_crc32_u64(crc64, word);
+		}
+		crc = static_cast<uint32_t>(crc64);
+#endif
+		for (; size >= 4; size -= 4, data += 4)
+		{
+			uint32_t word;
+			memcpy(&word, data, sizeof(word));
+			crc = _mm_crc32_u32(crc, word);
+		}
+		for (; size > 0; --size, ++data)
+		{
+			crc = _mm_crc32_u8(crc, *data);
+		}
+		return crc;
+	}
+#endif
+}
+
+uint32_t Crc32c::Compute(const uint8_t* data, size_t size, uint32_t crc)
+{
+#ifdef QUDP_X86
+	if (Tables().mHasSse42)
+	{
+		return ~UpdateSse42(data, size, ~crc);
+	}
+#endif
+	return ComputePortable(data, size, crc);
+}
+
+uint32_t Crc32c::ComputePortable(const uint8_t* data, size_t size, uint32_t crc)
+{
+	return ~UpdatePortable(Tables().mSlice, data, size, ~crc);
+}
+
+bool Crc32c::HasHardwareSupport()
+{
+	return Tables().mHasSse42;
+}
+
+void ChecksumNetwork::Seal(const std::vector<uint8_t>& data, std::vector<uint8_t>& sealed)
+{
+	const uint32_t crc = Crc32c::Compute(data.data(), data.size());
+	sealed.assign(data.begin(), data.end());
+	PutLe32(sealed, crc);
+}
+
+bool ChecksumNetwork::Unseal(std::vector<uint8_t>& data)
+{
+	if (data.size() < cTrailerBytes)
+	{
+		return false;
+	}
+	const size_t size = data.size() - cTrailerBytes;
+	if (Crc32c::Compute(data.data(), size) != LoadLe32(&data[size]))
+	{
+		return false;
+	}
+	data.resize(size);
+	return true;
+}
+
+void ChecksumNetwork::ProducerEnQ(const std::vector<uint8_t>& data)
+{
+	Seal(data, mProducerFrame);
+	mNetwork->ProducerEnQ(mProducerFrame);
+}
+
+void ChecksumNetwork::ConsumerEnQ(const std::vector<uint8_t>& data)
+{
+	Seal(data, mConsumerFrame);
+	mNetwork->ConsumerEnQ(mConsumerFrame);
+}
+
+bool ChecksumNetwork::DeQ(bool producer, std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut)
+{
+	using Clock = std::chrono::steady_clock;
+	const auto deadline = Clock::now() + timeOut;
+	auto remaining = timeOut;
+	for (;;)
+	{
+		const bool received = producer ? mNetwork->ProducerDeQ(data, remaining) : mNetwork->ConsumeDeQ(data, remaining);
+		if (!received)
+		{
+			return false;
+		}
+		if (Unseal(data))
+		{
+			return true;
+		}
+
+		++(producer ? mCorruptFeedback : mCorruptData);
+		Log("ChecksumNetwork - dropping corrupt %zu byte frame", data.size());
+		const auto now = Clock::now();
+		if (now >= deadline)
+		{
+			return false;
+		}
+		remaining = std::chrono::duration_cast<std::chrono::duration<int, std::milli>>(deadline - now);
+	}
+}
+
+bool ChecksumNetwork::ProducerDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut)
+{
+	return DeQ(true, data, timeOut);
+}
+
+bool ChecksumNetwork::ConsumeDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut)
+{
+	return DeQ(false, data, timeOut);
+}
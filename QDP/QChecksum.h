@@ -0,0 +1,64 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "QNetwork.h"
+
+/// <summary>
+/// CRC32C (Castagnoli, reflected polynomial 0x82f63b78), the checksum SSE4.2
+/// has an instruction for. Compute picks the instruction at runtime where
+/// the cpu has it and a slicing by 8 table otherwise. Passing the result of
+/// one call as crc to the next continues the checksum over more bytes.
+/// </summary>
+class Crc32c
+{
+public:
+	static uint32_t Compute(const uint8_t* data, size_t size, uint32_t crc = 0);
+	// the table driven version, for cpus without SSE4.2 and for testing
+	static uint32_t ComputePortable(const uint8_t* data, size_t size, uint32_t crc = 0);
+	static bool HasHardwareSupport();
+};
+
+/// <summary>
+/// Appends a CRC32C of the whole frame, little endian, to every frame
+/// crossing another network in either direction, and drops and counts any
+/// frame that arrives without a matching one. To the producer and consumer
+/// a corrupt frame is a lost one, so the usual repair resends it. Both ends
+/// must wrap their network the same way.
+/// </summary>
+class ChecksumNetwork : public INetwork
+{
+private:
+	static constexpr size_t cTrailerBytes = 4;
+
+	std::shared_ptr<INetwork> mNetwork;
+	std::vector<uint8_t> mProducerFrame;  // producer thread
+	std::vector<uint8_t> mConsumerFrame;  // consumer thread
+	std::atomic<size_t> mCorruptData{ 0 };
+	std::atomic<size_t> mCorruptFeedback{ 0 };
+
+	static void Seal(const std::vector<uint8_t>& data, std::vector<uint8_t>& sealed);
+	// checks and strips the trailer
+	static bool Unseal(std::vector<uint8_t>& data);
+	bool DeQ(bool producer, std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut);
+
+public:
+	explicit ChecksumNetwork(std::shared_ptr<INetwork> network) :mNetwork(network) {}
+
+	void ConfigureProducerThread() override { mNetwork->ConfigureProducerThread(); }
+	void ConfigureConsumerThread() override { mNetwork->ConfigureConsumerThread(); }
+	void ProducerEnQ(const std::vector<uint8_t>& data) override;
+	bool ProducerDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override;
+	void ConsumerEnQ(const std::vector<uint8_t>& data) override;
+	bool ConsumeDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override;
+	size_t ProducerToConsumerSize() override { return mNetwork->ProducerToConsumerSize(); }
+	size_t ConsumerToProducerSize() override { return mNetwork->ConsumerToProducerSize(); }
+	size_t MaxDatagramBytes() override
+	{
+		const size_t bytes = mNetwork->MaxDatagramBytes();
+		return bytes > cTrailerBytes ? bytes - cTrailerBytes : bytes;
+	}
+
+	// frames dropped for a bad checksum, producer to consumer and back
+	size_t CorruptData() { return mCorruptData; }
+	size_t CorruptFeedback() { return mCorruptFeedback; }
+};
@@ -0,0 +1,546 @@
+#include "pch.h"
+#include "QCodec.h"
+#include "QFec.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+	constexpr uint8_t cTypeMask = 0x07;
+	constexpr uint8_t cHasFec = 0x08;
+	constexpr uint8_t cHasRange = 0x10;
+	constexpr uint8_t cHasSession = 0x20;
+	constexpr uint8_t cHasLane = 0x40;
+	constexpr uint8_t cHasWindow = 0x80;
+
+	int LeadingZeros(uint64_t x)
+	{
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long index;
+		_BitScanReverse64(&index, x);
+		return 63 - static_cast<int>(index);
+#elif defined(__GNUC__)
+		return __builtin_clzll(x);
+#else
+		int count = 0;
+		for (uint64_t bit = uint64_t(1) << 63; (x & bit) == 0; bit >>= 1)
+		{
+			++count;
+		}
+		return count;
+#endif
+	}
+
+	int TrailingZeros(uint64_t x)
+	{
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long index;
+		_BitScanForward64(&index, x);
+		return static_cast<int>(index);
+#elif defined(__GNUC__)
+		return __builtin_ctzll(x);
+#else
+		int count = 0;
+		for (; (x & 1) == 0; x >>= 1)
+		{
+			++count;
+		}
+		return count;
+#endif
+	}
+
+	// byte by byte so the result does not depend on the host, compilers turn
+	// this into a single load on little endian machines
+	uint64_t LoadWord(const uint8_t* p)
+	{
+		uint64_t value = 0;
+		for (int i = 7; i >= 0; --i)
+		{
+			value = (value << 8) | p[i];
+		}
+		return value;
+	}
+
+	void StoreWord(uint8_t* p, uint64_t value)
+	{
+		for (int i = 0; i < 8; ++i)
+		{
+			p[i] = static_cast<uint8_t>(value >> (8 * i));
+		}
+	}
+
+	// most significant bit first
+	class BitWriter
+	{
+	private:
+		std::vector<uint8_t>& mOut;
+		uint64_t mBits{ 0 };
+		int mCount{ 0 };
+
+	public:
+		explicit BitWriter(std::vector<uint8_t>& out) :mOut(out) {}
+
+		// value must fit in bits, 1 to 64
+		void Put(uint64_t value, int bits)
+		{
+			if (bits > 32)
+			{
+				Put(value >> 32, bits - 32);
+				value &= 0xffffffff;
+				bits = 32;
+			}
+			mBits = (mBits << bits) | value;
+			mCount += bits;
+			while (mCount >= 8)
+			{
+				mCount -= 8;
+				mOut.push_back(static_cast<uint8_t>(mBits >> mCount));
+			}
+		}
+
+		void Flush()
+		{
+			if (mCount)
+			{
+				mOut.push_back(static_cast<uint8_t>(mBits << (8 - mCount)));
+				mCount = 0;
+			}
+		}
+	};
+
+	class BitReader
+	{
+	private:
+		const uint8_t* mIn;
+		const uint8_t* mEnd;
+		uint64_t mBits{ 0 };
+		int mCount{ 0 };
+		bool mOverrun{ false };
+
+	public:
+		BitReader(const uint8_t* in, const uint8_t* end) :mIn(in), mEnd(end) {}
+
+		uint64_t Get(int bits)
+		{
+			if (bits > 32)
+			{
+				const uint64_t high = Get(bits - 32);
+				return (high << 32) | Get(32);
+			}
+			while (mCount < bits)
+			{
+				uint8_t next = 0;
+				if (mIn < mEnd)
+				{
+					next = *mIn++;
+				}
+				else
+				{
+					mOverrun = true;
+				}
+				mBits = (mBits << 8) | next;
+				mCount += 8;
+			}
+			mCount -= bits;
+			return (mBits >> mCount) & (~uint64_t(0) >> (64 - bits));
+		}
+
+		bool Overrun() const { return mOverrun; }
+	};
+}
+
+void Varint::Put(uint64_t value, std::vector<uint8_t>& out)
+{
+	while (value >= 0x80)
+	{
+		out.push_back(static_cast<uint8_t>(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back(static_cast<uint8_t>(value));
+}
+
+bool Varint::Get(const uint8_t*& in, const uint8_t* end, uint64_t& value)
+{
+	value = 0;
+	for (int shift = 0; in < end && shift < 64; shift += 7)
+	{
+		const uint8_t byte = *in++;
+		value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void XorBodyCodec::Encode(const uint8_t* body, const uint8_t* previous, size_t size, std::vector<uint8_t>& out)
+{
+	BitWriter bits(out);
+	int windowLeading = -1;
+	int windowTrailing = 0;
+	const size_t words = size / 8;
+	for (size_t i = 0; i < words; ++i)
+	{
+		const uint64_t x = LoadWord(body + 8 * i) ^ LoadWord(previous + 8 * i);
+		if (x == 0)
+		{
+			bits.Put(0, 1);
+			continue;
+		}
+
+		// 5 bits of leading zero count, as in Gorilla
+		const int leading = (std::min)(LeadingZeros(x), 31);
+		const int trailing = TrailingZeros(x);
+		if (windowLeading >= 0 && leading >= windowLeading && trailing >= windowTrailing)
+		{
+			bits.Put(2, 2);
+			bits.Put(x >> windowTrailing, 64 - windowLeading - windowTrailing);
+		}
+		else
+		{
+			const int meaningful = 64 - leading - trailing;
+			bits.Put(3, 2);
+			bits.Put(leading, 5);
+			bits.Put(meaningful - 1, 6);
+			bits.Put(x >> trailing, meaningful);
+			windowLeading = leading;
+			windowTrailing = trailing;
+		}
+	}
+	bits.Flush();
+	for (size_t i = 8 * words; i < size; ++i)
+	{
+		out.push_back(body[i] ^ previous[i]);
+	}
+}
+
+bool XorBodyCodec::Decode(const uint8_t* in, size_t inSize, const uint8_t* previous, uint8_t* body, size_t size)
+{
+	// the XORs are unpacked first then applied to previous in one pass
+	const size_t words = size / 8;
+	const size_t tail = size - 8 * words;
+	if (inSize < tail)
+	{
+		return false;
+	}
+	BitReader bits(in, in + inSize - tail);
+	int windowLeading = 0;
+	int windowTrailing = 0;
+	for (size_t i = 0; i < words; ++i)
+	{
+		uint64_t x = 0;
+		if (bits.Get(1))
+		{
+			if (bits.Get(1))
+			{
+				windowLeading = static_cast<int>(bits.Get(5));
+				const int meaningful = static_cast<int>(bits.Get(6)) + 1;
+				windowTrailing = 64 - windowLeading - meaningful;
+				if (windowTrailing < 0)
+				{
+					return false;
+				}
+			}
+			x = bits.Get(64 - windowLeading - windowTrailing) << windowTrailing;
+		}
+		StoreWord(body + 8 * i, x);
+	}
+	if (bits.Overrun())
+	{
+		return false;
+	}
+	memcpy(body + 8 * words, in + inSize - tail, tail);
+	Gf256::XorInto(body, previous, size);
+	return true;
+}
+
+const uint8_t* BodyHistory::Find(uint32_t session, uint16_t lane, SeqNo seqNo) const
+{
+	const Slot& slot = mSlots[Index(lane, seqNo)];
+	if (!slot.mUsed || slot.mSession != session || slot.mLane != lane || slot.mSeqNo != seqNo)
+	{
+		return nullptr;
+	}
+	return slot.mBody.data();
+}
+
+void BodyHistory::Store(uint32_t session, uint16_t lane, SeqNo seqNo, const uint8_t* body, size_t size)
+{
+	Slot& slot = mSlots[Index(lane, seqNo)];
+	slot.mUsed = true;
+	slot.mSession = session;
+	slot.mLane = lane;
+	slot.mSeqNo = seqNo;
+	slot.mBody.assign(body, body + size);
+}
+
+void FrameEncoder::Encode(const std::vector<uint8_t>& frame, std::vector<uint8_t>& wire)
+{
+	Header header;
+	memcpy(&header, frame.data(), sizeof(header));
+	const uint8_t* body = frame.data() + sizeof(header);
+	const size_t size = header.mDataSize;
+
+	const uint8_t* reference = nullptr;
+	if (mConfig.mBodyCodec && header.mType == FrameType::Data && size != 0)
+	{
+		const bool resend = mSent.Find(header.mSession, header.mLane, header.mSeqNo) != nullptr;
+		const bool keyFrame = mConfig.mKeyFrameInterval == 0 || header.mSeqNo % mConfig.mKeyFrameInterval == 0;
+		if (!resend)
+		{
+			if (!keyFrame)
+			{
+				reference = mSent.Find(header.mSession, header.mLane, header.mSeqNo - 1);
+			}
+			mSent.Store(header.mSession, header.mLane, header.mSeqNo, body, size);
+		}
+	}
+
+	wire.clear();
+	uint8_t flags = static_cast<uint8_t>(header.mType) & cTypeMask;
+	flags |= (header.mFecDataFrames | header.mFecParityIndex | header.mFecParityFrames) ? cHasFec : 0;
+	flags |= header.mRange ? cHasRange : 0;
+	flags |= header.mSession ? cHasSession : 0;
+	flags |= header.mLane ? cHasLane : 0;
+	flags |= header.mWindow ? cHasWindow : 0;
+	wire.push_back(flags);
+	Varint::Put(header.mSeqNo, wire);
+	Varint::Put((static_cast<uint64_t>(size) << 1) | (reference ? 1 : 0), wire);
+	if (flags & cHasFec)
+	{
+		wire.push_back(header.mFecDataFrames);
+		wire.push_back(header.mFecParityIndex);
+		wire.push_back(header.mFecParityFrames);
+	}
+	if (flags & cHasRange)
+	{
+		Varint::Put(header.mRange, wire);
+	}
+	if (flags & cHasSession)
+	{
+		Varint::Put(header.mSession, wire);
+	}
+	if (flags & cHasLane)
+	{
+		Varint::Put(header.mLane, wire);
+	}
+	if (flags & cHasWindow)
+	{
+		Varint::Put(header.mWindow, wire);
+	}
+
+	if (reference)
+	{
+		mConfig.mBodyCodec->Encode(body, reference, size, wire);
+	}
+	else
+	{
+		wire.insert(wire.end(), body, body + size);
+	}
+}
+
+FrameDecoder::Result FrameDecoder::DecodeOne(const std::vector<uint8_t>& wire, Header& header)
+{
+	const uint8_t* in = wire.data();
+	const uint8_t* end = in + wire.size();
+	if (in == end)
+	{
+		return Result::Malformed;
+	}
+	const uint8_t flags = *in++;
+	uint64_t seqNo;
+	uint64_t sizeAndCoded;
+	if (!Varint::Get(in, end, seqNo) || !Varint::Get(in, end, sizeAndCoded))
+	{
+		return Result::Malformed;
+	}
+	header = Header(static_cast<SeqNo>(seqNo));
+	header.mType = static_cast<FrameType>(flags & cTypeMask);
+	header.mDataSize = static_cast<uint16_t>(sizeAndCoded >> 1);
+	const bool coded = (sizeAndCoded & 1) != 0;
+	if (flags & cHasFec)
+	{
+		if (end - in < 3)
+		{
+			return Result::Malformed;
+		}
+		header.mFecDataFrames = *in++;
+		header.mFecParityIndex = *in++;
+		header.mFecParityFrames = *in++;
+	}
+	uint64_t value;
+	if (flags & cHasRange)
+	{
+		if (!Varint::Get(in, end, value))
+		{
+			return Result::Malformed;
+		}
+		header.mRange = static_cast<uint16_t>(value);
+	}
+	if (flags & cHasSession)
+	{
+		if (!Varint::Get(in, end, value))
+		{
+			return Result::Malformed;
+		}
+		header.mSession = static_cast<uint32_t>(value);
+	}
+	if (flags & cHasLane)
+	{
+		if (!Varint::Get(in, end, value))
+		{
+			return Result::Malformed;
+		}
+		header.mLane = static_cast<uint16_t>(value);
+	}
+	if (flags & cHasWindow)
+	{
+		if (!Varint::Get(in, end, value))
+		{
+			return Result::Malformed;
+		}
+		header.mWindow = static_cast<uint16_t>(value);
+	}
+
+	const size_t size = header.mDataSize;
+	mFrame.resize(sizeof(header) + size);
+	memcpy(mFrame.data(), &header, sizeof(header));
+	if (!coded)
+	{
+		if (static_cast<size_t>(end - in) != size)
+		{
+			return Result::Malformed;
+		}
+		memcpy(mFrame.data() + sizeof(header), in, size);
+	}
+	else
+	{
+		if (!mConfig.mBodyCodec || header.mType != FrameType::Data)
+		{
+			return Result::Malformed;
+		}
+		const uint8_t* reference = mDecoded.Find(header.mSession, header.mLane, header.mSeqNo - 1);
+		if (reference == nullptr)
+		{
+			return Result::Held;
+		}
+		if (!mConfig.mBodyCodec->Decode(in, end - in, reference, mFrame.data() + sizeof(header), size))
+		{
+			return Result::Malformed;
+		}
+	}
+
+	if (header.mType == FrameType::Data && size != 0)
+	{
+		mDecoded.Store(header.mSession, header.mLane, header.mSeqNo, mFrame.data() + sizeof(header), size);
+	}
+	return Result::Decoded;
+}
+
+bool FrameDecoder::Decode(const std::vector<uint8_t>& wire, std::deque<std::vector<uint8_t>>& frames)
+{
+	Header header;
+	switch (DecodeOne(wire, header))
+	{
+	case Result::Malformed:
+		return false;
+	case Result::Held:
+		mHeld[HeldKey(header.mSession, header.mLane, header.mSeqNo)] = wire;
+		if (mHeld.size() > BodyHistory::cFrames)
+		{
+			mHeld.erase(mHeld.begin());
+		}
+		return true;
+	case Result::Decoded:
+		break;
+	}
+	frames.push_back(FramePool::Copy(mFrame));
+	if (header.mType != FrameType::Data || header.mDataSize == 0)
+	{
+		return true;
+	}
+
+	// a resend may have overtaken a held copy, then the frames coded against it follow
+	mHeld.erase(HeldKey(header.mSession, header.mLane, header.mSeqNo));
+	for (;;)
+	{
+		auto next = mHeld.find(HeldKey(header.mSession, header.mLane, header.mSeqNo + 1));
+		if (next == mHeld.end())
+		{
+			return true;
+		}
+		const std::vector<uint8_t> held = std::move(next->second);
+		mHeld.erase(next);
+		if (DecodeOne(held, header) != Result::Decoded)
+		{
+			// malformed
+			return true;
+		}
+		frames.push_back(FramePool::Copy(mFrame));
+	}
+}
+
+CodecNetwork::CodecNetwork(std::shared_ptr<INetwork> network, const CodecConfig& config) :
+	mNetwork(network),
+	mDataEncoder(config), mAckDecoder(config), mAckEncoder(config), mDataDecoder(config)
+{
+}
+
+void CodecNetwork::ProducerEnQ(const std::vector<uint8_t>& data)
+{
+	mDataEncoder.Encode(data, mProducerWire);
+	mFrameBytes += data.size();
+	mWireBytes += mProducerWire.size();
+	mNetwork->ProducerEnQ(mProducerWire);
+}
+
+void CodecNetwork::ConsumerEnQ(const std::vector<uint8_t>& data)
+{
+	mAckEncoder.Encode(data, mConsumerWire);
+	mNetwork->ConsumerEnQ(mConsumerWire);
+}
+
+bool CodecNetwork::DeQ(INetwork& network, bool producer, FrameDecoder& decoder, std::deque<std::vector<uint8_t>>& decoded,
+	std::vector<uint8_t>& wire, std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut)
+{
+	using Clock = std::chrono::steady_clock;
+	const auto deadline = Clock::now() + timeOut;
+	while (decoded.empty())
+	{
+		auto remaining = std::chrono::duration_cast<std::chrono::duration<int, std::milli>>(deadline - Clock::now());
+		if (remaining.count() < 0)
+		{
+			remaining = std::chrono::duration<int, std::milli>(0);
+		}
+		const bool received = producer ? network.ProducerDeQ(wire, remaining) : network.ConsumeDeQ(wire, remaining);
+		if (!received)
+		{
+			return false;
+		}
+		if (!decoder.Decode(wire, decoded))
+		{
+			Log("CodecNetwork - dropping malformed %zu byte frame", wire.size());
+		}
+		if (decoded.empty() && Clock::now() >= deadline)
+		{
+			return false;
+		}
+	}
+	FramePool::Release(std::move(data));
+	data = std::move(decoded.front());
+	decoded.pop_front();
+	return true;
+}
+
+bool CodecNetwork::ProducerDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut)
+{
+	return DeQ(*mNetwork, true, mAckDecoder, mAcks, mProducerWire, data, timeOut);
+}
+
+bool CodecNetwork::ConsumeDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut)
+{
+	return DeQ(*mNetwork, false, mDataDecoder, mData, mConsumerWire, data, timeOut);
+}
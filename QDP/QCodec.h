@@ -0,0 +1,171 @@
+#pragma once
+#include <deque>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+#include "QNetwork.h"
+
+/// <summary>
+/// LEB128 varints, seven bits a byte low group first, so the bytes on the
+/// wire do not depend on the host's byte order.
+/// </summary>
+class Varint
+{
+public:
+	static constexpr size_t cMaxBytes = 10;
+
+	static void Put(uint64_t value, std::vector<uint8_t>& out);
+
+	// false if the bytes run out before the last group
+	static bool Get(const uint8_t*& in, const uint8_t* end, uint64_t& value);
+};
+
+/// <summary>
+/// Turns a frame body into bytes on the wire given the body of the frame
+/// sent before it, and back. Both ends must use the same codec.
+/// </summary>
+class IBodyCodec
+{
+public:
+	virtual ~IBodyCodec() {}
+	virtual void Encode(const uint8_t* body, const uint8_t* previous, size_t size, std::vector<uint8_t>& out) = 0;
+	// false if in does not hold a whole body
+	virtual bool Decode(const uint8_t* in, size_t inSize, const uint8_t* previous, uint8_t* body, size_t size) = 0;
+};
+
+/// <summary>
+/// Gorilla style XOR coding for bodies made of 64 bit numbers, like
+/// SignalData. Each word is XORed with the same word of the previous body;
+/// an unchanged word costs one bit, otherwise only the bits between the
+/// leading and trailing zeros of the XOR are sent, reusing the last word's
+/// window when they fit in it. Words are read little endian, trailing bytes
+/// of a body that is not a whole number of words are sent as they are.
+/// </summary>
+class XorBodyCodec : public IBodyCodec
+{
+public:
+	void Encode(const uint8_t* body, const uint8_t* previous, size_t size, std::vector<uint8_t>& out) override;
+	bool Decode(const uint8_t* in, size_t inSize, const uint8_t* previous, uint8_t* body, size_t size) override;
+};
+
+struct CodecConfig
+{
+	std::shared_ptr<IBodyCodec> mBodyCodec;  // nullptr only compresses headers
+	uint32_t mKeyFrameInterval{ 64 };        // every Nth data frame is sent whole
+};
+
+/// <summary>
+/// Recent data frame bodies by session, lane and sequence number, lanes each
+/// number their frames from 1. A fixed ring, so a slot can be overwritten by
+/// a frame 256 further on or by another lane's.
+/// </summary>
+class BodyHistory
+{
+public:
+	static constexpr size_t cFrames = 256;
+
+	// nullptr if the frame is not held
+	const uint8_t* Find(uint32_t session, uint16_t lane, SeqNo seqNo) const;
+	void Store(uint32_t session, uint16_t lane, SeqNo seqNo, const uint8_t* body, size_t size);
+
+private:
+	struct Slot
+	{
+		bool mUsed{ false };
+		uint32_t mSession{ 0 };
+		uint16_t mLane{ 0 };
+		SeqNo mSeqNo{ 0 };
+		std::vector<uint8_t> mBody;
+	};
+	Slot mSlots[cFrames];
+
+	// lanes start at different slots, so lanes at similar numbers rarely evict each other
+	static size_t Index(uint16_t lane, SeqNo seqNo) { return (seqNo + lane * 67u) % cFrames; }
+};
+
+/// <summary>
+/// Writes frames in the compact wire format: a flags byte holding the frame
+/// type and which optional header fields follow, varint sequence number and
+/// size, then the body. A data body is coded against the frame one before it
+/// in sequence, unless that frame was never sent, the frame is a key frame,
+/// or it is a resend; resends go whole so a repair never depends on another
+/// frame having arrived.
+/// </summary>
+class FrameEncoder
+{
+private:
+	CodecConfig mConfig;
+	BodyHistory mSent;
+
+public:
+	explicit FrameEncoder(const CodecConfig& config = CodecConfig()) :mConfig(config) {}
+
+	void Encode(const std::vector<uint8_t>& frame, std::vector<uint8_t>& wire);
+};
+
+/// <summary>
+/// Reads the compact wire format back into frames. A coded body whose
+/// reference has not been decoded yet is held until it is, so a lost frame
+/// holds back only the frames coded against it until its resend arrives.
+/// </summary>
+class FrameDecoder
+{
+private:
+	CodecConfig mConfig;
+	BodyHistory mDecoded;
+	using HeldKey = std::tuple<uint32_t, uint16_t, SeqNo>;  // session, lane, sequence number
+	std::map<HeldKey, std::vector<uint8_t>> mHeld;         // wire bytes waiting for their reference
+	std::vector<uint8_t> mFrame;
+
+	enum class Result { Decoded, Held, Malformed };
+	Result DecodeOne(const std::vector<uint8_t>& wire, Header& header);
+
+public:
+	explicit FrameDecoder(const CodecConfig& config = CodecConfig()) :mConfig(config) {}
+
+	// appends every frame wire made decodable, in the order they became so,
+	// returns false if wire was not a frame in the compact format
+	bool Decode(const std::vector<uint8_t>& wire, std::deque<std::vector<uint8_t>>& frames);
+
+	size_t HeldFrames() const { return mHeld.size(); }
+};
+
+/// <summary>
+/// Compresses every frame crossing another network, both ends must wrap
+/// their network the same way. Acks and nacks only get the header coding.
+/// </summary>
+class CodecNetwork : public INetwork
+{
+private:
+	std::shared_ptr<INetwork> mNetwork;
+	FrameEncoder mDataEncoder;    // producer thread
+	FrameDecoder mAckDecoder;
+	FrameEncoder mAckEncoder;     // consumer thread
+	FrameDecoder mDataDecoder;
+	std::vector<uint8_t> mProducerWire;  // what the producer thread last sent or received
+	std::vector<uint8_t> mConsumerWire;
+	std::deque<std::vector<uint8_t>> mAcks;
+	std::deque<std::vector<uint8_t>> mData;
+	std::atomic<size_t> mFrameBytes{ 0 };
+	std::atomic<size_t> mWireBytes{ 0 };
+
+	static bool DeQ(INetwork& network, bool producer, FrameDecoder& decoder, std::deque<std::vector<uint8_t>>& decoded,
+		std::vector<uint8_t>& wire, std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut);
+
+public:
+	CodecNetwork(std::shared_ptr<INetwork> network, const CodecConfig& config = CodecConfig());
+
+	void ConfigureProducerThread() override { mNetwork->ConfigureProducerThread(); }
+	void ConfigureConsumerThread() override { mNetwork->ConfigureConsumerThread(); }
+	void ProducerEnQ(const std::vector<uint8_t>& data) override;
+	bool ProducerDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override;
+	void ConsumerEnQ(const std::vector<uint8_t>& data) override;
+	bool ConsumeDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override;
+	size_t ProducerToConsumerSize() override { return mNetwork->ProducerToConsumerSize(); }
+	size_t ConsumerToProducerSize() override { return mNetwork->ConsumerToProducerSize(); }
+
+	// producer to consumer bytes before and after coding
+	size_t FrameBytes() { return mFrameBytes; }
+	size_t WireBytes() { return mWireBytes; }
+};
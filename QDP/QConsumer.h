@@ -1,125 +1,640 @@
 #pragma once
-#include <future>
+#include <atomic>
+#include <deque>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include "QNetwork.h"
+#include "QFec.h"
+#include "QSendLog.h"
+#include "QTrace.h"
+
+enum class Delivery : uint8_t
+{
+	Ordered,    // in sequence, a frame waits for every gap before it to be filled
+	Unordered   // as it arrives, duplicates are still dropped
+};
+
+struct ConsumerConfig
+{
+	WaitConfig mWait;  // how DeQ waits for delivered frames, the worker waits as the transport does
+	RepairMode mRepair{ RepairMode::Ack };
+	// where the last frame handed to DeQ's queue is kept across restarts,
+	// empty starts every run from the first frame
+	std::string mCheckpointFile;
+	// how often an idle consumer acks, it acks every datagram otherwise
+	std::chrono::milliseconds mKeepalive{ 1000 };
+	Delivery mDelivery{ Delivery::Ordered };
+	// flow control, needs Ack repair: at most this many frames wait for DeQ
+	// or for a gap to fill, as acks hold the producer back to stay within
+	// it. Until the first ack only the producer's window limits it. Up to
+	// 65534, 0 is unbounded
+	size_t mMaxBufferedFrames{ 0 };
+	// samples where messages spend their time, see MessageTracer
+	std::shared_ptr<MessageTracer> mTracer;
+};
+
+/// <summary>
+/// Push delivery. Set, these are called on the consumer's worker with frames
+/// as they are delivered, still where the worker parsed them, instead of
+/// the frames being queued for DeQ, so DeQ never returns any. The worker
+/// receives nothing while they run, so they should be quick. A batch is a
+/// frame that arrived in sequence, or the run released when a gap is filled.
+/// Without OnDeliverBatch, OnDeliver is called for each frame of a batch.
+/// </summary>
+template <class T> struct DeliveryCallbacks
+{
+	std::function<void(const T&)> mOnDeliver;
+	std::function<void(const T*, size_t)> mOnDeliverBatch;
+};
+
+template <class T> class QShardedConsumer;
 
 template <class T> class QConsumer
 {
 private:
+	friend class QShardedConsumer<T>;
+
 	BlockingQ<T> mConsumerQ;
 	std::shared_ptr<INetwork> mTransport;
-	std::future<void> mWorker;
-	bool mStop{ false };
-	std::unordered_map<uint16_t, Frame<T>> pendingData;
+	std::thread mWorker;  // not started when driven
+	std::atomic<bool> mStop{ false };
+	std::unordered_map<SeqNo, Frame<T>> pendingData;
+	const Delivery mDelivery;
+	std::unordered_set<SeqNo> mDeliveredAhead;  // Unordered, delivered past a gap
+	FecDecoder mFecDecoder{ sizeof(T) };
+	std::atomic<size_t> mFecRecoveredFrames{ 0 };
+	std::vector<T> mDelivered; // frames released by one arrival, handed over in one EnQ
+	const DeliveryCallbacks<T> mCallbacks;
+	const bool mPushes;        // to the callbacks rather than mConsumerQ
+
+	const RepairMode mRepair;
+	SeqNo mHighestSeen{ 0 };   // from data and heartbeats, gaps below it are nacked
+	std::chrono::steady_clock::time_point mLastNack;
+	std::atomic<size_t> mUnrecoverableFrames{ 0 };
+	std::atomic<size_t> mMalformedFrames{ 0 };
+
+	std::unique_ptr<SeqNoCheckpoint> mCheckpoint;
+	SeqNo mFlushedSeqNo{ 0 };
+	std::chrono::steady_clock::time_point mLastCheckpointFlush;
+
+	const std::chrono::milliseconds mKeepalive;
+	std::chrono::steady_clock::time_point mLastAck;
+	uint32_t mSession{ 0 };  // frames from any other session are dropped
+
+	const size_t mMaxBufferedFrames;
+	size_t mAdvertisedFrames{ 0 };  // the window in the last ack
+	bool mReopening{ false };        // the last reopen ack is repeated, see ReopenAckDue
+	SeqNo mReopenLimit{ 0 };         // the highest frame seen when the window reopened
+	std::chrono::steady_clock::time_point mReopenedAt;
+	SeqNo mDrivenSeqNo{ 0 };  // last ordered sequence number when there is no worker
+
+	// DeliveredQ is in delivery order, so a traced frame is taken once DeQ
+	// has taken as many frames as were delivered before it
+	const std::shared_ptr<MessageTracer> mTracer;
+	uint64_t mDeliveredFrames{ 0 };  // into mConsumerQ, on the worker
+	std::atomic<uint64_t> mTakenFrames{ 0 };
+	std::mutex mTracedMux;
+	std::deque<std::pair<uint64_t, SeqNo>> mTracedInQ;  // index in delivery order
 
-	bool LooksLikeADuplicate(uint16_t lastOrderedSeqenceNumber, Frame<T>& frame)
+	void Trace(TraceStage stage, SeqNo seqNo)
 	{
-		constexpr uint16_t maxSeq = -1;
-		constexpr uint16_t window = maxSeq / 2;
-		const uint16_t minExcludedSequence = lastOrderedSeqenceNumber - window;
-		bool isADuplicate = false;
-		bool windowWrappedAround = minExcludedSequence > lastOrderedSeqenceNumber;
-		bool frameInExclusionWindow = false;
-		if (windowWrappedAround)
+		if (mTracer && mTracer->Sampled(seqNo))
 		{
-			frameInExclusionWindow = frame.mHeader.mSeqNo <= lastOrderedSeqenceNumber || frame.mHeader.mSeqNo >= minExcludedSequence;
+			mTracer->Record(stage, seqNo);
 		}
-		else
+	}
+
+	// before the frame is added to mDelivered or handed to Deliver
+	void TraceDelivered(SeqNo seqNo)
+	{
+		if (!mTracer || !mTracer->Sampled(seqNo))
+		{
+			return;
+		}
+		mTracer->Record(TraceStage::Delivered, seqNo);
+		if (!mPushes)
 		{
-			frameInExclusionWindow = minExcludedSequence <= frame.mHeader.mSeqNo && frame.mHeader.mSeqNo <= lastOrderedSeqenceNumber;
+			std::lock_guard<std::mutex> lock(mTracedMux);
+			mTracedInQ.emplace_back(mDeliveredFrames + mDelivered.size(), seqNo);
 		}
+	}
 
-		if (frameInExclusionWindow)
+	size_t TraceTaken(size_t count)
+	{
+		if (!mTracer || count == 0)
+		{
+			return count;
+		}
+		const uint64_t taken = mTakenFrames += count;
+		std::lock_guard<std::mutex> lock(mTracedMux);
+		while (!mTracedInQ.empty() && mTracedInQ.front().first < taken)
 		{
-			Log("Consumer - rx out of window frame %d", frame.mHeader.mSeqNo);
+			mTracer->Record(TraceStage::Taken, mTracedInQ.front().second);
+			mTracedInQ.pop_front();
+		}
+		return count;
+	}
+
+	bool LooksLikeADuplicate(SeqNo lastOrderedSeqenceNumber, Frame<T>& frame)
+	{
+		bool isADuplicate = false;
+		if (SeqDiff(frame.mHeader.mSeqNo, lastOrderedSeqenceNumber) <= 0)
+		{
+			Log("Consumer - rx out of window frame %u", frame.mHeader.mSeqNo);
 			isADuplicate = true;
 		}
-		if (pendingData.find(frame.mHeader.mSeqNo) != pendingData.end())
+		if (Holds(frame.mHeader.mSeqNo))
 		{
-			Log("Consumer - rx duplicate pending frame %d", frame.mHeader.mSeqNo);
+			Log("Consumer - rx duplicate pending frame %u", frame.mHeader.mSeqNo);
 			isADuplicate = true;
 		}
 
 		return isADuplicate;
 	}
 
-	uint16_t ProcessFrame(uint16_t lastOrderedSeqenceNumber, Frame<T>& frame)
+	// received but not yet counted into the last ordered sequence number
+	bool Holds(SeqNo seqNo)
+	{
+		return pendingData.count(seqNo) || mDeliveredAhead.count(seqNo);
+	}
+
+	SeqNo ProcessFrame(SeqNo lastOrderedSeqenceNumber, Frame<T>& frame)
 	{
 		if (LooksLikeADuplicate(lastOrderedSeqenceNumber, frame))
 		{
 			return lastOrderedSeqenceNumber;
 		}
 
-		pendingData.insert({ frame.mHeader.mSeqNo, frame });
+		if (SeqLess(mHighestSeen, frame.mHeader.mSeqNo))
+		{
+			mHighestSeen = frame.mHeader.mSeqNo;
+		}
+		Trace(TraceStage::Received, frame.mHeader.mSeqNo);
+		if (mDelivery == Delivery::Unordered)
+		{
+			return DeliverOnArrival(lastOrderedSeqenceNumber, frame);
+		}
+
+		// the next frame in order skips the pending map, which costs a node per frame
+		if (frame.mHeader.mSeqNo == lastOrderedSeqenceNumber + 1)
+		{
+			Log("Consumer - delivering %u", frame.mHeader.mSeqNo);
+			TraceDelivered(frame.mHeader.mSeqNo);
+			if (mPushes)
+			{
+				Deliver(&frame.mBody, 1);  // ahead of anything it releases, mDelivered is empty
+			}
+			else
+			{
+				mDelivered.push_back(frame.mBody);
+			}
+			++lastOrderedSeqenceNumber;
+		}
+		else
+		{
+			Trace(TraceStage::Parked, frame.mHeader.mSeqNo);
+			pendingData.insert({ frame.mHeader.mSeqNo, frame });
+		}
+		return DeliverInOrder(lastOrderedSeqenceNumber);
+	}
+
+	// acks stay cumulative, so the last ordered sequence number only moves
+	// over the run delivered without a gap
+	SeqNo DeliverOnArrival(SeqNo lastOrderedSeqenceNumber, Frame<T>& frame)
+	{
+		Log("Consumer - delivering %u on arrival", frame.mHeader.mSeqNo);
+		TraceDelivered(frame.mHeader.mSeqNo);
+		Deliver(&frame.mBody, 1);
+		if (frame.mHeader.mSeqNo == lastOrderedSeqenceNumber + 1)
+		{
+			return SkipDeliveredAhead(lastOrderedSeqenceNumber + 1);
+		}
+		mDeliveredAhead.insert(frame.mHeader.mSeqNo);
+		return SkipDeliveredAhead(lastOrderedSeqenceNumber);
+	}
+
+	void Deliver(const T* data, size_t count)
+	{
+		if (!mPushes)
+		{
+			mDeliveredFrames += count;
+			mConsumerQ.EnQ(data, count);
+		}
+		else if (mCallbacks.mOnDeliverBatch)
+		{
+			mCallbacks.mOnDeliverBatch(data, count);
+		}
+		else
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				mCallbacks.mOnDeliver(data[i]);
+			}
+		}
+	}
+
+	SeqNo SkipDeliveredAhead(SeqNo lastOrderedSeqenceNumber)
+	{
+		while (mDeliveredAhead.erase(lastOrderedSeqenceNumber + 1))
+		{
+			++lastOrderedSeqenceNumber;
+		}
+		return lastOrderedSeqenceNumber;
+	}
+
+	SeqNo DeliverInOrder(SeqNo lastOrderedSeqenceNumber)
+	{
 		auto nextFrame = pendingData.find(lastOrderedSeqenceNumber + 1);
 		while (nextFrame != pendingData.end())
 		{
-			Log("Consumer - delivering %d", nextFrame->second.mHeader.mSeqNo);
-			mConsumerQ.EnQ(nextFrame->second.mBody);
+			Log("Consumer - delivering %u", nextFrame->second.mHeader.mSeqNo);
+			TraceDelivered(nextFrame->second.mHeader.mSeqNo);
+			mDelivered.push_back(nextFrame->second.mBody);
 			pendingData.erase(nextFrame);
 			++lastOrderedSeqenceNumber;
 			nextFrame = pendingData.find(lastOrderedSeqenceNumber + 1);
 		}
+		// a hole being filled releases everything behind it at once
+		if (!mDelivered.empty())
+		{
+			Deliver(&mDelivered[0], mDelivered.size());
+			mDelivered.clear();
+		}
+
+		// listing every pending frame does not scale to large windows
+		Log("Consumer - %zu frames pending after %u", pendingData.size(), lastOrderedSeqenceNumber);
 
-		std::string frameNumbers;
-		for (auto pendingFrame : pendingData)
+		return lastOrderedSeqenceNumber;
+	}
+
+	SeqNo ProcessRecovered(SeqNo lastOrderedSeqenceNumber, FecDecoder::Recovered& recovered)
+	{
+		for (auto& body : recovered)
 		{
-			frameNumbers += std::to_string(pendingFrame.first) + ",";
+			T data;
+			memcpy(&data, &body.second[0], sizeof(data));
+			Frame<T> frame(Header(body.first), data);
+			++mFecRecoveredFrames;
+			lastOrderedSeqenceNumber = ProcessFrame(lastOrderedSeqenceNumber, frame);
 		}
-		Log("Consumer - pending frames %s", frameNumbers.c_str());
+		return lastOrderedSeqenceNumber;
+	}
+
+	/// <summary>
+	/// Frames older than the producer can still repair are given up on, any
+	/// held behind them are delivered
+	/// </summary>
+	SeqNo ProcessHeartbeat(SeqNo lastOrderedSeqenceNumber, const Header& heartbeat)
+	{
+		if (SeqLess(mHighestSeen, heartbeat.mSeqNo))
+		{
+			mHighestSeen = heartbeat.mSeqNo;
+		}
+
+		const SeqNo oldestRepairable = heartbeat.mSeqNo - heartbeat.mRange + 1;
+		if (!SeqLess(lastOrderedSeqenceNumber + 1, oldestRepairable))
+		{
+			return lastOrderedSeqenceNumber;
+		}
+
+		Log("Consumer - frames from %u to %u can no longer be repaired", lastOrderedSeqenceNumber + 1, oldestRepairable - 1);
+		while (SeqLess(lastOrderedSeqenceNumber + 1, oldestRepairable))
+		{
+			++lastOrderedSeqenceNumber;
+			if (mDeliveredAhead.erase(lastOrderedSeqenceNumber))
+			{
+				continue;
+			}
+			auto pending = pendingData.find(lastOrderedSeqenceNumber);
+			if (pending == pendingData.end())
+			{
+				++mUnrecoverableFrames;
+				continue;
+			}
+			TraceDelivered(pending->first);
+			mDelivered.push_back(pending->second.mBody);
+			pendingData.erase(pending);
+		}
+		return DeliverInOrder(SkipDeliveredAhead(lastOrderedSeqenceNumber));
+	}
 
+	/// <summary>
+	/// A new session means the producer restarted, or this end did. Whatever
+	/// is pending belongs to the old one, delivery carries on after the
+	/// hello unless the producer resumes a stream this end is further into.
+	/// Every hello is welcomed, as the last welcome may have been lost.
+	/// </summary>
+	SeqNo ProcessHello(SeqNo lastOrderedSeqenceNumber, const Header& hello)
+	{
+		if (hello.mSession != mSession)
+		{
+			const bool resume = hello.mRange != 0;
+			const SeqNo start = resume && SeqLess(hello.mSeqNo, lastOrderedSeqenceNumber) ? lastOrderedSeqenceNumber : hello.mSeqNo;
+			Log("Consumer - session %u replaces %u, delivering after %u", hello.mSession, mSession, start);
+			mSession = hello.mSession;
+			pendingData.clear();
+			mDeliveredAhead.clear();
+			mFecDecoder = FecDecoder(sizeof(T));
+			mHighestSeen = start;
+			lastOrderedSeqenceNumber = start;
+		}
+
+		Header welcome(lastOrderedSeqenceNumber);
+		welcome.mType = FrameType::Welcome;
+		welcome.mSession = mSession;
+		mTransport->ConsumerEnQ(Frame<T>(welcome).mBytes);
 		return lastOrderedSeqenceNumber;
 	}
 
+	// frames past the last ordered one the producer may send. Frames waiting
+	// on a gap are past it already, so only those waiting for DeQ count
+	size_t FreeFrames()
+	{
+		const size_t queued = mConsumerQ.Size();
+		return queued < mMaxBufferedFrames ? mMaxBufferedFrames - queued : 0;
+	}
+
+	// a producer held back by a small window only hears that it has grown
+	// from an ack
+	bool WindowReopened()
+	{
+		const size_t half = mMaxBufferedFrames / 2;
+		return mMaxBufferedFrames != 0 && mAdvertisedFrames <= half && FreeFrames() > half;
+	}
+
+	// a producer waiting on a closed window has nothing pending to resend,
+	// so if the ack that reopened it is lost nothing else would prompt one
+	// before the keepalive. It is repeated until a frame past the old limit
+	// arrives, or for a keepalive, after which the keepalives carry it
+	bool ReopenAckDue()
+	{
+		constexpr std::chrono::milliseconds reopenInterval(10);
+		if (!mReopening)
+		{
+			return false;
+		}
+		const auto now = std::chrono::steady_clock::now();
+		if (SeqLess(mReopenLimit, mHighestSeen) || now - mReopenedAt >= mKeepalive)
+		{
+			mReopening = false;
+			return false;
+		}
+		return now - mLastAck >= reopenInterval;
+	}
+
+	// one nack per missing run, resent while the gap stays open
+	void SendNacksIfNeeded(SeqNo lastOrderedSeqenceNumber)
+	{
+		constexpr std::chrono::milliseconds nackInterval(20);
+		constexpr int maxRunsPerRound = 8;
+		const auto now = std::chrono::steady_clock::now();
+		if (!SeqLess(lastOrderedSeqenceNumber, mHighestSeen) || now - mLastNack < nackInterval)
+		{
+			return;
+		}
+		mLastNack = now;
+
+		SeqNo seqNo = lastOrderedSeqenceNumber + 1;
+		for (int runs = 0; runs < maxRunsPerRound && !SeqLess(mHighestSeen, seqNo);)
+		{
+			if (Holds(seqNo))
+			{
+				++seqNo;
+				continue;
+			}
+
+			Header nack(seqNo);
+			nack.mType = FrameType::Nack;
+			nack.mSession = mSession;
+			while (!SeqLess(mHighestSeen, seqNo) && !Holds(seqNo) && nack.mRange < UINT16_MAX)
+			{
+				++nack.mRange;
+				++seqNo;
+			}
+			Log("Consumer - nack %u frames from %u", nack.mRange, nack.mSeqNo);
+			mTransport->ConsumerEnQ(Frame<T>(nack).mBytes);
+			++runs;
+		}
+	}
+
+	// the mapping outlives the process straight away, the disk is only
+	// brought up to date now and then so the position outlives the machine
+	void CheckpointIfNeeded(SeqNo lastOrderedSeqenceNumber, bool flush)
+	{
+		constexpr std::chrono::milliseconds flushInterval(100);
+		mCheckpoint->Store(lastOrderedSeqenceNumber);
+		const auto now = std::chrono::steady_clock::now();
+		if (mFlushedSeqNo != lastOrderedSeqenceNumber && (flush || now - mLastCheckpointFlush >= flushInterval))
+		{
+			mCheckpoint->Flush();
+			mFlushedSeqNo = lastOrderedSeqenceNumber;
+			mLastCheckpointFlush = now;
+		}
+	}
+
 	void Work()
 	{
-		uint16_t lastOrderedSeqenceNumber = 0;
+		mTransport->ConfigureConsumerThread();
+		SeqNo lastOrderedSeqenceNumber = mCheckpoint ? mCheckpoint->Load() : 0;
+		mHighestSeen = lastOrderedSeqenceNumber;
+		mFlushedSeqNo = lastOrderedSeqenceNumber;
+		if (mCheckpoint)
+		{
+			Log("Consumer - resuming after %u", lastOrderedSeqenceNumber);
+		}
 		std::chrono::duration<int, std::milli> timeOut(100);
+		std::vector<uint8_t> data; // reused, networks hand back its buffer on the next DeQ
 
 		while (!mStop)
 		{
-			std::vector<uint8_t> data;
-			bool hasData = mTransport->ConsumeDeQ(data, timeOut);
-			if (hasData)
+			// a small window is checked more often, to reopen it soon after DeQ
+			const bool windowLow = mMaxBufferedFrames != 0 && (mAdvertisedFrames <= mMaxBufferedFrames / 2 || mReopening);
+			std::chrono::duration<int, std::milli> wait = windowLow ? std::chrono::duration<int, std::milli>(10) : timeOut;
+			const bool hasData = mTransport->ConsumeDeQ(data, wait);
+			lastOrderedSeqenceNumber = Step(lastOrderedSeqenceNumber, data, hasData);
+		}
+	}
+
+	// handles one datagram, if there is one, then acks or nacks as due
+	SeqNo Step(SeqNo lastOrderedSeqenceNumber, std::vector<uint8_t>& data, bool hasData)
+	{
+		if (hasData && IsProbe(data))
+		{
+			hasData = false;  // a network that does not answer path MTU probes passed one on
+		}
+		if (hasData && !Frame<T>::Fits(data))
+		{
+			// dropped like a lost frame, repair resends it
+			Log("Consumer - dropping malformed %zu byte frame", data.size());
+			++mMalformedFrames;
+			hasData = false;
+		}
+		if (hasData)
+		{
+			Frame<T> frame(data);
+			FecDecoder::Recovered recovered;
+			if (frame.mHeader.mType == FrameType::Hello)
 			{
-				Frame<T> frame(data);
-				if (frame.mHasBody)
-				{
-					lastOrderedSeqenceNumber = ProcessFrame(lastOrderedSeqenceNumber, frame);
-				}
+				lastOrderedSeqenceNumber = ProcessHello(lastOrderedSeqenceNumber, frame.mHeader);
+			}
+			else if (frame.mHeader.mSession != mSession)
+			{
+				// the ack below tells the producer which session this end is on
+				Log("Consumer - rx frame %u from session %u, on %u", frame.mHeader.mSeqNo, frame.mHeader.mSession, mSession);
 			}
+			else if (frame.mHeader.mType == FrameType::Parity)
+			{
+				mFecDecoder.AddParity(frame.mHeader, &frame.mBytes[sizeof(Header)], lastOrderedSeqenceNumber, recovered);
+			}
+			else if (frame.mHeader.mType == FrameType::Heartbeat)
+			{
+				lastOrderedSeqenceNumber = ProcessHeartbeat(lastOrderedSeqenceNumber, frame.mHeader);
+			}
+			else if (frame.mHasBody)
+			{
+				lastOrderedSeqenceNumber = ProcessFrame(lastOrderedSeqenceNumber, frame);
+				mFecDecoder.AddData(frame.mHeader.mSeqNo, &frame.mBytes[sizeof(Header)], lastOrderedSeqenceNumber, recovered);
+			}
+			lastOrderedSeqenceNumber = ProcessRecovered(lastOrderedSeqenceNumber, recovered);
+		}
 
-			if (!mStop)
+		if (mCheckpoint)
+		{
+			CheckpointIfNeeded(lastOrderedSeqenceNumber, mStop);
+		}
+
+		if (mRepair == RepairMode::Nack)
+		{
+			SendNacksIfNeeded(lastOrderedSeqenceNumber);
+		}
+		else if (!mStop && (hasData || std::chrono::steady_clock::now() - mLastAck >= mKeepalive || WindowReopened() || ReopenAckDue()))
+		{
+			// a resent frame is answered even when nothing changed, as
+			// the last ack may have been lost
+			Header ackHeader(lastOrderedSeqenceNumber);
+			ackHeader.mSession = mSession;
+			if (mMaxBufferedFrames != 0)
 			{
-				// dumb down the ack rate later
-				Header ackHeader(lastOrderedSeqenceNumber);
-				Frame<T> ackFrame(ackHeader);
-				Log("Consumer - acknowledging %d", lastOrderedSeqenceNumber);
-				mTransport->ConsumerEnQ(ackFrame.mBytes);
+				if (WindowReopened())
+				{
+					mReopening = true;
+					mReopenLimit = mHighestSeen;
+					mReopenedAt = std::chrono::steady_clock::now();
+				}
+				mAdvertisedFrames = FreeFrames();
+				ackHeader.mWindow = static_cast<uint16_t>(mAdvertisedFrames + 1);
 			}
+			Frame<T> ackFrame(ackHeader);
+			Log("Consumer - acknowledging %u", lastOrderedSeqenceNumber);
+			mTransport->ConsumerEnQ(ackFrame.mBytes);
+			mLastAck = std::chrono::steady_clock::now();
 		}
+		return lastOrderedSeqenceNumber;
 	}
 
+	struct Driven {};
+
+	// no worker, a QShardedConsumer worker hands over what arrives for this
+	// consumer's flow, or nothing now and then so it can keep alive
+	QConsumer(std::shared_ptr<INetwork>& transport, const ConsumerConfig& config, Driven) :
+		mConsumerQ("DeliveredQ", config.mWait), mTransport(transport), mDelivery(config.mDelivery), mPushes(false),
+		mRepair(config.mRepair), mKeepalive(config.mKeepalive), mMaxBufferedFrames(config.mMaxBufferedFrames),
+		mTracer(config.mTracer)
+	{}
+
+	void Drive(std::vector<uint8_t>& data, bool hasData)
+	{
+		mDrivenSeqNo = Step(mDrivenSeqNo, data, hasData);
+	}
 
 public:
-	QConsumer(std::shared_ptr<INetwork>& transport) :mConsumerQ("DeliveredQ"), mTransport(transport)
+	QConsumer(std::shared_ptr<INetwork>& transport, const ConsumerConfig& config = ConsumerConfig(),
+		const DeliveryCallbacks<T>& callbacks = DeliveryCallbacks<T>()) :
+		mConsumerQ("DeliveredQ", config.mWait), mTransport(transport), mDelivery(config.mDelivery),
+		mCallbacks(callbacks), mPushes(callbacks.mOnDeliver || callbacks.mOnDeliverBatch), mRepair(config.mRepair),
+		mKeepalive(config.mKeepalive), mMaxBufferedFrames(config.mMaxBufferedFrames),
+		mTracer(config.mTracer)
 	{
-		mWorker = std::async(std::launch::async, [&]() {Work(); });
+		if (mMaxBufferedFrames != 0 && mRepair != RepairMode::Ack)
+		{
+			Log("QConsumer - flow control rides on acks, it needs Ack repair");
+			exit(1);
+		}
+		if (mMaxBufferedFrames >= UINT16_MAX)
+		{
+			Log("QConsumer - a window of %zu frames does not fit an ack", mMaxBufferedFrames);
+			exit(1);
+		}
+		if (!config.mCheckpointFile.empty())
+		{
+			mCheckpoint = std::make_unique<SeqNoCheckpoint>(config.mCheckpointFile);
+		}
+		mWorker = std::thread([this]() { Work(); });
 	}
 
+	// asynchronous readers still waiting are woken to find nothing, see DeQAwaiter
 	void Stop()
 	{
 		mStop = true;
-		mWorker.get();
+		if (mWorker.joinable())
+		{
+			mWorker.join();
+		}
+		mConsumerQ.CloseAsyncReaders();
 	}
 
+	bool Stopped() { return mStop; }
+
 	void DeQ(T& data)
 	{
 		mConsumerQ.DeQ(data);
+		TraceTaken(1);
+	}
+
+	size_t DeQ(T* data, size_t maxCount, std::chrono::duration<int, std::milli>& timeOut)
+	{
+		return TraceTaken(mConsumerQ.DeQ(data, maxCount, timeOut));
+	}
+
+	size_t DeQAll(std::vector<T>& data, std::chrono::duration<int, std::milli>& timeOut)
+	{
+		return TraceTaken(mConsumerQ.DeQAll(data, timeOut));
+	}
+
+	// takes up to maxCount delivered frames without waiting
+	size_t TryDeQ(T* data, size_t maxCount)
+	{
+		return TraceTaken(mConsumerQ.TryDeQ(data, maxCount));
+	}
+
+	// ready is called once a frame is waiting for TryDeQ, on the worker if
+	// there is not one yet, or once the consumer has stopped, see BlockingQ::WhenData
+	void WhenDelivered(std::function<void()> ready)
+	{
+		mConsumerQ.WhenData(std::move(ready));
 	}
 
 	size_t Size()
 	{
 		return mConsumerQ.Size();
 	}
+
+	size_t FecRecoveredFrames()
+	{
+		return mFecRecoveredFrames;
+	}
+
+	// frames skipped because the producer could no longer repair them, its
+	// Nack window moved on or they outlived its TTL
+	size_t UnrecoverableFrames()
+	{
+		return mUnrecoverableFrames;
+	}
+
+	// frames dropped for not being the length their header says
+	size_t MalformedFrames()
+	{
+		return mMalformedFrames;
+	}
 };
\ No newline at end of file
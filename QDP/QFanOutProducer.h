@@ -0,0 +1,277 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "QNetwork.h"
+#include "QFec.h"
+#include "QProducer.h"
+
+struct FanOutConfig
+{
+	// a subscriber whose acks stop advancing for this long while it holds
+	// frames in the window is dropped, 0 keeps every subscriber for good
+	std::chrono::milliseconds mEvictAfter{ 0 };
+};
+
+/// <summary>
+/// Sends one stream to every subscriber of an IFanOutNetwork. Frames are
+/// serialised once into a single retransmission window shared by all
+/// subscribers, each subscriber only adds its cumulative ack and resend
+/// timers. A frame leaves the window once every subscriber still in the
+/// set has acked it. Only the window, FEC and wait settings of
+/// ProducerConfig apply; pacing, Nack repair, a handshake, a send log, a TTL
+/// or a tracer are rejected. A window a consumer advertises in its acks is
+/// not honoured, the shared window is the only limit.
+/// </summary>
+template <class T> class QFanOutProducer
+{
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct Subscriber
+	{
+		SeqNo mAcked{ 0 };
+		Clock::time_point mLastProgress{ Clock::now() };
+		Clock::time_point mLastResent{ Clock::now() };
+		bool mEvicted{ false };
+	};
+
+	SeqNo mTxSequenceNo{ 1 };
+	BlockingQ<T> mProducerQ;
+	std::shared_ptr<IFanOutNetwork> mTransport;
+	std::thread mWorker;
+	std::atomic<bool> mStop{ false };
+	RingBuffer<Frame<T>> mPendingFrames;
+	std::vector<Subscriber> mSubscribers;
+	const uint32_t mMaxPendingFrames;
+	const FanOutConfig mFanOut;
+	std::unique_ptr<FecEncoder> mFecEncoder;
+	std::atomic<size_t> mResentFrames{ 0 };
+	std::atomic<size_t> mEvictedSubscribers{ 0 };
+
+	static constexpr size_t cMaxSendBatch = 64;
+	std::vector<T> mSendBatch = std::vector<T>(cMaxSendBatch);
+
+	bool HasUnacked(const Subscriber& subscriber) const
+	{
+		return !mPendingFrames.empty() && SeqLess(subscriber.mAcked, mPendingFrames.back().mHeader.mSeqNo);
+	}
+
+	void ReleaseAckedFrames()
+	{
+		while (!mPendingFrames.empty())
+		{
+			const SeqNo front = mPendingFrames.front().mHeader.mSeqNo;
+			auto holdsFront = [front](const Subscriber& subscriber)
+			{
+				return !subscriber.mEvicted && SeqLess(subscriber.mAcked, front);
+			};
+			if (std::any_of(mSubscribers.begin(), mSubscribers.end(), holdsFront))
+			{
+				break;
+			}
+			mPendingFrames.pop_front();
+		}
+	}
+
+	void OnAck(size_t index, Frame<T>& ackFrame)
+	{
+		if (index >= mSubscribers.size() || mSubscribers[index].mEvicted || mPendingFrames.empty())
+		{
+			return;
+		}
+
+		auto& subscriber = mSubscribers[index];
+		const SeqNo ack = ackFrame.mHeader.mSeqNo;
+		if (SeqLess(subscriber.mAcked, ack) && !SeqLess(mPendingFrames.back().mHeader.mSeqNo, ack))
+		{
+			Log("FanOut - subscriber %zu acked %u", index, ack);
+			subscriber.mAcked = ack;
+			subscriber.mLastProgress = Clock::now();
+			subscriber.mLastResent = subscriber.mLastProgress;
+			ReleaseAckedFrames();
+		}
+		else
+		{
+			Log("FanOut - subscriber %zu ack %u is old", index, ack);
+		}
+	}
+
+	// resends each lagging subscriber's next frame to it alone and drops
+	// subscribers that stopped acking, returns the time until the next resend
+	std::chrono::duration<int, std::milli> ResendOrEvict()
+	{
+		const std::chrono::milliseconds resendFrequency(100);
+		auto timeTillNextSend = resendFrequency;
+		const auto now = Clock::now();
+
+		for (size_t index = 0; index < mSubscribers.size(); ++index)
+		{
+			auto& subscriber = mSubscribers[index];
+			if (subscriber.mEvicted || !HasUnacked(subscriber))
+			{
+				continue;
+			}
+
+			if (mFanOut.mEvictAfter.count() > 0 && now - subscriber.mLastProgress >= mFanOut.mEvictAfter)
+			{
+				Log("FanOut - evicting subscriber %zu stuck at %u", index, subscriber.mAcked);
+				subscriber.mEvicted = true;
+				++mEvictedSubscribers;
+				ReleaseAckedFrames();
+				continue;
+			}
+
+			auto timeSinceResend = std::chrono::duration_cast<std::chrono::milliseconds>(now - subscriber.mLastResent);
+			if (timeSinceResend >= resendFrequency)
+			{
+				auto& frame = mPendingFrames[SeqDiff(subscriber.mAcked + 1, mPendingFrames.front().mHeader.mSeqNo)];
+				Log("FanOut - resending frame %u to subscriber %zu", frame.mHeader.mSeqNo, index);
+				mTransport->ProducerEnQ(index, frame.mBytes);
+				subscriber.mLastResent = now;
+				++mResentFrames;
+			}
+			else
+			{
+				timeTillNextSend = (std::min)(timeTillNextSend, resendFrequency - timeSinceResend);
+			}
+		}
+
+		return std::chrono::duration<int, std::milli>(timeTillNextSend.count());
+	}
+
+	void Send(const T& data)
+	{
+		Frame<T> frame(Header(mTxSequenceNo++), data);
+		Log("FanOut - sending new frame %u", frame.mHeader.mSeqNo);
+
+		// a subscriber that was idle starts its clocks with this frame
+		const auto now = Clock::now();
+		for (auto& subscriber : mSubscribers)
+		{
+			if (!HasUnacked(subscriber))
+			{
+				subscriber.mLastProgress = now;
+				subscriber.mLastResent = now;
+			}
+		}
+
+		mTransport->ProducerEnQ(frame.mBytes);
+		const Frame<T>& pending = mPendingFrames.emplace_back(std::move(frame));
+
+		if (mFecEncoder && mFecEncoder->Add(pending.mHeader.mSeqNo, &pending.mBytes[sizeof(Header)]))
+		{
+			for (uint8_t p = 0; p < mFecEncoder->ParityFrames(); ++p)
+			{
+				T parityBody;
+				memcpy(&parityBody, mFecEncoder->Parity(p), sizeof(parityBody));
+				mTransport->ProducerEnQ(Frame<T>(mFecEncoder->ParityHeader(p), parityBody).mBytes);
+			}
+		}
+
+		// with every subscriber evicted no ack will ever release it
+		if (mEvictedSubscribers == mSubscribers.size())
+		{
+			ReleaseAckedFrames();
+		}
+	}
+
+	void Work()
+	{
+		mTransport->ConfigureProducerThread();
+		std::chrono::duration<int, std::milli> deQAckTimeOut(0);
+		while (!mStop)
+		{
+			auto timeTillNextResend = ResendOrEvict();
+			if (mPendingFrames.size() >= mMaxPendingFrames)
+			{
+				Log("FanOut - Pending q full, waiting up to %dms for an ack", timeTillNextResend.count());
+				size_t subscriber;
+				std::vector<uint8_t> ackData;
+				if (mTransport->ProducerDeQ(subscriber, ackData, timeTillNextResend) && Frame<T>::Fits(ackData))
+				{
+					Frame<T> ackFrame(ackData);
+					OnAck(subscriber, ackFrame);
+				}
+			}
+			else
+			{
+				const size_t batch = (std::min<size_t>)(mMaxPendingFrames - mPendingFrames.size(), cMaxSendBatch);
+				const size_t count = mProducerQ.DeQ(&mSendBatch[0], batch, timeTillNextResend);
+				for (size_t i = 0; i < count; ++i)
+				{
+					Send(mSendBatch[i]);
+				}
+			}
+
+			size_t subscriber;
+			std::vector<uint8_t> ackData;
+			while (mTransport->ProducerDeQ(subscriber, ackData, deQAckTimeOut))
+			{
+				if (!Frame<T>::Fits(ackData))
+				{
+					Log("FanOut - dropping malformed %zu byte ack from subscriber %zu", ackData.size(), subscriber);
+					continue;
+				}
+				Frame<T> ackFrame(ackData);
+				OnAck(subscriber, ackFrame);
+			}
+		}
+	}
+
+public:
+	QFanOutProducer(std::shared_ptr<IFanOutNetwork> transport, const ProducerConfig& config = ProducerConfig(),
+		const FanOutConfig& fanOut = FanOutConfig()) :
+		mProducerQ("FanOutQ", config.mWait), mTransport(transport), mSubscribers(transport->Subscribers()),
+		mMaxPendingFrames(config.mMaxPendingFrames), mFanOut(fanOut)
+	{
+		if (mMaxPendingFrames == 0 || mMaxPendingFrames > static_cast<uint32_t>(INT32_MAX))
+		{
+			Log("QFanOutProducer - window of %u frames is outside the sequence space", mMaxPendingFrames);
+			exit(1);
+		}
+		const char* unsupported = config.mPacing.mEnabled ? "pacing" :
+			config.mRepair != RepairMode::Ack ? "Nack repair" :
+			config.mHandshake ? "a handshake" :
+			config.mLog.Enabled() ? "a send log" :
+			config.mTtl.count() != 0 ? "a TTL" :
+			config.mTracer ? "a tracer" : nullptr;
+		if (unsupported)
+		{
+			Log("QFanOutProducer - %s is not supported when fanning out", unsupported);
+			exit(1);
+		}
+		if (config.mFec.Enabled())
+		{
+			mFecEncoder = std::make_unique<FecEncoder>(config.mFec, sizeof(T));
+		}
+		mWorker = std::thread([this]() { Work(); });
+	}
+
+	uint32_t MaxPendingFrames() { return mMaxPendingFrames; }
+
+	size_t ResentFrames() { return mResentFrames; }
+
+	size_t EvictedSubscribers() { return mEvictedSubscribers; }
+
+	void Stop()
+	{
+		mStop = true;
+		mWorker.join();
+	}
+
+	void EnQ(const T& data)
+	{
+		mProducerQ.EnQ(data);
+	}
+
+	void EnQ(const T* data, size_t count)
+	{
+		mProducerQ.EnQ(data, count);
+	}
+
+	size_t Size()
+	{
+		return mProducerQ.Size();
+	}
+};
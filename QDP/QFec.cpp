@@ -0,0 +1,383 @@
+#include "pch.h"
+#include "QFec.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define QUDP_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define QUDP_TARGET_SSSE3
+#else
+#define QUDP_TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+#endif
+
+namespace
+{
+	struct GfTables
+	{
+		uint8_t mExp[512];
+		uint8_t mLog[256];
+		uint8_t mMul[256][256];
+		bool mHasSsse3{ false };
+
+		GfTables()
+		{
+			unsigned x = 1;
+			for (int i = 0; i < 255; ++i)
+			{
+				mExp[i] = static_cast<uint8_t>(x);
+				mLog[x] = static_cast<uint8_t>(i);
+				x <<= 1;
+				if (x & 0x100)
+				{
+					x ^= 0x11d;
+				}
+			}
+			for (int i = 255; i < 512; ++i)
+			{
+				mExp[i] = mExp[i - 255];
+			}
+			mLog[0] = 0;
+
+			for (int a = 0; a < 256; ++a)
+			{
+				for (int b = 0; b < 256; ++b)
+				{
+					mMul[a][b] = (a == 0 || b == 0) ? 0 : mExp[mLog[a] + mLog[b]];
+				}
+			}
+
+#ifdef QUDP_X86
+#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 1);
+			mHasSsse3 = (info[2] & (1 << 9)) != 0;
+#else
+			mHasSsse3 = __builtin_cpu_supports("ssse3");
+#endif
+#endif
+		}
+	};
+
+	const GfTables& Tables()
+	{
+		static const GfTables tables;
+		return tables;
+	}
+
+#ifdef QUDP_X86
+	// split c * x into c * low nibble ^ c * high nibble, each a 16 entry shuffle
+	QUDP_TARGET_SSSE3 size_t MulAddSsse3(uint8_t* dst, const uint8_t* src, const uint8_t* mulRow, size_t size)
+	{
+		alignas(16) uint8_t lo[16];
+		alignas(16) uint8_t hi[16];
+		for (int i = 0; i < 16; ++i)
+		{
+			lo[i] = mulRow[i];
+			hi[i] = mulRow[i << 4];
+		}
+		const __m128i loTable = _mm_load_si128(reinterpret_cast<const __m128i*>(lo));
+		const __m128i hiTable = _mm_load_si128(reinterpret_cast<const __m128i*>(hi));
+		const __m128i nibbleMask = _mm_set1_epi8(0x0f);
+
+		size_t i = 0;
+		for (; i + 16 <= size; i += 16)
+		{
+			__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+			__m128i loProduct = _mm_shuffle_epi8(loTable, _mm_and_si128(s, nibbleMask));
+			__m128i hiProduct = _mm_shuffle_epi8(hiTable, _mm_and_si128(_mm_srli_epi64(s, 4), nibbleMask));
+			d = _mm_xor_si128(d, _mm_xor_si128(loProduct, hiProduct));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), d);
+		}
+		return i;
+	}
+#endif
+}
+
+uint8_t Gf256::Mul(uint8_t a, uint8_t b)
+{
+	return Tables().mMul[a][b];
+}
+
+uint8_t Gf256::Inv(uint8_t a)
+{
+	const auto& tables = Tables();
+	return tables.mExp[255 - tables.mLog[a]];
+}
+
+uint8_t Gf256::Div(uint8_t a, uint8_t b)
+{
+	return Mul(a, Inv(b));
+}
+
+void Gf256::XorInto(uint8_t* dst, const uint8_t* src, size_t size)
+{
+	size_t i = 0;
+#ifdef QUDP_X86
+	for (; i + 16 <= size; i += 16)
+	{
+		__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(d, s));
+	}
+#endif
+	for (; i < size; ++i)
+	{
+		dst[i] ^= src[i];
+	}
+}
+
+void Gf256::MulAddInto(uint8_t* dst, const uint8_t* src, uint8_t c, size_t size)
+{
+	if (c == 0)
+	{
+		return;
+	}
+	if (c == 1)
+	{
+		XorInto(dst, src, size);
+		return;
+	}
+
+	const auto& tables = Tables();
+	const uint8_t* mulRow = tables.mMul[c];
+	size_t i = 0;
+#ifdef QUDP_X86
+	if (tables.mHasSsse3)
+	{
+		i = MulAddSsse3(dst, src, mulRow, size);
+	}
+#endif
+	for (; i < size; ++i)
+	{
+		dst[i] ^= mulRow[src[i]];
+	}
+}
+
+void Gf256::MulInPlace(uint8_t* dst, uint8_t c, size_t size)
+{
+	const uint8_t* mulRow = Tables().mMul[c];
+	for (size_t i = 0; i < size; ++i)
+	{
+		dst[i] = mulRow[dst[i]];
+	}
+}
+
+uint8_t Gf256::Coefficient(uint8_t parityIndex, uint8_t dataIndex)
+{
+	// Cauchy points x = parityIndex, y = 128 + dataIndex, each column scaled
+	// by (x0 ^ y) so that row 0 is all ones
+	const uint8_t y = static_cast<uint8_t>(FecConfig::cMaxFrames + dataIndex);
+	return Div(y, static_cast<uint8_t>(parityIndex ^ y));
+}
+
+
+FecEncoder::FecEncoder(const FecConfig& config, size_t symbolSize) :
+	mConfig(config), mSymbolSize(symbolSize), mParity(config.mParityFrames, std::vector<uint8_t>(symbolSize))
+{
+	if (mConfig.mDataFrames > FecConfig::cMaxFrames || mConfig.mParityFrames > FecConfig::cMaxFrames)
+	{
+		Log("FecEncoder - at most %d data and parity frames per group", FecConfig::cMaxFrames);
+		exit(1);
+	}
+}
+
+bool FecEncoder::Add(SeqNo seqNo, const uint8_t* body)
+{
+	if (mGroupCount == 0)
+	{
+		mGroupStart = seqNo;
+		for (auto& parity : mParity)
+		{
+			std::fill(parity.begin(), parity.end(), static_cast<uint8_t>(0));
+		}
+	}
+
+	for (uint8_t p = 0; p < mConfig.mParityFrames; ++p)
+	{
+		Gf256::MulAddInto(&mParity[p][0], body, Gf256::Coefficient(p, mGroupCount), mSymbolSize);
+	}
+
+	++mGroupCount;
+	if (mGroupCount == mConfig.mDataFrames)
+	{
+		mGroupCount = 0;
+		return true;
+	}
+	return false;
+}
+
+Header FecEncoder::ParityHeader(uint8_t parityIndex) const
+{
+	Header header(mGroupStart);
+	header.mDataSize = static_cast<uint16_t>(mSymbolSize);
+	header.mType = FrameType::Parity;
+	header.mFecDataFrames = mConfig.mDataFrames;
+	header.mFecParityIndex = parityIndex;
+	header.mFecParityFrames = mConfig.mParityFrames;
+	return header;
+}
+
+
+const uint8_t* FecDecoder::Find(SeqNo seqNo) const
+{
+	const size_t slot = seqNo % cHistory;
+	return mHistoryValid[slot] && mHistorySeqNo[slot] == seqNo ? &mHistory[slot * mSymbolSize] : nullptr;
+}
+
+void FecDecoder::Remember(SeqNo seqNo, const uint8_t* body)
+{
+	const size_t slot = seqNo % cHistory;
+	memcpy(&mHistory[slot * mSymbolSize], body, mSymbolSize);
+	mHistorySeqNo[slot] = seqNo;
+	mHistoryValid[slot] = true;
+}
+
+void FecDecoder::AddData(SeqNo seqNo, const uint8_t* body, SeqNo lastOrdered, Recovered& recovered)
+{
+	Remember(seqNo, body);
+	if (mGroups.empty())
+	{
+		return;
+	}
+
+	for (auto group = mGroups.begin(); group != mGroups.end(); ++group)
+	{
+		if (seqNo - group->first < group->second.mDataFrames)
+		{
+			TryDecode(group->first, lastOrdered, recovered);
+			break;
+		}
+	}
+	Prune(lastOrdered);
+}
+
+void FecDecoder::AddParity(const Header& header, const uint8_t* body, SeqNo lastOrdered, Recovered& recovered)
+{
+	if (header.mFecDataFrames == 0 || header.mDataSize != mSymbolSize)
+	{
+		return;
+	}
+
+	const SeqNo groupEnd = header.mSeqNo + header.mFecDataFrames - 1;
+	if (SeqDiff(groupEnd, lastOrdered) > 0)
+	{
+		auto& group = mGroups[header.mSeqNo];
+		group.mDataFrames = header.mFecDataFrames;
+		group.mParity.emplace(header.mFecParityIndex, std::vector<uint8_t>(body, body + mSymbolSize));
+		TryDecode(header.mSeqNo, lastOrdered, recovered);
+	}
+	Prune(lastOrdered);
+}
+
+void FecDecoder::TryDecode(SeqNo groupStart, SeqNo lastOrdered, Recovered& recovered)
+{
+	auto groupIt = mGroups.find(groupStart);
+	auto& group = groupIt->second;
+
+	std::vector<uint8_t> missing;
+	std::vector<uint8_t> known;
+	for (uint8_t i = 0; i < group.mDataFrames; ++i)
+	{
+		const SeqNo seqNo = groupStart + i;
+		if (Find(seqNo) != nullptr)
+		{
+			known.push_back(i);
+		}
+		else if (SeqDiff(seqNo, lastOrdered) <= 0)
+		{
+			// delivered but already dropped from the history, cannot help
+			mGroups.erase(groupIt);
+			return;
+		}
+		else
+		{
+			missing.push_back(i);
+		}
+	}
+
+	if (missing.empty())
+	{
+		mGroups.erase(groupIt);
+		return;
+	}
+	if (missing.size() > group.mParity.size())
+	{
+		return; // wait for more parity or data
+	}
+
+	// syndromes: parity with the contribution of every known frame removed
+	// leaves sum(coef * missing body) for each parity row
+	const size_t e = missing.size();
+	std::vector<uint8_t> rows;
+	std::vector<std::vector<uint8_t>> syndromes;
+	for (auto& parity : group.mParity)
+	{
+		if (rows.size() == e)
+		{
+			break;
+		}
+		rows.push_back(parity.first);
+		syndromes.push_back(parity.second);
+		auto& syndrome = syndromes.back();
+		for (auto i : known)
+		{
+			Gf256::MulAddInto(&syndrome[0], Find(groupStart + i), Gf256::Coefficient(parity.first, i), mSymbolSize);
+		}
+	}
+
+	std::vector<std::vector<uint8_t>> matrix(e, std::vector<uint8_t>(e));
+	for (size_t r = 0; r < e; ++r)
+	{
+		for (size_t c = 0; c < e; ++c)
+		{
+			matrix[r][c] = Gf256::Coefficient(rows[r], missing[c]);
+		}
+	}
+
+	// Gauss-Jordan, row operations applied to the syndromes as well
+	for (size_t c = 0; c < e; ++c)
+	{
+		size_t pivot = c;
+		while (matrix[pivot][c] == 0)
+		{
+			++pivot;
+		}
+		std::swap(matrix[pivot], matrix[c]);
+		std::swap(syndromes[pivot], syndromes[c]);
+
+		const uint8_t scale = Gf256::Inv(matrix[c][c]);
+		Gf256::MulInPlace(&matrix[c][0], scale, e);
+		Gf256::MulInPlace(&syndromes[c][0], scale, mSymbolSize);
+
+		for (size_t r = 0; r < e; ++r)
+		{
+			const uint8_t factor = matrix[r][c];
+			if (r != c && factor != 0)
+			{
+				Gf256::MulAddInto(&matrix[r][0], &matrix[c][0], factor, e);
+				Gf256::MulAddInto(&syndromes[r][0], &syndromes[c][0], factor, mSymbolSize);
+			}
+		}
+	}
+
+	for (size_t c = 0; c < e; ++c)
+	{
+		const SeqNo seqNo = groupStart + missing[c];
+		Log("Fec - recovered frame %u", seqNo);
+		Remember(seqNo, &syndromes[c][0]);
+		recovered.emplace_back(seqNo, std::move(syndromes[c]));
+	}
+	mGroups.erase(groupIt);
+}
+
+void FecDecoder::Prune(SeqNo lastOrdered)
+{
+	for (auto group = mGroups.begin(); group != mGroups.end();)
+	{
+		const SeqNo groupEnd = group->first + group->second.mDataFrames - 1;
+		group = SeqDiff(groupEnd, lastOrdered) <= 0 ? mGroups.erase(group) : std::next(group);
+	}
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include "QNetwork.h"
+
+/// <summary>
+/// GF(2^8) arithmetic (polynomial 0x11d) plus the bulk kernels used by the
+/// erasure code. The kernels pick an SSSE3 path at runtime where available.
+/// </summary>
+class Gf256
+{
+public:
+	static uint8_t Mul(uint8_t a, uint8_t b);
+	static uint8_t Div(uint8_t a, uint8_t b);
+	static uint8_t Inv(uint8_t a);
+
+	// dst ^= src
+	static void XorInto(uint8_t* dst, const uint8_t* src, size_t size);
+	// dst ^= c * src
+	static void MulAddInto(uint8_t* dst, const uint8_t* src, uint8_t c, size_t size);
+	// dst = c * dst
+	static void MulInPlace(uint8_t* dst, uint8_t c, size_t size);
+
+	/// <summary>
+	/// Coefficient applied to data frame dataIndex when building parity frame
+	/// parityIndex. A row scaled Cauchy matrix: any square sub matrix can be
+	/// inverted so any K losses in a group can be repaired from K parity
+	/// frames, and parity 0 is a plain XOR.
+	/// </summary>
+	static uint8_t Coefficient(uint8_t parityIndex, uint8_t dataIndex);
+};
+
+/// <summary>
+/// Number of data frames per FEC group and parity frames sent for each group.
+/// Zero parity frames turns FEC off, overhead is ParityFrames / DataFrames.
+/// </summary>
+struct FecConfig
+{
+	uint8_t mDataFrames{ 0 };
+	uint8_t mParityFrames{ 0 };
+
+	static constexpr uint8_t cMaxFrames = 128;
+
+	bool Enabled() const { return mDataFrames != 0 && mParityFrames != 0; }
+};
+
+/// <summary>
+/// Producer side. Accumulates the bodies of consecutive data frames and
+/// builds the parity bodies once a group is complete.
+/// </summary>
+class FecEncoder
+{
+private:
+	FecConfig mConfig;
+	size_t mSymbolSize;
+	std::vector<std::vector<uint8_t>> mParity;
+	SeqNo mGroupStart{ 0 };
+	uint8_t mGroupCount{ 0 };
+
+public:
+	FecEncoder(const FecConfig& config, size_t symbolSize);
+
+	// returns true when body completed a group, parity is then available
+	// until the next call
+	bool Add(SeqNo seqNo, const uint8_t* body);
+
+	Header ParityHeader(uint8_t parityIndex) const;
+	const uint8_t* Parity(uint8_t parityIndex) const { return &mParity[parityIndex][0]; }
+	uint8_t ParityFrames() const { return mConfig.mParityFrames; }
+};
+
+/// <summary>
+/// Consumer side. Remembers the bodies of recently received frames in a
+/// fixed ring and holds on to parity frames whose group still has holes;
+/// once a group has as many parity frames as missing data frames the
+/// missing bodies are solved for.
+/// </summary>
+class FecDecoder
+{
+public:
+	using Recovered = std::vector<std::pair<SeqNo, std::vector<uint8_t>>>;
+
+	static constexpr uint16_t cHistory = 256; // divides the sequence space
+
+private:
+	struct ParityGroup
+	{
+		uint8_t mDataFrames{ 0 };
+		std::map<uint8_t, std::vector<uint8_t>> mParity; // by parity index
+	};
+
+	size_t mSymbolSize;
+	std::vector<uint8_t> mHistory; // cHistory bodies, slot is seqNo % cHistory
+	std::vector<SeqNo> mHistorySeqNo;
+	std::vector<bool> mHistoryValid;
+	std::map<SeqNo, ParityGroup> mGroups;  // by first seq no in the group
+
+	const uint8_t* Find(SeqNo seqNo) const;
+	void Remember(SeqNo seqNo, const uint8_t* body);
+	void TryDecode(SeqNo groupStart, SeqNo lastOrdered, Recovered& recovered);
+	void Prune(SeqNo lastOrdered);
+
+public:
+	FecDecoder(size_t symbolSize) : mSymbolSize(symbolSize), mHistory(cHistory * symbolSize),
+		mHistorySeqNo(cHistory), mHistoryValid(cHistory, false)
+	{}
+
+	void AddData(SeqNo seqNo, const uint8_t* body, SeqNo lastOrdered, Recovered& recovered);
+	void AddParity(const Header& header, const uint8_t* body, SeqNo lastOrdered, Recovered& recovered);
+};
@@ -0,0 +1,182 @@
+#include "pch.h"
+#include "QFramePool.h"
+#include <atomic>
+#include <mutex>
+
+namespace
+{
+	constexpr size_t cThreadBuffers = 64;     // cache size per class, half of it moves to or from the depot at a time
+	constexpr size_t cDepotBuffers = 4096;    // per class, beyond this released buffers go back to the heap
+	constexpr size_t cDepotBytes = 8 << 20;   // and fewer of the larger classes
+	constexpr size_t cMaxBufferBytes = 64 << 10;
+	constexpr size_t cClasses = 11;           // capacities of FramePool::cMinBufferBytes to cMaxBufferBytes, doubling
+
+	using Buffers = std::vector<std::vector<uint8_t>>;
+
+	size_t ClassBytes(size_t sizeClass)
+	{
+		return FramePool::cMinBufferBytes << sizeClass;
+	}
+
+	size_t DepotLimit(size_t sizeClass)
+	{
+		return (std::min)(cDepotBuffers, cDepotBytes / ClassBytes(sizeClass));
+	}
+
+	// the smallest class that holds size bytes, cClasses if none does
+	size_t ClassFor(size_t size)
+	{
+		size_t sizeClass = 0;
+		while (sizeClass < cClasses && ClassBytes(sizeClass) < size)
+		{
+			++sizeClass;
+		}
+		return sizeClass;
+	}
+
+	// the largest class a buffer of this capacity can serve, cClasses if none
+	size_t ClassOf(size_t capacity)
+	{
+		if (capacity < FramePool::cMinBufferBytes || capacity > cMaxBufferBytes)
+		{
+			return cClasses;
+		}
+		size_t sizeClass = 0;
+		while (sizeClass + 1 < cClasses && ClassBytes(sizeClass + 1) <= capacity)
+		{
+			++sizeClass;
+		}
+		return sizeClass;
+	}
+
+	struct Depot
+	{
+		std::mutex mMux;
+		Buffers mBuffers[cClasses];
+		std::atomic<size_t> mHeapAllocations{ 0 };
+
+		Depot()
+		{
+			for (size_t sizeClass = 0; sizeClass < cClasses; ++sizeClass)
+			{
+				mBuffers[sizeClass].reserve(DepotLimit(sizeClass));
+			}
+		}
+	};
+
+	Depot& TheDepot()
+	{
+		static Depot depot;
+		return depot;
+	}
+
+	// moves up to count buffers from the back of from to to
+	void MoveBuffers(Buffers& from, Buffers& to, size_t count)
+	{
+		for (; count > 0 && !from.empty(); --count)
+		{
+			to.push_back(std::move(from.back()));
+			from.pop_back();
+		}
+	}
+
+	// set once this thread's cache is gone, buffers released after that are freed
+	thread_local bool tCacheDestroyed = false;
+
+	struct ThreadCache
+	{
+		Depot& mDepot;
+		Buffers mBuffers[cClasses];
+
+		ThreadCache() :mDepot(TheDepot())
+		{
+			for (auto& buffers : mBuffers)
+			{
+				buffers.reserve(cThreadBuffers);
+			}
+		}
+
+		~ThreadCache()
+		{
+			tCacheDestroyed = true;
+			std::lock_guard<std::mutex> lock(mDepot.mMux);
+			for (size_t sizeClass = 0; sizeClass < cClasses; ++sizeClass)
+			{
+				const size_t limit = DepotLimit(sizeClass);
+				MoveBuffers(mBuffers[sizeClass], mDepot.mBuffers[sizeClass], limit - (std::min)(limit, mDepot.mBuffers[sizeClass].size()));
+			}
+		}
+	};
+
+	ThreadCache* Cache()
+	{
+		if (tCacheDestroyed)
+		{
+			return nullptr;
+		}
+		thread_local ThreadCache cache;
+		return &cache;
+	}
+}
+
+std::vector<uint8_t> FramePool::Acquire(size_t size)
+{
+	std::vector<uint8_t> buffer;
+	const size_t sizeClass = ClassFor(size);
+	ThreadCache* cache = sizeClass < cClasses ? Cache() : nullptr;
+	if (cache && cache->mBuffers[sizeClass].empty())
+	{
+		std::lock_guard<std::mutex> lock(cache->mDepot.mMux);
+		MoveBuffers(cache->mDepot.mBuffers[sizeClass], cache->mBuffers[sizeClass], cThreadBuffers / 2);
+	}
+	if (cache && !cache->mBuffers[sizeClass].empty())
+	{
+		buffer = std::move(cache->mBuffers[sizeClass].back());
+		cache->mBuffers[sizeClass].pop_back();
+	}
+	else
+	{
+		buffer.reserve(sizeClass < cClasses ? ClassBytes(sizeClass) : size);
+		++TheDepot().mHeapAllocations;
+	}
+	buffer.resize(size);
+	return buffer;
+}
+
+std::vector<uint8_t> FramePool::Copy(const std::vector<uint8_t>& bytes)
+{
+	std::vector<uint8_t> buffer = Acquire(bytes.size());
+	std::copy(bytes.begin(), bytes.end(), buffer.begin());
+	return buffer;
+}
+
+void FramePool::Release(std::vector<uint8_t>&& buffer)
+{
+	const size_t sizeClass = ClassOf(buffer.capacity());
+	ThreadCache* cache = sizeClass < cClasses ? Cache() : nullptr;
+	if (cache == nullptr)
+	{
+		std::vector<uint8_t>().swap(buffer);
+		return;
+	}
+
+	Buffers& buffers = cache->mBuffers[sizeClass];
+	buffer.clear();
+	buffers.push_back(std::move(buffer));
+	buffer = std::vector<uint8_t>();
+	if (buffers.size() >= cThreadBuffers)
+	{
+		std::lock_guard<std::mutex> lock(cache->mDepot.mMux);
+		Buffers& depot = cache->mDepot.mBuffers[sizeClass];
+		const size_t limit = DepotLimit(sizeClass);
+		const size_t room = limit - (std::min)(limit, depot.size());
+		MoveBuffers(buffers, depot, (std::min)(room, cThreadBuffers / 2));
+		// the depot is full, the rest go back to the heap
+		buffers.resize(cThreadBuffers / 2);
+	}
+}
+
+size_t FramePool::HeapAllocations()
+{
+	return TheDepot().mHeapAllocations;
+}
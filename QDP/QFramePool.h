@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// <summary>
+/// Process wide pool of frame buffers shared by every queue. A buffer is a
+/// std::vector whose capacity is kept when it comes back, so once the pool
+/// has warmed up a frame moves from the producer through the network to the
+/// consumer without touching the heap. Buffers are kept in power of two
+/// size classes, so a small frame holds a small buffer. Each thread keeps a
+/// small cache per class and trades buffers with a shared depot in batches,
+/// so the depot lock is taken once per batch rather than once per frame.
+/// </summary>
+class FramePool
+{
+public:
+	static constexpr size_t cMinBufferBytes = 64;  // the smallest class, smaller buffers are not kept
+
+	// a buffer of size bytes, its capacity size rounded up to a power of two
+	// of at least cMinBufferBytes while that is no more than 64KB
+	static std::vector<uint8_t> Acquire(size_t size);
+	static std::vector<uint8_t> Copy(const std::vector<uint8_t>& bytes);
+
+	// leaves buffer empty
+	static void Release(std::vector<uint8_t>&& buffer);
+
+	// buffers the pool has had to take from the heap since the process started
+	static size_t HeapAllocations();
+};
@@ -1,6 +1,9 @@
 #include "pch.h"
 #include "QNetwork.h"
 #include <ws2tcpip.h>
+#include <mswsock.h>
+#include <mstcpip.h>
+#include <random>
 
 std::string getTimestamp() {
 	const auto now = std::chrono::system_clock::now();
@@ -21,7 +24,199 @@ std::string getTimestamp(const std::chrono::system_clock::time_point& now) {
 	return nowSs.str();
 }
 
-UdpNetwork::UdpNetwork()
+void getTimestamp(char* buffer, size_t size) {
+	const auto now = std::chrono::system_clock::now();
+	const auto nowAsTimeT = std::chrono::system_clock::to_time_t(now);
+	const auto nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+		now.time_since_epoch()) % 1000;
+	tm localTime;
+	localtime_s(&localTime, &nowAsTimeT);
+	sprintf_s(buffer, size, "%02d:%02d:%02d.%03d", localTime.tm_hour, localTime.tm_min, localTime.tm_sec,
+		static_cast<int>(nowMs.count()));
+}
+
+uint32_t NewSessionId()
+{
+	// the clock covers a random_device that is not random on some platforms
+	static std::mutex mux;
+	static std::mt19937 random(std::random_device{}() ^
+		static_cast<uint32_t>(std::chrono::steady_clock::now().time_since_epoch().count()));
+	std::lock_guard<std::mutex> lock(mux);
+	uint32_t session = 0;
+	while (session == 0)
+	{
+		session = random();
+	}
+	return session;
+}
+
+/// <summary>
+/// Tuning failures are logged but not fatal, the socket still works with the
+/// OS defaults. Returns how many failed.
+/// </summary>
+static size_t ApplySocketOptions(int socket, const UdpNetworkOptions& options)
+{
+	size_t failed = 0;
+	auto setOption = [socket, &failed](int level, int option, int value, const char* name)
+	{
+		auto result = setsockopt(socket, level, option, reinterpret_cast<const char*>(&value), sizeof(value));
+		if (result == SOCKET_ERROR)
+		{
+			auto error = WSAGetLastError();
+			Log("UdpNetwork - failed to set %s to %d, error %d", name, value, error);
+			++failed;
+		}
+	};
+
+	if (options.mReceiveBufferBytes > 0)
+	{
+		setOption(SOL_SOCKET, SO_RCVBUF, options.mReceiveBufferBytes, "SO_RCVBUF");
+	}
+	if (options.mSendBufferBytes > 0)
+	{
+		setOption(SOL_SOCKET, SO_SNDBUF, options.mSendBufferBytes, "SO_SNDBUF");
+	}
+	if (options.mReuseAddress)
+	{
+		setOption(SOL_SOCKET, SO_REUSEADDR, 1, "SO_REUSEADDR");
+	}
+	if (options.mDscp >= 0)
+	{
+		// DSCP is the top six bits of the TOS byte
+		setOption(IPPROTO_IP, IP_TOS, (options.mDscp & 0x3f) << 2, "IP_TOS");
+	}
+	return failed;
+}
+
+static void CheckDatagramBytes(const UdpNetworkOptions& options)
+{
+	constexpr int maxUdpPayload = 65507;
+	if (options.mMaxDatagramBytes < static_cast<int>(sizeof(Header)) || options.mMaxDatagramBytes > maxUdpPayload)
+	{
+		Log("UdpNetwork - %d byte datagrams cannot carry a frame", options.mMaxDatagramBytes);
+		exit(1);
+	}
+}
+
+static std::chrono::duration<int, std::milli> Remaining(std::chrono::steady_clock::time_point deadline)
+{
+	const auto remaining = std::chrono::duration_cast<std::chrono::duration<int, std::milli>>(deadline - std::chrono::steady_clock::now());
+	return (std::max)(remaining, std::chrono::duration<int, std::milli>(0));
+}
+
+// tells the prober a datagram of this size got through, with the probe's header and magic
+static void EchoProbe(int socket, const std::vector<uint8_t>& probe, const sockaddr_in& to)
+{
+	std::vector<uint8_t> echo(probe.begin(), probe.begin() + cProbeEchoBytes);
+	Header header;
+	memcpy(&header, echo.data(), sizeof(header));
+	header.mSeqNo = static_cast<SeqNo>(probe.size());
+	memcpy(&echo[0], &header, sizeof(header));
+	sendto(socket, reinterpret_cast<const char*>(&echo[0]), echo.size(), 0, reinterpret_cast<const SOCKADDR*>(&to), sizeof(to));
+}
+
+PathMtuSearch::PathMtuSearch(int maxBytes) :
+	mMaxBytes(maxBytes), mConfirmed((std::min)(maxBytes, cBaseBytes + 0)), mCeiling(maxBytes)
+{}
+
+int PathMtuSearch::Next(std::chrono::steady_clock::time_point now)
+{
+	constexpr std::chrono::milliseconds probeTimeout(200);
+	constexpr std::chrono::minutes researchInterval(10);
+	if (!Searching())
+	{
+		if (now - mSettledAt < researchInterval)
+		{
+			return 0;
+		}
+		// the path may carry more than it did
+		mCeiling = mMaxBytes;
+	}
+	if (mProbing != 0)
+	{
+		if (now - mSentAt < probeTimeout)
+		{
+			return 0;
+		}
+		if (++mMisses < cProbes)
+		{
+			mSentAt = now;
+			return mProbing;
+		}
+		mCeiling = mProbing - 1;
+		mProbing = 0;
+		mMisses = 0;
+		if (!Searching())
+		{
+			mSettledAt = now;
+			return 0;
+		}
+	}
+
+	// the largest size first, it is the likeliest, then halve the gap
+	mProbing = mCeiling == mMaxBytes ? mCeiling : mConfirmed + (mCeiling - mConfirmed + 1) / 2;
+	mSentAt = now;
+	return mProbing;
+}
+
+void PathMtuSearch::OnEcho(int bytes)
+{
+	if (bytes > mConfirmed)
+	{
+		mConfirmed = bytes;
+		mCeiling = (std::max)(mCeiling, bytes);  // a late echo of a size given up on
+	}
+	if (mProbing != 0 && bytes >= mProbing)
+	{
+		mProbing = 0;
+		mMisses = 0;
+	}
+	if (!Searching())
+	{
+		mSettledAt = std::chrono::steady_clock::now();
+	}
+}
+
+// like the socket options, failures are logged and counted but not fatal
+static size_t ConfigureWorkerThread(int cpu, int priority)
+{
+	size_t failed = 0;
+	auto thread = GetCurrentThread();
+	if (cpu >= 0 && (cpu >= 64 || SetThreadAffinityMask(thread, DWORD_PTR(1) << cpu) == 0))
+	{
+		Log("UdpNetwork - failed to pin worker to cpu %d, error %lu", cpu, GetLastError());
+		++failed;
+	}
+	if (priority != THREAD_PRIORITY_NORMAL && !SetThreadPriority(thread, priority))
+	{
+		Log("UdpNetwork - failed to set worker priority %d, error %lu", priority, GetLastError());
+		++failed;
+	}
+	return failed;
+}
+
+// exits if address is not a dotted IPv4 address
+static sockaddr_in ParseAddress(const std::string& address, int port)
+{
+	sockaddr_in parsed{};
+	parsed.sin_family = AF_INET;
+	auto result = inet_pton(AF_INET, address.c_str(), &(parsed.sin_addr));
+	if (result == 0)
+	{
+		Log("UdpNetwork - %s is not an IP address", address.c_str());
+		exit(1);
+	}
+	else if (result == -1)
+	{
+		auto error = WSAGetLastError();
+		Log("UdpNetwork - inet_pton failed with error %d", error);
+		exit(1);
+	}
+	parsed.sin_port = htons(port);
+	return parsed;
+}
+
+UdpNetwork::UdpNetwork(const UdpNetworkOptions& options) :mOptions(options)
 {
 	InitWinSock();
 
@@ -51,21 +246,20 @@ void  UdpNetwork::InitAsProducer(const std::string& consumerAddress, int consume
 		exit(1);
 	}
 
-	mConsumersAddress.sin_family = AF_INET;
-	auto result = inet_pton(AF_INET, consumerAddress.c_str(), &(mConsumersAddress.sin_addr));
-	if (result == 0)
+	mFailedOptions += ApplySocketOptions(mProducerSocket, mOptions);
+	CheckDatagramBytes(mOptions);
+
+	mConsumersAddress = ParseAddress(consumerAddress, consumerPort);
+	mIsProducer = true;
+	if (mOptions.mDiscoverPathMtu)
 	{
-		Log("UdpNetwork - %s is not an IP address", consumerAddress.c_str());
-		exit(1);
+		mPathMtu = std::make_unique<PathMtuSearch>(mOptions.mMaxDatagramBytes);
+		mPathMaxBytes = mPathMtu->Confirmed();
 	}
-	else if (result == -1)
+	else
 	{
-		auto error = WSAGetLastError();
-		Log("UdpNetwork - inet_pton failed with error %d", error);
-		exit(1);
+		mPathMaxBytes = mOptions.mMaxDatagramBytes;
 	}
-	mConsumersAddress.sin_port = htons(consumerPort);
-	mIsProducer = true;
 }
 
 void  UdpNetwork::InitAsConsumer(int consumerPort)
@@ -78,6 +272,9 @@ void  UdpNetwork::InitAsConsumer(int consumerPort)
 		exit(1);
 	}
 
+	mFailedOptions += ApplySocketOptions(consumerSocket, mOptions);
+	CheckDatagramBytes(mOptions);
+
 	sockaddr_in bindAddress;
 	bindAddress.sin_family = AF_INET;
 	bindAddress.sin_addr.s_addr = INADDR_ANY;
@@ -93,13 +290,24 @@ void  UdpNetwork::InitAsConsumer(int consumerPort)
 	mIsConsumer = true;
 }
 
-UdpNetwork::UdpNetwork(const std::string& consumerAddress, int consumerPort)
+void UdpNetwork::ConfigureProducerThread()
+{
+	mFailedOptions += ConfigureWorkerThread(mOptions.mProducerCpu, mOptions.mWorkerPriority);
+}
+
+void UdpNetwork::ConfigureConsumerThread()
+{
+	mFailedOptions += ConfigureWorkerThread(mOptions.mConsumerCpu, mOptions.mWorkerPriority);
+}
+
+UdpNetwork::UdpNetwork(const std::string& consumerAddress, int consumerPort, const UdpNetworkOptions& options) :
+	mOptions(options)
 {
 	InitWinSock();
 	InitAsProducer(consumerAddress, consumerPort);
 }
 
-UdpNetwork::UdpNetwork(int consumerPort)
+UdpNetwork::UdpNetwork(int consumerPort, const UdpNetworkOptions& options) :mOptions(options)
 {
 	InitWinSock();
 	InitAsConsumer(consumerPort);
@@ -122,21 +330,40 @@ void UdpNetwork::ProducerEnQ(const std::vector<uint8_t>& data)
 	sendto(mProducerSocket, reinterpret_cast<const char*>(&data[0]), data.size(), 0, reinterpret_cast<SOCKADDR*>(&mConsumersAddress), sizeof(mConsumersAddress));
 }
 
-bool WaitData(int socket, std::chrono::duration<int, std::milli>& timeOut)
+static bool WaitData(int socket, std::chrono::duration<int, std::milli>& timeOut, const WaitConfig& wait)
 {
 	fd_set readset;
-	int result;
+	int result = 0;
 	struct timeval tv;
+	const auto deadline = std::chrono::steady_clock::now() + timeOut;
+
+	// Winsock has no SO_BUSY_POLL, spinning polls with a zero timeout select
+	auto poll = [&]
+	{
+		FD_ZERO(&readset);
+		FD_SET(socket, &readset);
+		tv.tv_sec = 0;
+		tv.tv_usec = 0;
+		result = select(socket + 1, &readset, NULL, NULL, &tv);
+		return result != 0;
+	};
+	bool ready = wait.mStrategy != WaitStrategy::Block && SpinWait(wait, deadline, poll);
+
+	if (!ready && wait.Parks())
+	{
+		auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+		remaining = (std::max)(remaining, std::chrono::microseconds(0));
 
-	// Initialize the set.
-	FD_ZERO(&readset);
-	FD_SET(socket, &readset);
+		// Initialize the set.
+		FD_ZERO(&readset);
+		FD_SET(socket, &readset);
 
-	// Initialize time out struct.
-	tv.tv_sec = 0;
-	tv.tv_usec = timeOut.count() * 1000;
+		// Initialize time out struct.
+		tv.tv_sec = static_cast<long>(remaining.count() / 1000000);
+		tv.tv_usec = static_cast<long>(remaining.count() % 1000000);
 
-	result = select(socket + 1, &readset, NULL, NULL, &tv);
+		result = select(socket + 1, &readset, NULL, NULL, &tv);
+	}
 
 	// Timeout with no data.
 	if (result == 0) {
@@ -155,28 +382,31 @@ bool WaitData(int socket, std::chrono::duration<int, std::milli>& timeOut)
 	return true;
 }
 
-bool UdpNetwork::ReceiveData(int socket, std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut,
-	sockaddr_in* senderAddress, int* senderAddressSize)
+// received straight into data, which keeps its capacity from one datagram to the next
+static bool ReceiveData(int socket, std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut,
+	const UdpNetworkOptions& options, sockaddr_in* senderAddress, int* senderAddressSize)
 {
 	bool haveData = false;
-	if (WaitData(socket, timeOut))
+	if (WaitData(socket, timeOut, options.mWait))
 	{
-		constexpr int maxUpdBodySize = 512;
-		char buffer[maxUpdBodySize];
-
-		int numBytes = recvfrom(socket, buffer, maxUpdBodySize, 0, reinterpret_cast<SOCKADDR*>(senderAddress), senderAddressSize);
+		data.resize(options.mMaxDatagramBytes);
+		int numBytes = recvfrom(socket, reinterpret_cast<char*>(&data[0]), options.mMaxDatagramBytes, 0,
+			reinterpret_cast<SOCKADDR*>(senderAddress), senderAddressSize);
 		if (numBytes == SOCKET_ERROR)
 		{
 			auto error = WSAGetLastError();
-			Log("UdpNetwork - recvfrom failed, error %d", error);
+			if (error == WSAEMSGSIZE)
+			{
+				Log("UdpNetwork - dropping a datagram over %d bytes", options.mMaxDatagramBytes);
+			}
+			else
+			{
+				Log("UdpNetwork - recvfrom failed, error %d", error);
+			}
 		}
 
 		haveData = numBytes > 0;
-		if (haveData)
-		{
-			data.resize(numBytes);
-			memcpy(&data[0], &buffer[0], numBytes);
-		}
+		data.resize(haveData ? numBytes : 0);
 	}
 
 	return haveData;
@@ -190,9 +420,67 @@ bool UdpNetwork::ProducerDeQ(std::vector<uint8_t>& data, std::chrono::duration<i
 		exit(1);
 	}
 
+	ProbePathIfDue();
+	const auto deadline = std::chrono::steady_clock::now() + timeOut;
+	auto wait = timeOut;
 	sockaddr_in from;
 	int size = sizeof(from);
-	return ReceiveData(mProducerSocket, data, timeOut, &from, &size);
+	while (ReceiveData(mProducerSocket, data, wait, mOptions, &from, &size))
+	{
+		if (!IsProbe(data))
+		{
+			return true;
+		}
+		if (mPathMtu)
+		{
+			Header echo;
+			memcpy(&echo, data.data(), sizeof(echo));
+			mPathMtu->OnEcho(static_cast<int>(echo.mSeqNo));
+			if (mPathMaxBytes != mPathMtu->Confirmed())
+			{
+				mPathMaxBytes = mPathMtu->Confirmed();
+				Log("UdpNetwork - path carries %d byte datagrams", mPathMaxBytes.load());
+			}
+		}
+		wait = Remaining(deadline);
+	}
+	return false;
+}
+
+void UdpNetwork::ProbePathIfDue()
+{
+	if (!mPathMtu)
+	{
+		return;
+	}
+	const int bytes = mPathMtu->Next(std::chrono::steady_clock::now());
+	if (bytes == 0)
+	{
+		return;
+	}
+
+	Header header(static_cast<SeqNo>(bytes));
+	header.mType = FrameType::Probe;
+	std::vector<uint8_t> probe((std::max)(static_cast<size_t>(bytes), cProbeEchoBytes));
+	memcpy(&probe[0], &header, sizeof(header));
+	memcpy(&probe[sizeof(header)], &cProbeMagic, sizeof(cProbeMagic));
+	Log("UdpNetwork - probing the path with %d bytes", bytes);
+
+	// only the probe may not be fragmented, so it is dropped if too big for the
+	// path. Frames still go out whatever their size and the IP layer fragments
+	// those the path cannot carry. Sends are all on the producer thread
+	SetDontFragment(true);
+	sendto(mProducerSocket, reinterpret_cast<const char*>(&probe[0]), probe.size(), 0, reinterpret_cast<SOCKADDR*>(&mConsumersAddress), sizeof(mConsumersAddress));
+	SetDontFragment(false);
+}
+
+void UdpNetwork::SetDontFragment(bool dontFragment)
+{
+	const DWORD value = dontFragment ? 1 : 0;
+	if (setsockopt(mProducerSocket, IPPROTO_IP, IP_DONTFRAGMENT, reinterpret_cast<const char*>(&value), sizeof(value)) == SOCKET_ERROR)
+	{
+		Log("UdpNetwork - failed to set IP_DONTFRAGMENT to %lu, error %d", value, WSAGetLastError());
+	}
 }
 
 void UdpNetwork::ConsumerEnQ(const std::vector<uint8_t>& data)
@@ -218,12 +506,832 @@ bool UdpNetwork::ConsumeDeQ(std::vector<uint8_t>& data, std::chrono::duration<in
 		exit(1);
 	}
 
+	const auto deadline = std::chrono::steady_clock::now() + timeOut;
+	auto wait = timeOut;
 	int producerAddressSize = sizeof(mProducersAddress);
-	auto haveData = ReceiveData(consumerSocket, data, timeOut, &mProducersAddress, &producerAddressSize);
-	if (haveData)
+	while (ReceiveData(consumerSocket, data, wait, mOptions, &mProducersAddress, &producerAddressSize))
 	{
 		mHaveProducerAddr = true;
+		if (!IsProbe(data))
+		{
+			return true;
+		}
+		EchoProbe(consumerSocket, data, mProducersAddress);
+		wait = Remaining(deadline);
+	}
+	return false;
+}
+
+
+UdpFanOutNetwork::UdpFanOutNetwork(const std::vector<std::pair<std::string, int>>& subscribers, const UdpNetworkOptions& options) :
+	mOptions(options)
+{
+	WSAData wsaData;
+	auto result = WSAStartup(MAKEWORD(2, 2), &wsaData);
+	if (result != 0)
+	{
+		Log("UdpFanOutNetwork - failed to init Winsock %d", result);
+		exit(1);
+	}
+
+	mSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (mSocket == INVALID_SOCKET)
+	{
+		auto error = WSAGetLastError();
+		Log("UdpFanOutNetwork - failed to create socket, error %d", error);
+		exit(1);
+	}
+	ApplySocketOptions(mSocket, mOptions);
+
+	for (auto& subscriber : subscribers)
+	{
+		mSubscribers.push_back(ParseAddress(subscriber.first, subscriber.second));
+	}
+}
+
+UdpFanOutNetwork::~UdpFanOutNetwork()
+{
+	closesocket(mSocket);
+	WSACleanup();
+}
+
+void UdpFanOutNetwork::ConfigureProducerThread()
+{
+	ConfigureWorkerThread(mOptions.mProducerCpu, mOptions.mWorkerPriority);
+}
+
+void UdpFanOutNetwork::ProducerEnQ(const std::vector<uint8_t>& data)
+{
+	for (size_t subscriber = 0; subscriber < mSubscribers.size(); ++subscriber)
+	{
+		ProducerEnQ(subscriber, data);
+	}
+}
+
+void UdpFanOutNetwork::ProducerEnQ(size_t subscriber, const std::vector<uint8_t>& data)
+{
+	auto& address = mSubscribers[subscriber];
+	sendto(mSocket, reinterpret_cast<const char*>(&data[0]), data.size(), 0, reinterpret_cast<const SOCKADDR*>(&address), sizeof(address));
+}
+
+bool UdpFanOutNetwork::ProducerDeQ(size_t& subscriber, std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut)
+{
+	sockaddr_in from;
+	int size = sizeof(from);
+	if (!ReceiveData(mSocket, data, timeOut, mOptions, &from, &size))
+	{
+		return false;
+	}
+
+	for (subscriber = 0; subscriber < mSubscribers.size(); ++subscriber)
+	{
+		if (mSubscribers[subscriber].sin_addr.s_addr == from.sin_addr.s_addr && mSubscribers[subscriber].sin_port == from.sin_port)
+		{
+			return true;
+		}
+	}
+	Log("UdpFanOutNetwork - dropping datagram from unknown subscriber port %d", ntohs(from.sin_port));
+	return false;
+}
+
+// the IPv4 address shifted above the port
+static uint64_t FlowKey(const sockaddr_in& address)
+{
+	return (static_cast<uint64_t>(ntohl(address.sin_addr.s_addr)) << 16) | ntohs(address.sin_port);
+}
+
+static sockaddr_in FlowAddress(uint64_t flow)
+{
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(static_cast<uint32_t>(flow >> 16));
+	address.sin_port = htons(static_cast<uint16_t>(flow));
+	return address;
+}
+
+UdpShardSocket::UdpShardSocket(int port, const UdpNetworkOptions& options) :mOptions(options)
+{
+	WSAData wsaData;
+	auto result = WSAStartup(MAKEWORD(2, 2), &wsaData);
+	if (result != 0)
+	{
+		Log("UdpShardSocket - failed to init Winsock %d", result);
+		exit(1);
+	}
+
+	mSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (mSocket == INVALID_SOCKET)
+	{
+		auto error = WSAGetLastError();
+		Log("UdpShardSocket - failed to create socket, error %d", error);
+		exit(1);
+	}
+	ApplySocketOptions(mSocket, mOptions);
+
+	sockaddr_in bindAddress{};
+	bindAddress.sin_family = AF_INET;
+	bindAddress.sin_addr.s_addr = INADDR_ANY;
+	bindAddress.sin_port = htons(port);
+	result = bind(mSocket, reinterpret_cast<SOCKADDR*>(&bindAddress), sizeof(bindAddress));
+	if (result == SOCKET_ERROR)
+	{
+		auto error = WSAGetLastError();
+		Log("UdpShardSocket - failed to bind port %d, error %d", port, error);
+		exit(1);
+	}
+}
+
+UdpShardSocket::~UdpShardSocket()
+{
+	closesocket(mSocket);
+	WSACleanup();
+}
+
+void UdpShardSocket::ConfigureThread(int cpu)
+{
+	ConfigureWorkerThread(cpu, mOptions.mWorkerPriority);
+}
+
+bool UdpShardSocket::Receive(std::vector<uint8_t>& data, uint64_t& flow, std::chrono::duration<int, std::milli>& timeOut)
+{
+	const auto deadline = std::chrono::steady_clock::now() + timeOut;
+	auto wait = timeOut;
+	sockaddr_in from;
+	int size = sizeof(from);
+	while (ReceiveData(mSocket, data, wait, mOptions, &from, &size))
+	{
+		if (!IsProbe(data))
+		{
+			flow = FlowKey(from);
+			return true;
+		}
+		EchoProbe(mSocket, data, from);
+		wait = Remaining(deadline);
+	}
+	return false;
+}
+
+void UdpShardSocket::Send(uint64_t flow, const std::vector<uint8_t>& data)
+{
+	const auto address = FlowAddress(flow);
+	sendto(mSocket, reinterpret_cast<const char*>(&data[0]), data.size(), 0, reinterpret_cast<const SOCKADDR*>(&address), sizeof(address));
+}
+
+UdpMulticastNetwork::UdpMulticastNetwork(const MulticastGroup& group, Role role, const UdpNetworkOptions& options) :
+	mOptions(options)
+{
+	WSAData wsaData;
+	auto result = WSAStartup(MAKEWORD(2, 2), &wsaData);
+	if (result != 0)
+	{
+		Log("UdpMulticastNetwork - failed to init Winsock %d", result);
+		exit(1);
+	}
+
+	mGroupAddress = ParseAddress(group.mAddress, group.mPort);
+	if (role != Role::Consumer)
+	{
+		InitAsProducer(group);
+	}
+	if (role != Role::Producer)
+	{
+		InitAsConsumer(group);
+	}
+}
+
+void UdpMulticastNetwork::InitAsProducer(const MulticastGroup& group)
+{
+	mProducerSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (mProducerSocket == INVALID_SOCKET)
+	{
+		auto error = WSAGetLastError();
+		Log("UdpMulticastNetwork - failed to create producer socket, error %d", error);
+		exit(1);
+	}
+	ApplySocketOptions(mProducerSocket, mOptions);
+
+	auto sendInterface = ParseAddress(group.mInterface, 0).sin_addr;
+	auto result = setsockopt(mProducerSocket, IPPROTO_IP, IP_MULTICAST_IF, reinterpret_cast<const char*>(&sendInterface), sizeof(sendInterface));
+	if (result == SOCKET_ERROR)
+	{
+		auto error = WSAGetLastError();
+		Log("UdpMulticastNetwork - failed to send on interface %s, error %d", group.mInterface.c_str(), error);
+		exit(1);
+	}
+
+	result = setsockopt(mProducerSocket, IPPROTO_IP, IP_MULTICAST_TTL, reinterpret_cast<const char*>(&group.mTtl), sizeof(group.mTtl));
+	if (result == SOCKET_ERROR)
+	{
+		auto error = WSAGetLastError();
+		Log("UdpMulticastNetwork - failed to set ttl %d, error %d", group.mTtl, error);
 	}
-	return haveData;
 }
 
+void UdpMulticastNetwork::InitAsConsumer(const MulticastGroup& group)
+{
+	mConsumerSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (mConsumerSocket == INVALID_SOCKET)
+	{
+		auto error = WSAGetLastError();
+		Log("UdpMulticastNetwork - failed to create consumer socket, error %d", error);
+		exit(1);
+	}
+
+	// every consumer of the group on this host binds the same port
+	UdpNetworkOptions consumerOptions = mOptions;
+	consumerOptions.mReuseAddress = true;
+	ApplySocketOptions(mConsumerSocket, consumerOptions);
+
+	sockaddr_in bindAddress{};
+	bindAddress.sin_family = AF_INET;
+	bindAddress.sin_addr.s_addr = INADDR_ANY;
+	bindAddress.sin_port = htons(group.mPort);
+	auto result = bind(mConsumerSocket, reinterpret_cast<SOCKADDR*>(&bindAddress), sizeof(bindAddress));
+	if (result == SOCKET_ERROR)
+	{
+		auto error = WSAGetLastError();
+		Log("UdpMulticastNetwork - failed to bind consumer socket, error %d", error);
+		exit(1);
+	}
+
+	ip_mreq membership{};
+	membership.imr_multiaddr = mGroupAddress.sin_addr;
+	membership.imr_interface = ParseAddress(group.mInterface, 0).sin_addr;
+	result = setsockopt(mConsumerSocket, IPPROTO_IP, IP_ADD_MEMBERSHIP, reinterpret_cast<const char*>(&membership), sizeof(membership));
+	if (result == SOCKET_ERROR)
+	{
+		auto error = WSAGetLastError();
+		Log("UdpMulticastNetwork - failed to join %s, error %d", group.mAddress.c_str(), error);
+		exit(1);
+	}
+}
+
+UdpMulticastNetwork::~UdpMulticastNetwork()
+{
+	closesocket(mProducerSocket);
+	closesocket(mConsumerSocket);
+	WSACleanup();
+}
+
+void UdpMulticastNetwork::ConfigureProducerThread()
+{
+	ConfigureWorkerThread(mOptions.mProducerCpu, mOptions.mWorkerPriority);
+}
+
+void UdpMulticastNetwork::ConfigureConsumerThread()
+{
+	ConfigureWorkerThread(mOptions.mConsumerCpu, mOptions.mWorkerPriority);
+}
+
+void UdpMulticastNetwork::ProducerEnQ(const std::vector<uint8_t>& data)
+{
+	if (mProducerSocket == INVALID_SOCKET)
+	{
+		Log("UdpMulticastNetwork - Must be created as a producer");
+		exit(1);
+	}
+	sendto(mProducerSocket, reinterpret_cast<const char*>(&data[0]), data.size(), 0, reinterpret_cast<SOCKADDR*>(&mGroupAddress), sizeof(mGroupAddress));
+}
+
+bool UdpMulticastNetwork::ProducerDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut)
+{
+	if (mProducerSocket == INVALID_SOCKET)
+	{
+		Log("UdpMulticastNetwork - Must be created as a producer");
+		exit(1);
+	}
+
+	sockaddr_in from;
+	int size = sizeof(from);
+	return ReceiveData(mProducerSocket, data, timeOut, mOptions, &from, &size);
+}
+
+void UdpMulticastNetwork::ConsumerEnQ(const std::vector<uint8_t>& data)
+{
+	if (mConsumerSocket == INVALID_SOCKET)
+	{
+		Log("UdpMulticastNetwork - Must be created as a consumer");
+		exit(1);
+	}
+
+	if (mHaveProducerAddr)
+	{
+		sendto(mConsumerSocket, reinterpret_cast<const char*>(&data[0]), data.size(), 0, reinterpret_cast<SOCKADDR*>(&mProducersAddress), sizeof(mProducersAddress));
+	}
+}
+
+bool UdpMulticastNetwork::ConsumeDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut)
+{
+	if (mConsumerSocket == INVALID_SOCKET)
+	{
+		Log("UdpMulticastNetwork - Must be created as a consumer");
+		exit(1);
+	}
+
+	int producerAddressSize = sizeof(mProducersAddress);
+	auto haveData = ReceiveData(mConsumerSocket, data, timeOut, mOptions, &mProducersAddress, &producerAddressSize);
+	if (haveData)
+	{
+		mHaveProducerAddr = true;
+	}
+	return haveData;
+}
+
+
+/// <summary>
+/// One socket's share of Registered I/O: its request queue and a single
+/// registered buffer carved into receive slots, send slots, the address of
+/// each receive and the peer address sends go to.
+/// </summary>
+class RioUdpNetwork::Channel
+{
+private:
+	struct Received
+	{
+		uint32_t mSlot;
+		uint32_t mBytes;
+	};
+
+	static constexpr ULONGLONG cSendContext = 1ull << 32;
+	static constexpr uint32_t cCommitEvery = 32;
+
+	std::shared_ptr<RioEngine> mEngine;
+	const RioOptions mOptions;
+	const char* mName;
+	SOCKET mSocket{ INVALID_SOCKET };
+	RIO_RQ mRequests{ RIO_INVALID_RQ };
+	uint8_t* mBuffer{ nullptr };
+	size_t mBufferBytes{ 0 };
+	RIO_BUFFERID mBufferId{ RIO_INVALID_BUFFERID };
+
+	BlockingQ<Received> mReceived;
+	std::mutex mMux;  // request queue calls are not thread safe, the dispatcher and the owner both make them
+	std::vector<uint32_t> mFreeSends;
+	uint32_t mDeferredSends{ 0 };
+	bool mHavePeer{ false };
+	std::atomic<int> mOutstanding{ 0 };
+	std::atomic<bool> mClosing{ false };
+	std::atomic<size_t> mDroppedFrames{ 0 };
+
+	size_t ReceiveOffset(uint32_t slot) const { return static_cast<size_t>(slot) * mOptions.mSlotBytes; }
+	size_t SendOffset(uint32_t slot) const { return ReceiveOffset(mOptions.mReceiveSlots) + static_cast<size_t>(slot) * mOptions.mSlotBytes; }
+	size_t AddressOffset(uint32_t slot) const { return SendOffset(mOptions.mSendSlots) + slot * sizeof(SOCKADDR_INET); }
+	size_t PeerOffset() const { return AddressOffset(mOptions.mReceiveSlots); }
+
+	void PostReceive(uint32_t slot);
+	void CommitSends();
+
+public:
+	// bindPort 0 takes any port, peer null waits for the first datagram to say where to send
+	Channel(const RioOptions& options, const char* name, int bindPort, const sockaddr_in* peer);
+	~Channel();
+
+	void Send(const std::vector<uint8_t>& data);
+	bool Receive(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut);
+	void OnCompletion(const RIORESULT& result);
+	size_t DroppedFrames() { return mDroppedFrames; }
+};
+
+/// <summary>
+/// The completion queue every RIO channel in the process shares, drained by
+/// one dispatch thread. A receive is handed to its channel to be read and
+/// reposted there, a send completion frees its slot. RIO does not allow a
+/// queue to be resized while another thread uses it, so the dispatch thread
+/// also grows it, between dequeues, when a channel asks for more room.
+/// </summary>
+class RioEngine
+{
+private:
+	RIO_EXTENSION_FUNCTION_TABLE mRio{};
+	WaitConfig mWait;
+	HANDLE mEvent{ NULL };
+	RIO_CQ mQueue{ RIO_INVALID_CQ };
+	std::mutex mMux;
+	std::condition_variable mGrown;
+	ULONG mCapacity{ 0 };
+	ULONG mReserved{ 0 };
+	std::atomic<bool> mGrow{ false };
+	std::atomic<bool> mStop{ false };
+	std::thread mDispatcher;
+
+	void Dispatch()
+	{
+		constexpr ULONG maxResults = 256;
+		RIORESULT results[maxResults];
+		while (!mStop)
+		{
+			if (mGrow)
+			{
+				Grow();
+			}
+			ULONG count = 0;
+			auto dequeue = [&] { count = mRio.RIODequeueCompletion(mQueue, results, maxResults); return count != 0 || mGrow; };
+			const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+			if (!SpinWait(mWait, deadline, dequeue) || count == 0)
+			{
+				if (mWait.Parks() && !mGrow)
+				{
+					// signals at once if completions slipped in since the last look
+					mRio.RIONotify(mQueue);
+					WaitForSingleObject(mEvent, 100);
+				}
+				continue;
+			}
+			if (count == RIO_CORRUPT_CQ)
+			{
+				Log("RioEngine - completion queue corrupt");
+				exit(1);
+			}
+			for (ULONG i = 0; i < count; ++i)
+			{
+				reinterpret_cast<RioUdpNetwork::Channel*>(results[i].SocketContext)->OnCompletion(results[i]);
+			}
+		}
+	}
+
+	// on the dispatch thread, so nothing else is using the queue
+	void Grow()
+	{
+		std::lock_guard<std::mutex> lock(mMux);
+		const ULONG capacity = (std::max)(mReserved, mCapacity * 2);
+		if (!mRio.RIOResizeCompletionQueue(mQueue, capacity))
+		{
+			Log("RioEngine - failed to grow completion queue to %lu, error %d", capacity, WSAGetLastError());
+			exit(1);
+		}
+		mCapacity = capacity;
+		mGrow = false;
+		mGrown.notify_all();
+	}
+
+public:
+	RioEngine(const WaitConfig& wait) :mWait(wait)
+	{
+		// the function table is looked up through any socket opened for RIO
+		SOCKET probe = WSASocket(AF_INET, SOCK_DGRAM, IPPROTO_UDP, NULL, 0, WSA_FLAG_REGISTERED_IO);
+		GUID functionTableId = WSAID_MULTIPLE_RIO;
+		DWORD bytes = 0;
+		if (probe == INVALID_SOCKET || WSAIoctl(probe, SIO_GET_MULTIPLE_EXTENSION_FUNCTION_POINTER, &functionTableId,
+			sizeof(functionTableId), &mRio, sizeof(mRio), &bytes, NULL, NULL) == SOCKET_ERROR)
+		{
+			Log("RioEngine - Registered I/O is not available, error %d", WSAGetLastError());
+			exit(1);
+		}
+		closesocket(probe);
+
+		mEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+		RIO_NOTIFICATION_COMPLETION completion{};
+		completion.Type = RIO_EVENT_COMPLETION;
+		completion.Event.EventHandle = mEvent;
+		completion.Event.NotifyReset = TRUE;
+		mCapacity = 1024;
+		mQueue = mRio.RIOCreateCompletionQueue(mCapacity, &completion);
+		if (mQueue == RIO_INVALID_CQ)
+		{
+			Log("RioEngine - failed to create completion queue, error %d", WSAGetLastError());
+			exit(1);
+		}
+		mDispatcher = std::thread([this]() { Dispatch(); });
+	}
+
+	~RioEngine()
+	{
+		mStop = true;
+		SetEvent(mEvent);
+		mDispatcher.join();
+		mRio.RIOCloseCompletionQueue(mQueue);
+		CloseHandle(mEvent);
+	}
+
+	static std::shared_ptr<RioEngine> Get(const WaitConfig& wait)
+	{
+		static std::mutex mux;
+		static std::weak_ptr<RioEngine> shared;
+		std::lock_guard<std::mutex> lock(mux);
+		auto engine = shared.lock();
+		if (!engine)
+		{
+			engine = std::make_shared<RioEngine>(wait);
+			shared = engine;
+		}
+		return engine;
+	}
+
+	const RIO_EXTENSION_FUNCTION_TABLE& Rio() const { return mRio; }
+	RIO_CQ Queue() const { return mQueue; }
+
+	// the queue must have room for every request that can be outstanding,
+	// returns once the dispatch thread has grown it to fit
+	void Reserve(ULONG requests)
+	{
+		std::unique_lock<std::mutex> lock(mMux);
+		mReserved += requests;
+		if (mReserved <= mCapacity)
+		{
+			return;
+		}
+		mGrow = true;
+		SetEvent(mEvent);
+		mGrown.wait(lock, [this]() { return mReserved <= mCapacity; });
+	}
+
+	void Release(ULONG requests)
+	{
+		std::lock_guard<std::mutex> lock(mMux);
+		mReserved -= requests;
+	}
+};
+
+RioUdpNetwork::Channel::Channel(const RioOptions& options, const char* name, int bindPort, const sockaddr_in* peer) :
+	mEngine(RioEngine::Get(options.mDispatchWait)), mOptions(options), mName(name), mReceived(options.mSocket.mWait)
+{
+	auto& rio = mEngine->Rio();
+	mSocket = WSASocket(AF_INET, SOCK_DGRAM, IPPROTO_UDP, NULL, 0, WSA_FLAG_REGISTERED_IO);
+	if (mSocket == INVALID_SOCKET)
+	{
+		Log("RioUdpNetwork - failed to create %s socket, error %d", mName, WSAGetLastError());
+		exit(1);
+	}
+	ApplySocketOptions(static_cast<int>(mSocket), mOptions.mSocket);
+
+	// an ICMP port unreachable would otherwise fail the next posted receive
+	BOOL reportReset = FALSE;
+	DWORD bytes = 0;
+	WSAIoctl(mSocket, SIO_UDP_CONNRESET, &reportReset, sizeof(reportReset), NULL, 0, &bytes, NULL, NULL);
+
+	sockaddr_in bindAddress{};
+	bindAddress.sin_family = AF_INET;
+	bindAddress.sin_addr.s_addr = INADDR_ANY;
+	bindAddress.sin_port = htons(bindPort);
+	if (bind(mSocket, reinterpret_cast<SOCKADDR*>(&bindAddress), sizeof(bindAddress)) == SOCKET_ERROR)
+	{
+		Log("RioUdpNetwork - failed to bind %s socket, error %d", mName, WSAGetLastError());
+		exit(1);
+	}
+
+	mBufferBytes = PeerOffset() + sizeof(SOCKADDR_INET);
+	mBuffer = static_cast<uint8_t*>(VirtualAlloc(NULL, mBufferBytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+	mBufferId = mBuffer ? rio.RIORegisterBuffer(reinterpret_cast<PCHAR>(mBuffer), static_cast<DWORD>(mBufferBytes)) : RIO_INVALID_BUFFERID;
+	if (mBufferId == RIO_INVALID_BUFFERID)
+	{
+		Log("RioUdpNetwork - failed to register %zu byte buffer, error %d", mBufferBytes, WSAGetLastError());
+		exit(1);
+	}
+	if (peer)
+	{
+		memcpy(mBuffer + PeerOffset(), peer, sizeof(*peer));
+		mHavePeer = true;
+	}
+
+	mEngine->Reserve(mOptions.mReceiveSlots + mOptions.mSendSlots);
+	mRequests = rio.RIOCreateRequestQueue(mSocket, mOptions.mReceiveSlots, 1, mOptions.mSendSlots, 1,
+		mEngine->Queue(), mEngine->Queue(), this);
+	if (mRequests == RIO_INVALID_RQ)
+	{
+		Log("RioUdpNetwork - failed to create %s request queue, error %d", mName, WSAGetLastError());
+		exit(1);
+	}
+
+	mFreeSends.reserve(mOptions.mSendSlots);
+	for (uint32_t slot = mOptions.mSendSlots; slot > 0; --slot)
+	{
+		mFreeSends.push_back(slot - 1);
+	}
+	std::lock_guard<std::mutex> lock(mMux);
+	for (uint32_t slot = 0; slot < mOptions.mReceiveSlots; ++slot)
+	{
+		PostReceive(slot);
+	}
+}
+
+RioUdpNetwork::Channel::~Channel()
+{
+	// closing the socket fails whatever is still posted, wait for every one
+	// of those completions, however long, as each points at this channel
+	mClosing = true;
+	closesocket(mSocket);
+	const auto slow = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+	bool logged = false;
+	while (mOutstanding > 0)
+	{
+		if (std::chrono::steady_clock::now() < slow)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+		if (!logged)
+		{
+			Log("RioUdpNetwork - %s still waiting on %d requests after closing", mName, mOutstanding.load());
+			logged = true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	mEngine->Release(mOptions.mReceiveSlots + mOptions.mSendSlots);
+	mEngine->Rio().RIODeregisterBuffer(mBufferId);
+	VirtualFree(mBuffer, 0, MEM_RELEASE);
+}
+
+// called with mMux held
+void RioUdpNetwork::Channel::PostReceive(uint32_t slot)
+{
+	RIO_BUF data{ mBufferId, static_cast<ULONG>(ReceiveOffset(slot)), mOptions.mSlotBytes };
+	RIO_BUF address{ mBufferId, static_cast<ULONG>(AddressOffset(slot)), sizeof(SOCKADDR_INET) };
+	++mOutstanding;
+	if (!mEngine->Rio().RIOReceiveEx(mRequests, &data, 1, NULL, &address, NULL, NULL, 0, reinterpret_cast<PVOID>(static_cast<ULONGLONG>(slot))))
+	{
+		--mOutstanding;
+		Log("RioUdpNetwork - %s failed to post receive, error %d", mName, WSAGetLastError());
+	}
+}
+
+// called with mMux held
+void RioUdpNetwork::Channel::CommitSends()
+{
+	if (mDeferredSends)
+	{
+		mEngine->Rio().RIOSendEx(mRequests, NULL, 0, NULL, NULL, NULL, NULL, RIO_MSG_COMMIT_ONLY, NULL);
+		mDeferredSends = 0;
+	}
+}
+
+void RioUdpNetwork::Channel::Send(const std::vector<uint8_t>& data)
+{
+	std::lock_guard<std::mutex> lock(mMux);
+	if (!mHavePeer)
+	{
+		return; // the consumer has nowhere to send until the producer is heard from
+	}
+	if (data.size() > mOptions.mSlotBytes || mFreeSends.empty())
+	{
+		// like a full socket buffer, the repair logic covers it
+		++mDroppedFrames;
+		Log("RioUdpNetwork - %s dropping %zu byte frame, %zu send slots free", mName, data.size(), mFreeSends.size());
+		CommitSends();
+		return;
+	}
+
+	const uint32_t slot = mFreeSends.back();
+	mFreeSends.pop_back();
+	memcpy(mBuffer + SendOffset(slot), data.data(), data.size());
+	RIO_BUF buffer{ mBufferId, static_cast<ULONG>(SendOffset(slot)), static_cast<ULONG>(data.size()) };
+	RIO_BUF address{ mBufferId, static_cast<ULONG>(PeerOffset()), sizeof(SOCKADDR_INET) };
+
+	// a send without the defer flag also commits everything deferred before it
+	DWORD flags = RIO_MSG_DEFER;
+	if (++mDeferredSends >= cCommitEvery)
+	{
+		flags = 0;
+		mDeferredSends = 0;
+	}
+	++mOutstanding;
+	if (!mEngine->Rio().RIOSendEx(mRequests, &buffer, 1, NULL, &address, NULL, NULL, flags, reinterpret_cast<PVOID>(cSendContext | slot)))
+	{
+		--mOutstanding;
+		mFreeSends.push_back(slot);
+		Log("RioUdpNetwork - %s send failed, error %d", mName, WSAGetLastError());
+	}
+}
+
+bool RioUdpNetwork::Channel::Receive(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut)
+{
+	{
+		// this thread is about to wait, so what it sent so far goes now
+		std::lock_guard<std::mutex> lock(mMux);
+		CommitSends();
+	}
+
+	Received received;
+	if (!mReceived.DeQ(received, timeOut))
+	{
+		return false;
+	}
+	const uint8_t* bytes = mBuffer + ReceiveOffset(received.mSlot);
+	data.assign(bytes, bytes + received.mBytes);
+
+	std::lock_guard<std::mutex> lock(mMux);
+	const uint8_t* from = mBuffer + AddressOffset(received.mSlot);
+	if (!mHavePeer || memcmp(mBuffer + PeerOffset(), from, sizeof(SOCKADDR_INET)) != 0)
+	{
+		memcpy(mBuffer + PeerOffset(), from, sizeof(SOCKADDR_INET));
+		mHavePeer = true;
+	}
+	PostReceive(received.mSlot);
+	return true;
+}
+
+// on the dispatch thread
+void RioUdpNetwork::Channel::OnCompletion(const RIORESULT& result)
+{
+	const uint32_t slot = static_cast<uint32_t>(result.RequestContext);
+	if (result.RequestContext & cSendContext)
+	{
+		std::lock_guard<std::mutex> lock(mMux);
+		mFreeSends.push_back(slot);
+	}
+	else if (result.Status == 0 && !mClosing)
+	{
+		mReceived.EnQ(Received{ slot, result.BytesTransferred });
+	}
+	else if (!mClosing)
+	{
+		std::lock_guard<std::mutex> lock(mMux);
+		PostReceive(slot);
+	}
+	--mOutstanding;
+}
+
+void RioUdpNetwork::InitWinSock()
+{
+	WSAData data;
+	auto result = WSAStartup(MAKEWORD(2, 2), &data);
+	if (result != 0)
+	{
+		Log("RioUdpNetwork - failed to init Winsock %d", result);
+		exit(1);
+	}
+}
+
+RioUdpNetwork::RioUdpNetwork(const RioOptions& options) :mOptions(options)
+{
+	InitWinSock();
+	constexpr int consumerPort = 31415;
+	const sockaddr_in consumer = ParseAddress("127.0.0.1", consumerPort);
+	mProducer = std::make_unique<Channel>(mOptions, "producer", 0, &consumer);
+	mConsumer = std::make_unique<Channel>(mOptions, "consumer", consumerPort, nullptr);
+}
+
+RioUdpNetwork::RioUdpNetwork(const std::string& consumerAddress, int consumerPort, const RioOptions& options) :
+	mOptions(options)
+{
+	InitWinSock();
+	const sockaddr_in consumer = ParseAddress(consumerAddress, consumerPort);
+	mProducer = std::make_unique<Channel>(mOptions, "producer", 0, &consumer);
+}
+
+RioUdpNetwork::RioUdpNetwork(int consumerPort, const RioOptions& options) :mOptions(options)
+{
+	InitWinSock();
+	mConsumer = std::make_unique<Channel>(mOptions, "consumer", consumerPort, nullptr);
+}
+
+RioUdpNetwork::~RioUdpNetwork()
+{
+	mProducer.reset();
+	mConsumer.reset();
+	WSACleanup();
+}
+
+void RioUdpNetwork::ConfigureProducerThread()
+{
+	ConfigureWorkerThread(mOptions.mSocket.mProducerCpu, mOptions.mSocket.mWorkerPriority);
+}
+
+void RioUdpNetwork::ConfigureConsumerThread()
+{
+	ConfigureWorkerThread(mOptions.mSocket.mConsumerCpu, mOptions.mSocket.mWorkerPriority);
+}
+
+void RioUdpNetwork::ProducerEnQ(const std::vector<uint8_t>& data)
+{
+	if (!mProducer)
+	{
+		Log("RioUdpNetwork - Must be created as a producer");
+		exit(1);
+	}
+	mProducer->Send(data);
+}
+
+bool RioUdpNetwork::ProducerDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut)
+{
+	if (!mProducer)
+	{
+		Log("RioUdpNetwork - Must be created as a producer");
+		exit(1);
+	}
+	return mProducer->Receive(data, timeOut);
+}
+
+void RioUdpNetwork::ConsumerEnQ(const std::vector<uint8_t>& data)
+{
+	if (!mConsumer)
+	{
+		Log("RioUdpNetwork - Must be created as a consumer");
+		exit(1);
+	}
+	mConsumer->Send(data);
+}
+
+bool RioUdpNetwork::ConsumeDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut)
+{
+	if (!mConsumer)
+	{
+		Log("RioUdpNetwork - Must be created as a consumer");
+		exit(1);
+	}
+	return mConsumer->Receive(data, timeOut);
+}
+
+size_t RioUdpNetwork::DroppedFrames()
+{
+	return (mProducer ? mProducer->DroppedFrames() : 0) + (mConsumer ? mConsumer->DroppedFrames() : 0);
+}
@@ -1,26 +1,35 @@
 #pragma once
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
-#include <list>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <vector>
 
 #include <WinSock2.h>
 #include <Windows.h>
 #include "debugapi.h"
+#include "QFramePool.h"
+#include "QRingBuffer.h"
+#include "QWait.h"
 
 std::string getTimestamp(const std::chrono::system_clock::time_point& now);
 std::string getTimestamp();
+// the same into a buffer of at least 13 chars, Log formats this way so it never allocates
+void getTimestamp(char* buffer, size_t size);
 
 template <typename... Args>
 void Log(const char* format, Args... args) {
-	std::string formatAsString = "QUDP[%s] ";
-	formatAsString += format;
-	formatAsString += "\n";
 	char buffer[2000]; // problem when printing consumer pending buffer if we increase window size
-	sprintf_s(buffer, sizeof(buffer), formatAsString.c_str(), getTimestamp().c_str(), args...);
+	char timestamp[16];
+	getTimestamp(timestamp, sizeof(timestamp));
+	int length = sprintf_s(buffer, sizeof(buffer) - 1, "QUDP[%s] ", timestamp);
+	length += sprintf_s(buffer + length, sizeof(buffer) - 1 - length, format, args...);
+	buffer[length] = '\n';
+	buffer[length + 1] = '\0';
 	OutputDebugStringA(buffer);
 }
 
@@ -28,11 +37,15 @@ void Log(const char* format, Args... args) {
 template <class T> class BlockingQ
 {
 private:
-	std::list<T> q;
+	RingBuffer<T> q;
 	std::string mQName;
+	WaitConfig mWait;
 
 	std::mutex mMux;
 	std::condition_variable mConsumerSignal;
+	std::atomic<size_t> mSize{ 0 }; // lets spinning consumers poll without the lock
+	std::vector<std::function<void()>> mWhenData; // asynchronous readers waiting on an empty queue
+	bool mAsyncClosed{ false };
 
 	template <typename... Args>
 	void Log(const char* format, Args... args)
@@ -43,57 +56,202 @@ private:
 		}
 	}
 
+	// returns with the lock held and q not empty, or false once the deadline passes
+	bool WaitForData(std::unique_lock<std::mutex>& lock, std::chrono::steady_clock::time_point deadline)
+	{
+		for (;;)
+		{
+			SpinWait(mWait, deadline, [&] { return mSize.load(std::memory_order_acquire) > 0; });
+			lock.lock();
+			if (q.size() > 0)
+			{
+				return true;
+			}
+
+			const auto now = std::chrono::steady_clock::now();
+			if (mWait.Parks() && now < deadline)
+			{
+				Log("%s Consumer waiting for Data", mQName.c_str());
+				if (deadline == std::chrono::steady_clock::time_point::max())
+				{
+					mConsumerSignal.wait(lock, [&] {return q.size() > 0; });
+					return true;
+				}
+				if (mConsumerSignal.wait_until(lock, deadline, [&] {return q.size() > 0; }))
+				{
+					Log("%s Consumer woke with Data", mQName.c_str());
+					return true;
+				}
+			}
+			if (std::chrono::steady_clock::now() >= deadline)
+			{
+				Log("%s Consumer timed out", mQName.c_str());
+				return false;
+			}
+			lock.unlock(); // another consumer took it, keep spinning
+		}
+	}
+
+	// called with the lock held by whichever EnQ ends the queue being empty
+	void WakeAsyncReaders(std::unique_lock<std::mutex>& lock)
+	{
+		if (mWhenData.empty())
+		{
+			return;
+		}
+		std::vector<std::function<void()>> waiting;
+		waiting.swap(mWhenData);
+		lock.unlock();
+		for (auto& ready : waiting)
+		{
+			ready();
+		}
+	}
+
 public:
-	BlockingQ(const std::string& name) :mQName(name) {}
+	BlockingQ(const std::string& name, const WaitConfig& wait = WaitConfig()) :mQName(name), mWait(wait) {}
 	BlockingQ() {} // unnamed, no logging
+	explicit BlockingQ(const WaitConfig& wait) :mWait(wait) {}
 
 	void EnQ(T data)
 	{
 		std::unique_lock<std::mutex> lock(mMux);
-		q.emplace_back(data);
+		q.emplace_back(std::move(data));
+		mSize.store(q.size(), std::memory_order_release);
 		if (q.size() == 1)
 		{
 			Log("%s Waking consumer", mQName.c_str());
 			mConsumerSignal.notify_one();
+			WakeAsyncReaders(lock);
 		}
 	}
 
-	bool DeQ(T& data, std::chrono::duration<int, std::milli>& timeOut)
+	// one lock and at most one wake up for the whole batch
+	void EnQ(const T* data, size_t count)
 	{
+		if (count == 0)
+		{
+			return;
+		}
 		std::unique_lock<std::mutex> lock(mMux);
-		if (q.size() == 0)
+		const bool wasEmpty = q.empty();
+		for (size_t i = 0; i < count; ++i)
 		{
-			Log("%s Consumer waiting for Data", mQName.c_str());
-			auto hasData = mConsumerSignal.wait_for(lock, timeOut, [&] {return q.size() > 0; });
-			if (!hasData)
-			{
-				Log("%s Consumer timed out", mQName.c_str());
-				return false;
-			}
-			Log("%s Consumer woke with Data", mQName.c_str());
+			q.push_back(data[i]);
+		}
+		mSize.store(q.size(), std::memory_order_release);
+		if (wasEmpty)
+		{
+			Log("%s Waking consumer", mQName.c_str());
+			mConsumerSignal.notify_one();
+			WakeAsyncReaders(lock);
+		}
+	}
+
+	bool DeQ(T& data, std::chrono::duration<int, std::milli>& timeOut)
+	{
+		std::unique_lock<std::mutex> lock(mMux, std::defer_lock);
+		if (!WaitForData(lock, std::chrono::steady_clock::now() + timeOut))
+		{
+			return false;
 		}
 
-		data = q.front();
+		data = std::move(q.front());
 		q.pop_front();
+		mSize.store(q.size(), std::memory_order_release);
 		return true;
 	}
 
-	void DeQ(T& data)
+	// waits for at least one element then takes up to maxCount, returns how many
+	size_t DeQ(T* data, size_t maxCount, std::chrono::duration<int, std::milli>& timeOut)
+	{
+		std::unique_lock<std::mutex> lock(mMux, std::defer_lock);
+		if (maxCount == 0 || !WaitForData(lock, std::chrono::steady_clock::now() + timeOut))
+		{
+			return 0;
+		}
+
+		size_t count = 0;
+		for (; count < maxCount && !q.empty(); ++count)
+		{
+			data[count] = std::move(q.front());
+			q.pop_front();
+		}
+		mSize.store(q.size(), std::memory_order_release);
+		return count;
+	}
+
+	// waits for at least one element then appends everything queued to data
+	size_t DeQAll(std::vector<T>& data, std::chrono::duration<int, std::milli>& timeOut)
+	{
+		std::unique_lock<std::mutex> lock(mMux, std::defer_lock);
+		if (!WaitForData(lock, std::chrono::steady_clock::now() + timeOut))
+		{
+			return 0;
+		}
+
+		const size_t count = q.size();
+		data.insert(data.end(), std::make_move_iterator(q.begin()), std::make_move_iterator(q.end()));
+		q.clear();
+		mSize.store(0, std::memory_order_release);
+		return count;
+	}
+
+	// takes up to maxCount without waiting, returns how many
+	size_t TryDeQ(T* data, size_t maxCount)
+	{
+		std::lock_guard<std::mutex> lock(mMux);
+		size_t count = 0;
+		for (; count < maxCount && !q.empty(); ++count)
+		{
+			data[count] = std::move(q.front());
+			q.pop_front();
+		}
+		mSize.store(q.size(), std::memory_order_release);
+		return count;
+	}
+
+	/// <summary>
+	/// For readers that must not block a thread. ready is called once there
+	/// is something to take: straight away if there is already, otherwise by
+	/// the EnQ that adds it, on that thread and without the lock. Every
+	/// reader waiting this way is called, so another may take what woke it
+	/// first. Once CloseAsyncReaders has been called ready is called
+	/// straight away, data or not.
+	/// </summary>
+	void WhenData(std::function<void()> ready)
 	{
 		std::unique_lock<std::mutex> lock(mMux);
-		if (q.size() == 0)
+		if (q.empty() && !mAsyncClosed)
 		{
-			Log("%s Consumer waiting for Data", mQName.c_str());
-			mConsumerSignal.wait(lock);
+			mWhenData.push_back(std::move(ready));
+			return;
 		}
-		data = q.front();
+		lock.unlock();
+		ready();
+	}
+
+	// calls every reader waiting in WhenData now, and any later one straight
+	// away, for a queue nothing will be added to
+	void CloseAsyncReaders()
+	{
+		std::unique_lock<std::mutex> lock(mMux);
+		mAsyncClosed = true;
+		WakeAsyncReaders(lock);
+	}
+
+	void DeQ(T& data)
+	{
+		std::unique_lock<std::mutex> lock(mMux, std::defer_lock);
+		WaitForData(lock, std::chrono::steady_clock::time_point::max());
+		data = std::move(q.front());
 		q.pop_front();
+		mSize.store(q.size(), std::memory_order_release);
 	}
 
 	size_t Size()
 	{
-		std::lock_guard<std::mutex> lock(mMux);
-		return q.size();
+		return mSize.load(std::memory_order_acquire);
 	}
 };
 
@@ -104,12 +262,20 @@ class INetwork
 {
 public:
 	virtual ~INetwork() {}
+	// called on the producer / consumer worker thread before it starts work.
+	// Workers are threads of their own, not std::async's, which MSVC takes
+	// from a pool, so what is set here goes when the worker does
+	virtual void ConfigureProducerThread() {}
+	virtual void ConfigureConsumerThread() {}
 	virtual void ProducerEnQ(const std::vector<uint8_t>& data) = 0;
 	virtual bool ProducerDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) = 0;
 	virtual void ConsumerEnQ(const std::vector<uint8_t>& data) = 0;
 	virtual bool ConsumeDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) = 0;
 	virtual size_t ConsumerToProducerSize() = 0;
 	virtual size_t ProducerToConsumerSize() = 0;
+	// the largest datagram known to reach the consumer unfragmented, 0 when
+	// the network does not limit it
+	virtual size_t MaxDatagramBytes() { return 0; }
 };
 
 class IdealNetwork : public INetwork
@@ -119,23 +285,27 @@ private:
 	BlockingQ<std::vector<uint8_t>> mConsumerToProducer;
 
 public:
-	IdealNetwork() :mProdToConsumer(/*"P->C"*/), mConsumerToProducer(/*"C->P"*/)
+	IdealNetwork(const WaitConfig& wait = WaitConfig()) :mProdToConsumer(/*"P->C"*/ wait), mConsumerToProducer(/*"C->P"*/ wait)
 	{}
 
+	// queued frames are pooled copies, and a reader's old buffer goes back
+	// to the pool before the next frame is moved in
 	void ProducerEnQ(const std::vector<uint8_t>& data) override
 	{
-		mProdToConsumer.EnQ(data);
+		mProdToConsumer.EnQ(FramePool::Copy(data));
 	}
 	bool ProducerDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override
 	{
+		FramePool::Release(std::move(data));
 		return mConsumerToProducer.DeQ(data, timeOut);
 	}
 	void ConsumerEnQ(const std::vector<uint8_t>& data) override
 	{
-		mConsumerToProducer.EnQ(data);
+		mConsumerToProducer.EnQ(FramePool::Copy(data));
 	}
 	bool ConsumeDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override
 	{
+		FramePool::Release(std::move(data));
 		return mProdToConsumer.DeQ(data, timeOut);
 	}
 
@@ -156,10 +326,71 @@ public:
 };
 
 
+/// <summary>
+/// Socket and worker thread tuning, zero / -1 values leave the OS default.
+/// </summary>
+struct UdpNetworkOptions
+{
+	int mReceiveBufferBytes{ 0 };  // SO_RCVBUF
+	int mSendBufferBytes{ 0 };     // SO_SNDBUF
+	// DSCP code point, written to IP_TOS. Windows accepts the option but only
+	// marks packets with it when the DisableUserTOSSetting registry value
+	// allows, otherwise use a QoS policy or qWAVE's QOSSetFlow
+	int mDscp{ -1 };
+	bool mReuseAddress{ false };   // SO_REUSEADDR, Winsock's equivalent of SO_REUSEPORT
+	int mProducerCpu{ -1 };        // pin the producer worker to this cpu
+	int mConsumerCpu{ -1 };
+	int mWorkerPriority{ THREAD_PRIORITY_NORMAL };
+	WaitConfig mWait;              // Winsock has no SO_BUSY_POLL, spinning polls select instead
+	// the largest datagram received, and the most path MTU discovery tries.
+	// Ethernet's 1500 byte MTU less the IPv4 and UDP headers, raise it for
+	// jumbo frames, up to 65507
+	int mMaxDatagramBytes{ 1472 };
+	// UdpNetwork producers probe, with don't fragment set, for the largest
+	// datagram the path carries. Frames are never sent with it set, so one
+	// too big for the path is fragmented rather than lost
+	bool mDiscoverPathMtu{ true };
+};
+
+/// <summary>
+/// Path MTU discovery in the style of RFC 8899 (DPLPMTUD): datagrams of the
+/// size Next returns are sent with don't fragment set and echoed by the
+/// far end, an echo confirms that size and cProbes unanswered probes rule
+/// it out. The largest size is tried first, then a binary search down to a
+/// size every IPv4 path carries. It searches again now and then, in case
+/// the path has changed.
+/// </summary>
+class PathMtuSearch
+{
+public:
+	static constexpr int cBaseBytes = 576 - 28;  // the IPv4 minimum MTU less the IPv4 and UDP headers
+	static constexpr int cProbes = 3;
+
+	explicit PathMtuSearch(int maxBytes);
+
+	// the size to probe now, 0 when none is due
+	int Next(std::chrono::steady_clock::time_point now);
+	void OnEcho(int bytes);
+
+	int Confirmed() const { return mConfirmed; }
+	bool Searching() const { return mConfirmed < mCeiling; }
+
+private:
+	const int mMaxBytes;
+	int mConfirmed;          // largest size echoed
+	int mCeiling;            // largest size not yet ruled out
+	int mProbing{ 0 };       // size in flight, 0 when none is
+	int mMisses{ 0 };
+	std::chrono::steady_clock::time_point mSentAt;
+	std::chrono::steady_clock::time_point mSettledAt;
+};
+
 // refactor to producer
 class UdpNetwork : public INetwork
 {
 private:
+	UdpNetworkOptions mOptions;
+
 	int mProducerSocket;
 	sockaddr_in mConsumersAddress{};
 
@@ -167,28 +398,36 @@ private:
 	sockaddr_in mProducersAddress{};  // not known until first frame from the producer
 	bool mHaveProducerAddr{ false };
 
-	bool ReceiveData(int socket, std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut,
-		sockaddr_in* senderAddress, int* senderAddressSize);
-
 	bool mIsProducer{false};
 	bool mIsConsumer{ false };
 
+	// the producer's thread probes, others read what it found
+	std::unique_ptr<PathMtuSearch> mPathMtu;
+	std::atomic<int> mPathMaxBytes{ 0 };
+	std::atomic<size_t> mFailedOptions{ 0 };
+
+	void ProbePathIfDue();
+	void SetDontFragment(bool dontFragment);
+
 	void InitWinSock();
 	void  InitAsProducer(const std::string& consumerAddress, int consumerPort);
 	void  InitAsConsumer(int consumerPort);
 
 public:
 	// init as prod/consumer on loopback address
-	UdpNetwork();
+	UdpNetwork(const UdpNetworkOptions& options = UdpNetworkOptions());
 
 	// init as producer
-	UdpNetwork(const std::string& consumerAddress, int consumerPort);
+	UdpNetwork(const std::string& consumerAddress, int consumerPort, const UdpNetworkOptions& options = UdpNetworkOptions());
 
 	// init as consumer
-	UdpNetwork(int consumerPort);
+	UdpNetwork(int consumerPort, const UdpNetworkOptions& options = UdpNetworkOptions());
 
 	~UdpNetwork();
 
+	void ConfigureProducerThread() override;
+	void ConfigureConsumerThread() override;
+
 	void ProducerEnQ(const std::vector<uint8_t>& data) override;
 
 	bool ProducerDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override;
@@ -215,38 +454,376 @@ public:
 	{
 		return 0;
 	}
+
+	// from path MTU discovery, which starts out at PathMtuSearch::cBaseBytes,
+	// mMaxDatagramBytes without it
+	size_t MaxDatagramBytes() override
+	{
+		return mPathMaxBytes;
+	}
+
+	// socket and thread options that could not be applied, each is logged
+	size_t FailedOptions() { return mFailedOptions; }
+};
+
+
+/// <summary>
+/// One producer sending the same stream to a fixed set of subscribers. A
+/// frame goes to every subscriber, or to one when it is a resend, and acks
+/// come back tagged with the subscriber that sent them.
+/// </summary>
+class IFanOutNetwork
+{
+public:
+	virtual ~IFanOutNetwork() {}
+	virtual void ConfigureProducerThread() {}
+	virtual size_t Subscribers() = 0;
+	virtual void ProducerEnQ(const std::vector<uint8_t>& data) = 0;
+	virtual void ProducerEnQ(size_t subscriber, const std::vector<uint8_t>& data) = 0;
+	virtual bool ProducerDeQ(size_t& subscriber, std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) = 0;
 };
 
+/// <summary>
+/// In process fan out, Subscriber(i) is the INetwork a QConsumer for that
+/// subscriber runs on.
+/// </summary>
+class IdealFanOutNetwork : public IFanOutNetwork
+{
+private:
+	using TaggedAck = std::pair<size_t, std::vector<uint8_t>>;
+
+	class Endpoint : public INetwork
+	{
+	private:
+		size_t mSubscriber;
+		BlockingQ<std::vector<uint8_t>> mProdToConsumer;
+		std::shared_ptr<BlockingQ<TaggedAck>> mAcks;
+
+	public:
+		Endpoint(size_t subscriber, std::shared_ptr<BlockingQ<TaggedAck>> acks, const WaitConfig& wait) :
+			mSubscriber(subscriber), mProdToConsumer(wait), mAcks(acks)
+		{}
+
+		void Deliver(const std::vector<uint8_t>& data) { mProdToConsumer.EnQ(data); }
+
+		void ProducerEnQ(const std::vector<uint8_t>& data) override
+		{
+			Log("IdealFanOutNetwork - subscriber end has no producer side");
+			exit(1);
+		}
+		bool ProducerDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override
+		{
+			Log("IdealFanOutNetwork - subscriber end has no producer side");
+			exit(1);
+		}
+		void ConsumerEnQ(const std::vector<uint8_t>& data) override
+		{
+			mAcks->EnQ(TaggedAck(mSubscriber, data));
+		}
+		bool ConsumeDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override
+		{
+			return mProdToConsumer.DeQ(data, timeOut);
+		}
+		size_t ProducerToConsumerSize() override { return mProdToConsumer.Size(); }
+		size_t ConsumerToProducerSize() override { return mAcks->Size(); }
+	};
+
+	std::shared_ptr<BlockingQ<TaggedAck>> mAcks;
+	std::vector<std::shared_ptr<Endpoint>> mEndpoints;
+
+public:
+	IdealFanOutNetwork(size_t subscribers, const WaitConfig& wait = WaitConfig()) :
+		mAcks(std::make_shared<BlockingQ<TaggedAck>>(wait))
+	{
+		for (size_t i = 0; i < subscribers; ++i)
+		{
+			mEndpoints.push_back(std::make_shared<Endpoint>(i, mAcks, wait));
+		}
+	}
+
+	std::shared_ptr<INetwork> Subscriber(size_t subscriber) { return mEndpoints[subscriber]; }
+
+	size_t Subscribers() override { return mEndpoints.size(); }
+
+	void ProducerEnQ(const std::vector<uint8_t>& data) override
+	{
+		for (auto& endpoint : mEndpoints)
+		{
+			endpoint->Deliver(data);
+		}
+	}
+	void ProducerEnQ(size_t subscriber, const std::vector<uint8_t>& data) override
+	{
+		mEndpoints[subscriber]->Deliver(data);
+	}
+	bool ProducerDeQ(size_t& subscriber, std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override
+	{
+		TaggedAck ack;
+		if (!mAcks->DeQ(ack, timeOut))
+		{
+			return false;
+		}
+		subscriber = ack.first;
+		data = std::move(ack.second);
+		return true;
+	}
+};
+
+/// <summary>
+/// Fan out over one unconnected socket. Subscribers run a consumer
+/// UdpNetwork on their port; acks are matched to subscribers by address.
+/// </summary>
+class UdpFanOutNetwork : public IFanOutNetwork
+{
+private:
+	UdpNetworkOptions mOptions;
+	int mSocket;
+	std::vector<sockaddr_in> mSubscribers;
+
+public:
+	// subscribers as address, port pairs
+	UdpFanOutNetwork(const std::vector<std::pair<std::string, int>>& subscribers, const UdpNetworkOptions& options = UdpNetworkOptions());
+	~UdpFanOutNetwork();
+
+	void ConfigureProducerThread() override;
+	size_t Subscribers() override { return mSubscribers.size(); }
+	void ProducerEnQ(const std::vector<uint8_t>& data) override;
+	void ProducerEnQ(size_t subscriber, const std::vector<uint8_t>& data) override;
+	bool ProducerDeQ(size_t& subscriber, std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override;
+};
+
+/// <summary>
+/// One of the receive sockets of a sharded consumer, bound to its own port.
+/// Datagrams come with the address they came from as a flow key, feedback is
+/// sent back to a flow key. Driven from one thread.
+/// </summary>
+class UdpShardSocket
+{
+private:
+	UdpNetworkOptions mOptions;
+	int mSocket;
+
+public:
+	UdpShardSocket(int port, const UdpNetworkOptions& options = UdpNetworkOptions());
+	~UdpShardSocket();
+
+	// pins the calling thread to cpu, -1 leaves it where it is
+	void ConfigureThread(int cpu);
+	bool Receive(std::vector<uint8_t>& data, uint64_t& flow, std::chrono::duration<int, std::milli>& timeOut);
+	void Send(uint64_t flow, const std::vector<uint8_t>& data);
+};
+
+struct MulticastGroup
+{
+	std::string mAddress;                  // e.g. 239.255.31.41
+	int mPort{ 0 };
+	std::string mInterface{ "0.0.0.0" };   // local interface to send and join on, 127.0.0.1 for loopback
+	int mTtl{ 1 };                         // hops, 1 keeps it on the local subnet
+};
+
+/// <summary>
+/// IP multicast. The producer sends every frame, repairs included, once to
+/// the group; consumers join the group and send feedback by unicast to the
+/// address the frames came from. Run both ends with RepairMode::Nack.
+/// </summary>
+class UdpMulticastNetwork : public INetwork
+{
+public:
+	enum class Role { Producer, Consumer, Both };
+
+private:
+	UdpNetworkOptions mOptions;
+	int mProducerSocket{ static_cast<int>(INVALID_SOCKET) };
+	int mConsumerSocket{ static_cast<int>(INVALID_SOCKET) };
+	sockaddr_in mGroupAddress{};
+	sockaddr_in mProducersAddress{};  // not known until the first frame arrives
+	bool mHaveProducerAddr{ false };
+
+	void InitAsProducer(const MulticastGroup& group);
+	void InitAsConsumer(const MulticastGroup& group);
+
+public:
+	UdpMulticastNetwork(const MulticastGroup& group, Role role, const UdpNetworkOptions& options = UdpNetworkOptions());
+	~UdpMulticastNetwork();
+
+	void ConfigureProducerThread() override;
+	void ConfigureConsumerThread() override;
+	void ProducerEnQ(const std::vector<uint8_t>& data) override;
+	bool ProducerDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override;
+	void ConsumerEnQ(const std::vector<uint8_t>& data) override;
+	bool ConsumeDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override;
+	size_t ProducerToConsumerSize() override { return 0; }
+	size_t ConsumerToProducerSize() override { return 0; }
+};
+
+
+/// <summary>
+/// Registered I/O sizing. Each socket keeps mReceiveSlots receives posted at
+/// all times and may have mSendSlots sends in flight, a slot holds one
+/// datagram of up to mSlotBytes.
+/// </summary>
+struct RioOptions
+{
+	uint32_t mReceiveSlots{ 256 };
+	uint32_t mSendSlots{ 1024 };
+	uint32_t mSlotBytes{ 2048 };
+	// how the completion dispatcher waits, taken from the first RioUdpNetwork in the process
+	WaitConfig mDispatchWait;
+	UdpNetworkOptions mSocket;  // mWait is how readers wait for dispatched completions
+};
+
+class RioEngine;
+
+/// <summary>
+/// UdpNetwork over Winsock Registered I/O. Receives stay posted in registered
+/// buffers and are reposted as they are read. Sends are deferred and
+/// committed together when the sending thread next reads, or every 32
+/// frames. One completion queue, drained by one dispatch thread, serves
+/// every RioUdpNetwork in the process. Each end must only be driven from one
+/// thread, as QProducer and QConsumer do.
+/// </summary>
+class RioUdpNetwork : public INetwork
+{
+private:
+	friend class RioEngine;
+	class Channel;
+
+	RioOptions mOptions;
+	std::unique_ptr<Channel> mProducer;
+	std::unique_ptr<Channel> mConsumer;
+
+	void InitWinSock();
+
+public:
+	// init as prod/consumer on loopback address
+	RioUdpNetwork(const RioOptions& options = RioOptions());
+
+	// init as producer
+	RioUdpNetwork(const std::string& consumerAddress, int consumerPort, const RioOptions& options = RioOptions());
+
+	// init as consumer
+	RioUdpNetwork(int consumerPort, const RioOptions& options = RioOptions());
+
+	~RioUdpNetwork();
+
+	void ConfigureProducerThread() override;
+	void ConfigureConsumerThread() override;
+	void ProducerEnQ(const std::vector<uint8_t>& data) override;
+	bool ProducerDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override;
+	void ConsumerEnQ(const std::vector<uint8_t>& data) override;
+	bool ConsumeDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override;
+	size_t ProducerToConsumerSize() override { return 0; }
+	size_t ConsumerToProducerSize() override { return 0; }
+
+	// datagrams not sent because every send slot was in flight or they were too big
+	size_t DroppedFrames();
+};
+
+/// <summary>
+/// Frame sequence numbers. Compared with serial number arithmetic (RFC 1982)
+/// so ordering survives wrap around for any two numbers less than half the
+/// sequence space apart, which bounds the window at 2^31 frames.
+/// </summary>
+using SeqNo = uint32_t;
+
+// how far a is ahead of b, negative when a is behind
+inline int32_t SeqDiff(SeqNo a, SeqNo b)
+{
+	return static_cast<int32_t>(a - b);
+}
+
+inline bool SeqLess(SeqNo a, SeqNo b)
+{
+	return SeqDiff(a, b) < 0;
+}
+
+enum class FrameType : uint8_t
+{
+	Data,      // carries a T, or is an ack when it has no body
+	Parity,    // carries FEC parity over a group of data frames
+	Nack,      // consumer is missing mRange frames from mSeqNo
+	Heartbeat, // producer has sent up to mSeqNo and can still repair the last mRange
+	Hello,     // producer starting session mSession after mSeqNo, mRange 1 lets the consumer keep its place
+	Welcome,   // consumer has joined mSession and delivered up to mSeqNo
+	Probe      // path MTU probe of mSeqNo bytes, echoed by UdpNetwork consumers as cProbeEchoBytes with mSeqNo the size received
+};
+
+/// <summary>
+/// Ack: the consumer acks cumulatively after every datagram, the producer
+/// resends the oldest unacked frame on a timer and stops when its window is
+/// full. Nack: consumers only report gaps, the producer keeps its window as a
+/// repair buffer it never waits on, dropping the oldest frame when full, and
+/// heartbeats its newest frame so lost tails are noticed. Suits one to many
+/// transports where per datagram acks from every consumer do not scale.
+/// </summary>
+enum class RepairMode : uint8_t
+{
+	Ack,
+	Nack
+};
 
 struct Header
 {
-	Header(uint16_t seqNo) :mSeqNo(seqNo) {};
+	Header(SeqNo seqNo) :mSeqNo(seqNo) {};
 	Header()
 	{
 	}
 
-	uint16_t mSeqNo{ 0 };
+	SeqNo mSeqNo{ 0 };   // first frame in the group for parity frames
 	uint16_t mDataSize{ 0 };
+	FrameType mType{ FrameType::Data };
+	uint8_t mFecDataFrames{ 0 };
+	uint8_t mFecParityIndex{ 0 };
+	uint8_t mFecParityFrames{ 0 };
+	uint16_t mRange{ 0 };    // Nack and Heartbeat frame count, also keeps the struct free of padding
+	uint32_t mSession{ 0 };  // producer session the frame belongs to, 0 when there was no handshake
+	uint16_t mLane{ 0 };     // priority lane, stamped by PriorityNetwork
+	// on acks, 1 + how many frames past mSeqNo the consumer will take, 0
+	// when it sets no limit. Also keeps the struct free of padding
+	uint16_t mWindow{ 0 };
 };
 
+// follows the header of probes and their echoes. Networks such as
+// CodecNetwork send datagrams that are not a Header, so the type byte alone
+// could be any byte of theirs
+constexpr uint64_t cProbeMagic = 0x45424f5250504451;  // "QDPPROBE"
+constexpr size_t cProbeEchoBytes = sizeof(Header) + sizeof(cProbeMagic);
+
+// probes stay inside the UDP networks, anything else that gets one drops it
+inline bool IsProbe(const std::vector<uint8_t>& data)
+{
+	if (data.size() < cProbeEchoBytes)
+	{
+		return false;
+	}
+	Header header;
+	memcpy(&header, data.data(), sizeof(header));
+	uint64_t magic;
+	memcpy(&magic, data.data() + sizeof(header), sizeof(magic));
+	return header.mType == FrameType::Probe && magic == cProbeMagic;
+}
+
+// a random non zero id, so a restarted producer never reuses its last session's
+uint32_t NewSessionId();
+
 /// <summary>
 /// Assuming same endian and padding in structs. In real life would look at 
 /// using protocol buffers.
 /// </summary>
 /// <typeparam name="T"></typeparam>
 template <class T> struct Frame {
-	std::vector<uint8_t> mBytes;
+	std::vector<uint8_t> mBytes;  // from FramePool, and back to it when the frame goes
 	Header mHeader;
 	T mBody;
 	bool mHasBody;
 
-	Frame(const Header& header) :mBytes(sizeof(header)), mHeader(header), mHasBody(false)
+	Frame(const Header& header) :mBytes(FramePool::Acquire(sizeof(header))), mHeader(header), mHasBody(false)
 	{
 		mHeader.mDataSize = 0;
 		memcpy(&mBytes[0], &mHeader, sizeof(mHeader));
 	}
 
-	Frame(const Header& header, const T& body) :mBytes(sizeof(header) + sizeof(body)), mHeader(header),
+	Frame(const Header& header, const T& body) :mBytes(FramePool::Acquire(sizeof(header) + sizeof(body))), mHeader(header),
 		mBody(body), mHasBody(true)
 	{
 		mHeader.mDataSize = sizeof(body);
@@ -254,7 +831,7 @@ template <class T> struct Frame {
 		memcpy(&mBytes[sizeof(mHeader)], &mBody, sizeof(mBody));
 	}
 
-	Frame(const std::vector<uint8_t>& data) : mBytes(data)
+	Frame(const std::vector<uint8_t>& data) : mBytes(FramePool::Copy(data))
 	{
 		memcpy(&mHeader, &(mBytes[0]), sizeof(mHeader));
 		mHasBody = mHeader.mDataSize != 0;
@@ -264,5 +841,52 @@ template <class T> struct Frame {
 		}
 	}
 
+	Frame(const Frame& other) :mBytes(FramePool::Copy(other.mBytes)), mHeader(other.mHeader), mBody(other.mBody),
+		mHasBody(other.mHasBody)
+	{}
+
+	Frame(Frame&& other) = default;
+
+	Frame& operator=(const Frame& other)
+	{
+		if (this != &other)
+		{
+			FramePool::Release(std::move(mBytes));
+			mBytes = FramePool::Copy(other.mBytes);
+			mHeader = other.mHeader;
+			mBody = other.mBody;
+			mHasBody = other.mHasBody;
+		}
+		return *this;
+	}
+
+	Frame& operator=(Frame&& other)
+	{
+		FramePool::Release(std::move(mBytes));
+		mBytes = std::move(other.mBytes);
+		mHeader = other.mHeader;
+		mBody = std::move(other.mBody);
+		mHasBody = other.mHasBody;
+		return *this;
+	}
+
+	~Frame()
+	{
+		FramePool::Release(std::move(mBytes));
+	}
+
 	Frame() {};
+
+	// only a whole header followed by exactly the body it claims is parsed,
+	// anything else was truncated or corrupted on the way
+	static bool Fits(const std::vector<uint8_t>& data)
+	{
+		if (data.size() < sizeof(Header))
+		{
+			return false;
+		}
+		Header header;
+		memcpy(&header, data.data(), sizeof(header));
+		return (header.mDataSize == 0 || header.mDataSize == sizeof(T)) && data.size() == sizeof(Header) + header.mDataSize;
+	}
 };
\ No newline at end of file
@@ -0,0 +1,115 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+struct PacingConfig
+{
+	bool mEnabled{ false };
+	double mMaxFramesPerSec{ 0 };  // hard cap, 0 to pace on RTT alone
+	double mBurstFrames{ 2 };      // credit that may build up while idle
+};
+
+/// <summary>
+/// Token bucket that spreads a window of frames evenly over one smoothed
+/// round trip, optionally capped at a fixed rate. Tokens may go negative so
+/// frames sent without asking (resends, parity) still delay what follows.
+/// </summary>
+class Pacer
+{
+private:
+	using Clock = std::chrono::steady_clock;
+
+	PacingConfig mConfig;
+	uint32_t mWindow;
+	double mTokens;
+	Clock::time_point mLastRefill;
+	std::chrono::nanoseconds mSmoothedRtt{ 0 };
+
+	void Refill(Clock::time_point now)
+	{
+		const double rate = FramesPerSec();
+		if (rate == 0)
+		{
+			mTokens = mConfig.mBurstFrames;
+		}
+		else
+		{
+			const std::chrono::duration<double> elapsed = now - mLastRefill;
+			mTokens = (std::min)(mConfig.mBurstFrames, mTokens + elapsed.count() * rate);
+		}
+		mLastRefill = now;
+	}
+
+public:
+	Pacer(const PacingConfig& config, uint32_t window) :
+		mConfig(config), mWindow(window), mLastRefill(Clock::now())
+	{
+		mConfig.mBurstFrames = (std::max)(1.0, mConfig.mBurstFrames);
+		mTokens = mConfig.mBurstFrames;
+	}
+
+	// RFC 6298 smoothing, only feed samples from frames that were not resent
+	void OnRttSample(std::chrono::nanoseconds rtt)
+	{
+		mSmoothedRtt = mSmoothedRtt.count() == 0 ? rtt : (mSmoothedRtt * 7 + rtt) / 8;
+	}
+
+	std::chrono::nanoseconds SmoothedRtt() const { return mSmoothedRtt; }
+
+	// 0 means unpaced
+	double FramesPerSec() const
+	{
+		if (!mConfig.mEnabled)
+		{
+			return 0;
+		}
+
+		double rttRate = 0;
+		if (mSmoothedRtt.count() > 0)
+		{
+			rttRate = mWindow / std::chrono::duration<double>(mSmoothedRtt).count();
+		}
+		if (rttRate == 0 || mConfig.mMaxFramesPerSec == 0)
+		{
+			return (std::max)(rttRate, mConfig.mMaxFramesPerSec);
+		}
+		return (std::min)(rttRate, mConfig.mMaxFramesPerSec);
+	}
+
+	// how long until the next frame may go
+	std::chrono::nanoseconds Delay()
+	{
+		Refill(Clock::now());
+		if (mTokens >= 1)
+		{
+			return std::chrono::nanoseconds(0);
+		}
+		const std::chrono::duration<double> wait((1 - mTokens) / FramesPerSec());
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(wait);
+	}
+
+	void OnSend()
+	{
+		Refill(Clock::now());
+		mTokens -= 1;
+	}
+
+	/// <summary>
+	/// sleep_for cannot resolve the sub millisecond gaps pacing needs, so the
+	/// tail of a wait is spent yielding
+	/// </summary>
+	static void Wait(std::chrono::nanoseconds delay)
+	{
+		const auto until = Clock::now() + delay;
+		const auto sleepResolution = std::chrono::milliseconds(2);
+		if (delay > sleepResolution)
+		{
+			std::this_thread::sleep_for(delay - sleepResolution);
+		}
+		while (Clock::now() < until)
+		{
+			std::this_thread::yield();
+		}
+	}
+};
@@ -0,0 +1,168 @@
+#pragma once
+#include "QProducer.h"
+#include "QConsumer.h"
+#include "QPriorityNetwork.h"
+
+struct PriorityConfig
+{
+	LaneScheduling mScheduling{ LaneScheduling::Strict };
+	// one per lane, the most urgent first. Weighted sends up to this many
+	// frames from a lane before moving on to the next
+	std::vector<uint32_t> mWeights{ 1, 1 };
+};
+
+/// <summary>
+/// One QProducer per lane over a shared PriorityNetwork, each with its own
+/// window, so a lane stalled on repairs holds up no other.
+/// </summary>
+template <class T> class QPriorityProducer
+{
+private:
+	std::shared_ptr<PriorityNetwork> mLanes;
+	std::vector<std::unique_ptr<QProducer<T>>> mProducers;
+
+public:
+	// config applies to every lane
+	QPriorityProducer(std::shared_ptr<INetwork> network, const PriorityConfig& priority = PriorityConfig(),
+		const ProducerConfig& config = ProducerConfig())
+	{
+		if (config.mLog.Enabled())
+		{
+			Log("QPriorityProducer - lanes cannot share one send log");
+			exit(1);
+		}
+		mLanes = PriorityNetwork::Create(network, priority.mScheduling, priority.mWeights);
+		for (size_t lane = 0; lane < mLanes->Lanes(); ++lane)
+		{
+			auto transport = mLanes->Lane(lane);
+			mProducers.push_back(std::make_unique<QProducer<T>>(transport, config));
+		}
+	}
+
+	size_t Lanes() { return mProducers.size(); }
+
+	QProducer<T>& Lane(size_t lane) { return *mProducers[lane]; }
+
+	void Stop()
+	{
+		for (auto& producer : mProducers)
+		{
+			producer->Stop();
+		}
+	}
+
+	void EnQ(size_t lane, const T& data)
+	{
+		mProducers[lane]->EnQ(data);
+	}
+
+	void EnQ(size_t lane, const T* data, size_t count)
+	{
+		mProducers[lane]->EnQ(data, count);
+	}
+
+	size_t Size()
+	{
+		size_t size = 0;
+		for (auto& producer : mProducers)
+		{
+			size += producer->Size();
+		}
+		return size;
+	}
+};
+
+/// <summary>
+/// One QConsumer per lane, each delivering its lane in order, read them
+/// most urgent first.
+/// </summary>
+template <class T> class QPriorityConsumer
+{
+private:
+	std::shared_ptr<PriorityNetwork> mLanes;
+	std::vector<std::unique_ptr<QConsumer<T>>> mConsumers;
+
+public:
+	QPriorityConsumer(std::shared_ptr<INetwork> network, size_t lanes, const ConsumerConfig& config = ConsumerConfig())
+	{
+		// scheduling only matters to the sending side
+		mLanes = PriorityNetwork::Create(network, LaneScheduling::Strict, std::vector<uint32_t>(lanes, 1));
+		for (size_t lane = 0; lane < mLanes->Lanes(); ++lane)
+		{
+			auto transport = mLanes->Lane(lane);
+			mConsumers.push_back(std::make_unique<QConsumer<T>>(transport, config));
+		}
+	}
+
+	size_t Lanes() { return mConsumers.size(); }
+
+	QConsumer<T>& Lane(size_t lane) { return *mConsumers[lane]; }
+
+	void Stop()
+	{
+		for (auto& consumer : mConsumers)
+		{
+			consumer->Stop();
+		}
+	}
+
+	size_t DeQ(size_t lane, T* data, size_t maxCount, std::chrono::duration<int, std::milli>& timeOut)
+	{
+		return mConsumers[lane]->DeQ(data, maxCount, timeOut);
+	}
+
+	size_t DeQAll(size_t lane, std::vector<T>& data, std::chrono::duration<int, std::milli>& timeOut)
+	{
+		return mConsumers[lane]->DeQAll(data, timeOut);
+	}
+};
+
+/// <summary>
+/// ReliableQ with priority lanes, both ends over one network.
+/// </summary>
+template <class T> class PriorityReliableQ
+{
+private:
+	std::unique_ptr<QPriorityConsumer<T>> mConsumer;
+	std::unique_ptr<QPriorityProducer<T>> mProducer;
+
+public:
+	// both ends use the producer's repair mode
+	PriorityReliableQ(std::shared_ptr<INetwork> network, const PriorityConfig& priority = PriorityConfig(),
+		const ProducerConfig& config = ProducerConfig(), const ConsumerConfig& consumerConfig = ConsumerConfig())
+	{
+		ConsumerConfig matched = consumerConfig;
+		matched.mRepair = config.mRepair;
+		mConsumer = std::make_unique<QPriorityConsumer<T>>(network, priority.mWeights.size(), matched);
+		mProducer = std::make_unique<QPriorityProducer<T>>(network, priority, config);
+	}
+
+	~PriorityReliableQ()
+	{
+		mConsumer->Stop();
+		mProducer->Stop();
+	}
+
+	PriorityReliableQ(const PriorityReliableQ&) = delete;
+
+	void EnQ(size_t lane, const T& data)
+	{
+		mProducer->EnQ(lane, data);
+	}
+
+	void EnQ(size_t lane, const T* data, size_t count)
+	{
+		mProducer->EnQ(lane, data, count);
+	}
+
+	// returns the number of elements written to data, 0 on time out
+	size_t DeQ(size_t lane, T* data, size_t maxCount, std::chrono::duration<int, std::milli>& timeOut)
+	{
+		return mConsumer->DeQ(lane, data, maxCount, timeOut);
+	}
+
+	size_t DeQAll(size_t lane, std::vector<T>& data, std::chrono::duration<int, std::milli>& timeOut)
+	{
+		return mConsumer->DeQAll(lane, data, timeOut);
+	}
+};
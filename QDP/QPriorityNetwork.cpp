@@ -0,0 +1,279 @@
+#include "pch.h"
+#include "QPriorityNetwork.h"
+
+LaneScheduler::LaneScheduler(LaneScheduling scheduling, const std::vector<uint32_t>& weights) :
+	mScheduling(scheduling), mWeights(weights), mLanes(weights.size())
+{
+	if (mLanes.empty() || mLanes.size() > UINT16_MAX)
+	{
+		Log("LaneScheduler - %zu lanes, needs 1 to %u", mLanes.size(), UINT16_MAX);
+		exit(1);
+	}
+	for (auto& weight : mWeights)
+	{
+		weight = (std::max)(weight, 1u);
+	}
+	mCredit = mWeights[0];
+}
+
+void LaneScheduler::Push(size_t lane, std::vector<uint8_t>&& frame)
+{
+	mLanes[lane].push_back(std::move(frame));
+	++mQueued;
+}
+
+bool LaneScheduler::Pop(std::vector<uint8_t>& frame)
+{
+	if (mQueued == 0)
+	{
+		return false;
+	}
+
+	size_t lane = 0;
+	if (mScheduling == LaneScheduling::Strict)
+	{
+		while (mLanes[lane].empty())
+		{
+			++lane;
+		}
+	}
+	else
+	{
+		// an empty lane gives up the rest of its turn
+		while (mCredit == 0 || mLanes[mTurn].empty())
+		{
+			mTurn = (mTurn + 1) % mLanes.size();
+			mCredit = mWeights[mTurn];
+		}
+		--mCredit;
+		lane = mTurn;
+	}
+
+	frame = std::move(mLanes[lane].front());
+	mLanes[lane].pop_front();
+	--mQueued;
+	return true;
+}
+
+/// <summary>
+/// What a QProducer or QConsumer for one lane sees of the PriorityNetwork.
+/// </summary>
+class PriorityNetwork::LaneNetwork : public INetwork
+{
+private:
+	std::shared_ptr<PriorityNetwork> mNetwork;
+	size_t mLane;
+
+public:
+	LaneNetwork(std::shared_ptr<PriorityNetwork> network, size_t lane) :mNetwork(network), mLane(lane) {}
+
+	void ProducerEnQ(const std::vector<uint8_t>& data) override
+	{
+		mNetwork->ProducerEnQ(mLane, data);
+	}
+	bool ProducerDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override
+	{
+		return mNetwork->ProducerDeQ(mLane, data, timeOut);
+	}
+	void ConsumerEnQ(const std::vector<uint8_t>& data) override
+	{
+		mNetwork->ConsumerEnQ(mLane, data);
+	}
+	bool ConsumeDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override
+	{
+		return mNetwork->ConsumeDeQ(mLane, data, timeOut);
+	}
+	size_t ProducerToConsumerSize() override
+	{
+		return mNetwork->ProducerToConsumerSize(mLane);
+	}
+	size_t ConsumerToProducerSize() override
+	{
+		return mNetwork->ConsumerToProducerSize(mLane);
+	}
+};
+
+PriorityNetwork::PriorityNetwork(std::shared_ptr<INetwork> network, LaneScheduling scheduling, const std::vector<uint32_t>& weights) :
+	mNetwork(network), mLaneCount(weights.size()), mScheduler(scheduling, weights)
+{
+	for (size_t lane = 0; lane < mLaneCount; ++lane)
+	{
+		mData.push_back(std::make_unique<BlockingQ<std::vector<uint8_t>>>());
+		mFeedback.push_back(std::make_unique<BlockingQ<std::vector<uint8_t>>>());
+	}
+}
+
+std::shared_ptr<PriorityNetwork> PriorityNetwork::Create(std::shared_ptr<INetwork> network,
+	LaneScheduling scheduling, const std::vector<uint32_t>& weights)
+{
+	return std::shared_ptr<PriorityNetwork>(new PriorityNetwork(network, scheduling, weights));
+}
+
+PriorityNetwork::~PriorityNetwork()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMux);
+		mStop = true;
+	}
+	mToSend.notify_one();
+	for (auto* worker : { &mSender, &mFeedbackReceiver, &mDataReceiver })
+	{
+		if (worker->joinable())
+		{
+			worker->join();
+		}
+	}
+}
+
+std::shared_ptr<INetwork> PriorityNetwork::Lane(size_t lane)
+{
+	if (lane >= mLaneCount)
+	{
+		Log("PriorityNetwork - no lane %zu, there are %zu", lane, mLaneCount);
+		exit(1);
+	}
+	return std::make_shared<LaneNetwork>(shared_from_this(), lane);
+}
+
+void PriorityNetwork::StartProducerSide()
+{
+	std::call_once(mProducerStarted, [this]()
+		{
+			mSender = std::thread([this]() { Send(); });
+			mFeedbackReceiver = std::thread([this]() { ReceiveFeedback(); });
+		});
+}
+
+void PriorityNetwork::StartConsumerSide()
+{
+	std::call_once(mConsumerStarted, [this]()
+		{
+			mDataReceiver = std::thread([this]() { ReceiveData(); });
+		});
+}
+
+size_t PriorityNetwork::LaneOf(const std::vector<uint8_t>& frame)
+{
+	// too short to say, dropped along with frames for lanes that do not exist
+	if (frame.size() < sizeof(Header))
+	{
+		return SIZE_MAX;
+	}
+	Header header;
+	memcpy(&header, &frame[0], sizeof(header));
+	return header.mLane;
+}
+
+// in place, frames are copied once into pooled buffers before this
+static void StampLane(std::vector<uint8_t>& frame, size_t lane)
+{
+	Header header;
+	memcpy(&header, &frame[0], sizeof(header));
+	header.mLane = static_cast<uint16_t>(lane);
+	memcpy(&frame[0], &header, sizeof(header));
+}
+
+void PriorityNetwork::Send()
+{
+	mNetwork->ConfigureProducerThread();
+	std::vector<uint8_t> frame;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mMux);
+			mToSend.wait(lock, [this]() { return mStop || mScheduler.Size() != 0; });
+			if (mStop)
+			{
+				return;
+			}
+			mScheduler.Pop(frame);
+		}
+		mNetwork->ProducerEnQ(frame);
+		FramePool::Release(std::move(frame));
+	}
+}
+
+void PriorityNetwork::ReceiveFeedback()
+{
+	std::chrono::duration<int, std::milli> timeOut(100);
+	std::vector<uint8_t> data;
+	while (!mStop)
+	{
+		if (mNetwork->ProducerDeQ(data, timeOut))
+		{
+			const size_t lane = LaneOf(data);
+			if (lane >= mLaneCount)
+			{
+				Log("PriorityNetwork - feedback for lane %zu, there are %zu", lane, mLaneCount);
+				continue;
+			}
+			mFeedback[lane]->EnQ(FramePool::Copy(data));
+		}
+	}
+}
+
+void PriorityNetwork::ReceiveData()
+{
+	mNetwork->ConfigureConsumerThread();
+	std::chrono::duration<int, std::milli> timeOut(100);
+	std::vector<uint8_t> data;
+	while (!mStop)
+	{
+		if (mNetwork->ConsumeDeQ(data, timeOut))
+		{
+			const size_t lane = LaneOf(data);
+			if (lane >= mLaneCount)
+			{
+				Log("PriorityNetwork - frame for lane %zu, there are %zu", lane, mLaneCount);
+				continue;
+			}
+			mData[lane]->EnQ(FramePool::Copy(data));
+		}
+	}
+}
+
+void PriorityNetwork::ProducerEnQ(size_t lane, const std::vector<uint8_t>& data)
+{
+	StartProducerSide();
+	auto frame = FramePool::Copy(data);
+	StampLane(frame, lane);
+	{
+		std::lock_guard<std::mutex> lock(mMux);
+		mScheduler.Push(lane, std::move(frame));
+	}
+	mToSend.notify_one();
+}
+
+bool PriorityNetwork::ProducerDeQ(size_t lane, std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut)
+{
+	StartProducerSide();
+	FramePool::Release(std::move(data));
+	return mFeedback[lane]->DeQ(data, timeOut);
+}
+
+void PriorityNetwork::ConsumerEnQ(size_t lane, const std::vector<uint8_t>& data)
+{
+	StartConsumerSide();
+	std::lock_guard<std::mutex> lock(mFeedbackMux);
+	mFeedbackFrame.assign(data.begin(), data.end());
+	StampLane(mFeedbackFrame, lane);
+	mNetwork->ConsumerEnQ(mFeedbackFrame);
+}
+
+bool PriorityNetwork::ConsumeDeQ(size_t lane, std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut)
+{
+	StartConsumerSide();
+	FramePool::Release(std::move(data));
+	return mData[lane]->DeQ(data, timeOut);
+}
+
+size_t PriorityNetwork::ProducerToConsumerSize(size_t lane)
+{
+	std::lock_guard<std::mutex> lock(mMux);
+	return mScheduler.Size(lane) + mData[lane]->Size();
+}
+
+size_t PriorityNetwork::ConsumerToProducerSize(size_t lane)
+{
+	return mFeedback[lane]->Size();
+}
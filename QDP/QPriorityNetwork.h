@@ -0,0 +1,106 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "QNetwork.h"
+
+enum class LaneScheduling : uint8_t
+{
+	Strict,    // always the highest priority lane with something to send
+	Weighted   // round robin, each lane sending up to its weight in frames per turn
+};
+
+/// <summary>
+/// Picks which lane's frame goes on the wire next. Lane 0 has the highest
+/// priority. Not thread safe, PriorityNetwork calls it under its lock.
+/// </summary>
+class LaneScheduler
+{
+private:
+	LaneScheduling mScheduling;
+	std::vector<uint32_t> mWeights;
+	std::vector<RingBuffer<std::vector<uint8_t>>> mLanes;  // sized once, never moved
+	size_t mQueued{ 0 };
+	size_t mTurn{ 0 };       // Weighted, the lane whose turn it is
+	uint32_t mCredit{ 0 };   // frames it may still send this turn
+
+public:
+	// one weight per lane, only Weighted uses their values
+	LaneScheduler(LaneScheduling scheduling, const std::vector<uint32_t>& weights);
+
+	size_t Lanes() const { return mLanes.size(); }
+	size_t Size() const { return mQueued; }
+	size_t Size(size_t lane) const { return mLanes[lane].size(); }
+
+	void Push(size_t lane, std::vector<uint8_t>&& frame);
+
+	// false when every lane is empty
+	bool Pop(std::vector<uint8_t>& frame);
+};
+
+/// <summary>
+/// Several reliable streams, each with its own sequence space and window,
+/// sharing one INetwork. Lane(i) is the INetwork a QProducer or QConsumer
+/// for lane i is given, the lane travels in each frame's header.
+/// Frames to the consumer queue per lane and one sender thread drains them
+/// as the scheduler picks, so urgent frames overtake a backlog of bulk ones
+/// and never wait behind a bulk lane's full window or its repairs.
+/// Feedback is small and goes straight out. Incoming frames are sorted
+/// into their lanes by one receiver thread per side, started by the first
+/// lane to use that side so a producer only network is never read as a
+/// consumer.
+/// </summary>
+class PriorityNetwork : public std::enable_shared_from_this<PriorityNetwork>
+{
+private:
+	class LaneNetwork;
+
+	std::shared_ptr<INetwork> mNetwork;
+	size_t mLaneCount;
+
+	std::mutex mMux;
+	std::condition_variable mToSend;
+	LaneScheduler mScheduler;
+	std::mutex mFeedbackMux;  // consumer lanes share the network's one ConsumerEnQ
+	std::vector<uint8_t> mFeedbackFrame;  // stamped feedback, reused under mFeedbackMux
+
+	// pooled copies, as in IdealNetwork
+	std::vector<std::unique_ptr<BlockingQ<std::vector<uint8_t>>>> mData;      // sorted, to consumer lanes
+	std::vector<std::unique_ptr<BlockingQ<std::vector<uint8_t>>>> mFeedback;  // sorted, to producer lanes
+
+	std::atomic<bool> mStop{ false };
+	std::once_flag mProducerStarted;
+	std::once_flag mConsumerStarted;
+	std::thread mSender;
+	std::thread mFeedbackReceiver;
+	std::thread mDataReceiver;
+
+	void StartProducerSide();
+	void StartConsumerSide();
+	void Send();
+	void ReceiveFeedback();
+	void ReceiveData();
+	size_t LaneOf(const std::vector<uint8_t>& frame);
+
+	void ProducerEnQ(size_t lane, const std::vector<uint8_t>& data);
+	bool ProducerDeQ(size_t lane, std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut);
+	void ConsumerEnQ(size_t lane, const std::vector<uint8_t>& data);
+	bool ConsumeDeQ(size_t lane, std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut);
+	size_t ProducerToConsumerSize(size_t lane);
+	size_t ConsumerToProducerSize(size_t lane);
+
+	PriorityNetwork(std::shared_ptr<INetwork> network, LaneScheduling scheduling, const std::vector<uint32_t>& weights);
+
+public:
+	// one lane per weight, lane 0 the most urgent
+	static std::shared_ptr<PriorityNetwork> Create(std::shared_ptr<INetwork> network,
+		LaneScheduling scheduling, const std::vector<uint32_t>& weights);
+	~PriorityNetwork();
+	PriorityNetwork(const PriorityNetwork&) = delete;
+
+	size_t Lanes() const { return mLaneCount; }
+
+	// keeps this PriorityNetwork alive
+	std::shared_ptr<INetwork> Lane(size_t lane);
+};
@@ -1,46 +1,393 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
 #include <future>
+#include <mutex>
+#include <thread>
 #include "QNetwork.h"
+#include "QFec.h"
+#include "QPacer.h"
+#include "QSendLog.h"
+#include "QTrace.h"
+
+struct ProducerConfig
+{
+	// frames sent but not yet acked, must stay below half the sequence space
+	uint32_t mMaxPendingFrames{ 8 };
+	FecConfig mFec;
+	PacingConfig mPacing;
+	WaitConfig mWait;  // how the worker waits for frames to send
+	RepairMode mRepair{ RepairMode::Ack };  // Nack windows are capped at 65535 frames
+	SendLogConfig mLog;  // durable mode, needs Ack repair
+	// agree a session with the consumer before sending, so either end can
+	// restart, needs Ack repair
+	bool mHandshake{ false };
+	// how often an idle Nack stream heartbeats once its newest frame has been
+	// heartbeated a few times
+	std::chrono::milliseconds mKeepalive{ 1000 };
+	// partial reliability, how long after its first send a frame is repaired
+	// before the consumer is told to skip it, 0 repairs until acked. The skip
+	// heartbeat limits the window to 65535 frames
+	std::chrono::milliseconds mTtl{ 0 };
+	// samples where messages spend their time, see MessageTracer
+	std::shared_ptr<MessageTracer> mTracer;
+};
 
 template <class T> class QProducer
 {
 private:
-	uint16_t mTxSequenceNo{ 1 };
+	struct PendingFrame
+	{
+		PendingFrame(Frame<T>&& frame) :mFrame(std::move(frame)), mSentAt(std::chrono::steady_clock::now()), mFirstSentAt(mSentAt) {}
+
+		Frame<T> mFrame;
+		std::chrono::steady_clock::time_point mSentAt;
+		std::chrono::steady_clock::time_point mFirstSentAt;
+		bool mResent{ false }; // ambiguous rtt sample once resent (Karn)
+	};
+
+	SeqNo mTxSequenceNo{ 1 };
 	BlockingQ<T> mProducerQ;
 	std::shared_ptr<INetwork> mTransport;
-	std::future<void> mWorker;
-	bool mStop{ false };
-	std::list<Frame<T>> mPendingFrames;
+	std::thread mWorker;
+	std::atomic<bool> mStop{ false };
+	RingBuffer<PendingFrame> mPendingFrames;
 	std::chrono::time_point<std::chrono::system_clock> mTimePendingFrameLastSent;
-	const uint16_t mMaxPendingFrames = 8;
+	const uint32_t mMaxPendingFrames;
+	std::unique_ptr<FecEncoder> mFecEncoder;
+	std::atomic<size_t> mResentFrames{ 0 };
+	std::atomic<size_t> mMalformedFrames{ 0 };
+	Pacer mPacer;
+	std::atomic<int64_t> mSmoothedRtt_ns{ 0 };
+
+	static constexpr size_t cMaxSendBatch = 64;
+	std::vector<T> mSendBatch = std::vector<T>(cMaxSendBatch);
+
+	const RepairMode mRepair;
+	std::chrono::steady_clock::time_point mLastHeartbeat;
+	const std::chrono::milliseconds mKeepalive;
+	SeqNo mLastHeartbeatSeqNo{ 0 };
+	int mRepeatedHeartbeats{ 0 };
+
+	// with a handshake nothing new is sent until the consumer has welcomed
+	// this session, and again whenever its feedback shows it has lost it
+	const bool mHandshake;
+	uint32_t mSession{ 0 };
+	bool mConnected{ true };
+	bool mResumePending{ false };  // durable mode, the first welcome says where to resume
+	std::chrono::steady_clock::time_point mLastHello;
+
+	const std::chrono::milliseconds mTtl;
+	std::atomic<size_t> mExpiredFrames{ 0 };
+	SeqNo mExpiredUpTo{ 0 };       // newest frame given up on
+	SeqNo mConsumerHas{ 0 };       // newest cumulative ack
+	bool mPeerLimited{ false };    // the consumer advertises a window
+	SeqNo mSendLimit{ 0 };         // newest frame it will take, when it does
+	std::chrono::steady_clock::time_point mLastSkip;
+
+	// durable mode, frames are logged as they are queued and committed
+	// before they are sent
+	std::unique_ptr<SendLog> mSendLog;
+	std::mutex mEnQMux;          // keeps tokens, the log, traced numbers and the queue in the same order
+	size_t mRecoveredFrames{ 0 };
+	size_t mResumeSkip{ 0 };     // recovered frames the consumer already holds
+
+	// frames through mProducerQ, and how many of them are acked or given up
+	// on (sent, with Nack repair), which is what a flush waits on
+	std::atomic<uint64_t> mQueuedFrames{ 0 };
+	std::atomic<uint64_t> mSettledFrames{ 0 };
+	std::mutex mFlushMux;
+	std::vector<std::pair<uint64_t, std::function<void(bool)>>> mFlushWaiters;
+	std::atomic<bool> mFlushWaiting{ false };  // spares the worker the lock
+	bool mFlushClosed{ false };                // stopped, nothing more will settle
+
+	// frames leave ToSendQ in order, the Nth queued is sent as mFirstSeqNo + N
+	std::shared_ptr<MessageTracer> mTracer;
+	SeqNo mFirstSeqNo{ 1 };
+	SeqNo mBlockedTraced{ 0 };  // the window full stage is recorded once per frame
+
+	size_t mPathBytes{ 0 };  // the transport's MaxDatagramBytes when last checked
+
+	void Trace(TraceStage stage, SeqNo seqNo)
+	{
+		if (mTracer && mTracer->Sampled(seqNo))
+		{
+			mTracer->Record(stage, seqNo);
+		}
+	}
+
+	// only the sampled numbers in the run are visited
+	void TraceRun(TraceStage stage, SeqNo first, size_t count)
+	{
+		const SeqNo end = first + static_cast<SeqNo>(count);
+		for (SeqNo seqNo = mTracer->NextSampled(first); SeqLess(seqNo, end); seqNo += mTracer->SampleEvery())
+		{
+			mTracer->Record(stage, seqNo);
+		}
+	}
+
+	void Settle(size_t count)
+	{
+		mSettledFrames += count;
+		// sequentially consistent, as WhenFlushed sets the flag then reads the count
+		if (!mFlushWaiting)
+		{
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock(mFlushMux);
+		std::vector<std::function<void(bool)>> flushed;
+		const uint64_t settled = mSettledFrames;
+		for (auto waiter = mFlushWaiters.begin(); waiter != mFlushWaiters.end();)
+		{
+			if (waiter->first <= settled)
+			{
+				flushed.push_back(std::move(waiter->second));
+				waiter = mFlushWaiters.erase(waiter);
+			}
+			else
+			{
+				++waiter;
+			}
+		}
+		mFlushWaiting = !mFlushWaiters.empty();
+		lock.unlock();
+		for (auto& done : flushed)
+		{
+			done(true);
+		}
+	}
+
+	// new frames the consumer's advertised window has room for
+	size_t PeerWindow()
+	{
+		if (!mPeerLimited)
+		{
+			return SIZE_MAX;
+		}
+		const int32_t room = SeqDiff(mSendLimit, mTxSequenceNo) + 1;
+		return room > 0 ? static_cast<size_t>(room) : 0;
+	}
 
 	void ClearPendingFrames(Frame<T>& ackFrame)
 	{
-		auto frame = std::find_if(mPendingFrames.begin(), mPendingFrames.end(), [&](Frame<T>& frame)
-			{return frame.mHeader.mSeqNo == ackFrame.mHeader.mSeqNo; }
-		);
-		if (frame != mPendingFrames.end())
+		// the window rides on the newest ack, an older one may reorder past it
+		if (ackFrame.mHeader.mType == FrameType::Data && !SeqLess(ackFrame.mHeader.mSeqNo, mConsumerHas))
+		{
+			mPeerLimited = ackFrame.mHeader.mWindow != 0;
+			mSendLimit = ackFrame.mHeader.mSeqNo + ackFrame.mHeader.mWindow - 1;
+		}
+		if (SeqLess(mConsumerHas, ackFrame.mHeader.mSeqNo))
 		{
-			Log("Prod - ack %d clearing pending from %d to %d",
+			mConsumerHas = ackFrame.mHeader.mSeqNo;
+		}
+
+		// acks are cumulative and pending frames are consecutive, so the ack
+		// says how many frames to drop from the front
+		const int32_t ackedCount = mPendingFrames.empty() ? 0 :
+			SeqDiff(ackFrame.mHeader.mSeqNo, mPendingFrames.front().mFrame.mHeader.mSeqNo) + 1;
+		if (ackedCount > 0 && static_cast<size_t>(ackedCount) <= mPendingFrames.size())
+		{
+			Log("Prod - ack %u clearing pending from %u to %u",
 				ackFrame.mHeader.mSeqNo,
-				mPendingFrames.begin()->mHeader.mSeqNo,
-				frame->mHeader.mSeqNo);
-			frame++; // erase has a (] range
-			mPendingFrames.erase(mPendingFrames.begin(), frame);
+				mPendingFrames.front().mFrame.mHeader.mSeqNo,
+				ackFrame.mHeader.mSeqNo);
+			// frames acked behind a resent one waited on the gap, not the path
+			const auto acked = mPendingFrames.begin() + ackedCount;
+			if (std::none_of(mPendingFrames.begin(), acked, [](const PendingFrame& frame) {return frame.mResent; }))
+			{
+				mPacer.OnRttSample(std::chrono::steady_clock::now() - (acked - 1)->mSentAt);
+				mSmoothedRtt_ns = mPacer.SmoothedRtt().count();
+			}
+			if (mTracer)
+			{
+				TraceRun(TraceStage::Acked, mPendingFrames.front().mFrame.mHeader.mSeqNo, ackedCount);
+			}
+			mPendingFrames.pop_front(ackedCount);
+			if (mRepair == RepairMode::Ack)
+			{
+				Settle(ackedCount);
+			}
 			mTimePendingFrameLastSent = std::chrono::system_clock::now();
+			if (mSendLog)
+			{
+				mSendLog->Release(ackFrame.mHeader.mSeqNo);
+			}
 
 			if (mPendingFrames.size() > 0)
 			{
-				Log("Prod - next pending frame is %d",
-					mPendingFrames.begin()->mHeader.mSeqNo);
+				Log("Prod - next pending frame is %u",
+					mPendingFrames.begin()->mFrame.mHeader.mSeqNo);
 			}
 		}
 		else
 		{
-			Log("Prod - ack %d is old", ackFrame.mHeader.mSeqNo);
+			Log("Prod - ack %u is old", ackFrame.mHeader.mSeqNo);
 		}
 	}
 
+	// several consumers usually miss the same frame, one repair serves them all
+	void RepairFrames(const Frame<T>& nackFrame)
+	{
+		constexpr std::chrono::milliseconds repairHoldoff(10);
+		const auto now = std::chrono::steady_clock::now();
+		for (uint16_t i = 0; i < nackFrame.mHeader.mRange && !mPendingFrames.empty(); ++i)
+		{
+			const SeqNo seqNo = nackFrame.mHeader.mSeqNo + i;
+			const int32_t index = SeqDiff(seqNo, mPendingFrames.front().mFrame.mHeader.mSeqNo);
+			if (index < 0)
+			{
+				continue; // already dropped, the heartbeat tells the consumer to move on
+			}
+			if (static_cast<size_t>(index) >= mPendingFrames.size())
+			{
+				break;
+			}
+
+			auto& pending = mPendingFrames[index];
+			if (pending.mResent && now - pending.mSentAt < repairHoldoff)
+			{
+				continue;
+			}
+			Log("Prod - repairing frame %u", seqNo);
+			Trace(TraceStage::Resent, seqNo);
+			mTransport->ProducerEnQ(pending.mFrame.mBytes);
+			pending.mResent = true;
+			pending.mSentAt = now;
+			mPacer.OnSend();
+			++mResentFrames;
+		}
+	}
+
+	Header NewHeader(SeqNo seqNo) const
+	{
+		Header header(seqNo);
+		header.mSession = mSession;
+		return header;
+	}
+
+	void SendHelloIfNeeded()
+	{
+		constexpr std::chrono::milliseconds helloInterval(100);
+		const auto now = std::chrono::steady_clock::now();
+		if (now - mLastHello < helloInterval)
+		{
+			return;
+		}
+
+		// start after the oldest frame the consumer may not have
+		Header hello = NewHeader((mPendingFrames.empty() ? mTxSequenceNo : mPendingFrames.front().mFrame.mHeader.mSeqNo) - 1);
+		hello.mType = FrameType::Hello;
+		hello.mRange = mSendLog ? 1 : 0;
+		Log("Prod - hello for session %u after %u", mSession, hello.mSeqNo);
+		mTransport->ProducerEnQ(Frame<T>(hello).mBytes);
+		mLastHello = now;
+	}
+
+	void OnWelcome(Frame<T>& welcomeFrame)
+	{
+		if (welcomeFrame.mHeader.mSession != mSession || mConnected)
+		{
+			return; // an earlier session's, or a repeat
+		}
+		Log("Prod - session %u joined, consumer has %u", mSession, welcomeFrame.mHeader.mSeqNo);
+		mConnected = true;
+		if (mResumePending)
+		{
+			mResumePending = false;
+			ResumeAfter(welcomeFrame.mHeader.mSeqNo);
+		}
+		else
+		{
+			ClearPendingFrames(welcomeFrame);
+		}
+
+		// the consumer dropped whatever arrived while it did not know the session
+		const auto now = std::chrono::steady_clock::now();
+		for (auto& pending : mPendingFrames)
+		{
+			Trace(TraceStage::Resent, pending.mFrame.mHeader.mSeqNo);
+			mTransport->ProducerEnQ(pending.mFrame.mBytes);
+			pending.mResent = true;
+			pending.mSentAt = now;
+			mPacer.OnSend();
+			++mResentFrames;
+		}
+		mTimePendingFrameLastSent = std::chrono::system_clock::now();
+	}
+
+	void OnFeedback(Frame<T>& feedbackFrame)
+	{
+		if (mHandshake)
+		{
+			if (feedbackFrame.mHeader.mType == FrameType::Welcome)
+			{
+				OnWelcome(feedbackFrame);
+				return;
+			}
+			if (feedbackFrame.mHeader.mSession != mSession)
+			{
+				if (mConnected)
+				{
+					Log("Prod - consumer is on session %u not %u, saying hello again", feedbackFrame.mHeader.mSession, mSession);
+					mConnected = false;
+					mLastHello = std::chrono::steady_clock::time_point();
+				}
+				return;
+			}
+			if (!mConnected)
+			{
+				return;
+			}
+		}
+
+		if (feedbackFrame.mHeader.mType == FrameType::Nack)
+		{
+			RepairFrames(feedbackFrame);
+		}
+		else
+		{
+			ClearPendingFrames(feedbackFrame);
+		}
+	}
+
+	std::chrono::duration<int, std::milli> SendHeartbeatIfNeeded()
+	{
+		constexpr int idleHeartbeats = 3;
+		const std::chrono::duration<int, std::milli> maxWait(100);
+		if (mPendingFrames.empty())
+		{
+			return maxWait;
+		}
+
+		// once every consumer has had a few chances to see the newest frame
+		// the stream is idle, and only needs keeping alive
+		const SeqNo newest = mPendingFrames.back().mFrame.mHeader.mSeqNo;
+		std::chrono::duration<int, std::milli> heartbeatFrequency(100);
+		if (newest == mLastHeartbeatSeqNo && mRepeatedHeartbeats >= idleHeartbeats)
+		{
+			heartbeatFrequency = std::chrono::duration_cast<std::chrono::duration<int, std::milli>>(mKeepalive);
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		auto timeSinceHeartbeat = std::chrono::duration_cast<std::chrono::milliseconds>(now - mLastHeartbeat);
+		if (timeSinceHeartbeat < heartbeatFrequency)
+		{
+			// the caller also waits on new frames and mStop with this
+			return (std::min)(maxWait, std::chrono::duration_cast<std::chrono::duration<int, std::milli>>(heartbeatFrequency - timeSinceHeartbeat));
+		}
+
+		mRepeatedHeartbeats = newest == mLastHeartbeatSeqNo ? mRepeatedHeartbeats + 1 : 1;
+		mLastHeartbeatSeqNo = newest;
+		Header heartbeat = NewHeader(newest);
+		heartbeat.mType = FrameType::Heartbeat;
+		heartbeat.mRange = static_cast<uint16_t>(mPendingFrames.size());
+		Log("Prod - heartbeat at %u, %u repairable", heartbeat.mSeqNo, heartbeat.mRange);
+		mTransport->ProducerEnQ(Frame<T>(heartbeat).mBytes);
+		mLastHeartbeat = now;
+		return maxWait;
+	}
+
 	std::chrono::duration<int, std::milli> ResendPendingFrameIfNeeded()
 	{
 		std::chrono::duration<int, std::milli> resendFrequency(100);
@@ -52,10 +399,14 @@ private:
 			auto timeSinceResend = std::chrono::duration_cast<std::chrono::milliseconds>(now - mTimePendingFrameLastSent);
 			if (timeSinceResend >= resendFrequency)
 			{
-				Log("Prod - resending frame %d",
-					mPendingFrames.front().mHeader.mSeqNo);
-				mTransport->ProducerEnQ(mPendingFrames.front().mBytes);
+				Log("Prod - resending frame %u",
+					mPendingFrames.front().mFrame.mHeader.mSeqNo);
+				Trace(TraceStage::Resent, mPendingFrames.front().mFrame.mHeader.mSeqNo);
+				mTransport->ProducerEnQ(mPendingFrames.front().mFrame.mBytes);
+				mPendingFrames.front().mResent = true;
+				mPacer.OnSend();
 				mTimePendingFrameLastSent = now;
+				++mResentFrames;
 			}
 			else
 			{
@@ -66,61 +417,457 @@ private:
 		return timeTillNextSend;
 	}
 
+	/// <summary>
+	/// Gives up on frames first sent longer than the TTL ago and tells the
+	/// consumer to skip them, with a heartbeat saying what is still repairable.
+	/// In Ack mode the heartbeat is repeated while acks show it has not got
+	/// through.
+	/// Returns how long until the next frame expires.
+	/// </summary>
+	std::chrono::duration<int, std::milli> ExpireFrames()
+	{
+		constexpr std::chrono::milliseconds skipInterval(100);
+		const std::chrono::duration<int, std::milli> maxWait(100);
+		const auto now = std::chrono::steady_clock::now();
+		bool expired = false;
+		while (!mPendingFrames.empty() && now - mPendingFrames.front().mFirstSentAt >= mTtl)
+		{
+			mExpiredUpTo = mPendingFrames.front().mFrame.mHeader.mSeqNo;
+			Log("Prod - frame %u expired", mExpiredUpTo);
+			Trace(TraceStage::Expired, mExpiredUpTo);
+			mPendingFrames.pop_front();
+			++mExpiredFrames;
+			expired = true;
+			if (mRepair == RepairMode::Ack)
+			{
+				Settle(1);
+			}
+		}
+
+		// Nack heartbeats already repeat what is repairable
+		const bool skipLost = mRepair == RepairMode::Ack && SeqLess(mConsumerHas, mExpiredUpTo) && now - mLastSkip >= skipInterval;
+		if (expired || skipLost)
+		{
+			Header skip = NewHeader(mTxSequenceNo - 1);
+			skip.mType = FrameType::Heartbeat;
+			skip.mRange = static_cast<uint16_t>((std::min<size_t>)(mPendingFrames.size(), UINT16_MAX));
+			Log("Prod - consumer to skip to %u", mExpiredUpTo);
+			mTransport->ProducerEnQ(Frame<T>(skip).mBytes);
+			mPacer.OnSend();
+			mLastSkip = now;
+			mTimePendingFrameLastSent = std::chrono::system_clock::now();
+		}
+
+		if (mPendingFrames.empty())
+		{
+			return maxWait;
+		}
+		const auto untilExpiry = std::chrono::duration_cast<std::chrono::duration<int, std::milli>>(
+			mPendingFrames.front().mFirstSentAt + mTtl - now) + std::chrono::duration<int, std::milli>(1);
+		return (std::min)(maxWait, untilExpiry);
+	}
+
+	void SendParityIfGroupComplete(const Frame<T>& frame)
+	{
+		if (!mFecEncoder || !mFecEncoder->Add(frame.mHeader.mSeqNo, &frame.mBytes[sizeof(Header)]))
+		{
+			return;
+		}
+
+		for (uint8_t p = 0; p < mFecEncoder->ParityFrames(); ++p)
+		{
+			T parityBody;
+			memcpy(&parityBody, mFecEncoder->Parity(p), sizeof(parityBody));
+			Header header = mFecEncoder->ParityHeader(p);
+			header.mSession = mSession;
+			Frame<T> parity(header, parityBody);
+			Log("Prod - sending parity %d for group from %u", p, parity.mHeader.mSeqNo);
+			mTransport->ProducerEnQ(parity.mBytes);
+			mPacer.OnSend();
+		}
+	}
+
+
+	// feedback is only parsed when it is the length its header says
+	bool Malformed(const std::vector<uint8_t>& data)
+	{
+		if (Frame<T>::Fits(data))
+		{
+			return false;
+		}
+		Log("Prod - dropping malformed %zu byte feedback frame", data.size());
+		++mMalformedFrames;
+		return true;
+	}
+
+	/// <summary>
+	/// In durable mode nothing is sent until an ack says where the consumer
+	/// picks up. Recovered frames up to it are skipped. A bare header asks
+	/// for that ack now and then, as networks that only answer a peer they
+	/// have heard from would drop the one a consumer sends as it starts.
+	/// </summary>
+	void WaitForResumePoint()
+	{
+		constexpr std::chrono::milliseconds askInterval(100);
+		std::chrono::duration<int, std::milli> timeOut(100);
+		auto lastAsked = std::chrono::steady_clock::now() - askInterval;
+		while (!mStop)
+		{
+			// frames queued meanwhile still reach the disk a group at a time
+			mSendLog->Commit();
+			const auto now = std::chrono::steady_clock::now();
+			if (now - lastAsked >= askInterval)
+			{
+				Log("Prod - asking the consumer where to resume");
+				mTransport->ProducerEnQ(Frame<T>(NewHeader(mTxSequenceNo - 1)).mBytes);
+				lastAsked = now;
+			}
+			std::vector<uint8_t> ackData;
+			if (!mTransport->ProducerDeQ(ackData, timeOut) || Malformed(ackData))
+			{
+				continue;
+			}
+			Frame<T> ackFrame(ackData);
+			if (ackFrame.mHeader.mType == FrameType::Data)
+			{
+				ResumeAfter(ackFrame.mHeader.mSeqNo);
+				return;
+			}
+		}
+	}
+
+	// recovered frames up to resumeAfter are skipped
+	void ResumeAfter(SeqNo resumeAfter)
+	{
+		const int32_t held = SeqDiff(resumeAfter + 1, mTxSequenceNo);
+		if (held < 0)
+		{
+			Log("Prod - consumer at %u is missing frames the log no longer holds, resuming from %u", resumeAfter, mTxSequenceNo);
+		}
+		else if (static_cast<size_t>(held) > mRecoveredFrames)
+		{
+			Log("Prod - consumer at %u is ahead of the log at %u", resumeAfter, mTxSequenceNo + mRecoveredFrames - 1);
+		}
+		mResumeSkip = (std::min)(static_cast<size_t>((std::max)(held, 0)), mRecoveredFrames);
+		Log("Prod - consumer resumes after %u, skipping %zu recovered frames", resumeAfter, mResumeSkip);
+		mSendLog->Release(resumeAfter);
+	}
+
+	// frames are all one size, so once the path is too small for them every
+	// one is fragmented, and losing any fragment loses the frame
+	void CheckFramesFitPath()
+	{
+		const size_t pathBytes = mTransport->MaxDatagramBytes();
+		if (pathBytes == mPathBytes)
+		{
+			return;
+		}
+		mPathBytes = pathBytes;
+		if (pathBytes != 0 && sizeof(Header) + sizeof(T) > pathBytes)
+		{
+			Log("Prod - %zu byte frames do not fit the %zu byte datagrams the path carries, they will be fragmented", sizeof(Header) + sizeof(T), pathBytes);
+		}
+	}
 
 	void Work()
 	{
+		mTransport->ConfigureProducerThread();
+		if (mSendLog && !mHandshake)
+		{
+			WaitForResumePoint();
+		}
 		//std::chrono::duration<int, std::milli> deQDataTimeOut(100);
 		std::chrono::duration<int, std::milli> deQAckTimeOut(0);
+		std::vector<uint8_t> ackData; // reused, networks hand back its buffer on the next DeQ
 		while (!mStop)
 		{
-			auto timeTillNextResend = ResendPendingFrameIfNeeded();
-			if (mPendingFrames.size() >= mMaxPendingFrames)
+			CheckFramesFitPath();
+			if (!mConnected)
 			{
-				Log("Prod - Pending q full, sleeping %dms", timeTillNextResend.count());
-				std::this_thread::sleep_for(timeTillNextResend);
+				SendHelloIfNeeded();
+				std::chrono::duration<int, std::milli> helloTimeOut(10);
+				if (mTransport->ProducerDeQ(ackData, helloTimeOut) && !Malformed(ackData))
+				{
+					Frame<T> feedbackFrame(ackData);
+					OnFeedback(feedbackFrame);
+				}
+				continue;
+			}
+
+			auto timeTillNextResend = mRepair == RepairMode::Ack ? ResendPendingFrameIfNeeded() : SendHeartbeatIfNeeded();
+			if (mTtl.count() != 0)
+			{
+				timeTillNextResend = (std::min)(timeTillNextResend, ExpireFrames());
+			}
+			auto paceDelay = mPacer.Delay();
+			const bool peerFull = mRepair == RepairMode::Ack && PeerWindow() == 0;
+			if (mRepair == RepairMode::Ack && (mPendingFrames.size() >= mMaxPendingFrames || peerFull))
+			{
+				// wait on the acks rather than sleeping, so the window reopens
+				// (and the rtt sample is taken) as soon as one arrives
+				Log("Prod - %s full, waiting up to %dms for an ack", peerFull ? "consumer window" : "Pending q",
+					timeTillNextResend.count());
+				if (mSendLog)
+				{
+					mSendLog->Commit(); // what is queued behind the window is not held back from the disk
+				}
+				if (mTracer && mBlockedTraced != mTxSequenceNo && mProducerQ.Size() != 0)
+				{
+					mBlockedTraced = mTxSequenceNo;
+					Trace(TraceStage::WindowBlocked, mTxSequenceNo);
+				}
+				if (mTransport->ProducerDeQ(ackData, timeTillNextResend) && !Malformed(ackData))
+				{
+					Frame<T> ackFrame(ackData);
+					OnFeedback(ackFrame);
+				}
+			}
+			else if (paceDelay.count() > 0)
+			{
+				Pacer::Wait(std::min<std::chrono::nanoseconds>(paceDelay, timeTillNextResend));
 			}
 			else
 			{
-				T data;
-				bool hasData = mProducerQ.DeQ(data, timeTillNextResend);
-				if (hasData)
+				// take as much as the window allows in one go, a paced sender
+				// may only send one frame per token
+				size_t batch = cMaxSendBatch;
+				if (mRepair == RepairMode::Ack)
 				{
-					Frame<T> frame(Header(mTxSequenceNo++), data);
-					Log("Prod - sending new frame %d", frame.mHeader.mSeqNo);
+					batch = (std::min)({ mMaxPendingFrames - mPendingFrames.size(), cMaxSendBatch, PeerWindow() });
+				}
+				if (mPacer.FramesPerSec() != 0)
+				{
+					batch = 1;
+				}
+				const size_t count = mProducerQ.DeQ(&mSendBatch[0], batch, timeTillNextResend);
+				if (count && mSendLog)
+				{
+					mSendLog->Commit(); // one flush for everything queued so far
+				}
+				for (size_t i = 0; i < count; ++i)
+				{
+					if (mResumeSkip > 0)
+					{
+						--mResumeSkip;
+						Log("Prod - consumer already holds %u", mTxSequenceNo++);
+						Settle(1);
+						continue;
+					}
+					Frame<T> frame(NewHeader(mTxSequenceNo++), mSendBatch[i]);
+					Log("Prod - sending new frame %u", frame.mHeader.mSeqNo);
+					// before the send, which the consumer may see first
+					Trace(TraceStage::Sent, frame.mHeader.mSeqNo);
 					mTransport->ProducerEnQ(frame.mBytes);
-					mPendingFrames.emplace_back(frame);
-					Log("Prod - pending q frames %d to %d", 
-						mPendingFrames.front().mHeader.mSeqNo,
-						mPendingFrames.back().mHeader.mSeqNo);
+					mPacer.OnSend();
+					SendParityIfGroupComplete(frame);
+					mPendingFrames.emplace_back(std::move(frame));
+					if (mPendingFrames.size() > mMaxPendingFrames)
+					{
+						mPendingFrames.pop_front(); // Nack repair buffer is full
+					}
+				}
+				if (mRepair == RepairMode::Nack)
+				{
+					Settle(count);
+				}
+				if (!mPendingFrames.empty())
+				{
+					Log("Prod - pending q frames %u to %u", 
+						mPendingFrames.front().mFrame.mHeader.mSeqNo,
+						mPendingFrames.back().mFrame.mHeader.mSeqNo);
 				}
 			}
 
-			std::vector<uint8_t> ackData;
 			while (mTransport->ProducerDeQ(ackData, deQAckTimeOut))
 			{
+				if (Malformed(ackData))
+				{
+					continue;
+				}
 				Frame<T> ackFrame(ackData);
-				ClearPendingFrames(ackFrame);
+				OnFeedback(ackFrame);
 			}
 		}
 	}
 public:
-	QProducer(std::shared_ptr<INetwork>& transport) :mProducerQ("ToSendQ"), mTransport(transport)
+	QProducer(std::shared_ptr<INetwork>& transport, const ProducerConfig& config = ProducerConfig()) :
+		mProducerQ("ToSendQ", config.mWait), mTransport(transport), mMaxPendingFrames(config.mMaxPendingFrames),
+		mPacer(config.mPacing, config.mMaxPendingFrames), mRepair(config.mRepair), mKeepalive(config.mKeepalive),
+		mHandshake(config.mHandshake), mTtl(config.mTtl), mTracer(config.mTracer)
 	{
+		if (mMaxPendingFrames == 0 || mMaxPendingFrames > static_cast<uint32_t>(INT32_MAX))
+		{
+			Log("QProducer - window of %u frames is outside the sequence space", mMaxPendingFrames);
+			exit(1);
+		}
+		if (mRepair == RepairMode::Nack && mMaxPendingFrames > UINT16_MAX)
+		{
+			Log("QProducer - repair window of %u frames does not fit a heartbeat", mMaxPendingFrames);
+			exit(1);
+		}
+		if (mTtl.count() != 0 && mMaxPendingFrames > UINT16_MAX)
+		{
+			Log("QProducer - a TTL needs a window of at most %u frames to fit the skip heartbeat, not %u",
+				static_cast<uint32_t>(UINT16_MAX), mMaxPendingFrames);
+			exit(1);
+		}
+		if (config.mFec.Enabled())
+		{
+			mFecEncoder = std::make_unique<FecEncoder>(config.mFec, sizeof(T));
+		}
+		if (config.mLog.Enabled())
+		{
+			if (mRepair != RepairMode::Ack)
+			{
+				Log("QProducer - a send log needs acks to know what it may release");
+				exit(1);
+			}
+			if (mTtl.count() != 0)
+			{
+				Log("QProducer - a send log keeps every frame until acked, it cannot expire them");
+				exit(1);
+			}
+			// frames left by the last run go first, under the numbers they were logged with
+			mSendLog = std::make_unique<SendLog>(config.mLog, sizeof(T));
+			auto recovered = mSendLog->Open();
+			mTxSequenceNo = recovered.empty() ? mSendLog->NextSeqNo() : recovered.front().first;
+			mRecoveredFrames = recovered.size();
+			for (auto& body : recovered)
+			{
+				T data;
+				memcpy(&data, &body.second[0], sizeof(data));
+				mProducerQ.EnQ(data);
+			}
+			mQueuedFrames = mRecoveredFrames;
+		}
+		if (mHandshake)
+		{
+			if (mRepair != RepairMode::Ack)
+			{
+				Log("QProducer - a handshake needs the one consumer Ack repair talks to");
+				exit(1);
+			}
+			mSession = NewSessionId();
+			mConnected = false;
+			mResumePending = mSendLog != nullptr;
+		}
+		mFirstSeqNo = mTxSequenceNo;
 		mTimePendingFrameLastSent = std::chrono::system_clock::now();
-		mWorker = std::async(std::launch::async, [&]() {Work(); });
+		mWorker = std::thread([this]() { Work(); });
 	}
 
-	uint16_t MaxPendingFrames() { return mMaxPendingFrames; }
+	uint32_t MaxPendingFrames() { return mMaxPendingFrames; }
+
+	size_t ResentFrames() { return mResentFrames; }
+
+	// feedback frames dropped for not being the length their header says
+	size_t MalformedFrames() { return mMalformedFrames; }
 
+	// frames given up on once they outlived the TTL
+	size_t ExpiredFrames() { return mExpiredFrames; }
+
+	std::chrono::nanoseconds SmoothedRtt() { return std::chrono::nanoseconds(mSmoothedRtt_ns); }
+
+	/// <summary>
+	/// Stops the worker, frames not yet acked are dropped. Flush first to
+	/// wait for them. WhenFlushed callbacks still waiting are called with
+	/// false, and so is any made later.
+	/// </summary>
 	void Stop()
 	{
 		mStop = true;
-		mWorker.get();
+		mWorker.join();
+		std::unique_lock<std::mutex> lock(mFlushMux);
+		auto waiting = std::move(mFlushWaiters);
+		mFlushWaiters.clear();
+		mFlushWaiting = false;
+		mFlushClosed = true;
+		lock.unlock();
+		for (auto& waiter : waiting)
+		{
+			waiter.second(false);
+		}
+	}
+
+	uint64_t EnQ(const T& data)
+	{
+		return EnQ(&data, 1);
+	}
+
+	/// <summary>
+	/// Returns a token for these frames, the count of frames queued up to and
+	/// including them. They have all settled once SettledFrames reaches it,
+	/// pass it to WhenSettled or WhenFlushed to be told.
+	/// In durable mode the frames are logged but not yet on disk when this returns.
+	/// </summary>
+	uint64_t EnQ(const T* data, size_t count)
+	{
+		std::lock_guard<std::mutex> lock(mEnQMux);
+		for (size_t i = 0; mSendLog && i < count; ++i)
+		{
+			mSendLog->Append(&data[i]);
+		}
+		if (mTracer)
+		{
+			TraceRun(TraceStage::Queued, mFirstSeqNo + static_cast<SeqNo>(mQueuedFrames), count);
+		}
+		const uint64_t token = mQueuedFrames += count;
+		mProducerQ.EnQ(data, count);
+		return token;
+	}
+
+	// frames queued so far, recovered ones included
+	uint64_t QueuedFrames() { return mQueuedFrames; }
+
+	// frames acked or given up on, or with Nack repair sent
+	uint64_t SettledFrames() { return mSettledFrames; }
+
+	/// <summary>
+	/// done(true) is called once queuedFrames frames have settled: straight
+	/// away if they have, otherwise on the worker as the ack for the last of
+	/// them arrives. done(false) if the producer stops first. Pass
+	/// QueuedFrames() to wait for everything queued so far.
+	/// </summary>
+	void WhenFlushed(uint64_t queuedFrames, std::function<void(bool)> done)
+	{
+		std::unique_lock<std::mutex> lock(mFlushMux);
+		if (mSettledFrames < queuedFrames && !mFlushClosed)
+		{
+			mFlushWaiters.emplace_back(queuedFrames, std::move(done));
+			mFlushWaiting = true;
+			// the worker may have settled them before it could see the waiter
+			if (mSettledFrames < queuedFrames)
+			{
+				return;
+			}
+			done = std::move(mFlushWaiters.back().second);
+			mFlushWaiters.pop_back();
+			mFlushWaiting = !mFlushWaiters.empty();
+		}
+		lock.unlock();
+		done(mSettledFrames >= queuedFrames);
+	}
+
+	// ready once the frames up to token have settled, true, or Stop gave up on them, false
+	std::future<bool> WhenSettled(uint64_t token)
+	{
+		auto settled = std::make_shared<std::promise<bool>>();
+		auto future = settled->get_future();
+		WhenFlushed(token, [settled](bool flushed) { settled->set_value(flushed); });
+		return future;
 	}
 
-	void EnQ(const T& data)
+	// waits up to timeOut for every frame queued so far to settle, false if
+	// they have not or Stop discarded them
+	bool Flush(std::chrono::duration<int, std::milli> timeOut)
 	{
-		mProducerQ.EnQ(data);
+		const uint64_t token = QueuedFrames();
+		if (mSettledFrames >= token)
+		{
+			return true;
+		}
+		auto settled = WhenSettled(token);
+		return settled.wait_for(timeOut) == std::future_status::ready && settled.get();
 	}
 
 	size_t Size()
@@ -0,0 +1,146 @@
+#pragma once
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <utility>
+
+/// <summary>
+/// FIFO over a power of two array that doubles when full and never shrinks,
+/// so a queue that has reached its working size stops allocating. Stands in
+/// for std::deque and std::list, which allocate a block or node per handful
+/// of elements (per element with MSVC's deque) as they churn, and keeps
+/// their member names so it drops into the same code.
+/// </summary>
+template <class T> class RingBuffer
+{
+private:
+	std::allocator<T> mAllocator;
+	T* mSlots{ nullptr };
+	size_t mCapacity{ 0 };  // 0 or a power of two
+	size_t mHead{ 0 };
+	size_t mSize{ 0 };
+
+	T* Slot(size_t index) const { return mSlots + ((mHead + index) & (mCapacity - 1)); }
+
+	void Grow()
+	{
+		const size_t capacity = mCapacity ? mCapacity * 2 : 16;
+		T* slots = mAllocator.allocate(capacity);
+		for (size_t i = 0; i < mSize; ++i)
+		{
+			T* from = Slot(i);
+			new (slots + i) T(std::move(*from));
+			from->~T();
+		}
+		if (mSlots)
+		{
+			mAllocator.deallocate(mSlots, mCapacity);
+		}
+		mSlots = slots;
+		mCapacity = capacity;
+		mHead = 0;
+	}
+
+public:
+	template <class Ring, class Value> class Iterator
+	{
+	private:
+		Ring* mRing;
+		size_t mIndex;
+
+	public:
+		using iterator_category = std::random_access_iterator_tag;
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+		using pointer = Value*;
+		using reference = Value&;
+
+		Iterator(Ring* ring, size_t index) :mRing(ring), mIndex(index) {}
+
+		Value& operator*() const { return (*mRing)[mIndex]; }
+		Value* operator->() const { return &(*mRing)[mIndex]; }
+		Value& operator[](difference_type n) const { return (*mRing)[mIndex + n]; }
+		Iterator& operator++() { ++mIndex; return *this; }
+		Iterator operator++(int) { Iterator was = *this; ++mIndex; return was; }
+		Iterator& operator--() { --mIndex; return *this; }
+		Iterator operator--(int) { Iterator was = *this; --mIndex; return was; }
+		Iterator& operator+=(difference_type n) { mIndex += n; return *this; }
+		Iterator& operator-=(difference_type n) { mIndex -= n; return *this; }
+		Iterator operator+(difference_type n) const { return Iterator(mRing, mIndex + n); }
+		Iterator operator-(difference_type n) const { return Iterator(mRing, mIndex - n); }
+		difference_type operator-(const Iterator& other) const { return static_cast<difference_type>(mIndex - other.mIndex); }
+		bool operator==(const Iterator& other) const { return mIndex == other.mIndex; }
+		bool operator!=(const Iterator& other) const { return mIndex != other.mIndex; }
+		bool operator<(const Iterator& other) const { return mIndex < other.mIndex; }
+		bool operator>(const Iterator& other) const { return mIndex > other.mIndex; }
+		bool operator<=(const Iterator& other) const { return mIndex <= other.mIndex; }
+		bool operator>=(const Iterator& other) const { return mIndex >= other.mIndex; }
+	};
+	using iterator = Iterator<RingBuffer, T>;
+	using const_iterator = Iterator<const RingBuffer, const T>;
+
+	RingBuffer() {}
+	RingBuffer(const RingBuffer&) = delete;
+	RingBuffer& operator=(const RingBuffer&) = delete;
+
+	~RingBuffer()
+	{
+		clear();
+		if (mSlots)
+		{
+			mAllocator.deallocate(mSlots, mCapacity);
+		}
+	}
+
+	size_t size() const { return mSize; }
+	bool empty() const { return mSize == 0; }
+
+	T& operator[](size_t index) { return *Slot(index); }
+	const T& operator[](size_t index) const { return *Slot(index); }
+	T& front() { return *Slot(0); }
+	const T& front() const { return *Slot(0); }
+	T& back() { return *Slot(mSize - 1); }
+	const T& back() const { return *Slot(mSize - 1); }
+
+	iterator begin() { return iterator(this, 0); }
+	iterator end() { return iterator(this, mSize); }
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, mSize); }
+
+	template <typename... Args> T& emplace_back(Args&&... args)
+	{
+		if (mSize == mCapacity)
+		{
+			Grow();
+		}
+		T* slot = Slot(mSize);
+		new (slot) T(std::forward<Args>(args)...);
+		++mSize;
+		return *slot;
+	}
+
+	void push_back(const T& value) { emplace_back(value); }
+	void push_back(T&& value) { emplace_back(std::move(value)); }
+
+	void pop_front()
+	{
+		Slot(0)->~T();
+		mHead = (mHead + 1) & (mCapacity - 1);
+		--mSize;
+	}
+
+	void pop_front(size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			pop_front();
+		}
+	}
+
+	void clear()
+	{
+		pop_front(mSize);
+		mHead = 0;
+	}
+};
@@ -0,0 +1,302 @@
+#include "pch.h"
+#include "QSendLog.h"
+#include <algorithm>
+
+namespace
+{
+	constexpr uint32_t cSegmentMagic = 0x474c5551;     // "QULG"
+	constexpr uint32_t cCheckpointMagic = 0x50435551;  // "QUCP"
+
+	struct SegmentHeader
+	{
+		uint32_t mMagic;
+		uint32_t mBodySize;
+		uint32_t mFrames;
+		SeqNo mFirstSeqNo;
+	};
+
+	struct RecordHeader
+	{
+		SeqNo mSeqNo;
+		uint32_t mChecksum;
+	};
+
+	struct CheckpointRecord
+	{
+		uint32_t mMagic;
+		SeqNo mSeqNo;
+	};
+
+	// FNV-1a, enough to tell a record torn by a crash from a whole one
+	uint32_t Checksum(SeqNo seqNo, const uint8_t* body, size_t size)
+	{
+		uint32_t hash = 2166136261u;
+		auto add = [&hash](uint8_t byte)
+		{
+			hash ^= byte;
+			hash *= 16777619u;
+		};
+		for (int shift = 0; shift < 32; shift += 8)
+		{
+			add(static_cast<uint8_t>(seqNo >> shift));
+		}
+		for (size_t i = 0; i < size; ++i)
+		{
+			add(body[i]);
+		}
+		return hash;
+	}
+}
+
+MappedFile::MappedFile(const std::string& path, size_t size)
+{
+	mFile = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (mFile == INVALID_HANDLE_VALUE)
+	{
+		Log("MappedFile - failed to open %s, error %lu", path.c_str(), GetLastError());
+		exit(1);
+	}
+
+	if (size == 0)
+	{
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(mFile, &fileSize) || fileSize.QuadPart == 0)
+		{
+			Log("MappedFile - %s is empty", path.c_str());
+			exit(1);
+		}
+		size = static_cast<size_t>(fileSize.QuadPart);
+	}
+
+	// a mapping larger than the file grows the file
+	const uint64_t mappingSize = size;
+	mMapping = CreateFileMappingA(mFile, NULL, PAGE_READWRITE, static_cast<DWORD>(mappingSize >> 32),
+		static_cast<DWORD>(mappingSize & 0xffffffff), NULL);
+	if (mMapping == NULL)
+	{
+		Log("MappedFile - failed to map %s, error %lu", path.c_str(), GetLastError());
+		exit(1);
+	}
+	mView = static_cast<uint8_t*>(MapViewOfFile(mMapping, FILE_MAP_ALL_ACCESS, 0, 0, size));
+	if (mView == nullptr)
+	{
+		Log("MappedFile - failed to view %s, error %lu", path.c_str(), GetLastError());
+		exit(1);
+	}
+	mSize = size;
+}
+
+MappedFile::~MappedFile()
+{
+	UnmapViewOfFile(mView);
+	CloseHandle(mMapping);
+	CloseHandle(mFile);
+}
+
+void MappedFile::Flush(size_t offset, size_t length)
+{
+	// FlushViewOfFile only starts the write back, FlushFileBuffers waits for it
+	if (!FlushViewOfFile(mView + offset, length) || !FlushFileBuffers(mFile))
+	{
+		Log("MappedFile - flush failed, error %lu", GetLastError());
+	}
+}
+
+SendLog::SendLog(const SendLogConfig& config, size_t bodySize) :
+	mConfig(config), mBodySize(bodySize)
+{
+	// keep every record 8 byte aligned
+	mSlotSize = (sizeof(RecordHeader) + mBodySize + 7) & ~size_t(7);
+	if (mConfig.mSegmentFrames == 0)
+	{
+		Log("SendLog - segments must hold at least one frame");
+		exit(1);
+	}
+}
+
+size_t SendLog::SlotOffset(uint32_t slot) const
+{
+	return sizeof(SegmentHeader) + slot * mSlotSize;
+}
+
+std::shared_ptr<SendLog::Segment> SendLog::OpenSegment(const std::string& path, SeqNo firstSeqNo, bool create)
+{
+	auto segment = std::make_shared<Segment>();
+	segment->mPath = path;
+	segment->mFile = std::make_unique<MappedFile>(path, create ? SlotOffset(mConfig.mSegmentFrames) : 0);
+	auto header = reinterpret_cast<SegmentHeader*>(segment->mFile->Data());
+	if (create)
+	{
+		header->mMagic = cSegmentMagic;
+		header->mBodySize = static_cast<uint32_t>(mBodySize);
+		header->mFrames = mConfig.mSegmentFrames;
+		header->mFirstSeqNo = firstSeqNo;
+		segment->mFile->Flush(0, sizeof(SegmentHeader));
+	}
+	else if (segment->mFile->Size() < sizeof(SegmentHeader) || header->mMagic != cSegmentMagic ||
+		header->mBodySize != mBodySize || segment->mFile->Size() < SlotOffset(header->mFrames))
+	{
+		Log("SendLog - %s is not a log of %zu byte frames", path.c_str(), mBodySize);
+		exit(1);
+	}
+	segment->mFirstSeqNo = header->mFirstSeqNo;
+	return segment;
+}
+
+void SendLog::AddSegment()
+{
+	char name[32];
+	sprintf_s(name, sizeof(name), "\\seg-%08x.qlog", mNextSeqNo);
+	mSegments.push_back(OpenSegment(mConfig.mDirectory + name, mNextSeqNo, true));
+}
+
+SendLog::Recovered SendLog::Open()
+{
+	std::lock_guard<std::mutex> lock(mMux);
+	CreateDirectoryA(mConfig.mDirectory.c_str(), NULL);
+
+	WIN32_FIND_DATAA found;
+	HANDLE search = FindFirstFileA((mConfig.mDirectory + "\\seg-*.qlog").c_str(), &found);
+	if (search != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			mSegments.push_back(OpenSegment(mConfig.mDirectory + "\\" + found.cFileName, 0, false));
+		} while (FindNextFileA(search, &found));
+		FindClose(search);
+	}
+	std::sort(mSegments.begin(), mSegments.end(), [](const std::shared_ptr<Segment>& a, const std::shared_ptr<Segment>& b)
+	{
+		return SeqLess(a->mFirstSeqNo, b->mFirstSeqNo);
+	});
+
+	// records are good up to the first torn or missing one, nothing after
+	// it was committed so nothing after it was sent
+	Recovered recovered;
+	size_t keep = 0;
+	if (!mSegments.empty())
+	{
+		mNextSeqNo = mSegments.front()->mFirstSeqNo;
+	}
+	for (; keep < mSegments.size() && mSegments[keep]->mFirstSeqNo == mNextSeqNo; ++keep)
+	{
+		auto& file = *mSegments[keep]->mFile;
+		const auto header = reinterpret_cast<const SegmentHeader*>(file.Data());
+		uint32_t slot = 0;
+		for (; slot < header->mFrames; ++slot)
+		{
+			const auto record = reinterpret_cast<const RecordHeader*>(file.Data() + SlotOffset(slot));
+			const auto body = reinterpret_cast<const uint8_t*>(record + 1);
+			if (record->mSeqNo != mNextSeqNo || record->mChecksum != Checksum(record->mSeqNo, body, mBodySize))
+			{
+				break;
+			}
+			recovered.emplace_back(mNextSeqNo++, std::vector<uint8_t>(body, body + mBodySize));
+		}
+		if (slot == 0)
+		{
+			break; // an empty segment is dropped and started again below
+		}
+	}
+	while (mSegments.size() > keep)
+	{
+		Log("SendLog - dropping %s, it holds nothing after %u", mSegments.back()->mPath.c_str(), mNextSeqNo - 1);
+		const std::string path = mSegments.back()->mPath;
+		mSegments.pop_back();
+		DeleteFileA(path.c_str());
+	}
+
+	Log("SendLog - recovered %zu frames, next is %u", recovered.size(), mNextSeqNo);
+	mCommittedSeqNo = mNextSeqNo;
+	AddSegment();
+	return recovered;
+}
+
+SeqNo SendLog::NextSeqNo()
+{
+	std::lock_guard<std::mutex> lock(mMux);
+	return mNextSeqNo;
+}
+
+SeqNo SendLog::Append(const void* body)
+{
+	std::lock_guard<std::mutex> lock(mMux);
+	uint32_t slot = SeqDiff(mNextSeqNo, mSegments.back()->mFirstSeqNo);
+	if (slot == mConfig.mSegmentFrames)
+	{
+		AddSegment();
+		slot = 0;
+	}
+
+	auto record = reinterpret_cast<RecordHeader*>(mSegments.back()->mFile->Data() + SlotOffset(slot));
+	memcpy(record + 1, body, mBodySize);
+	record->mSeqNo = mNextSeqNo;
+	record->mChecksum = Checksum(mNextSeqNo, reinterpret_cast<const uint8_t*>(record + 1), mBodySize);
+	return mNextSeqNo++;
+}
+
+void SendLog::Commit()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMux);
+		mCommitRanges.clear();
+		for (auto& segment : mSegments)
+		{
+			if (mCommittedSeqNo == mNextSeqNo)
+			{
+				break;
+			}
+			const int32_t from = SeqDiff(mCommittedSeqNo, segment->mFirstSeqNo);
+			if (from < 0 || from >= static_cast<int32_t>(mConfig.mSegmentFrames))
+			{
+				continue;
+			}
+			const int32_t to = (std::min)(SeqDiff(mNextSeqNo, segment->mFirstSeqNo), static_cast<int32_t>(mConfig.mSegmentFrames));
+			mCommitRanges.push_back({ segment->mFile.get(), SlotOffset(from), SlotOffset(to) - SlotOffset(from) });
+			mCommittedSeqNo += to - from;
+		}
+	}
+
+	// appends carry on while the disk catches up, they only write past what
+	// is being flushed and only Release, on this thread, removes segments
+	for (auto& range : mCommitRanges)
+	{
+		range.mFile->Flush(range.mOffset, range.mLength);
+	}
+}
+
+void SendLog::Release(SeqNo acked)
+{
+	std::lock_guard<std::mutex> lock(mMux);
+	while (mSegments.size() > 1 && !SeqLess(acked, mSegments[1]->mFirstSeqNo - 1))
+	{
+		const std::string path = mSegments.front()->mPath;
+		mSegments.pop_front();
+		DeleteFileA(path.c_str());
+		Log("SendLog - released %s", path.c_str());
+	}
+}
+
+SeqNoCheckpoint::SeqNoCheckpoint(const std::string& path) :
+	mFile(path, sizeof(CheckpointRecord))
+{
+}
+
+SeqNo SeqNoCheckpoint::Load()
+{
+	auto record = reinterpret_cast<const CheckpointRecord*>(mFile.Data());
+	return record->mMagic == cCheckpointMagic ? record->mSeqNo : 0;
+}
+
+void SeqNoCheckpoint::Store(SeqNo seqNo)
+{
+	auto record = reinterpret_cast<CheckpointRecord*>(mFile.Data());
+	record->mSeqNo = seqNo;
+	record->mMagic = cCheckpointMagic;
+}
+
+void SeqNoCheckpoint::Flush()
+{
+	mFile.Flush(0, sizeof(CheckpointRecord));
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "QNetwork.h"
+
+/// <summary>
+/// A file mapped read/write in full. Opening an existing file keeps its
+/// contents, a size larger than the file grows it. Failures are fatal.
+/// </summary>
+class MappedFile
+{
+private:
+	HANDLE mFile{ INVALID_HANDLE_VALUE };
+	HANDLE mMapping{ NULL };
+	uint8_t* mView{ nullptr };
+	size_t mSize{ 0 };
+
+public:
+	// size 0 maps the file at its current size
+	MappedFile(const std::string& path, size_t size);
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	uint8_t* Data() { return mView; }
+	size_t Size() const { return mSize; }
+
+	// writes [offset, offset + length) back to the file and waits for the disk
+	void Flush(size_t offset, size_t length);
+};
+
+struct SendLogConfig
+{
+	std::string mDirectory;            // empty keeps the producer in memory only
+	uint32_t mSegmentFrames{ 4096 };   // frames per segment file
+
+	bool Enabled() const { return !mDirectory.empty(); }
+};
+
+/// <summary>
+/// Producer side write ahead log of frame bodies, kept as fixed size records
+/// in memory mapped segment files named after their first sequence number.
+/// Append only copies into the mapping. Commit flushes everything appended
+/// since the last commit in one go, so one disk flush covers a whole batch.
+/// A segment is deleted once every frame in it has been acked, the newest is
+/// always kept so the sequence numbers carry on after a restart.
+/// </summary>
+class SendLog
+{
+public:
+	// sequence number and body of each frame found on open, oldest first
+	using Recovered = std::vector<std::pair<SeqNo, std::vector<uint8_t>>>;
+
+private:
+	struct Segment
+	{
+		SeqNo mFirstSeqNo;
+		std::string mPath;
+		std::unique_ptr<MappedFile> mFile;
+	};
+
+	SendLogConfig mConfig;
+	size_t mBodySize;
+	size_t mSlotSize;
+
+	std::mutex mMux;
+	std::deque<std::shared_ptr<Segment>> mSegments;  // oldest first, appends go to the back
+	SeqNo mNextSeqNo{ 1 };
+	SeqNo mCommittedSeqNo{ 1 };                      // first frame not yet flushed
+
+	struct CommitRange
+	{
+		MappedFile* mFile;
+		size_t mOffset;
+		size_t mLength;
+	};
+	std::vector<CommitRange> mCommitRanges;  // reused by every Commit
+
+	std::shared_ptr<Segment> OpenSegment(const std::string& path, SeqNo firstSeqNo, bool create);
+	void AddSegment();
+	size_t SlotOffset(uint32_t slot) const;
+
+public:
+	SendLog(const SendLogConfig& config, size_t bodySize);
+
+	/// <summary>
+	/// Reads back every intact record left by an earlier run and starts a
+	/// fresh segment after them. Call once, before the first Append.
+	/// </summary>
+	Recovered Open();
+
+	// the sequence number the next Append is given
+	SeqNo NextSeqNo();
+
+	// copies one body into the log, nothing is written to disk until Commit
+	SeqNo Append(const void* body);
+
+	// flushes every record appended since the last commit, Commit and
+	// Release must be called from the same thread
+	void Commit();
+
+	// deletes the segments holding only frames up to and including acked
+	void Release(SeqNo acked);
+};
+
+/// <summary>
+/// Consumer side record of the last frame handed to the application, in a
+/// small memory mapped file. Store is a plain write to the mapping, which
+/// survives the process dying; Flush makes it survive the machine dying too.
+/// </summary>
+class SeqNoCheckpoint
+{
+private:
+	MappedFile mFile;
+
+public:
+	explicit SeqNoCheckpoint(const std::string& path);
+
+	// 0 for a new file
+	SeqNo Load();
+	void Store(SeqNo seqNo);
+	void Flush();
+};
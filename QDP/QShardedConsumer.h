@@ -0,0 +1,167 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <unordered_map>
+#include "QConsumer.h"
+
+struct ShardedConsumerConfig
+{
+	int mBasePort{ 31430 };
+	size_t mShards{ 2 };        // shard i receives on mBasePort + i
+	int mFirstCpu{ -1 };        // pins shard i's worker to cpu mFirstCpu + i, -1 leaves them unpinned
+	UdpNetworkOptions mSocket;  // mProducerCpu and mConsumerCpu are not used
+	ConsumerConfig mConsumer;   // for every flow, which cannot share a checkpoint file
+
+	// the port a producer with this key sends to. Fibonacci hashing spreads
+	// keys that differ only in their low bits, producer ids 0, 1, 2... included
+	int ShardPort(uint32_t flowKey) const
+	{
+		const uint64_t hash = static_cast<uint32_t>(flowKey * 2654435769u);
+		return mBasePort + static_cast<int>((hash * mShards) >> 32);
+	}
+};
+
+/// <summary>
+/// Receives from many producers on one host. Each shard is a socket and a
+/// worker, optionally pinned, that runs the consumers of every flow (a
+/// producer, by its address) arriving on that socket itself, so shards share
+/// no state and take no lock per frame. Winsock cannot spread one port over
+/// sockets as SO_REUSEPORT does, so producers pick a shard's port with
+/// ShardedConsumerConfig::ShardPort. Each flow is read as a QConsumer of its
+/// own, through Flow.
+/// </summary>
+template <class T> class QShardedConsumer
+{
+private:
+	// feedback for one flow goes out of its shard's socket, frames for the
+	// flow are handed to its consumer by the shard worker
+	class FlowNetwork : public INetwork
+	{
+	private:
+		UdpShardSocket& mSocket;
+		uint64_t mFlow;
+
+	public:
+		FlowNetwork(UdpShardSocket& socket, uint64_t flow) :mSocket(socket), mFlow(flow) {}
+
+		void ProducerEnQ(const std::vector<uint8_t>& data) override
+		{
+			Log("QShardedConsumer - a flow has no producer side");
+			exit(1);
+		}
+		bool ProducerDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override
+		{
+			Log("QShardedConsumer - a flow has no producer side");
+			exit(1);
+		}
+		void ConsumerEnQ(const std::vector<uint8_t>& data) override
+		{
+			mSocket.Send(mFlow, data);
+		}
+		bool ConsumeDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override
+		{
+			Log("QShardedConsumer - a flow is fed by its shard worker");
+			exit(1);
+		}
+		size_t ProducerToConsumerSize() override { return 0; }
+		size_t ConsumerToProducerSize() override { return 0; }
+	};
+
+	const ShardedConsumerConfig mConfig;
+	std::vector<std::unique_ptr<UdpShardSocket>> mSockets;
+	std::vector<std::thread> mWorkers;
+	std::atomic<bool> mStop{ false };
+
+	std::mutex mFlowsMux;  // taken when a flow first arrives and when one is looked up
+	std::vector<std::unique_ptr<QConsumer<T>>> mFlows;
+
+	QConsumer<T>& AddFlow(size_t shard, uint64_t flow)
+	{
+		std::shared_ptr<INetwork> network = std::make_shared<FlowNetwork>(*mSockets[shard], flow);
+		std::unique_ptr<QConsumer<T>> consumer(new QConsumer<T>(network, mConfig.mConsumer, typename QConsumer<T>::Driven()));
+
+		std::lock_guard<std::mutex> lock(mFlowsMux);
+		Log("QShardedConsumer - flow %zu on shard %zu", mFlows.size(), shard);
+		mFlows.push_back(std::move(consumer));
+		return *mFlows.back();
+	}
+
+	void Work(size_t shard)
+	{
+		auto& socket = *mSockets[shard];
+		socket.ConfigureThread(mConfig.mFirstCpu < 0 ? -1 : mConfig.mFirstCpu + static_cast<int>(shard));
+
+		// only this worker reaches its flows, so finding one takes no lock
+		std::unordered_map<uint64_t, QConsumer<T>*> flows;
+		std::chrono::duration<int, std::milli> timeOut(100);
+		std::vector<uint8_t> data;
+		auto lastIdle = std::chrono::steady_clock::now();
+		while (!mStop)
+		{
+			uint64_t key;
+			if (socket.Receive(data, key, timeOut))
+			{
+				auto flow = flows.find(key);
+				if (flow == flows.end())
+				{
+					flow = flows.emplace(key, &AddFlow(shard, key)).first;
+				}
+				flow->second->Drive(data, true);
+			}
+
+			// every flow has a turn without data as often as a QConsumer of
+			// its own would, to keep alive and nack
+			const auto now = std::chrono::steady_clock::now();
+			if (now - lastIdle >= timeOut)
+			{
+				for (auto& flow : flows)
+				{
+					flow.second->Drive(data, false);
+				}
+				lastIdle = now;
+			}
+		}
+	}
+
+public:
+	QShardedConsumer(const ShardedConsumerConfig& config = ShardedConsumerConfig()) :mConfig(config)
+	{
+		if (!config.mConsumer.mCheckpointFile.empty())
+		{
+			Log("QShardedConsumer - flows cannot share one checkpoint file");
+			exit(1);
+		}
+		for (size_t shard = 0; shard < config.mShards; ++shard)
+		{
+			mSockets.push_back(std::make_unique<UdpShardSocket>(config.mBasePort + static_cast<int>(shard), config.mSocket));
+		}
+		for (size_t shard = 0; shard < config.mShards; ++shard)
+		{
+			mWorkers.emplace_back([this, shard]() { Work(shard); });
+		}
+	}
+
+	void Stop()
+	{
+		mStop = true;
+		for (auto& worker : mWorkers)
+		{
+			worker.join();
+		}
+	}
+
+	size_t Shards() { return mSockets.size(); }
+
+	// flows seen so far, numbered in the order they first arrived
+	size_t Flows()
+	{
+		std::lock_guard<std::mutex> lock(mFlowsMux);
+		return mFlows.size();
+	}
+
+	QConsumer<T>& Flow(size_t flow)
+	{
+		std::lock_guard<std::mutex> lock(mFlowsMux);
+		return *mFlows[flow];
+	}
+};
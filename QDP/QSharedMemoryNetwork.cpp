@@ -0,0 +1,249 @@
+#include "pch.h"
+#include "QSharedMemoryNetwork.h"
+#include <new>
+
+namespace
+{
+	constexpr uint32_t cSectionMagic = 0x4d535551;  // "QUSM"
+	constexpr uint32_t cWrapMarker = 0xffffffff;     // rest of the ring is unused, carry on from the start
+
+	// records are a 4 byte length and the frame, kept 8 byte aligned so a
+	// length never straddles the end of the ring
+	uint64_t RecordBytes(size_t frameBytes)
+	{
+		return (sizeof(uint32_t) + frameBytes + 7) & ~uint64_t(7);
+	}
+
+	uint32_t RingBytes(uint32_t requested)
+	{
+		return (std::max)(64u, (requested + 7) & ~7u);
+	}
+}
+
+/// <summary>
+/// Ring indices are byte counts that only grow, the writer owns mTail and
+/// the reader mHead, each on its own cache line.
+/// </summary>
+struct SharedMemoryNetwork::Ring
+{
+	alignas(64) std::atomic<uint64_t> mTail;
+	std::atomic<uint64_t> mWrittenFrames;
+	alignas(64) std::atomic<uint64_t> mHead;
+	std::atomic<uint64_t> mReadFrames;
+	alignas(64) std::atomic<uint32_t> mReaderWaiting;
+	uint32_t mCapacity;
+};
+
+namespace
+{
+	struct Section
+	{
+		std::atomic<uint32_t> mMagic;  // set last by whichever end created the section
+		uint32_t mDataRingBytes;
+		uint32_t mAckRingBytes;
+	};
+
+	constexpr size_t cRingsOffset = 64;
+}
+
+SharedMemoryNetwork::SharedMemoryNetwork(const std::string& name, const SharedMemoryOptions& options) :
+	mOptions(options)
+{
+	static_assert(sizeof(Section) <= cRingsOffset, "section header overlaps the rings");
+	mOptions.mDataRingBytes = RingBytes(mOptions.mDataRingBytes);
+	mOptions.mAckRingBytes = RingBytes(mOptions.mAckRingBytes);
+	const size_t ringsBytes = 2 * sizeof(Ring);
+	const uint64_t sectionBytes = cRingsOffset + ringsBytes + mOptions.mDataRingBytes + mOptions.mAckRingBytes;
+
+	// pagefile backed, the section goes away with the last handle to it
+	const std::string sectionName = "Local\\QUDP-" + name;
+	mSection = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, static_cast<DWORD>(sectionBytes >> 32),
+		static_cast<DWORD>(sectionBytes & 0xffffffff), sectionName.c_str());
+	if (mSection == NULL)
+	{
+		Log("SharedMemoryNetwork - failed to create %s, error %lu", sectionName.c_str(), GetLastError());
+		exit(1);
+	}
+	const bool created = GetLastError() != ERROR_ALREADY_EXISTS;
+	mView = static_cast<uint8_t*>(MapViewOfFile(mSection, FILE_MAP_ALL_ACCESS, 0, 0, static_cast<size_t>(sectionBytes)));
+	if (mView == nullptr)
+	{
+		Log("SharedMemoryNetwork - failed to map %s, error %lu", sectionName.c_str(), GetLastError());
+		exit(1);
+	}
+
+	// a new section is zero filled, so both rings start empty
+	auto section = reinterpret_cast<Section*>(mView);
+	if (created)
+	{
+		section->mDataRingBytes = mOptions.mDataRingBytes;
+		section->mAckRingBytes = mOptions.mAckRingBytes;
+		mDataRing = new (mView + cRingsOffset) Ring();
+		mAckRing = new (mView + cRingsOffset + sizeof(Ring)) Ring();
+		mDataRing->mCapacity = mOptions.mDataRingBytes;
+		mAckRing->mCapacity = mOptions.mAckRingBytes;
+		section->mMagic.store(cSectionMagic, std::memory_order_release);
+	}
+	else
+	{
+		const auto giveUp = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+		while (section->mMagic.load(std::memory_order_acquire) != cSectionMagic && std::chrono::steady_clock::now() < giveUp)
+		{
+			std::this_thread::yield();
+		}
+		if (section->mMagic.load(std::memory_order_acquire) != cSectionMagic ||
+			section->mDataRingBytes != mOptions.mDataRingBytes || section->mAckRingBytes != mOptions.mAckRingBytes)
+		{
+			Log("SharedMemoryNetwork - %s was opened with other ring sizes", sectionName.c_str());
+			exit(1);
+		}
+		mDataRing = reinterpret_cast<Ring*>(mView + cRingsOffset);
+		mAckRing = reinterpret_cast<Ring*>(mView + cRingsOffset + sizeof(Ring));
+	}
+	mDataBytes = mView + cRingsOffset + ringsBytes;
+	mAckBytes = mDataBytes + mOptions.mDataRingBytes;
+
+	// auto reset, one SetEvent wakes the one reader
+	mDataEvent = CreateEventA(NULL, FALSE, FALSE, (sectionName + "-data").c_str());
+	mAckEvent = CreateEventA(NULL, FALSE, FALSE, (sectionName + "-ack").c_str());
+	if (mDataEvent == NULL || mAckEvent == NULL)
+	{
+		Log("SharedMemoryNetwork - failed to create events for %s, error %lu", sectionName.c_str(), GetLastError());
+		exit(1);
+	}
+	Log("SharedMemoryNetwork - %s %s", created ? "created" : "opened", sectionName.c_str());
+}
+
+SharedMemoryNetwork::~SharedMemoryNetwork()
+{
+	CloseHandle(mDataEvent);
+	CloseHandle(mAckEvent);
+	UnmapViewOfFile(mView);
+	CloseHandle(mSection);
+}
+
+void SharedMemoryNetwork::Write(Ring& ring, uint8_t* bytes, HANDLE readerEvent, const std::vector<uint8_t>& data)
+{
+	const uint64_t needed = RecordBytes(data.size());
+	const uint64_t head = ring.mHead.load(std::memory_order_acquire);
+	uint64_t tail = ring.mTail.load(std::memory_order_relaxed);
+	uint64_t offset = tail % ring.mCapacity;
+	const uint64_t toEnd = ring.mCapacity - offset;
+	const uint64_t skipped = toEnd < needed ? toEnd : 0;
+	if (tail + skipped + needed - head > ring.mCapacity)
+	{
+		++mDroppedFrames;
+		Log("SharedMemoryNetwork - ring full, dropping %zu byte frame", data.size());
+		return;
+	}
+
+	if (skipped)
+	{
+		*reinterpret_cast<uint32_t*>(bytes + offset) = cWrapMarker;
+		tail += skipped;
+		offset = 0;
+	}
+	*reinterpret_cast<uint32_t*>(bytes + offset) = static_cast<uint32_t>(data.size());
+	memcpy(bytes + offset + sizeof(uint32_t), data.data(), data.size());
+	ring.mWrittenFrames.fetch_add(1, std::memory_order_relaxed);
+
+	// publishing the tail and checking for a sleeper must not be reordered,
+	// or the reader could park just after looking at the old tail
+	ring.mTail.store(tail + needed, std::memory_order_seq_cst);
+	if (ring.mReaderWaiting.exchange(0, std::memory_order_seq_cst))
+	{
+		SetEvent(readerEvent);
+	}
+}
+
+bool SharedMemoryNetwork::TryRead(Ring& ring, const uint8_t* bytes, std::vector<uint8_t>& data)
+{
+	uint64_t head = ring.mHead.load(std::memory_order_relaxed);
+	if (head == ring.mTail.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+
+	uint64_t offset = head % ring.mCapacity;
+	uint32_t size = *reinterpret_cast<const uint32_t*>(bytes + offset);
+	if (size == cWrapMarker)
+	{
+		head += ring.mCapacity - offset;
+		offset = 0;
+		size = *reinterpret_cast<const uint32_t*>(bytes);
+	}
+	const uint8_t* frame = bytes + offset + sizeof(uint32_t);
+	data.assign(frame, frame + size);
+	ring.mReadFrames.fetch_add(1, std::memory_order_relaxed);
+	ring.mHead.store(head + RecordBytes(size), std::memory_order_release);
+	return true;
+}
+
+bool SharedMemoryNetwork::Read(Ring& ring, const uint8_t* bytes, HANDLE readerEvent, std::vector<uint8_t>& data,
+	std::chrono::duration<int, std::milli>& timeOut)
+{
+	using Clock = std::chrono::steady_clock;
+	const auto deadline = Clock::now() + timeOut;
+	auto hasData = [&ring]()
+	{
+		return ring.mHead.load(std::memory_order_relaxed) != ring.mTail.load(std::memory_order_seq_cst);
+	};
+
+	for (;;)
+	{
+		if (TryRead(ring, bytes, data))
+		{
+			return true;
+		}
+		if (SpinWait(mOptions.mWait, deadline, hasData))
+		{
+			continue;
+		}
+
+		const auto now = Clock::now();
+		if (now >= deadline || !mOptions.mWait.Parks())
+		{
+			return TryRead(ring, bytes, data);
+		}
+
+		// flag before the last look, see Write
+		ring.mReaderWaiting.store(1, std::memory_order_seq_cst);
+		if (!hasData())
+		{
+			// rounded up, a 0ms wait would spin
+			const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now) + std::chrono::milliseconds(1);
+			WaitForSingleObject(readerEvent, static_cast<DWORD>(remaining.count()));
+		}
+		ring.mReaderWaiting.store(0, std::memory_order_relaxed);
+	}
+}
+
+void SharedMemoryNetwork::ProducerEnQ(const std::vector<uint8_t>& data)
+{
+	Write(*mDataRing, mDataBytes, mDataEvent, data);
+}
+
+bool SharedMemoryNetwork::ProducerDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut)
+{
+	return Read(*mAckRing, mAckBytes, mAckEvent, data, timeOut);
+}
+
+void SharedMemoryNetwork::ConsumerEnQ(const std::vector<uint8_t>& data)
+{
+	Write(*mAckRing, mAckBytes, mAckEvent, data);
+}
+
+bool SharedMemoryNetwork::ConsumeDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut)
+{
+	return Read(*mDataRing, mDataBytes, mDataEvent, data, timeOut);
+}
+
+size_t SharedMemoryNetwork::ProducerToConsumerSize()
+{
+	return static_cast<size_t>(mDataRing->mWrittenFrames.load() - mDataRing->mReadFrames.load());
+}
+
+size_t SharedMemoryNetwork::ConsumerToProducerSize()
+{
+	return static_cast<size_t>(mAckRing->mWrittenFrames.load() - mAckRing->mReadFrames.load());
+}
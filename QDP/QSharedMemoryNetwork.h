@@ -0,0 +1,55 @@
+#pragma once
+#include "QNetwork.h"
+
+struct SharedMemoryOptions
+{
+	uint32_t mDataRingBytes{ 1 << 20 };  // producer to consumer
+	uint32_t mAckRingBytes{ 64 << 10 };  // consumer to producer
+	WaitConfig mWait;                    // spinning readers skip the event wake up
+};
+
+/// <summary>
+/// Producer and consumer on the same host, talking through two single
+/// producer single consumer byte rings in a named shared memory section.
+/// Either end may open the section first, both must use the same name and
+/// sizes. A reader only parks on the ring's named event after flagging that
+/// it is about to, so a writer pays for SetEvent only when the reader sleeps.
+/// Like a socket buffer, a frame that does not fit in a full ring is dropped
+/// and left to the repair logic.
+/// </summary>
+class SharedMemoryNetwork : public INetwork
+{
+private:
+	struct Ring;
+
+	SharedMemoryOptions mOptions;
+	HANDLE mSection{ NULL };
+	uint8_t* mView{ nullptr };
+	Ring* mDataRing{ nullptr };
+	Ring* mAckRing{ nullptr };
+	uint8_t* mDataBytes{ nullptr };
+	uint8_t* mAckBytes{ nullptr };
+	HANDLE mDataEvent{ NULL };
+	HANDLE mAckEvent{ NULL };
+	std::atomic<size_t> mDroppedFrames{ 0 };
+
+	void Write(Ring& ring, uint8_t* bytes, HANDLE readerEvent, const std::vector<uint8_t>& data);
+	bool TryRead(Ring& ring, const uint8_t* bytes, std::vector<uint8_t>& data);
+	bool Read(Ring& ring, const uint8_t* bytes, HANDLE readerEvent, std::vector<uint8_t>& data,
+		std::chrono::duration<int, std::milli>& timeOut);
+
+public:
+	SharedMemoryNetwork(const std::string& name, const SharedMemoryOptions& options = SharedMemoryOptions());
+	~SharedMemoryNetwork();
+	SharedMemoryNetwork(const SharedMemoryNetwork&) = delete;
+
+	void ProducerEnQ(const std::vector<uint8_t>& data) override;
+	bool ProducerDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override;
+	void ConsumerEnQ(const std::vector<uint8_t>& data) override;
+	bool ConsumeDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override;
+	size_t ProducerToConsumerSize() override;
+	size_t ConsumerToProducerSize() override;
+
+	// frames this end could not fit in a full ring
+	size_t DroppedFrames() { return mDroppedFrames; }
+};
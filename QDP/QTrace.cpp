@@ -0,0 +1,183 @@
+#include "pch.h"
+#include "QTrace.h"
+#include <algorithm>
+#include <fstream>
+
+namespace
+{
+	std::atomic<uint64_t> gNextTracerId{ 1 };
+
+	// the buffer this thread last recorded into, and whose it is
+	struct CachedBuffer
+	{
+		uint64_t mTracer{ 0 };
+		void* mBuffer{ nullptr };
+	};
+	thread_local CachedBuffer tCached;
+
+	const char* StageName(TraceStage stage)
+	{
+		switch (stage)
+		{
+		case TraceStage::Queued: return "queued";
+		case TraceStage::WindowBlocked: return "window full";
+		case TraceStage::Sent: return "sent";
+		case TraceStage::Resent: return "resent";
+		case TraceStage::Acked: return "acked";
+		case TraceStage::Expired: return "expired";
+		case TraceStage::Received: return "received";
+		case TraceStage::Parked: return "parked";
+		case TraceStage::Delivered: return "delivered";
+		case TraceStage::Taken: return "taken";
+		}
+		return "unknown";
+	}
+
+	// what a message is doing from this stage until its next, nullptr once it is done with
+	const char* WaitName(TraceStage stage)
+	{
+		switch (stage)
+		{
+		case TraceStage::Queued: return "ToSendQ";
+		case TraceStage::WindowBlocked: return "window full";
+		case TraceStage::Sent: return "in flight";
+		case TraceStage::Resent: return "in flight";
+		case TraceStage::Received: return "arriving";
+		case TraceStage::Parked: return "pendingData";
+		case TraceStage::Delivered: return "DeliveredQ";
+		default: return nullptr;
+		}
+	}
+
+	bool OnConsumer(TraceStage stage)
+	{
+		return stage >= TraceStage::Received;
+	}
+}
+
+MessageTracer::MessageTracer(const TraceConfig& config) :
+	mMask(config.mSampleEvery - 1), mEventsPerThread(config.mEventsPerThread), mId(gNextTracerId++)
+{
+	if (config.mSampleEvery == 0 || (config.mSampleEvery & mMask) != 0)
+	{
+		Log("MessageTracer - sampling every %u is not a power of two", config.mSampleEvery);
+		exit(1);
+	}
+}
+
+MessageTracer::ThreadBuffer& MessageTracer::Buffer()
+{
+	if (tCached.mTracer == mId)
+	{
+		return *static_cast<ThreadBuffer*>(tCached.mBuffer);
+	}
+	return AddBuffer();
+}
+
+MessageTracer::ThreadBuffer& MessageTracer::AddBuffer()
+{
+	std::lock_guard<std::mutex> lock(mBuffersMux);
+	const auto thread = std::this_thread::get_id();
+	auto found = std::find_if(mBuffers.begin(), mBuffers.end(),
+		[thread](const std::unique_ptr<ThreadBuffer>& buffer) { return buffer->mThread == thread; });
+	if (found == mBuffers.end())
+	{
+		mBuffers.push_back(std::make_unique<ThreadBuffer>(mEventsPerThread));
+		found = mBuffers.end() - 1;
+	}
+	tCached.mTracer = mId;
+	tCached.mBuffer = found->get();
+	return **found;
+}
+
+void MessageTracer::Record(TraceStage stage, SeqNo seqNo)
+{
+	ThreadBuffer& buffer = Buffer();
+	// only this thread writes the buffer, so plain loads and stores will do
+	const size_t count = buffer.mCount.load(std::memory_order_relaxed);
+	if (count == buffer.mCapacity)
+	{
+		buffer.mDropped.store(buffer.mDropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		return;
+	}
+	const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+	buffer.mEvents[count] = Event{ now, seqNo, stage };
+	buffer.mCount.store(count + 1, std::memory_order_release);
+}
+
+std::vector<MessageTracer::Event> MessageTracer::Events()
+{
+	std::lock_guard<std::mutex> lock(mBuffersMux);
+	std::vector<Event> events;
+	for (auto& buffer : mBuffers)
+	{
+		const size_t count = buffer->mCount.load(std::memory_order_acquire);
+		events.insert(events.end(), buffer->mEvents.get(), buffer->mEvents.get() + count);
+	}
+	return events;
+}
+
+size_t MessageTracer::DroppedEvents()
+{
+	std::lock_guard<std::mutex> lock(mBuffersMux);
+	size_t dropped = 0;
+	for (auto& buffer : mBuffers)
+	{
+		dropped += buffer->mDropped.load(std::memory_order_relaxed);
+	}
+	return dropped;
+}
+
+void MessageTracer::ExportChromeTrace(std::ostream& out)
+{
+	// a track per message on each end, its stages in the order they happened
+	auto events = Events();
+	std::stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b)
+		{
+			if (OnConsumer(a.mStage) != OnConsumer(b.mStage))
+			{
+				return OnConsumer(b.mStage);
+			}
+			return a.mSeqNo != b.mSeqNo ? a.mSeqNo < b.mSeqNo : a.mTime_ns < b.mTime_ns;
+		});
+
+	out << "{\"traceEvents\":[\n";
+	out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"producer\"}},\n";
+	out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"consumer\"}}";
+	char line[200];
+	for (size_t i = 0; i < events.size(); ++i)
+	{
+		const Event& event = events[i];
+		const int pid = OnConsumer(event.mStage) ? 2 : 1;
+		// microseconds, with the nanoseconds kept as a fraction
+		const double ts = event.mTime_ns / 1000.0;
+		snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u}",
+			StageName(event.mStage), ts, pid, event.mSeqNo);
+		out << line;
+
+		const bool hasNext = i + 1 < events.size() && events[i + 1].mSeqNo == event.mSeqNo &&
+			OnConsumer(events[i + 1].mStage) == OnConsumer(event.mStage);
+		const char* wait = WaitName(event.mStage);
+		if (hasNext && wait)
+		{
+			const double dur = (events[i + 1].mTime_ns - event.mTime_ns) / 1000.0;
+			snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}",
+				wait, ts, dur, pid, event.mSeqNo);
+			out << line;
+		}
+	}
+	out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
+
+bool MessageTracer::ExportChromeTrace(const std::string& fileName)
+{
+	std::ofstream out(fileName, std::ios::trunc);
+	if (!out)
+	{
+		Log("MessageTracer - cannot write %s", fileName.c_str());
+		return false;
+	}
+	ExportChromeTrace(out);
+	return static_cast<bool>(out);
+}
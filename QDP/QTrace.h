@@ -0,0 +1,96 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+#include "QNetwork.h"
+
+// where a message is, each stage lasts until the next one on the same end
+enum class TraceStage : uint8_t
+{
+	Queued,         // producer, EnQ put it in ToSendQ
+	WindowBlocked,  // producer, next to send but the window is full
+	Sent,           // producer, first transmitted
+	Resent,         // producer, transmitted again
+	Acked,          // producer, an ack covered it
+	Expired,        // producer, given up on after the TTL
+	Received,       // consumer, first arrival
+	Parked,         // consumer, held in pendingData behind a gap
+	Delivered,      // consumer, into DeliveredQ or the callbacks
+	Taken           // consumer, DeQ handed it to the application
+};
+
+struct TraceConfig
+{
+	// every Nth sequence number is traced, a power of two. Both ends pick the
+	// same messages, so their stages line up
+	uint32_t mSampleEvery{ 64 };
+	// per thread, once full that thread's later events are dropped and counted
+	size_t mEventsPerThread{ 1 << 16 };
+};
+
+/// <summary>
+/// Records timestamped lifecycle stages of sampled messages. Each thread
+/// that records gets a buffer of its own that only it writes, so recording
+/// takes no lock and no atomic read-modify-write. The same tracer can be
+/// given to a producer and its consumer, or each end can export its own and
+/// the files be loaded together. Export writes Chrome trace JSON, which
+/// chrome://tracing and Perfetto both open, with a track per message.
+/// </summary>
+class MessageTracer
+{
+public:
+	struct Event
+	{
+		int64_t mTime_ns;  // steady clock
+		SeqNo mSeqNo;
+		TraceStage mStage;
+	};
+
+	explicit MessageTracer(const TraceConfig& config = TraceConfig());
+	MessageTracer(const MessageTracer&) = delete;
+
+	bool Sampled(SeqNo seqNo) const { return (seqNo & mMask) == 0; }
+	uint32_t SampleEvery() const { return mMask + 1; }
+
+	// the first sampled sequence number from seqNo on
+	SeqNo NextSampled(SeqNo seqNo) const { return (seqNo + mMask) & ~mMask; }
+
+	void Record(TraceStage stage, SeqNo seqNo);
+
+	// a copy of every event so far, by thread then in the order recorded.
+	// Safe while threads are still recording
+	std::vector<Event> Events();
+
+	// events a full thread buffer could not take
+	size_t DroppedEvents();
+
+	// the events so far as Chrome trace JSON
+	void ExportChromeTrace(std::ostream& out);
+	bool ExportChromeTrace(const std::string& fileName);
+
+private:
+	struct ThreadBuffer
+	{
+		// zeroed, so the pages are touched here rather than while recording
+		explicit ThreadBuffer(size_t capacity) :mEvents(new Event[capacity]()), mCapacity(capacity) {}
+
+		const std::thread::id mThread{ std::this_thread::get_id() };
+		std::unique_ptr<Event[]> mEvents;
+		const size_t mCapacity;
+		std::atomic<size_t> mCount{ 0 };    // events published to readers
+		std::atomic<size_t> mDropped{ 0 };
+	};
+
+	const uint32_t mMask;
+	const size_t mEventsPerThread;
+	const uint64_t mId;  // tells a thread's cached buffer from a dead tracer's at the same address
+
+	std::mutex mBuffersMux;  // taken the first time a thread records, and by readers
+	std::vector<std::unique_ptr<ThreadBuffer>> mBuffers;
+
+	ThreadBuffer& Buffer();
+	ThreadBuffer& AddBuffer();
+};
@@ -0,0 +1,69 @@
+#pragma once
+#include <chrono>
+#include <thread>
+#include <Windows.h>
+
+/// <summary>
+/// How a thread waits for work. Block parks straight away, the spin
+/// strategies trade a core for skipping the wake up on the next arrival.
+/// </summary>
+enum class WaitStrategy : uint8_t
+{
+	Block,          // park until signalled or timed out
+	SpinThenPark,   // spin for mSpin_us then park
+	SpinThenYield,  // spin for mSpin_us then yield the core until timed out
+	BusySpin,       // spin until timed out, never gives up the core
+};
+
+struct WaitConfig
+{
+	WaitStrategy mStrategy{ WaitStrategy::Block };
+	uint32_t mSpin_us{ 50 };
+
+	// whether the caller should park for what is left of the timeout once
+	// SpinWait gives up
+	bool Parks() const { return mStrategy == WaitStrategy::Block || mStrategy == WaitStrategy::SpinThenPark; }
+};
+
+/// <summary>
+/// Polls ready() as the strategy allows until it returns true or the
+/// deadline passes. Returns ready()'s last answer, parking is left to the
+/// caller as only it knows what to park on.
+/// </summary>
+template <class Ready>
+bool SpinWait(const WaitConfig& config, std::chrono::steady_clock::time_point deadline, Ready ready)
+{
+	using Clock = std::chrono::steady_clock;
+	if (config.mStrategy == WaitStrategy::Block)
+	{
+		return ready();
+	}
+
+	const auto now = Clock::now();
+	auto spinUntil = deadline;
+	if (config.mStrategy != WaitStrategy::BusySpin && deadline - now > std::chrono::microseconds(config.mSpin_us))
+	{
+		spinUntil = now + std::chrono::microseconds(config.mSpin_us);
+	}
+	while (Clock::now() < spinUntil)
+	{
+		if (ready())
+		{
+			return true;
+		}
+		YieldProcessor();
+	}
+
+	if (config.mStrategy == WaitStrategy::SpinThenYield)
+	{
+		while (Clock::now() < deadline)
+		{
+			if (ready())
+			{
+				return true;
+			}
+			std::this_thread::yield();
+		}
+	}
+	return ready();
+}
@@ -3,6 +3,14 @@
 
 #include "QProducer.h"
 #include "QConsumer.h"
+#include "QFanOutProducer.h"
+#include "QShardedConsumer.h"
+#include "QSharedMemoryNetwork.h"
+#include "QPriority.h"
+#include "QCodec.h"
+#include "QChecksum.h"
+#include "QCapture.h"
+#include "QAsync.h"
 
 
 template <class T> class ReliableQ
@@ -13,10 +21,15 @@ private:
 	std::shared_ptr<INetwork> mTransport;
 public:
 
-	ReliableQ(std::shared_ptr<INetwork> network) : mTransport(network)
+	// both ends use the producer's repair mode, with callbacks DeQ gets nothing
+	ReliableQ(std::shared_ptr<INetwork> network, const ProducerConfig& config = ProducerConfig(),
+		const ConsumerConfig& consumerConfig = ConsumerConfig(), const DeliveryCallbacks<T>& callbacks = DeliveryCallbacks<T>()) :
+		mTransport(network)
 	{
-		mConsumer = std::make_unique<QConsumer<T>>(mTransport);
-		mProducer = std::make_unique<QProducer<T>>(mTransport);
+		ConsumerConfig matched = consumerConfig;
+		matched.mRepair = config.mRepair;
+		mConsumer = std::make_unique<QConsumer<T>>(mTransport, matched, callbacks);
+		mProducer = std::make_unique<QProducer<T>>(mTransport, config);
 	};
 
 	~ReliableQ()
@@ -27,9 +40,27 @@ public:
 
 	ReliableQ(const ReliableQ&) = delete;
 
-	void EnQ(T& data)
+	// returns a token for WhenSettled, see QProducer::EnQ
+	uint64_t EnQ(T& data)
 	{
-		mProducer->EnQ(data);
+		return mProducer->EnQ(data);
+	}
+
+	uint64_t EnQ(const T* data, size_t count)
+	{
+		return mProducer->EnQ(data, count);
+	}
+
+	// true once the consumer has acked the frames up to token, false if they were given up on
+	std::future<bool> WhenSettled(uint64_t token)
+	{
+		return mProducer->WhenSettled(token);
+	}
+
+	// waits up to timeOut for everything queued so far to be acked
+	bool Flush(std::chrono::duration<int, std::milli> timeOut)
+	{
+		return mProducer->Flush(timeOut);
 	}
 
 	void DeQ(T& data)
@@ -37,6 +68,44 @@ public:
 		mConsumer->DeQ(data);
 	}
 
+	// returns the number of elements written to data, 0 on time out
+	size_t DeQ(T* data, size_t maxCount, std::chrono::duration<int, std::milli>& timeOut)
+	{
+		return mConsumer->DeQ(data, maxCount, timeOut);
+	}
+
+	// appends everything delivered so far, waiting up to timeOut for the first
+	size_t DeQAll(std::vector<T>& data, std::chrono::duration<int, std::milli>& timeOut)
+	{
+		return mConsumer->DeQAll(data, timeOut);
+	}
+
+#ifdef QUDP_COROUTINES
+	// queuing never blocks, so this never suspends
+	std::suspend_never EnQAsync(const T* data, size_t count)
+	{
+		mProducer->EnQ(data, count);
+		return {};
+	}
+
+	std::suspend_never EnQAsync(const T& data)
+	{
+		return EnQAsync(&data, 1);
+	}
+
+	// co_await for up to maxCount frames, see DeQAwaiter
+	DeQAwaiter<T> DeQAsync(T* data, size_t maxCount, IExecutor& executor)
+	{
+		return DeQAwaiter<T>(*mConsumer, data, maxCount, executor);
+	}
+
+	// co_await until everything queued so far is acked, see FlushAwaiter
+	FlushAwaiter<T> FlushAsync(IExecutor& executor)
+	{
+		return FlushAwaiter<T>(*mProducer, executor);
+	}
+#endif
+
 	size_t Size()
 	{
 		// race hazard here but it suits its purpose 
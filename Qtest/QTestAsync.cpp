@@ -0,0 +1,242 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "Qudp.h"
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#ifdef QUDP_COROUTINES
+namespace Qtest
+{
+	// starts straight away and cleans up after itself, as a runtime's task would
+	struct DetachedTask
+	{
+		struct promise_type
+		{
+			DetachedTask get_return_object() { return {}; }
+			std::suspend_never initial_suspend() noexcept { return {}; }
+			std::suspend_never final_suspend() noexcept { return {}; }
+			void return_void() {}
+			void unhandled_exception() { std::terminate(); }
+		};
+	};
+
+	struct AsyncBody
+	{
+		AsyncBody(int value) :mValue(value) {}
+		AsyncBody() {};
+
+		int mValue{ 0 };
+	};
+
+	// counts frames out of order rather than asserting, it runs on the executor
+	DetachedTask ReadInOrder(ReliableQ<AsyncBody>& q, IExecutor& executor, int count,
+		std::atomic<int>& outOfOrder, std::atomic<int>& finished)
+	{
+		std::vector<AsyncBody> received(32);
+		for (int next = 0; next < count;)
+		{
+			const size_t taken = co_await q.DeQAsync(&received[0], received.size(), executor);
+			for (size_t i = 0; i < taken; ++i, ++next)
+			{
+				if (received[i].mValue != next)
+				{
+					++outOfOrder;
+				}
+			}
+		}
+		++finished;
+	}
+
+	DetachedTask SendThenFlush(ReliableQ<AsyncBody>& q, IExecutor& executor, int count, std::atomic<int>& finished)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			co_await q.EnQAsync(AsyncBody(i));
+		}
+		co_await q.FlushAsync(executor);
+		++finished;
+	}
+
+	// reads until an await gives nothing, as it does once the consumer stops
+	DetachedTask ReadUntilStopped(QConsumer<AsyncBody>& consumer, IExecutor& executor,
+		std::atomic<int>& taken, std::atomic<int>& finished)
+	{
+		AsyncBody received[8];
+		for (;;)
+		{
+			const size_t count = co_await DeQAwaiter<AsyncBody>(consumer, received, 8, executor);
+			if (count == 0)
+			{
+				break;
+			}
+			taken += static_cast<int>(count);
+		}
+		++finished;
+	}
+
+	DetachedTask FlushOnce(QProducer<AsyncBody>& producer, IExecutor& executor, std::atomic<int>& flushed, std::atomic<int>& finished)
+	{
+		const bool acked = co_await FlushAwaiter<AsyncBody>(producer, executor);
+		if (acked)
+		{
+			++flushed;
+		}
+		++finished;
+	}
+
+	TEST_CLASS(QtestAsync)
+	{
+	private:
+		static void RunUntil(std::vector<WorkQueueExecutor*> executors, std::atomic<int>& finished, int target)
+		{
+			const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+			std::vector<std::future<void>> threads;
+			for (auto executor : executors)
+			{
+				threads.push_back(std::async(std::launch::async, [&, executor]()
+					{
+						while (finished < target && std::chrono::steady_clock::now() < deadline)
+						{
+							executor->RunOne(std::chrono::duration<int, std::milli>(10));
+						}
+					}));
+			}
+			for (auto& thread : threads)
+			{
+				thread.get();
+			}
+		}
+
+	public:
+		TEST_METHOD(BlockingQ_WhenDataCalledOnceByTheEnQThatFillsIt)
+		{
+			BlockingQ<int> q;
+			int calls = 0;
+			q.WhenData([&]() { ++calls; });
+			Assert::AreEqual(0, calls);
+			q.EnQ(1);
+			q.EnQ(2);
+			Assert::AreEqual(1, calls);
+
+			q.WhenData([&]() { ++calls; });
+			Assert::AreEqual(2, calls);
+			int taken[4];
+			Assert::AreEqual(2, static_cast<int>(q.TryDeQ(taken, 4)));
+			Assert::AreEqual(0, static_cast<int>(q.TryDeQ(taken, 4)));
+		}
+
+		TEST_METHOD(BlockingQ_WhenDataWakesEveryReaderAndAnyAfterClose)
+		{
+			BlockingQ<int> q;
+			int calls = 0;
+			q.WhenData([&]() { ++calls; });
+			q.WhenData([&]() { ++calls; });
+			q.EnQ(1);
+			Assert::AreEqual(2, calls);
+
+			int taken[4];
+			Assert::AreEqual(1, static_cast<int>(q.TryDeQ(taken, 4)));
+			q.WhenData([&]() { ++calls; });
+			q.CloseAsyncReaders();
+			Assert::AreEqual(3, calls);
+			q.WhenData([&]() { ++calls; });
+			Assert::AreEqual(4, calls);
+		}
+
+		TEST_METHOD(Consumer_StopResumesEveryWaitingReader)
+		{
+			constexpr int frames = 100;
+			WorkQueueExecutor executor;
+			std::atomic<int> taken{ 0 };
+			std::atomic<int> finished{ 0 };
+			std::shared_ptr<INetwork> network(new IdealNetwork());
+			auto consumer = std::make_unique<QConsumer<AsyncBody>>(network);
+			auto producer = std::make_unique<QProducer<AsyncBody>>(network, ProducerConfig{ 32 });
+			for (int i = 0; i < 3; ++i)
+			{
+				ReadUntilStopped(*consumer, executor, taken, finished);
+			}
+			for (int i = 0; i < frames; ++i)
+			{
+				producer->EnQ(AsyncBody(i));
+			}
+			const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+			while (taken < frames && std::chrono::steady_clock::now() < deadline)
+			{
+				executor.RunOne(std::chrono::duration<int, std::milli>(10));
+			}
+			Assert::AreEqual(frames, taken.load());
+			Assert::AreEqual(0, finished.load());
+
+			consumer->Stop();
+			RunUntil({ &executor }, finished, 3);
+			Assert::AreEqual(3, finished.load());
+			producer->Stop();
+		}
+
+		TEST_METHOD(Producer_StopResumesFlushWithFalse)
+		{
+			WorkQueueExecutor executor;
+			std::atomic<int> flushed{ 0 };
+			std::atomic<int> finished{ 0 };
+			std::shared_ptr<INetwork> network(new IdealNetwork());
+			auto producer = std::make_unique<QProducer<AsyncBody>>(network, ProducerConfig{ 16 });
+			producer->EnQ(AsyncBody(1));
+			FlushOnce(*producer, executor, flushed, finished);
+			Assert::AreEqual(0, finished.load());
+
+			// nobody acks it
+			producer->Stop();
+			RunUntil({ &executor }, finished, 1);
+			Assert::AreEqual(1, finished.load());
+			Assert::AreEqual(0, flushed.load());
+		}
+
+		TEST_METHOD(ReliableQ_ManyQueuesReadByTwoThreads)
+		{
+			constexpr int queues = 16;
+			constexpr int frames = 200;
+			WorkQueueExecutor executor;
+			std::atomic<int> outOfOrder{ 0 };
+			std::atomic<int> finished{ 0 };
+			std::vector<std::unique_ptr<ReliableQ<AsyncBody>>> qs;
+			for (int i = 0; i < queues; ++i)
+			{
+				qs.push_back(std::make_unique<ReliableQ<AsyncBody>>(std::shared_ptr<INetwork>(new IdealNetwork()), ProducerConfig{ 32 }));
+				ReadInOrder(*qs.back(), executor, frames, outOfOrder, finished);
+			}
+			// every reader is suspended, none holds a thread
+			Assert::AreEqual(0, finished.load());
+
+			for (int i = 0; i < frames; ++i)
+			{
+				for (auto& q : qs)
+				{
+					AsyncBody body(i);
+					q->EnQ(body);
+				}
+			}
+			RunUntil({ &executor, &executor }, finished, queues);
+			Assert::AreEqual(queues, finished.load());
+			Assert::AreEqual(0, outOfOrder.load());
+		}
+
+		TEST_METHOD(ReliableQ_FlushAsyncResumesOnceEverythingIsAcked)
+		{
+			constexpr int frames = 300;
+			WorkQueueExecutor executor;
+			std::atomic<int> finished{ 0 };
+			ReliableQ<AsyncBody> q(std::shared_ptr<INetwork>(new IdealNetwork()), ProducerConfig{ 16 });
+			SendThenFlush(q, executor, frames, finished);
+			RunUntil({ &executor }, finished, 1);
+			Assert::AreEqual(1, finished.load());
+
+			// the consumer queues a frame for DeQ before acking it
+			std::vector<AsyncBody> received;
+			std::chrono::duration<int, std::milli> noWait(0);
+			Assert::AreEqual(frames, static_cast<int>(q.DeQAll(received, noWait)));
+		}
+	};
+}
+#endif
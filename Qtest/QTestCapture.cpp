@@ -0,0 +1,162 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "Qudp.h"
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Qtest
+{
+	TEST_CLASS(QtestCapture)
+	{
+	private:
+		struct Body
+		{
+			Body(int value) :mValue(value) {}
+			Body() {};
+
+			int mValue{ 0 };
+		};
+
+		static void AssertDelivered(QConsumer<Body>& consumer, int count)
+		{
+			std::vector<Body> received;
+			std::chrono::duration<int, std::milli> timeout(2000);
+			while (static_cast<int>(received.size()) < count)
+			{
+				Assert::IsTrue(consumer.DeQAll(received, timeout) > 0);
+			}
+			Assert::AreEqual(count, static_cast<int>(received.size()));
+			for (int i = 0; i < count; ++i)
+			{
+				Assert::AreEqual(i, received[i].mValue);
+			}
+		}
+
+		static size_t Count(const std::vector<CaptureRecord>& records, CaptureEvent event)
+		{
+			return std::count_if(records.begin(), records.end(),
+				[event](const CaptureRecord& record) { return record.mEvent == event; });
+		}
+
+		// captures a producer and consumer passing frames over an IdealNetwork
+		static std::vector<CaptureRecord> CaptureRun(const std::string& path, int frames)
+		{
+			auto capture = std::make_shared<CaptureNetwork>(std::make_shared<IdealNetwork>(), path);
+			std::shared_ptr<INetwork> network = capture;
+			auto consumer = std::make_unique<QConsumer<Body>>(network);
+			auto producer = std::make_unique<QProducer<Body>>(network, ProducerConfig{ 16 });
+			for (int i = 0; i < frames; ++i)
+			{
+				producer->EnQ(Body(i));
+			}
+			AssertDelivered(*consumer, frames);
+			consumer->Stop();
+			producer->Stop();
+			capture->Flush();
+			return CaptureNetwork::Read(path);
+		}
+
+	public:
+		TEST_METHOD(Capture_RecordsEachDatagramEachWayInOrder)
+		{
+			const std::string path = "QtestCapture.qcap";
+			constexpr int frames = 100;
+			const auto records = CaptureRun(path, frames);
+			DeleteFileA(path.c_str());
+
+			Assert::IsTrue(Count(records, CaptureEvent::ProducerSent) >= frames);
+			Assert::IsTrue(Count(records, CaptureEvent::ConsumerReceived) >= frames);
+			Assert::IsTrue(Count(records, CaptureEvent::ConsumerSent) > 0);
+			Assert::IsTrue(Count(records, CaptureEvent::ProducerReceived) > 0);
+			for (size_t i = 1; i < records.size(); ++i)
+			{
+				Assert::IsTrue(records[i - 1].mTime_ns <= records[i].mTime_ns);
+			}
+
+			// nothing is lost on an IdealNetwork, so what arrived is what was sent
+			std::vector<const CaptureRecord*> sent;
+			std::vector<const CaptureRecord*> received;
+			for (auto& record : records)
+			{
+				if (record.mEvent == CaptureEvent::ProducerSent)
+				{
+					sent.push_back(&record);
+				}
+				else if (record.mEvent == CaptureEvent::ConsumerReceived)
+				{
+					received.push_back(&record);
+				}
+			}
+			Assert::IsTrue(received.size() <= sent.size());
+			for (size_t i = 0; i < received.size(); ++i)
+			{
+				Assert::IsTrue(sent[i]->mData == received[i]->mData);
+				Assert::IsTrue(sent[i]->mTime_ns <= received[i]->mTime_ns);
+			}
+		}
+
+		TEST_METHOD(Capture_RunsLongerThanABlockStayInOrder)
+		{
+			// several write blocks, each swapped out while both threads go on recording
+			const std::string path = "QtestCaptureBlocks.qcap";
+			constexpr int frames = 10000;
+			const auto records = CaptureRun(path, frames);
+			DeleteFileA(path.c_str());
+
+			size_t bytes = 0;
+			for (size_t i = 0; i < records.size(); ++i)
+			{
+				bytes += records[i].mData.size();
+				Assert::IsTrue(i == 0 || records[i - 1].mTime_ns <= records[i].mTime_ns);
+			}
+			Assert::IsTrue(bytes > 4 * (1 << 16));
+			Assert::IsTrue(Count(records, CaptureEvent::ConsumerReceived) >= frames);
+		}
+
+		TEST_METHOD(Replay_ConsumerGetsTheCapturedRunBack)
+		{
+			const std::string path = "QtestReplay.qcap";
+			constexpr int frames = 100;
+			const auto records = CaptureRun(path, frames);
+			DeleteFileA(path.c_str());
+
+			auto replay = std::make_shared<ReplayNetwork>(records, ReplayConfig{ 0 });
+			std::shared_ptr<INetwork> network = replay;
+			auto consumer = std::make_unique<QConsumer<Body>>(network);
+			AssertDelivered(*consumer, frames);
+			consumer->Stop();
+			Assert::IsTrue(replay->ConsumerSentFrames() > 0);
+			Assert::AreEqual(0, static_cast<int>(replay->ProducerSentFrames()));
+		}
+
+		TEST_METHOD(Replay_KeepsTheRecordedGapsScaledBySpeed)
+		{
+			const std::vector<CaptureRecord> records{
+				{ 0, CaptureEvent::ConsumerReceived, { 1 } },
+				{ 200000000, CaptureEvent::ConsumerReceived, { 2 } },
+				{ 300000000, CaptureEvent::ProducerSent, { 3 } },
+			};
+			ReplayNetwork replay(records, ReplayConfig{ 4 });
+			std::vector<uint8_t> data;
+			std::chrono::duration<int, std::milli> timeOut(1000);
+			const auto start = std::chrono::steady_clock::now();
+			Assert::IsTrue(replay.ConsumeDeQ(data, timeOut));
+			Assert::AreEqual(1, static_cast<int>(data[0]));
+			Assert::IsFalse(replay.Finished());
+
+			// 200ms at four times the speed is due 50ms in, too late for a 10ms wait
+			std::chrono::duration<int, std::milli> shortWait(10);
+			Assert::IsFalse(replay.ConsumeDeQ(data, shortWait));
+			Assert::IsTrue(replay.ConsumeDeQ(data, timeOut));
+			const auto elapsed = std::chrono::steady_clock::now() - start;
+			Assert::AreEqual(2, static_cast<int>(data[0]));
+			Assert::IsTrue(elapsed >= std::chrono::milliseconds(50));
+			Assert::IsTrue(elapsed < std::chrono::milliseconds(200));
+
+			// what the captured side sent is not played to anyone
+			Assert::IsTrue(replay.Finished());
+			Assert::IsFalse(replay.ConsumeDeQ(data, shortWait));
+		}
+	};
+}
@@ -0,0 +1,141 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "Qudp.h"
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Qtest
+{
+	/// <summary>
+	/// Flips a bit in every Nth datagram each way, or with truncate set
+	/// drops the last byte of every Nth producer to consumer datagram.
+	/// </summary>
+	class DamagingNetwork : public IdealNetwork
+	{
+		size_t mN;
+		bool mTruncate;
+		size_t mData{ 0 };
+		size_t mFeedback{ 0 };
+
+		std::vector<uint8_t> Damage(const std::vector<uint8_t>& data, size_t count)
+		{
+			std::vector<uint8_t> damaged(data);
+			if (count % mN == 0)
+			{
+				if (mTruncate)
+				{
+					damaged.pop_back();
+				}
+				else
+				{
+					damaged[count % damaged.size()] ^= 0x10;
+				}
+			}
+			return damaged;
+		}
+
+	public:
+		DamagingNetwork(size_t n, bool truncate) :mN(n), mTruncate(truncate) {}
+
+		void ProducerEnQ(const std::vector<uint8_t>& data) override
+		{
+			IdealNetwork::ProducerEnQ(Damage(data, ++mData));
+		}
+		void ConsumerEnQ(const std::vector<uint8_t>& data) override
+		{
+			IdealNetwork::ConsumerEnQ(mTruncate ? data : Damage(data, ++mFeedback));
+		}
+	};
+
+	TEST_CLASS(QtestChecksum)
+	{
+	private:
+		struct Body
+		{
+			Body(int value) :mValue(value), mCheck(-value) {}
+			Body() {};
+
+			int mValue{ 0 };
+			int mCheck{ 0 };
+		};
+
+		static void AssertDelivered(QConsumer<Body>& consumer, int count)
+		{
+			std::vector<Body> received;
+			std::chrono::duration<int, std::milli> timeout(2000);
+			while (static_cast<int>(received.size()) < count)
+			{
+				Assert::IsTrue(consumer.DeQAll(received, timeout) > 0);
+			}
+			Assert::AreEqual(count, static_cast<int>(received.size()));
+			for (int i = 0; i < count; ++i)
+			{
+				Assert::AreEqual(i, received[i].mValue);
+				Assert::AreEqual(-i, received[i].mCheck);
+			}
+		}
+
+	public:
+		TEST_METHOD(Crc32c_KnownValueAndBothPathsAgree)
+		{
+			const std::string check = "123456789";
+			const auto bytes = reinterpret_cast<const uint8_t*>(check.data());
+			Assert::AreEqual(0xe3069283u, Crc32c::Compute(bytes, check.size()));
+			Assert::AreEqual(0xe3069283u, Crc32c::ComputePortable(bytes, check.size()));
+			Assert::AreEqual(0xe3069283u, Crc32c::Compute(bytes + 4, 5, Crc32c::Compute(bytes, 4)));
+
+			std::vector<uint8_t> data(131);
+			for (size_t i = 0; i < data.size(); ++i)
+			{
+				data[i] = static_cast<uint8_t>(i * 29 + 7);
+			}
+			for (size_t offset = 0; offset < 8; ++offset)
+			{
+				for (size_t size = 0; size + offset <= data.size(); size += 13)
+				{
+					Assert::AreEqual(Crc32c::ComputePortable(&data[offset], size), Crc32c::Compute(&data[offset], size));
+				}
+			}
+		}
+
+		TEST_METHOD(ChecksumNetwork_CorruptFramesDroppedAndRepaired)
+		{
+			ProducerConfig config{ 64 };
+			auto checksum = std::make_shared<ChecksumNetwork>(std::make_shared<DamagingNetwork>(23, false));
+			std::shared_ptr<INetwork> network = checksum;
+			constexpr int frames = 300;
+			{
+				auto consumer = std::make_unique<QConsumer<Body>>(network);
+				auto producer = std::make_unique<QProducer<Body>>(network, config);
+				for (int i = 0; i < frames; ++i)
+				{
+					producer->EnQ(Body(i));
+				}
+				AssertDelivered(*consumer, frames);
+				Assert::AreEqual(0, static_cast<int>(consumer->MalformedFrames()));
+				consumer->Stop();
+				producer->Stop();
+			}
+			Assert::IsTrue(checksum->CorruptData() > 0);
+			Assert::IsTrue(checksum->CorruptFeedback() > 0);
+		}
+
+		TEST_METHOD(Consumer_TruncatedFrameDroppedAndRepaired)
+		{
+			ProducerConfig config{ 64 };
+			std::shared_ptr<INetwork> network = std::make_shared<DamagingNetwork>(23, true);
+			constexpr int frames = 300;
+			auto consumer = std::make_unique<QConsumer<Body>>(network);
+			auto producer = std::make_unique<QProducer<Body>>(network, config);
+			for (int i = 0; i < frames; ++i)
+			{
+				producer->EnQ(Body(i));
+			}
+			AssertDelivered(*consumer, frames);
+			Assert::IsTrue(consumer->MalformedFrames() > 0);
+			consumer->Stop();
+			producer->Stop();
+		}
+	};
+}
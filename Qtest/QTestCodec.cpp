@@ -0,0 +1,234 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "Qudp.h"
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Qtest
+{
+#pragma pack(push, 1)
+	struct CodecTestSample
+	{
+		CodecTestSample(double value, double timeStamp) :mValue(value), mTimeStamp_sec(timeStamp) {}
+		CodecTestSample() {};
+
+		double mValue{ 0 };
+		double mTimeStamp_sec{ 0 };
+		uint8_t mStatus[3]{};  // not a whole word, sent as plain XOR bytes
+	};
+#pragma pack(pop)
+
+	/// <summary>
+	/// Loses every Nth producer to consumer datagram.
+	/// </summary>
+	class EveryNthLostNetwork : public IdealNetwork
+	{
+		size_t mN;
+		size_t mSent{ 0 };
+
+	public:
+		EveryNthLostNetwork(size_t n) :mN(n) {}
+
+		void ProducerEnQ(const std::vector<uint8_t>& data) override
+		{
+			if (++mSent % mN != 0)
+			{
+				IdealNetwork::ProducerEnQ(data);
+			}
+		}
+	};
+
+	TEST_CLASS(QtestCodec)
+	{
+	private:
+		static CodecTestSample Sample(int i)
+		{
+			// a 12 bit reading scaled to volts, sampled every ms
+			CodecTestSample sample(((1000 + (i * 7) % 50) * 5.0) / 4096, 1700000000.0 + i * 0.001);
+			sample.mStatus[0] = static_cast<uint8_t>(i / 100);
+			return sample;
+		}
+
+	public:
+		TEST_METHOD(Codec_XorBodyRoundTripsAndSkipsUnchangedWords)
+		{
+			XorBodyCodec codec;
+			CodecTestSample previous = Sample(0);
+			for (int i = 1; i < 300; ++i)
+			{
+				const CodecTestSample sample = Sample(i);
+				std::vector<uint8_t> coded;
+				codec.Encode(reinterpret_cast<const uint8_t*>(&sample), reinterpret_cast<const uint8_t*>(&previous), sizeof(sample), coded);
+				Assert::IsTrue(coded.size() < sizeof(sample));
+
+				CodecTestSample decoded;
+				Assert::IsTrue(codec.Decode(coded.data(), coded.size(), reinterpret_cast<const uint8_t*>(&previous),
+					reinterpret_cast<uint8_t*>(&decoded), sizeof(decoded)));
+				Assert::AreEqual(0, memcmp(&sample, &decoded, sizeof(sample)));
+				previous = sample;
+			}
+
+			// two unchanged words are two bits, then the three tail bytes
+			std::vector<uint8_t> coded;
+			codec.Encode(reinterpret_cast<const uint8_t*>(&previous), reinterpret_cast<const uint8_t*>(&previous), sizeof(previous), coded);
+			Assert::AreEqual(4, static_cast<int>(coded.size()));
+		}
+
+		TEST_METHOD(Codec_HeaderFieldsSurviveAndLostReferencesHoldFrames)
+		{
+			CodecConfig config;
+			config.mBodyCodec = std::make_shared<XorBodyCodec>();
+			FrameEncoder encoder(config);
+			FrameDecoder decoder(config);
+
+			Header parity(70000);
+			parity.mType = FrameType::Parity;
+			parity.mFecDataFrames = 8;
+			parity.mFecParityIndex = 1;
+			parity.mFecParityFrames = 2;
+			parity.mRange = 3;
+			parity.mSession = 0xdeadbeef;
+			parity.mLane = 2;
+			const Frame<CodecTestSample> sent(parity, Sample(1));
+			std::vector<uint8_t> wire;
+			encoder.Encode(sent.mBytes, wire);
+			std::deque<std::vector<uint8_t>> frames;
+			Assert::IsTrue(decoder.Decode(wire, frames));
+			Assert::AreEqual(1, static_cast<int>(frames.size()));
+			Assert::IsTrue(frames.front() == sent.mBytes);
+
+			// frames 2 and 3 are coded against the one before, so lose frame 1
+			std::vector<std::vector<uint8_t>> wires;
+			for (SeqNo seqNo = 1; seqNo <= 3; ++seqNo)
+			{
+				encoder.Encode(Frame<CodecTestSample>(Header(seqNo), Sample(seqNo)).mBytes, wire);
+				wires.push_back(wire);
+			}
+			Assert::IsTrue(wires[1].size() < wires[0].size());
+			frames.clear();
+			Assert::IsTrue(decoder.Decode(wires[1], frames));
+			Assert::IsTrue(decoder.Decode(wires[2], frames));
+			Assert::AreEqual(0, static_cast<int>(frames.size()));
+			Assert::AreEqual(2, static_cast<int>(decoder.HeldFrames()));
+
+			// the resend goes whole and releases what was held behind it
+			encoder.Encode(Frame<CodecTestSample>(Header(1), Sample(1)).mBytes, wire);
+			Assert::IsTrue(wire == wires[0]);
+			Assert::IsTrue(decoder.Decode(wire, frames));
+			Assert::AreEqual(3, static_cast<int>(frames.size()));
+			Assert::AreEqual(0, static_cast<int>(decoder.HeldFrames()));
+			for (SeqNo seqNo = 1; seqNo <= 3; ++seqNo)
+			{
+				Assert::IsTrue(frames[seqNo - 1] == Frame<CodecTestSample>(Header(seqNo), Sample(seqNo)).mBytes);
+			}
+
+			wire.resize(wire.size() - 1);
+			Assert::IsFalse(decoder.Decode(wire, frames));
+		}
+
+		TEST_METHOD(CodecNetwork_DeliversInOrderOverLossyLink)
+		{
+			auto lossy = std::make_shared<EveryNthLostNetwork>(23);
+			CodecConfig config;
+			config.mBodyCodec = std::make_shared<XorBodyCodec>();
+			auto codec = std::make_shared<CodecNetwork>(lossy, config);
+			constexpr int samples = 300;
+			{
+				ReliableQ<CodecTestSample> q(codec, ProducerConfig{ 64 });
+				for (int i = 0; i < samples; ++i)
+				{
+					CodecTestSample sample = Sample(i);
+					q.EnQ(sample);
+				}
+				std::vector<CodecTestSample> received;
+				std::chrono::duration<int, std::milli> timeout(2000);
+				while (static_cast<int>(received.size()) < samples)
+				{
+					Assert::IsTrue(q.DeQAll(received, timeout) > 0);
+				}
+				for (int i = 0; i < samples; ++i)
+				{
+					const CodecTestSample expected = Sample(i);
+					Assert::AreEqual(0, memcmp(&expected, &received[i], sizeof(expected)));
+				}
+			}
+			Assert::IsTrue(codec->WireBytes() * 2 < codec->FrameBytes());
+		}
+
+		TEST_METHOD(CodecNetwork_LanesWithTheSameNumbersKeepTheirOwnBodies)
+		{
+			// both lanes number their frames from 1, with different bodies
+			auto lossy = std::make_shared<EveryNthLostNetwork>(23);
+			CodecConfig config;
+			config.mBodyCodec = std::make_shared<XorBodyCodec>();
+			auto codec = std::make_shared<CodecNetwork>(lossy, config);
+			constexpr int samples = 300;
+			{
+				PriorityReliableQ<CodecTestSample> q(codec, PriorityConfig(), ProducerConfig{ 64 });
+				for (int i = 0; i < samples; ++i)
+				{
+					q.EnQ(0, Sample(i));
+					q.EnQ(1, Sample(i + 5000));
+				}
+				for (size_t lane = 0; lane < 2; ++lane)
+				{
+					std::vector<CodecTestSample> received;
+					std::chrono::duration<int, std::milli> timeout(2000);
+					while (static_cast<int>(received.size()) < samples)
+					{
+						Assert::IsTrue(q.DeQAll(lane, received, timeout) > 0);
+					}
+					for (int i = 0; i < samples; ++i)
+					{
+						const CodecTestSample expected = Sample(i + (lane == 0 ? 0 : 5000));
+						Assert::AreEqual(0, memcmp(&expected, &received[i], sizeof(expected)));
+					}
+				}
+			}
+			Assert::IsTrue(codec->WireBytes() * 2 < codec->FrameBytes());
+		}
+
+		TEST_METHOD(Codec_WireFramesAreNeverTakenForProbes)
+		{
+			// no session, so the body starts at byte 3 and byte 6 is where a
+			// Header keeps its type, here the value FrameType::Probe has
+			CodecTestSample sample;
+			memset(&sample, static_cast<int>(FrameType::Probe), sizeof(sample));
+			Frame<CodecTestSample> frame(Header(1), sample);
+			FrameEncoder encoder;
+			std::vector<uint8_t> wire;
+			encoder.Encode(frame.mBytes, wire);
+			Assert::IsTrue(wire.size() >= sizeof(Header));
+			Assert::AreEqual(static_cast<int>(FrameType::Probe), static_cast<int>(wire[6]));
+			Assert::IsFalse(IsProbe(wire));
+		}
+
+		TEST_METHOD(CodecNetwork_AcksFramesOverUdpWhilePathIsProbed)
+		{
+			CodecConfig config;
+			config.mBodyCodec = std::make_shared<XorBodyCodec>();
+			std::shared_ptr<INetwork> consumerEnd(new CodecNetwork(std::make_shared<UdpNetwork>(31423), config));
+			std::shared_ptr<INetwork> producerEnd(new CodecNetwork(std::make_shared<UdpNetwork>("127.0.0.1", 31423), config));
+			auto consumer = std::make_unique<QConsumer<CodecTestSample>>(consumerEnd);
+			auto producer = std::make_unique<QProducer<CodecTestSample>>(producerEnd, ProducerConfig{ 16 });
+			constexpr int samples = 300;
+			for (int i = 0; i < samples; ++i)
+			{
+				CodecTestSample sample = Sample(i);
+				memset(sample.mStatus, static_cast<int>(FrameType::Probe), sizeof(sample.mStatus));
+				producer->EnQ(sample);
+			}
+			std::vector<CodecTestSample> received;
+			std::chrono::duration<int, std::milli> timeout(2000);
+			while (static_cast<int>(received.size()) < samples)
+			{
+				Assert::IsTrue(consumer->DeQAll(received, timeout) > 0);
+			}
+			Assert::IsTrue(producer->Flush(std::chrono::duration<int, std::milli>(2000)));
+			Assert::AreEqual(0, static_cast<int>(consumer->MalformedFrames()));
+			consumer->Stop();
+			producer->Stop();
+		}
+	};
+}
@@ -0,0 +1,128 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "Qudp.h"
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Qtest
+{
+	TEST_CLASS(QtestFanOut)
+	{
+	private:
+		struct Body
+		{
+			Body(int value) :mValue(value) {}
+			Body() {};
+
+			int mValue{ 0 };
+		};
+
+		static void AssertDeliveredInOrder(QConsumer<Body>& consumer, int count)
+		{
+			std::vector<Body> received;
+			std::chrono::duration<int, std::milli> timeout(2000);
+			while (static_cast<int>(received.size()) < count)
+			{
+				Assert::IsTrue(consumer.DeQAll(received, timeout) > 0);
+			}
+			Assert::AreEqual(count, static_cast<int>(received.size()));
+			for (int i = 0; i < count; ++i)
+			{
+				Assert::AreEqual(i, received[i].mValue);
+			}
+		}
+
+	public:
+		TEST_METHOD(FanOut_WindowHeldUntilEverySubscriberAcks)
+		{
+			auto fanOut = std::make_shared<IdealFanOutNetwork>(2);
+			auto producer = std::make_unique<QFanOutProducer<Body>>(fanOut, ProducerConfig{ 4 });
+			auto first = fanOut->Subscriber(0);
+			auto consumer0 = std::make_unique<QConsumer<Body>>(first);
+			for (int i = 0; i < 10; ++i)
+			{
+				producer->EnQ(Body{ i });
+			}
+
+			// subscriber 1 is not acking yet, so only the first window went out
+			std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(50));
+			Assert::AreEqual(6, static_cast<int>(producer->Size()));
+			Assert::AreEqual(4, static_cast<int>(consumer0->Size()));
+
+			auto second = fanOut->Subscriber(1);
+			auto consumer1 = std::make_unique<QConsumer<Body>>(second);
+			AssertDeliveredInOrder(*consumer0, 10);
+			AssertDeliveredInOrder(*consumer1, 10);
+			Assert::AreEqual(0, static_cast<int>(producer->EvictedSubscribers()));
+
+			producer->Stop();
+			consumer0->Stop();
+			consumer1->Stop();
+		}
+
+		TEST_METHOD(FanOut_SilentSubscriberEvicted)
+		{
+			auto fanOut = std::make_shared<IdealFanOutNetwork>(3);
+			auto producer = std::make_unique<QFanOutProducer<Body>>(fanOut, ProducerConfig{ 4 },
+				FanOutConfig{ std::chrono::milliseconds(200) });
+			auto first = fanOut->Subscriber(0);
+			auto second = fanOut->Subscriber(1);
+			auto consumer0 = std::make_unique<QConsumer<Body>>(first);
+			auto consumer1 = std::make_unique<QConsumer<Body>>(second);
+			for (int i = 0; i < 20; ++i)
+			{
+				producer->EnQ(Body{ i });
+			}
+
+			AssertDeliveredInOrder(*consumer0, 20);
+			AssertDeliveredInOrder(*consumer1, 20);
+			Assert::AreEqual(1, static_cast<int>(producer->EvictedSubscribers()));
+
+			producer->Stop();
+			consumer0->Stop();
+			consumer1->Stop();
+		}
+
+		TEST_METHOD(FanOut_KeepsSendingOnceEverySubscriberIsEvicted)
+		{
+			auto fanOut = std::make_shared<IdealFanOutNetwork>(1);
+			auto producer = std::make_unique<QFanOutProducer<Body>>(fanOut, ProducerConfig{ 4 },
+				FanOutConfig{ std::chrono::milliseconds(100) });
+			for (int i = 0; i < 10; ++i)
+			{
+				producer->EnQ(Body{ i });
+			}
+
+			// nobody acks, so the first window is held until the eviction
+			for (int wait = 0; wait < 100 && producer->Size() > 0; ++wait)
+			{
+				std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(10));
+			}
+			Assert::AreEqual(1, static_cast<int>(producer->EvictedSubscribers()));
+			Assert::AreEqual(0, static_cast<int>(producer->Size()));
+			producer->Stop();
+		}
+
+		TEST_METHOD(FanOut_UdpLoopBackSubscribers)
+		{
+			std::shared_ptr<IFanOutNetwork> fanOut(new UdpFanOutNetwork({ { "127.0.0.1", 31416 }, { "127.0.0.1", 31417 } }));
+			std::shared_ptr<INetwork> first(new UdpNetwork(31416));
+			std::shared_ptr<INetwork> second(new UdpNetwork(31417));
+			auto consumer0 = std::make_unique<QConsumer<Body>>(first);
+			auto consumer1 = std::make_unique<QConsumer<Body>>(second);
+			auto producer = std::make_unique<QFanOutProducer<Body>>(fanOut, ProducerConfig{ 16 });
+			for (int i = 0; i < 100; ++i)
+			{
+				producer->EnQ(Body{ i });
+			}
+
+			AssertDeliveredInOrder(*consumer0, 100);
+			AssertDeliveredInOrder(*consumer1, 100);
+
+			producer->Stop();
+			consumer0->Stop();
+			consumer1->Stop();
+		}
+	};
+}
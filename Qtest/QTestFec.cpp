@@ -0,0 +1,140 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "Qudp.h"
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Qtest
+{
+	struct FecTestBody
+	{
+		FecTestBody(uint32_t value) :mValue(value), mCheck(~value) {}
+		FecTestBody() {};
+
+		uint32_t mValue{ 0 };
+		uint32_t mCheck{ 0 };
+		uint8_t mPadding[24]{};
+	};
+
+	TEST_CLASS(QtestFec)
+	{
+	private:
+		std::vector<Frame<FecTestBody>> Produced(std::shared_ptr<INetwork>& network)
+		{
+			std::vector<Frame<FecTestBody>> frames;
+			while (network->ProducerToConsumerSize())
+			{
+				std::chrono::duration<int, std::milli> timeout(100);
+				std::vector<uint8_t> data;
+				network->ConsumeDeQ(data, timeout);
+				frames.emplace_back(data);
+			}
+			return frames;
+		}
+
+	public:
+		TEST_METHOD(Gf256_MulAddMatchesScalar)
+		{
+			std::vector<uint8_t> src(67);
+			for (size_t i = 0; i < src.size(); ++i)
+			{
+				src[i] = static_cast<uint8_t>(i * 37 + 11);
+			}
+			for (int c = 0; c < 256; ++c)
+			{
+				std::vector<uint8_t> dst(src.size(), 0x5a);
+				Gf256::MulAddInto(&dst[0], &src[0], static_cast<uint8_t>(c), src.size());
+				for (size_t i = 0; i < src.size(); ++i)
+				{
+					Assert::AreEqual(static_cast<int>(0x5a ^ Gf256::Mul(static_cast<uint8_t>(c), src[i])), static_cast<int>(dst[i]));
+				}
+			}
+			Assert::AreEqual(1, static_cast<int>(Gf256::Mul(7, Gf256::Inv(7))));
+		}
+
+		TEST_METHOD(Fec_AnyLossesUpToParityCountRecovered)
+		{
+			const FecConfig config{ 6, 3 };
+			FecEncoder encoder(config, sizeof(FecTestBody));
+			std::vector<FecTestBody> bodies;
+			for (uint32_t i = 0; i < config.mDataFrames; ++i)
+			{
+				bodies.emplace_back(1000 + i);
+				encoder.Add(0xfffffffd + i, reinterpret_cast<uint8_t*>(&bodies.back()));
+			}
+
+			// lose data frames 0 and 5 and parity frame 1
+			FecDecoder decoder(sizeof(FecTestBody));
+			FecDecoder::Recovered recovered;
+			const SeqNo lastOrdered = 0xfffffffc;
+			decoder.AddParity(encoder.ParityHeader(0), encoder.Parity(0), lastOrdered, recovered);
+			for (uint32_t i : {1, 2, 3, 4})
+			{
+				decoder.AddData(0xfffffffd + i, reinterpret_cast<uint8_t*>(&bodies[i]), lastOrdered, recovered);
+			}
+			Assert::AreEqual(0, static_cast<int>(recovered.size()));
+			decoder.AddParity(encoder.ParityHeader(2), encoder.Parity(2), lastOrdered, recovered);
+			Assert::AreEqual(2, static_cast<int>(recovered.size()));
+
+			for (auto& frame : recovered)
+			{
+				FecTestBody body;
+				memcpy(&body, &frame.second[0], sizeof(body));
+				const SeqNo index = frame.first - 0xfffffffd;
+				Assert::AreEqual(bodies[index].mValue, body.mValue);
+				Assert::AreEqual(bodies[index].mCheck, body.mCheck);
+			}
+		}
+
+		TEST_METHOD(Producer_ParitySentPerGroup)
+		{
+			std::shared_ptr<INetwork> network(new IdealNetwork());
+			auto producer = std::make_unique<QProducer<FecTestBody>>(network, ProducerConfig{ 8, FecConfig{ 3, 1 } });
+			for (uint32_t i = 1; i <= 4; ++i)
+			{
+				producer->EnQ(FecTestBody{ i });
+			}
+			std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(10));
+			producer->Stop();
+
+			auto frames = Produced(network);
+			Assert::AreEqual(5, static_cast<int>(frames.size()));
+			Assert::IsTrue(frames[3].mHeader.mType == FrameType::Parity);
+			Assert::AreEqual(1, static_cast<int>(frames[3].mHeader.mSeqNo));
+			Assert::AreEqual(3, static_cast<int>(frames[3].mHeader.mFecDataFrames));
+			Assert::AreEqual(4, static_cast<int>(frames[4].mHeader.mSeqNo));
+		}
+
+		TEST_METHOD(Consumer_LostFrameRecoveredFromParity)
+		{
+			auto network = std::shared_ptr<INetwork>(new IdealNetwork());
+			auto consumer = std::make_unique<QConsumer<FecTestBody>>(network);
+
+			FecEncoder encoder(FecConfig{ 3, 1 }, sizeof(FecTestBody));
+			for (uint16_t seqNo = 1; seqNo <= 3; ++seqNo)
+			{
+				Frame<FecTestBody> frame(Header(seqNo), FecTestBody{ seqNo * 10u });
+				encoder.Add(seqNo, &frame.mBytes[sizeof(Header)]);
+				if (seqNo != 2)
+				{
+					network->ProducerEnQ(frame.mBytes);
+				}
+			}
+			FecTestBody parityBody;
+			memcpy(&parityBody, encoder.Parity(0), sizeof(parityBody));
+			network->ProducerEnQ(Frame<FecTestBody>(encoder.ParityHeader(0), parityBody).mBytes);
+			std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(100));
+			consumer->Stop();
+
+			Assert::AreEqual(3, static_cast<int>(consumer->Size()));
+			Assert::AreEqual(1, static_cast<int>(consumer->FecRecoveredFrames()));
+			for (uint32_t i = 1; i <= 3; ++i)
+			{
+				FecTestBody rcvddata;
+				consumer->DeQ(rcvddata);
+				Assert::AreEqual(i * 10, rcvddata.mValue);
+			}
+		}
+	};
+}
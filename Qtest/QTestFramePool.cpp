@@ -0,0 +1,144 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "Qudp.h"
+#include <new>
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace
+{
+	std::atomic<size_t> gHeapAllocations{ 0 };
+}
+
+// every allocation made by this module, the library included, is counted
+void* operator new(size_t size)
+{
+	++gHeapAllocations;
+	void* allocation = malloc(size ? size : 1);
+	if (allocation == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	return allocation;
+}
+
+void operator delete(void* allocation) noexcept
+{
+	free(allocation);
+}
+
+void operator delete(void* allocation, size_t) noexcept
+{
+	free(allocation);
+}
+
+namespace Qtest
+{
+	TEST_CLASS(QtestFramePool)
+	{
+	private:
+		struct Body
+		{
+			Body(int value) :mValue(value) {}
+			Body() {};
+
+			int mValue{ 0 };
+			double mReading{ 0 };
+		};
+
+	public:
+		TEST_METHOD(FramePool_ReleasedBuffersAreReused)
+		{
+			std::vector<std::vector<uint8_t>> held;
+			held.reserve(200);
+			for (int i = 0; i < 200; ++i)
+			{
+				held.push_back(FramePool::Acquire(64));
+				Assert::AreEqual(64, static_cast<int>(held.back().size()));
+				Assert::AreEqual(64, static_cast<int>(held.back().capacity()));
+			}
+			for (auto& buffer : held)
+			{
+				FramePool::Release(std::move(buffer));
+				Assert::IsTrue(buffer.empty());
+			}
+			held.clear();
+
+			const size_t poolAllocations = FramePool::HeapAllocations();
+			const size_t heapAllocations = gHeapAllocations;
+			for (int i = 0; i < 200; ++i)
+			{
+				held.push_back(FramePool::Acquire(64));
+			}
+			Assert::AreEqual(static_cast<int>(poolAllocations), static_cast<int>(FramePool::HeapAllocations()));
+			Assert::AreEqual(static_cast<int>(heapAllocations), static_cast<int>(gHeapAllocations.load()));
+			for (auto& buffer : held)
+			{
+				FramePool::Release(std::move(buffer));
+			}
+		}
+
+		TEST_METHOD(FramePool_BuffersAreSizedToTheirFrame)
+		{
+			// a small frame is not handed a large buffer, even one just released
+			auto large = FramePool::Acquire(1500);
+			Assert::AreEqual(2048, static_cast<int>(large.capacity()));
+			FramePool::Release(std::move(large));
+			auto small = FramePool::Acquire(sizeof(Header) + sizeof(Body));
+			Assert::AreEqual(64, static_cast<int>(small.capacity()));
+			auto copy = FramePool::Copy(std::vector<uint8_t>(100, 7));
+			Assert::AreEqual(128, static_cast<int>(copy.capacity()));
+			Assert::AreEqual(100, static_cast<int>(copy.size()));
+			Assert::AreEqual(7, static_cast<int>(copy[99]));
+			FramePool::Release(std::move(small));
+			FramePool::Release(std::move(copy));
+		}
+
+		TEST_METHOD(ReliableQ_NoHeapAllocationPerMessageOnceWarm)
+		{
+			ReliableQ<Body> q(std::shared_ptr<INetwork>(new IdealNetwork()), ProducerConfig{ 64 });
+			std::chrono::duration<int, std::milli> timeout(2000);
+			auto exchange = [&](int count)
+			{
+				for (int i = 0; i < count; ++i)
+				{
+					Body sent(i);
+					q.EnQ(sent);
+					Body received;
+					Assert::AreEqual(1, static_cast<int>(q.DeQ(&received, 1, timeout)));
+					Assert::AreEqual(i, received.mValue);
+				}
+			};
+
+			// fills the pool and grows every queue to its working size
+			exchange(2000);
+			const size_t before = gHeapAllocations;
+			exchange(2000);
+			Assert::AreEqual(0, static_cast<int>(gHeapAllocations - before));
+		}
+
+		TEST_METHOD(PriorityReliableQ_NoHeapAllocationPerMessageOnceWarm)
+		{
+			PriorityReliableQ<Body> q(std::shared_ptr<INetwork>(new IdealNetwork()), PriorityConfig(), ProducerConfig{ 64 });
+			std::chrono::duration<int, std::milli> timeout(2000);
+			auto exchange = [&](int count)
+			{
+				for (int i = 0; i < count; ++i)
+				{
+					const size_t lane = i % 2;
+					q.EnQ(lane, Body(i));
+					Body received;
+					Assert::AreEqual(1, static_cast<int>(q.DeQ(lane, &received, 1, timeout)));
+					Assert::AreEqual(i, received.mValue);
+				}
+			};
+
+			// the lane stamp and the sort into lanes reuse pooled buffers too
+			exchange(2000);
+			const size_t before = gHeapAllocations;
+			exchange(2000);
+			Assert::AreEqual(0, static_cast<int>(gHeapAllocations - before));
+		}
+	};
+}
@@ -0,0 +1,125 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "Qudp.h"
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Qtest
+{
+	TEST_CLASS(QtestPriority)
+	{
+	private:
+		struct Body
+		{
+			Body(int value) :mValue(value) {}
+			Body() {};
+
+			int mValue{ 0 };
+		};
+
+		// loses every frame on one lane while mBlocked is set
+		class BlockedLaneNetwork : public IdealNetwork
+		{
+		public:
+			std::atomic<bool> mBlocked{ true };
+			uint16_t mLane;
+
+			BlockedLaneNetwork(uint16_t lane) :mLane(lane) {}
+
+			void ProducerEnQ(const std::vector<uint8_t>& data) override
+			{
+				Header header;
+				memcpy(&header, &data[0], sizeof(header));
+				if (!(mBlocked && header.mLane == mLane))
+				{
+					IdealNetwork::ProducerEnQ(data);
+				}
+			}
+		};
+
+		static std::vector<uint8_t> FrameFor(int lane, uint8_t value)
+		{
+			return std::vector<uint8_t>{ static_cast<uint8_t>(lane), value };
+		}
+
+		static std::vector<int> Drain(LaneScheduler& scheduler)
+		{
+			std::vector<int> order;
+			std::vector<uint8_t> frame;
+			while (scheduler.Pop(frame))
+			{
+				order.push_back(frame[0]);
+			}
+			return order;
+		}
+
+	public:
+		TEST_METHOD(LaneScheduler_StrictAndWeightedOrder)
+		{
+			LaneScheduler strict(LaneScheduling::Strict, { 1, 1 });
+			for (uint8_t i = 0; i < 3; ++i)
+			{
+				strict.Push(1, FrameFor(1, i));
+			}
+			strict.Push(0, FrameFor(0, 0));
+			strict.Push(0, FrameFor(0, 1));
+			Assert::IsTrue(std::vector<int>{ 0, 0, 1, 1, 1 } == Drain(strict));
+
+			// lane 0 sends 3 for each of lane 1's, an empty lane gives up its turn
+			LaneScheduler weighted(LaneScheduling::Weighted, { 3, 1 });
+			for (uint8_t i = 0; i < 7; ++i)
+			{
+				weighted.Push(0, FrameFor(0, i));
+			}
+			for (uint8_t i = 0; i < 4; ++i)
+			{
+				weighted.Push(1, FrameFor(1, i));
+			}
+			Assert::IsTrue(std::vector<int>{ 0, 0, 0, 1, 0, 0, 0, 1, 0, 1, 1 } == Drain(weighted));
+			Assert::AreEqual(0, static_cast<int>(weighted.Size()));
+		}
+
+		TEST_METHOD(PriorityReliableQ_UrgentLaneNotHeldBehindStalledBulkLane)
+		{
+			auto network = std::make_shared<BlockedLaneNetwork>(1);
+			PriorityReliableQ<Body> q(network);
+
+			// bulk fills its window and then waits on repairs that cannot get through
+			std::vector<Body> bulk;
+			for (int i = 0; i < 100; ++i)
+			{
+				bulk.emplace_back(i);
+			}
+			q.EnQ(1, &bulk[0], bulk.size());
+			for (int i = 0; i < 10; ++i)
+			{
+				q.EnQ(0, Body{ 1000 + i });
+			}
+
+			std::vector<Body> received;
+			std::chrono::duration<int, std::milli> timeout(2000);
+			while (received.size() < 10)
+			{
+				Assert::IsTrue(q.DeQAll(0, received, timeout) > 0);
+			}
+			for (int i = 0; i < 10; ++i)
+			{
+				Assert::AreEqual(1000 + i, received[i].mValue);
+			}
+			std::chrono::duration<int, std::milli> none(0);
+			Assert::AreEqual(0, static_cast<int>(q.DeQAll(1, received, none)));
+
+			network->mBlocked = false;
+			received.clear();
+			while (received.size() < bulk.size())
+			{
+				Assert::IsTrue(q.DeQAll(1, received, timeout) > 0);
+			}
+			for (int i = 0; i < 100; ++i)
+			{
+				Assert::AreEqual(i, received[i].mValue);
+			}
+		}
+	};
+}
@@ -0,0 +1,182 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "Qudp.h"
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Qtest
+{
+	TEST_CLASS(QtestSendLog)
+	{
+	private:
+		struct Body
+		{
+			Body(int value) :mValue(value) {}
+			Body() {};
+
+			int mValue{ 0 };
+		};
+
+		static void RemoveLogFiles(const std::string& directory)
+		{
+			WIN32_FIND_DATAA found;
+			HANDLE search = FindFirstFileA((directory + "\\*.qlog").c_str(), &found);
+			if (search != INVALID_HANDLE_VALUE)
+			{
+				do
+				{
+					DeleteFileA((directory + "\\" + found.cFileName).c_str());
+				} while (FindNextFileA(search, &found));
+				FindClose(search);
+			}
+		}
+
+		static void AssertDelivered(QConsumer<Body>& consumer, int from, int to)
+		{
+			std::vector<Body> received;
+			std::chrono::duration<int, std::milli> timeout(2000);
+			while (static_cast<int>(received.size()) < to - from + 1)
+			{
+				Assert::IsTrue(consumer.DeQAll(received, timeout) > 0);
+			}
+			Assert::AreEqual(to - from + 1, static_cast<int>(received.size()));
+			for (int i = from; i <= to; ++i)
+			{
+				Assert::AreEqual(i, received[i - from].mValue);
+			}
+		}
+
+	public:
+		TEST_METHOD(SendLog_RecoversCommittedFramesAndReleasesAckedSegments)
+		{
+			const SendLogConfig config{ "QtestSendLog", 4 };
+			RemoveLogFiles(config.mDirectory);
+			{
+				SendLog log(config, sizeof(Body));
+				Assert::AreEqual(0, static_cast<int>(log.Open().size()));
+				for (int i = 1; i <= 10; ++i)
+				{
+					Body body(i * 100);
+					Assert::AreEqual(static_cast<SeqNo>(i), log.Append(&body));
+				}
+				log.Commit();
+			}
+			{
+				SendLog log(config, sizeof(Body));
+				auto recovered = log.Open();
+				Assert::AreEqual(10, static_cast<int>(recovered.size()));
+				for (int i = 0; i < 10; ++i)
+				{
+					Body body;
+					memcpy(&body, &recovered[i].second[0], sizeof(body));
+					Assert::AreEqual(static_cast<SeqNo>(i + 1), recovered[i].first);
+					Assert::AreEqual((i + 1) * 100, body.mValue);
+				}
+				Assert::AreEqual(static_cast<SeqNo>(11), log.NextSeqNo());
+
+				// frames 1 to 8 fill the first two segments, 9 and 10 share the third
+				log.Release(8);
+			}
+			{
+				SendLog log(config, sizeof(Body));
+				auto recovered = log.Open();
+				Assert::AreEqual(2, static_cast<int>(recovered.size()));
+				Assert::AreEqual(static_cast<SeqNo>(9), recovered.front().first);
+				Assert::AreEqual(static_cast<SeqNo>(11), log.NextSeqNo());
+				log.Release(10);
+			}
+			{
+				// everything acked, the numbering still carries on
+				SendLog log(config, sizeof(Body));
+				Assert::AreEqual(0, static_cast<int>(log.Open().size()));
+				Assert::AreEqual(static_cast<SeqNo>(11), log.NextSeqNo());
+			}
+			RemoveLogFiles(config.mDirectory);
+		}
+
+		TEST_METHOD(Producer_ResumesFromLogAndConsumerCheckpoint)
+		{
+			ProducerConfig config;
+			config.mLog.mDirectory = "QtestResumeLog";
+			config.mLog.mSegmentFrames = 8;
+			ConsumerConfig consumerConfig;
+			consumerConfig.mCheckpointFile = "QtestResumeLog\\consumer.qlog";
+			RemoveLogFiles(config.mLog.mDirectory);
+
+			// no consumer yet, the frames only reach the log
+			{
+				std::shared_ptr<INetwork> network = std::make_shared<IdealNetwork>();
+				auto producer = std::make_unique<QProducer<Body>>(network, config);
+				for (int i = 0; i < 10; ++i)
+				{
+					producer->EnQ(Body{ i });
+				}
+				std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(50));
+				producer->Stop();
+				// only bare headers asking where to resume went out
+				Assert::IsTrue(network->ProducerToConsumerSize() > 0);
+				std::vector<uint8_t> sent;
+				std::chrono::duration<int, std::milli> noWait(0);
+				while (network->ConsumeDeQ(sent, noWait))
+				{
+					Assert::AreEqual(sizeof(Header), sent.size());
+				}
+			}
+
+			// a restarted producer sends what the last one left behind
+			{
+				std::shared_ptr<INetwork> network = std::make_shared<IdealNetwork>();
+				auto producer = std::make_unique<QProducer<Body>>(network, config);
+				auto consumer = std::make_unique<QConsumer<Body>>(network, consumerConfig);
+				AssertDelivered(*consumer, 0, 9);
+				for (int i = 10; i < 20; ++i)
+				{
+					producer->EnQ(Body{ i });
+				}
+				AssertDelivered(*consumer, 10, 19);
+				consumer->Stop();
+				producer->Stop();
+			}
+
+			// both ends restarted, nothing delivered twice
+			{
+				std::shared_ptr<INetwork> network = std::make_shared<IdealNetwork>();
+				auto producer = std::make_unique<QProducer<Body>>(network, config);
+				auto consumer = std::make_unique<QConsumer<Body>>(network, consumerConfig);
+				for (int i = 20; i < 25; ++i)
+				{
+					producer->EnQ(Body{ i });
+				}
+				AssertDelivered(*consumer, 20, 24);
+				consumer->Stop();
+				producer->Stop();
+			}
+			RemoveLogFiles(config.mLog.mDirectory);
+		}
+
+		TEST_METHOD(Producer_DurableOverUdpAsksWhereToResume)
+		{
+			// without probes nothing else would tell the consumer where the producer is
+			UdpNetworkOptions options;
+			options.mDiscoverPathMtu = false;
+			ProducerConfig config{ 16 };
+			config.mLog.mDirectory = "QtestUdpLog";
+			RemoveLogFiles(config.mLog.mDirectory);
+			{
+				std::shared_ptr<INetwork> consumerEnd(new UdpNetwork(31422, options));
+				std::shared_ptr<INetwork> producerEnd(new UdpNetwork("127.0.0.1", 31422, options));
+				auto consumer = std::make_unique<QConsumer<Body>>(consumerEnd);
+				auto producer = std::make_unique<QProducer<Body>>(producerEnd, config);
+				for (int i = 0; i < 50; ++i)
+				{
+					producer->EnQ(Body{ i });
+				}
+				AssertDelivered(*consumer, 0, 49);
+				consumer->Stop();
+				producer->Stop();
+			}
+			RemoveLogFiles(config.mLog.mDirectory);
+		}
+	};
+}
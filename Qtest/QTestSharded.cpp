@@ -0,0 +1,100 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "Qudp.h"
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Qtest
+{
+	TEST_CLASS(QtestSharded)
+	{
+	private:
+		struct Body
+		{
+			Body(int producer, int value) :mProducer(producer), mValue(value) {}
+			Body() {};
+
+			int mProducer{ 0 };
+			int mValue{ 0 };
+		};
+
+	public:
+		TEST_METHOD(ShardPort_SpreadsSequentialKeys)
+		{
+			ShardedConsumerConfig config;
+			config.mShards = 4;
+			std::vector<int> perShard(config.mShards);
+			for (uint32_t key = 0; key < 400; ++key)
+			{
+				const int port = config.ShardPort(key);
+				Assert::IsTrue(port >= config.mBasePort && port < config.mBasePort + 4);
+				++perShard[port - config.mBasePort];
+			}
+			for (int count : perShard)
+			{
+				Assert::IsTrue(count > 80 && count < 120);
+			}
+		}
+
+		TEST_METHOD(ShardedConsumer_EachFlowDeliveredInOrder)
+		{
+			constexpr int producers = 4;
+			constexpr int frames = 200;
+			ShardedConsumerConfig config;
+			config.mShards = 2;
+			QShardedConsumer<Body> consumer(config);
+
+			std::vector<std::unique_ptr<QProducer<Body>>> senders;
+			std::vector<int> shardUsed(config.mShards);
+			for (int producer = 0; producer < producers; ++producer)
+			{
+				const int port = config.ShardPort(producer);
+				++shardUsed[port - config.mBasePort];
+				std::shared_ptr<INetwork> network(new UdpNetwork("127.0.0.1", port));
+				senders.push_back(std::make_unique<QProducer<Body>>(network, ProducerConfig{ 32 }));
+			}
+			Assert::IsTrue(shardUsed[0] > 0 && shardUsed[1] > 0);
+			for (int i = 0; i < frames; ++i)
+			{
+				for (int producer = 0; producer < producers; ++producer)
+				{
+					senders[producer]->EnQ(Body(producer, i));
+				}
+			}
+
+			std::chrono::duration<int, std::milli> timeout(2000);
+			const auto deadline = std::chrono::steady_clock::now() + timeout;
+			while (consumer.Flows() < producers && std::chrono::steady_clock::now() < deadline)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+			Assert::AreEqual(producers, static_cast<int>(consumer.Flows()));
+
+			std::vector<bool> seen(producers);
+			for (size_t flow = 0; flow < consumer.Flows(); ++flow)
+			{
+				std::vector<Body> received;
+				while (received.size() < frames)
+				{
+					Assert::IsTrue(consumer.Flow(flow).DeQAll(received, timeout) > 0);
+				}
+				Assert::AreEqual(frames, static_cast<int>(received.size()));
+				const int producer = received[0].mProducer;
+				Assert::IsFalse(seen[producer]);
+				seen[producer] = true;
+				for (int i = 0; i < frames; ++i)
+				{
+					Assert::AreEqual(producer, received[i].mProducer);
+					Assert::AreEqual(i, received[i].mValue);
+				}
+			}
+
+			for (auto& sender : senders)
+			{
+				sender->Stop();
+			}
+			consumer.Stop();
+		}
+	};
+}
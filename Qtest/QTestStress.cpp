@@ -95,9 +95,9 @@ namespace Qtest
 	TEST_CLASS(QtestStress)
 	{
 	private:
-		void StressTestNetwork(std::shared_ptr<INetwork> network, uint32_t numberOfFrames)
+		void StressTestNetwork(std::shared_ptr<INetwork> network, uint32_t numberOfFrames, const ProducerConfig& config = ProducerConfig())
 		{
-			auto queue = std::make_shared<ReliableQ<TestBody>>(network);
+			auto queue = std::make_shared<ReliableQ<TestBody>>(network, config);
 			auto producer = std::async(std::launch::async, [&](std::shared_ptr<ReliableQ<TestBody>> p)
 				{
 					std::chrono::duration<int, std::micro> sleepTime(500);
@@ -149,6 +149,12 @@ namespace Qtest
 			StressTestNetwork(network, 200);
 		}
 
+		TEST_METHOD(StressLosyNetworkWithFec)
+		{
+			auto network = std::make_shared<ImperfectNetwork>(20.0f, 0.0f, 0.0f);
+			StressTestNetwork(network, 200, ProducerConfig{ 8, FecConfig{ 4, 2 } });
+		}
+
 		TEST_METHOD(StressReallyBadNetwork)
 		{
 			auto network = std::make_shared<ImperfectNetwork>(50.0f/3.0f, 50.0f / 3.0f, 50.0f / 3.0f);
@@ -161,6 +167,37 @@ namespace Qtest
 			StressTestNetwork(network, 200);
 		}
 
+		TEST_METHOD(StressSharedMemoryNetwork)
+		{
+			auto network = std::make_shared<SharedMemoryNetwork>("QtestStress");
+			StressTestNetwork(network, 200);
+		}
+
+		TEST_METHOD(StressRioLoopBackNetwork)
+		{
+			auto network = std::make_shared<RioUdpNetwork>();
+			StressTestNetwork(network, 200);
+		}
+
+		TEST_METHOD(StressLosyNetworkWithNacks)
+		{
+			auto network = std::make_shared<ImperfectNetwork>(20.0f, 0.0f, 0.0f);
+			ProducerConfig config;
+			config.mMaxPendingFrames = 256;
+			config.mRepair = RepairMode::Nack;
+			StressTestNetwork(network, 200, config);
+		}
+
+		TEST_METHOD(StressMulticastLoopBackNetwork)
+		{
+			auto network = std::make_shared<UdpMulticastNetwork>(MulticastGroup{ "239.255.31.41", 31418, "127.0.0.1" },
+				UdpMulticastNetwork::Role::Both);
+			ProducerConfig config;
+			config.mMaxPendingFrames = 256;
+			config.mRepair = RepairMode::Nack;
+			StressTestNetwork(network, 200, config);
+		}
+
 		
 	};
 }
\ No newline at end of file
@@ -0,0 +1,114 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "Qudp.h"
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Qtest
+{
+	TEST_CLASS(QtestTrace)
+	{
+	private:
+		struct Body
+		{
+			Body(int value) :mValue(value) {}
+			Body() {};
+
+			int mValue{ 0 };
+		};
+
+		// when each stage first happened to seqNo, -1 if it did not
+		static std::vector<int64_t> Stages(const std::vector<MessageTracer::Event>& events, SeqNo seqNo)
+		{
+			std::vector<int64_t> stages(static_cast<size_t>(TraceStage::Taken) + 1, -1);
+			for (auto& event : events)
+			{
+				auto& at = stages[static_cast<size_t>(event.mStage)];
+				if (event.mSeqNo == seqNo && at < 0)
+				{
+					at = event.mTime_ns;
+				}
+			}
+			return stages;
+		}
+
+		static int64_t At(const std::vector<int64_t>& stages, TraceStage stage)
+		{
+			return stages[static_cast<size_t>(stage)];
+		}
+
+	public:
+		TEST_METHOD(Tracer_EachThreadFillsItsOwnBuffer)
+		{
+			MessageTracer tracer(TraceConfig{ 4, 8 });
+			Assert::IsTrue(tracer.Sampled(8));
+			Assert::IsFalse(tracer.Sampled(9));
+			Assert::AreEqual(12u, tracer.NextSampled(9));
+
+			for (SeqNo seqNo = 0; seqNo < 40; seqNo += 4)
+			{
+				tracer.Record(TraceStage::Sent, seqNo);
+			}
+			std::async(std::launch::async, [&]()
+				{
+					tracer.Record(TraceStage::Received, 4);
+				}).get();
+
+			// the first thread took 8 of its 10, the other has a buffer of its own
+			Assert::AreEqual(9, static_cast<int>(tracer.Events().size()));
+			Assert::AreEqual(2, static_cast<int>(tracer.DroppedEvents()));
+		}
+
+		TEST_METHOD(Tracer_SampledMessagesPassEveryStageInOrder)
+		{
+			constexpr int frames = 200;
+			auto tracer = std::make_shared<MessageTracer>(TraceConfig{ 8 });
+			std::shared_ptr<INetwork> network(new IdealNetwork());
+			ConsumerConfig consumerConfig;
+			consumerConfig.mTracer = tracer;
+			ProducerConfig producerConfig{ 16 };
+			producerConfig.mTracer = tracer;
+			auto consumer = std::make_unique<QConsumer<Body>>(network, consumerConfig);
+			auto producer = std::make_unique<QProducer<Body>>(network, producerConfig);
+			for (int i = 0; i < frames; ++i)
+			{
+				producer->EnQ(Body(i));
+			}
+
+			std::vector<Body> received;
+			std::chrono::duration<int, std::milli> timeout(2000);
+			while (received.size() < frames)
+			{
+				Assert::IsTrue(consumer->DeQAll(received, timeout) > 0);
+			}
+			Assert::IsTrue(producer->Flush(std::chrono::duration<int, std::milli>(2000)));
+			consumer->Stop();
+			producer->Stop();
+
+			// frame N was queued Nth, so numbers 1 to 200 were sent
+			const auto events = tracer->Events();
+			Assert::IsTrue(events.size() >= frames / 8 * 6);
+			for (SeqNo seqNo = 8; seqNo <= frames; seqNo += 8)
+			{
+				const auto stages = Stages(events, seqNo);
+				Assert::IsTrue(At(stages, TraceStage::Queued) > 0);
+				Assert::IsTrue(At(stages, TraceStage::Queued) <= At(stages, TraceStage::Sent));
+				Assert::IsTrue(At(stages, TraceStage::Sent) <= At(stages, TraceStage::Received));
+				Assert::IsTrue(At(stages, TraceStage::Received) <= At(stages, TraceStage::Delivered));
+				Assert::IsTrue(At(stages, TraceStage::Delivered) <= At(stages, TraceStage::Taken));
+				Assert::IsTrue(At(stages, TraceStage::Received) <= At(stages, TraceStage::Acked));
+			}
+			for (auto& event : events)
+			{
+				Assert::IsTrue(tracer->Sampled(event.mSeqNo));
+			}
+
+			std::ostringstream json;
+			tracer->ExportChromeTrace(json);
+			Assert::AreEqual(0, static_cast<int>(json.str().find("{\"traceEvents\":[")));
+			Assert::IsTrue(json.str().find("\"ToSendQ\"") != std::string::npos);
+			Assert::IsTrue(json.str().find("\"DeliveredQ\"") != std::string::npos);
+		}
+	};
+}
@@ -18,6 +18,78 @@ namespace Qtest
 	TEST_CLASS(QtestUnit)
 	{
 	private:
+		// loses every send of one data frame
+		class DropFrameNetwork : public IdealNetwork
+		{
+			SeqNo mDropped;
+
+		public:
+			DropFrameNetwork(SeqNo dropped) :mDropped(dropped) {}
+
+			void ProducerEnQ(const std::vector<uint8_t>& data) override
+			{
+				Frame<TestBody> frame(data);
+				if (frame.mHeader.mType != FrameType::Data || frame.mHeader.mSeqNo != mDropped)
+				{
+					IdealNetwork::ProducerEnQ(data);
+				}
+			}
+		};
+
+		// loses the first ack that opens a consumer's window from half or less to more
+		class DropReopenAckNetwork : public IdealNetwork
+		{
+			size_t mHalf;
+			size_t mLastFree{ SIZE_MAX };  // open until an ack says otherwise
+
+		public:
+			bool mDropped{ false };
+
+			DropReopenAckNetwork(size_t window) :mHalf(window / 2) {}
+
+			void ConsumerEnQ(const std::vector<uint8_t>& data) override
+			{
+				Frame<TestBody> frame(data);
+				if (frame.mHeader.mType == FrameType::Data && frame.mHeader.mWindow != 0)
+				{
+					const size_t free = frame.mHeader.mWindow - 1u;
+					const bool reopens = mLastFree <= mHalf && free > mHalf;
+					mLastFree = free;
+					if (reopens && !mDropped)
+					{
+						mDropped = true;
+						return;
+					}
+				}
+				IdealNetwork::ConsumerEnQ(data);
+			}
+		};
+
+		// records which threads configure and use each side
+		class ThreadRecordingNetwork : public IdealNetwork
+		{
+		public:
+			std::atomic<std::thread::id> mProducerConfigured;
+			std::atomic<std::thread::id> mProducerSent;
+			std::atomic<std::thread::id> mConsumerConfigured;
+			std::atomic<std::thread::id> mConsumerReceived;
+
+			void ConfigureProducerThread() override { mProducerConfigured = std::this_thread::get_id(); }
+			void ConfigureConsumerThread() override { mConsumerConfigured = std::this_thread::get_id(); }
+
+			void ProducerEnQ(const std::vector<uint8_t>& data) override
+			{
+				mProducerSent = std::this_thread::get_id();
+				IdealNetwork::ProducerEnQ(data);
+			}
+
+			bool ConsumeDeQ(std::vector<uint8_t>& data, std::chrono::duration<int, std::milli>& timeOut) override
+			{
+				mConsumerReceived = std::this_thread::get_id();
+				return IdealNetwork::ConsumeDeQ(data, timeOut);
+			}
+		};
+
 		Header GetLastAck(std::shared_ptr<INetwork>& network, size_t& waitingAckCount)
 		{
 			Header header;
@@ -159,6 +231,615 @@ namespace Qtest
 			Assert::AreEqual(static_cast<int>(0), static_cast<int>(producer->Size()));
 		}
 
+		TEST_METHOD(Producer_LargeWindowSentWithoutAcks)
+		{
+			std::shared_ptr<INetwork> network(new IdealNetwork());
+			ProducerConfig config;
+			config.mMaxPendingFrames = 20000;
+			auto producer = std::make_unique<QProducer<TestBody>>(network, config);
+			for (int i = 1; i <= 20000; ++i)
+			{
+				producer->EnQ(TestBody{ i });
+			}
+			for (int wait = 0; wait < 500 && producer->Size() != 0; ++wait)
+			{
+				std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(10));
+			}
+			producer->Stop();
+
+			// the oldest frame may also have been resent while the window filled
+			SeqNo highestSeqNo = 0;
+			while (network->ProducerToConsumerSize())
+			{
+				std::chrono::duration<int, std::milli> timeout(100);
+				std::vector<uint8_t> data;
+				network->ConsumeDeQ(data, timeout);
+				Frame<TestBody> frame(data);
+				if (frame.mHeader.mSeqNo > highestSeqNo)
+				{
+					Assert::AreEqual(highestSeqNo + 1, frame.mHeader.mSeqNo);
+					highestSeqNo = frame.mHeader.mSeqNo;
+				}
+			}
+			Assert::AreEqual(20000, static_cast<int>(highestSeqNo));
+		}
+
+		TEST_METHOD(Producer_PacingCapSpacesFrames)
+		{
+			std::shared_ptr<INetwork> network(new IdealNetwork());
+			ProducerConfig config;
+			config.mMaxPendingFrames = 50;
+			config.mPacing = PacingConfig{ true, 100.0, 1.0 };
+			auto producer = std::make_unique<QProducer<TestBody>>(network, config);
+			for (int i = 1; i <= 50; ++i)
+			{
+				producer->EnQ(TestBody{ i });
+			}
+			std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(95));
+			producer->Stop();
+
+			size_t deliveryCount = 0;
+			GetLastProduced(network, deliveryCount);
+			Assert::IsTrue(5 <= deliveryCount && deliveryCount <= 15);
+		}
+
+		TEST_METHOD(Pacer_WindowSpreadOverRtt)
+		{
+			Pacer pacer(PacingConfig{ true, 0.0, 1.0 }, 10);
+			Assert::AreEqual(0.0, pacer.FramesPerSec()); // no rtt yet, unpaced
+			pacer.OnRttSample(std::chrono::milliseconds(10));
+			Assert::AreEqual(1000.0, pacer.FramesPerSec());
+
+			Assert::AreEqual(0LL, static_cast<long long>(pacer.Delay().count()));
+			pacer.OnSend();
+			auto delay = pacer.Delay();
+			Assert::IsTrue(std::chrono::microseconds(900) < delay && delay <= std::chrono::milliseconds(1));
+
+			Pacer capped(PacingConfig{ true, 200.0, 1.0 }, 10);
+			capped.OnRttSample(std::chrono::milliseconds(10));
+			Assert::AreEqual(200.0, capped.FramesPerSec());
+		}
+
+		TEST_METHOD(SeqNo_OrderingSurvivesWrapAround)
+		{
+			Assert::IsTrue(SeqLess(0xfffffff0, 5));
+			Assert::IsFalse(SeqLess(5, 0xfffffff0));
+			Assert::AreEqual(21, SeqDiff(5, 0xfffffff0));
+			Assert::IsTrue(SeqLess(0x7fffffff, 0x80000000));
+		}
+
+		TEST_METHOD(BlockingQ_EveryWaitStrategyDeliversAndTimesOut)
+		{
+			for (auto strategy : { WaitStrategy::Block, WaitStrategy::SpinThenPark, WaitStrategy::SpinThenYield, WaitStrategy::BusySpin })
+			{
+				BlockingQ<int> q(WaitConfig{ strategy, 50 });
+				std::chrono::duration<int, std::milli> timeout(20);
+				int value = 0;
+
+				auto start = std::chrono::steady_clock::now();
+				Assert::IsFalse(q.DeQ(value, timeout));
+				Assert::IsTrue(std::chrono::steady_clock::now() - start >= timeout);
+
+				auto later = std::async(std::launch::async, [&]()
+					{
+						std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(5));
+						q.EnQ(42);
+					});
+				timeout = std::chrono::duration<int, std::milli>(1000);
+				Assert::IsTrue(q.DeQ(value, timeout));
+				Assert::AreEqual(42, value);
+				later.get();
+
+				// zero timeout polls without waiting
+				timeout = std::chrono::duration<int, std::milli>(0);
+				Assert::IsFalse(q.DeQ(value, timeout));
+			}
+		}
+
+		TEST_METHOD(ReliableQ_BulkEnQDeQKeepsOrder)
+		{
+			ReliableQ<TestBody> q(std::shared_ptr<INetwork>(new IdealNetwork()), ProducerConfig{ 16 });
+			std::vector<TestBody> sent;
+			for (int i = 0; i < 100; ++i)
+			{
+				sent.emplace_back(i);
+			}
+			q.EnQ(&sent[0], sent.size());
+
+			std::vector<TestBody> received(30);
+			std::chrono::duration<int, std::milli> timeout(1000);
+			size_t count = 0;
+			while (count < 70)
+			{
+				auto batch = q.DeQ(&received[0], (std::min)(received.size(), 70 - count), timeout);
+				Assert::IsTrue(batch > 0);
+				for (size_t i = 0; i < batch; ++i)
+				{
+					Assert::AreEqual(static_cast<int>(count + i), received[i].mValue);
+				}
+				count += batch;
+			}
+
+			std::vector<TestBody> rest;
+			while (count + rest.size() < sent.size())
+			{
+				Assert::IsTrue(q.DeQAll(rest, timeout) > 0);
+			}
+			for (size_t i = 0; i < rest.size(); ++i)
+			{
+				Assert::AreEqual(static_cast<int>(count + i), rest[i].mValue);
+			}
+
+			timeout = std::chrono::duration<int, std::milli>(10);
+			Assert::AreEqual(0, static_cast<int>(q.DeQ(&received[0], received.size(), timeout)));
+		}
+
+		TEST_METHOD(SharedMemory_FramesCrossTheRingWrapAndDropWhenFull)
+		{
+			// two ends of one section, as a producer and a consumer process would open it
+			SharedMemoryOptions options{ 256, 256 };
+			SharedMemoryNetwork producerEnd("QtestShmRing", options);
+			SharedMemoryNetwork consumerEnd("QtestShmRing", options);
+
+			// records are a 4 byte length and the frame, 8 byte aligned
+			const int fit = 256 / static_cast<int>((4 + sizeof(Header) + sizeof(TestBody) + 7) & ~size_t(7));
+			for (int i = 0; i < fit + 2; ++i)
+			{
+				producerEnd.ProducerEnQ(Frame<TestBody>(Header(i), TestBody(i)).mBytes);
+			}
+			Assert::AreEqual(2, static_cast<int>(producerEnd.DroppedFrames()));
+			Assert::AreEqual(fit, static_cast<int>(consumerEnd.ProducerToConsumerSize()));
+
+			std::chrono::duration<int, std::milli> timeout(0);
+			std::vector<uint8_t> data;
+			for (int i = 0; i < fit; ++i)
+			{
+				Assert::IsTrue(consumerEnd.ConsumeDeQ(data, timeout));
+				Assert::AreEqual(i, Frame<TestBody>(data).mBody.mValue);
+			}
+			Assert::IsFalse(consumerEnd.ConsumeDeQ(data, timeout));
+
+			// the ring wraps every few frames
+			for (int i = 0; i < 100; ++i)
+			{
+				producerEnd.ProducerEnQ(Frame<TestBody>(Header(i), TestBody(i)).mBytes);
+				Assert::IsTrue(consumerEnd.ConsumeDeQ(data, timeout));
+				Assert::AreEqual(i, Frame<TestBody>(data).mBody.mValue);
+			}
+
+			// a parked reader is woken by the other end
+			auto ack = std::async(std::launch::async, [&]()
+				{
+					std::chrono::duration<int, std::milli> wait(2000);
+					std::vector<uint8_t> ackData;
+					return producerEnd.ProducerDeQ(ackData, wait) ? Frame<TestBody>(ackData).mHeader.mSeqNo : 0;
+				});
+			std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(20));
+			consumerEnd.ConsumerEnQ(Frame<TestBody>(Header(42)).mBytes);
+			Assert::AreEqual(42u, ack.get());
+		}
+
+		TEST_METHOD(SharedMemory_ProducerAndConsumerOnSeparateEnds)
+		{
+			SharedMemoryOptions options{ 1024, 256 };
+			std::shared_ptr<INetwork> producerEnd = std::make_shared<SharedMemoryNetwork>("QtestShmEnds", options);
+			std::shared_ptr<INetwork> consumerEnd = std::make_shared<SharedMemoryNetwork>("QtestShmEnds", options);
+			auto producer = std::make_unique<QProducer<TestBody>>(producerEnd, ProducerConfig{ 32 });
+			auto consumer = std::make_unique<QConsumer<TestBody>>(consumerEnd);
+
+			// 32 byte records, so a window of 32 just fits and the ring wraps every window
+			std::vector<TestBody> sent;
+			for (int i = 0; i < 500; ++i)
+			{
+				sent.emplace_back(i);
+			}
+			producer->EnQ(&sent[0], sent.size());
+
+			std::vector<TestBody> received;
+			std::chrono::duration<int, std::milli> timeout(2000);
+			while (received.size() < sent.size())
+			{
+				Assert::IsTrue(consumer->DeQAll(received, timeout) > 0);
+			}
+			for (size_t i = 0; i < received.size(); ++i)
+			{
+				Assert::AreEqual(static_cast<int>(i), received[i].mValue);
+			}
+			consumer->Stop();
+			producer->Stop();
+		}
+
+		TEST_METHOD(Rio_ProducerAndConsumerOnSeparateEnds)
+		{
+			// separate networks, one completion queue between them
+			RioOptions options;
+			options.mReceiveSlots = 64;
+			options.mSendSlots = 64;
+			auto consumerRio = std::make_shared<RioUdpNetwork>(31420, options);
+			auto producerRio = std::make_shared<RioUdpNetwork>("127.0.0.1", 31420, options);
+			std::shared_ptr<INetwork> consumerEnd = consumerRio;
+			std::shared_ptr<INetwork> producerEnd = producerRio;
+			auto producer = std::make_unique<QProducer<TestBody>>(producerEnd, ProducerConfig{ 32 });
+			auto consumer = std::make_unique<QConsumer<TestBody>>(consumerEnd);
+
+			std::vector<TestBody> sent;
+			for (int i = 0; i < 500; ++i)
+			{
+				sent.emplace_back(i);
+			}
+			producer->EnQ(&sent[0], sent.size());
+
+			std::vector<TestBody> received;
+			std::chrono::duration<int, std::milli> timeout(2000);
+			while (received.size() < sent.size())
+			{
+				Assert::IsTrue(consumer->DeQAll(received, timeout) > 0);
+			}
+			for (size_t i = 0; i < received.size(); ++i)
+			{
+				Assert::AreEqual(static_cast<int>(i), received[i].mValue);
+			}
+			consumer->Stop();
+			producer->Stop();
+			Assert::AreEqual(0, static_cast<int>(producerRio->DroppedFrames() + consumerRio->DroppedFrames()));
+		}
+
+		TEST_METHOD(PathMtuSearch_SettlesOnTheLargestSizeThatGetsThrough)
+		{
+			constexpr int pathBytes = 1000;
+			PathMtuSearch search(1472);
+			Assert::AreEqual(static_cast<int>(PathMtuSearch::cBaseBytes), search.Confirmed());
+			auto now = std::chrono::steady_clock::now();
+			int probes = 0;
+			for (int step = 0; step < 200 && search.Searching(); ++step)
+			{
+				const int bytes = search.Next(now);
+				if (bytes != 0)
+				{
+					++probes;
+					if (bytes <= pathBytes)
+					{
+						search.OnEcho(bytes);
+					}
+				}
+				now += std::chrono::milliseconds(50);
+			}
+			Assert::IsFalse(search.Searching());
+			Assert::AreEqual(pathBytes, search.Confirmed());
+			Assert::IsTrue(probes <= 11 * PathMtuSearch::cProbes);
+			Assert::AreEqual(0, search.Next(now));
+		}
+
+		TEST_METHOD(UdpNetwork_LargeFramesCrossAndThePathIsProbed)
+		{
+			// one byte short of what the producer tries first, so the search
+			// rules that out then climbs to this
+			UdpNetworkOptions consumerOptions;
+			consumerOptions.mMaxDatagramBytes = 1471;
+			std::shared_ptr<INetwork> consumerEnd(new UdpNetwork(31421, consumerOptions));
+			auto producerUdp = std::make_shared<UdpNetwork>("127.0.0.1", 31421);
+			std::shared_ptr<INetwork> producerEnd = producerUdp;
+			Assert::AreEqual(static_cast<int>(PathMtuSearch::cBaseBytes), static_cast<int>(producerUdp->MaxDatagramBytes()));
+
+			struct LargeBody
+			{
+				int mValue{ 0 };
+				uint8_t mPadding[1000]{};
+			};
+			auto producer = std::make_unique<QProducer<LargeBody>>(producerEnd, ProducerConfig{ 32 });
+			auto consumer = std::make_unique<QConsumer<LargeBody>>(consumerEnd);
+			for (int i = 0; i < 100; ++i)
+			{
+				LargeBody body;
+				body.mValue = i;
+				producer->EnQ(body);
+			}
+			std::vector<LargeBody> received;
+			std::chrono::duration<int, std::milli> timeout(2000);
+			while (received.size() < 100)
+			{
+				Assert::IsTrue(consumer->DeQAll(received, timeout) > 0);
+			}
+			for (int i = 0; i < 100; ++i)
+			{
+				Assert::AreEqual(i, received[i].mValue);
+			}
+
+			for (int wait = 0; wait < 300 && producerUdp->MaxDatagramBytes() != 1471; ++wait)
+			{
+				std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(10));
+			}
+			Assert::AreEqual(1471, static_cast<int>(producerUdp->MaxDatagramBytes()));
+			Assert::AreEqual(0, static_cast<int>(consumer->MalformedFrames()));
+			consumer->Stop();
+			producer->Stop();
+		}
+
+		TEST_METHOD(UdpNetwork_FramesLargerThanThePathStillCross)
+		{
+			// the producer never probes past its 1472 bytes, so these frames
+			// are always over what the path is known to carry
+			UdpNetworkOptions consumerOptions;
+			consumerOptions.mMaxDatagramBytes = 8000;
+			std::shared_ptr<INetwork> consumerEnd(new UdpNetwork(31424, consumerOptions));
+			auto producerUdp = std::make_shared<UdpNetwork>("127.0.0.1", 31424);
+			std::shared_ptr<INetwork> producerEnd = producerUdp;
+
+			struct HugeBody
+			{
+				int mValue{ 0 };
+				uint8_t mPadding[3000]{};
+			};
+			auto producer = std::make_unique<QProducer<HugeBody>>(producerEnd, ProducerConfig{ 32 });
+			auto consumer = std::make_unique<QConsumer<HugeBody>>(consumerEnd);
+			std::vector<HugeBody> received;
+			std::chrono::duration<int, std::milli> timeout(2000);
+			for (int i = 0; i < 100; ++i)
+			{
+				HugeBody body;
+				body.mValue = i;
+				producer->EnQ(body);
+				if (i == 49)
+				{
+					// the rest go once the search has settled on the path
+					for (int wait = 0; wait < 300 && producerUdp->MaxDatagramBytes() != 1472; ++wait)
+					{
+						std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(10));
+					}
+					Assert::AreEqual(1472, static_cast<int>(producerUdp->MaxDatagramBytes()));
+				}
+			}
+			while (received.size() < 100)
+			{
+				Assert::IsTrue(consumer->DeQAll(received, timeout) > 0);
+			}
+			for (int i = 0; i < 100; ++i)
+			{
+				Assert::AreEqual(i, received[i].mValue);
+			}
+			consumer->Stop();
+			producer->Stop();
+		}
+
+		TEST_METHOD(Network_ConfigureHooksRunOnTheWorkers)
+		{
+			auto recording = std::make_shared<ThreadRecordingNetwork>();
+			std::shared_ptr<INetwork> network = recording;
+			auto consumer = std::make_unique<QConsumer<TestBody>>(network);
+			auto producer = std::make_unique<QProducer<TestBody>>(network, ProducerConfig{ 16 });
+			producer->EnQ(TestBody{ 1 });
+			TestBody received;
+			std::chrono::duration<int, std::milli> timeout(2000);
+			Assert::AreEqual(1, static_cast<int>(consumer->DeQ(&received, 1, timeout)));
+			consumer->Stop();
+			producer->Stop();
+
+			Assert::IsTrue(recording->mProducerConfigured.load() == recording->mProducerSent.load());
+			Assert::IsTrue(recording->mConsumerConfigured.load() == recording->mConsumerReceived.load());
+			Assert::IsTrue(recording->mProducerConfigured.load() != recording->mConsumerConfigured.load());
+			Assert::IsTrue(recording->mProducerConfigured.load() != std::this_thread::get_id());
+			Assert::IsTrue(recording->mConsumerConfigured.load() != std::this_thread::get_id());
+		}
+
+		TEST_METHOD(UdpNetwork_BadOptionIsLoggedNotFatal)
+		{
+			// there is no cpu 1000 to pin the producer to
+			UdpNetworkOptions producerOptions;
+			producerOptions.mProducerCpu = 1000;
+			std::shared_ptr<INetwork> consumerEnd(new UdpNetwork(31425));
+			auto producerUdp = std::make_shared<UdpNetwork>("127.0.0.1", 31425, producerOptions);
+			std::shared_ptr<INetwork> producerEnd = producerUdp;
+			auto consumer = std::make_unique<QConsumer<TestBody>>(consumerEnd);
+			auto producer = std::make_unique<QProducer<TestBody>>(producerEnd, ProducerConfig{ 16 });
+			for (int i = 0; i < 10; ++i)
+			{
+				producer->EnQ(TestBody{ i });
+			}
+			std::vector<TestBody> received;
+			std::chrono::duration<int, std::milli> timeout(2000);
+			while (received.size() < 10)
+			{
+				Assert::IsTrue(consumer->DeQAll(received, timeout) > 0);
+			}
+			consumer->Stop();
+			producer->Stop();
+			Assert::AreEqual(1, static_cast<int>(producerUdp->FailedOptions()));
+		}
+
+		TEST_METHOD(Producer_EnQTokensSettleAsAcksArrive)
+		{
+			std::shared_ptr<INetwork> network(new IdealNetwork());
+			auto consumer = std::make_unique<QConsumer<TestBody>>(network);
+			auto producer = std::make_unique<QProducer<TestBody>>(network, ProducerConfig{ 16 });
+			std::vector<uint64_t> tokens;
+			for (int i = 0; i < 100; ++i)
+			{
+				tokens.push_back(producer->EnQ(TestBody(i)));
+			}
+			TestBody block[10];
+			tokens.push_back(producer->EnQ(block, 10));
+			for (size_t i = 0; i < 100; ++i)
+			{
+				Assert::AreEqual(static_cast<uint64_t>(i + 1), tokens[i]);
+			}
+			Assert::AreEqual(static_cast<uint64_t>(110), tokens.back());
+
+			auto half = producer->WhenSettled(tokens[49]);
+			Assert::IsTrue(half.wait_for(std::chrono::seconds(2)) == std::future_status::ready);
+			Assert::IsTrue(producer->SettledFrames() >= 50);
+			Assert::IsTrue(producer->Flush(std::chrono::duration<int, std::milli>(2000)));
+			Assert::AreEqual(static_cast<uint64_t>(110), producer->SettledFrames());
+			Assert::IsTrue(producer->WhenSettled(tokens.back()).wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+			consumer->Stop();
+			producer->Stop();
+		}
+
+		TEST_METHOD(Producer_FlushTimesOutWithNoConsumerAndStopFailsWaiters)
+		{
+			std::shared_ptr<INetwork> network(new IdealNetwork());
+			auto producer = std::make_unique<QProducer<TestBody>>(network, ProducerConfig{ 16 });
+			const uint64_t token = producer->EnQ(TestBody(1));
+			auto settled = producer->WhenSettled(token);
+			Assert::IsFalse(producer->Flush(std::chrono::duration<int, std::milli>(50)));
+			auto flushing = std::async(std::launch::async, [&producer]()
+				{
+					return producer->Flush(std::chrono::duration<int, std::milli>(10000));
+				});
+			std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(50));
+			producer->Stop();
+
+			// the frame was discarded, not settled
+			Assert::IsTrue(flushing.wait_for(std::chrono::seconds(2)) == std::future_status::ready);
+			Assert::IsFalse(flushing.get());
+			Assert::IsFalse(settled.get());
+			Assert::IsFalse(producer->Flush(std::chrono::duration<int, std::milli>(50)));
+		}
+
+		static void AssertDelivered(QConsumer<TestBody>& consumer, int from, int to)
+		{
+			std::vector<TestBody> received;
+			std::chrono::duration<int, std::milli> timeout(2000);
+			while (static_cast<int>(received.size()) < to - from + 1)
+			{
+				Assert::IsTrue(consumer.DeQAll(received, timeout) > 0);
+			}
+			Assert::AreEqual(to - from + 1, static_cast<int>(received.size()));
+			for (int i = from; i <= to; ++i)
+			{
+				Assert::AreEqual(i, received[i - from].mValue);
+			}
+		}
+
+		TEST_METHOD(Handshake_RestartedProducerStartsANewSession)
+		{
+			std::shared_ptr<INetwork> network(new IdealNetwork());
+			ProducerConfig config;
+			config.mHandshake = true;
+			auto consumer = std::make_unique<QConsumer<TestBody>>(network);
+			auto producer = std::make_unique<QProducer<TestBody>>(network, config);
+			for (int i = 0; i < 10; ++i)
+			{
+				producer->EnQ(TestBody{ i });
+			}
+			AssertDelivered(*consumer, 0, 9);
+			producer->Stop();
+
+			// numbered from 1 again, which the consumer has already delivered
+			producer = std::make_unique<QProducer<TestBody>>(network, config);
+			for (int i = 100; i < 110; ++i)
+			{
+				producer->EnQ(TestBody{ i });
+			}
+			AssertDelivered(*consumer, 100, 109);
+			consumer->Stop();
+			producer->Stop();
+		}
+
+		TEST_METHOD(Handshake_RestartedConsumerIsWelcomedBack)
+		{
+			std::shared_ptr<INetwork> network(new IdealNetwork());
+			ProducerConfig config;
+			config.mHandshake = true;
+			auto producer = std::make_unique<QProducer<TestBody>>(network, config);
+			auto consumer = std::make_unique<QConsumer<TestBody>>(network);
+			for (int i = 0; i < 10; ++i)
+			{
+				producer->EnQ(TestBody{ i });
+			}
+			AssertDelivered(*consumer, 0, 9);
+			std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(50));
+			consumer->Stop();
+
+			// the new consumer drops these until the producer says hello again
+			consumer = std::make_unique<QConsumer<TestBody>>(network);
+			for (int i = 10; i < 20; ++i)
+			{
+				producer->EnQ(TestBody{ i });
+			}
+			AssertDelivered(*consumer, 10, 19);
+			consumer->Stop();
+			producer->Stop();
+		}
+
+		TEST_METHOD(Producer_NackRepairsOnlyMissingFrames)
+		{
+			std::shared_ptr<INetwork> network(new IdealNetwork());
+			ProducerConfig config;
+			config.mRepair = RepairMode::Nack;
+			auto producer = std::make_unique<QProducer<TestBody>>(network, config);
+			for (int i = 1; i <= 10; ++i)
+			{
+				producer->EnQ(TestBody{ i });
+			}
+			std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(10));
+			Header nack(4);
+			nack.mType = FrameType::Nack;
+			nack.mRange = 2;
+			network->ConsumerEnQ(Frame<TestBody>(nack).mBytes);
+			std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(10));
+			producer->Stop();
+
+			// the window never blocks, all ten go out and the last eight stay repairable
+			std::vector<SeqNo> data;
+			Header lastHeartbeat;
+			while (network->ProducerToConsumerSize())
+			{
+				std::chrono::duration<int, std::milli> timeout(100);
+				std::vector<uint8_t> bytes;
+				network->ConsumeDeQ(bytes, timeout);
+				Frame<TestBody> frame(bytes);
+				if (frame.mHeader.mType == FrameType::Heartbeat)
+				{
+					lastHeartbeat = frame.mHeader;
+				}
+				else
+				{
+					data.push_back(frame.mHeader.mSeqNo);
+				}
+			}
+			Assert::AreEqual(12, static_cast<int>(data.size()));
+			Assert::AreEqual(4, static_cast<int>(data[10]));
+			Assert::AreEqual(5, static_cast<int>(data[11]));
+			Assert::AreEqual(2, static_cast<int>(producer->ResentFrames()));
+			Assert::IsTrue(lastHeartbeat.mType == FrameType::Heartbeat);
+		}
+
+		TEST_METHOD(Consumer_NacksGapsAndSkipsWhatCannotBeRepaired)
+		{
+			auto network = std::shared_ptr<INetwork>(new IdealNetwork());
+			ConsumerConfig config;
+			config.mRepair = RepairMode::Nack;
+			auto consumer = std::make_unique<QConsumer<TestBody>>(network, config);
+			for (SeqNo seqNo : { 1, 2, 4 })
+			{
+				network->ProducerEnQ(Frame<TestBody>(Header(seqNo), TestBody{ static_cast<int>(seqNo) }).mBytes);
+			}
+			std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(10));
+
+			size_t feedbackCount = 0;
+			Header nack = GetLastAck(network, feedbackCount);
+			Assert::AreEqual(1, static_cast<int>(feedbackCount));
+			Assert::IsTrue(nack.mType == FrameType::Nack);
+			Assert::AreEqual(3, static_cast<int>(nack.mSeqNo));
+			Assert::AreEqual(1, static_cast<int>(nack.mRange));
+			Assert::AreEqual(2, static_cast<int>(consumer->Size()));
+
+			// producer can only repair 5 and 6 now, so 3 is given up and 4 delivered
+			Header heartbeat(6);
+			heartbeat.mType = FrameType::Heartbeat;
+			heartbeat.mRange = 2;
+			network->ProducerEnQ(Frame<TestBody>(heartbeat).mBytes);
+			std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(50));
+			consumer->Stop();
+
+			Assert::AreEqual(3, static_cast<int>(consumer->Size()));
+			Assert::AreEqual(1, static_cast<int>(consumer->UnrecoverableFrames()));
+			nack = GetLastAck(network, feedbackCount);
+			Assert::IsTrue(nack.mType == FrameType::Nack);
+			Assert::AreEqual(5, static_cast<int>(nack.mSeqNo));
+			Assert::AreEqual(2, static_cast<int>(nack.mRange));
+		}
+
 		TEST_METHOD(Consumer_InSequenceMessageDelivered)
 		{
 			std::shared_ptr<INetwork> network(new IdealNetwork());
@@ -182,14 +863,17 @@ namespace Qtest
 		TEST_METHOD(Consumer_SendsAcksWhenNoDataRx)
 		{
 			auto network = std::shared_ptr<INetwork>(new IdealNetwork());
-			auto consumer = std::make_unique<QConsumer<TestBody>>(network);
+			ConsumerConfig config;
+			config.mKeepalive = std::chrono::milliseconds(250);
+			auto consumer = std::make_unique<QConsumer<TestBody>>(network, config);
 
 			std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(1000));
 			consumer->Stop();
 
+			// idle, so only keepalives
 			size_t waitingAckCount;
 			auto ackHeader = GetLastAck(network, waitingAckCount);
-			Assert::IsTrue(8 <= waitingAckCount && waitingAckCount <= 10);
+			Assert::IsTrue(3 <= waitingAckCount && waitingAckCount <= 5);
 			Assert::AreEqual(0, (int)ackHeader.mSeqNo);
 		}
 
@@ -239,6 +923,61 @@ namespace Qtest
 			}
 		}
 
+		TEST_METHOD(Consumer_CallbackDeliversInOrderWithoutQueuing)
+		{
+			auto network = std::shared_ptr<INetwork>(new IdealNetwork());
+			std::vector<int> delivered;
+			DeliveryCallbacks<TestBody> callbacks;
+			callbacks.mOnDeliver = [&](const TestBody& body) { delivered.push_back(body.mValue); };
+			auto consumer = std::make_unique<QConsumer<TestBody>>(network, ConsumerConfig(), callbacks);
+
+			network->ProducerEnQ(Frame(Header(2), TestBody{ 20 }).mBytes);
+			network->ProducerEnQ(Frame(Header(3), TestBody{ 30 }).mBytes);
+			network->ProducerEnQ(Frame(Header(1), TestBody{ 10 }).mBytes);
+			network->ProducerEnQ(Frame(Header(4), TestBody{ 40 }).mBytes);
+			std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(500));
+			consumer->Stop();
+
+			Assert::AreEqual(0, (int)consumer->Size());
+			Assert::AreEqual(4, (int)delivered.size());
+			for (int i = 0; i < 4; ++i)
+			{
+				Assert::AreEqual((i + 1) * 10, delivered[i]);
+			}
+			size_t waitingAckCount;
+			auto ackHeader = GetLastAck(network, waitingAckCount);
+			Assert::AreEqual((int)4, (int)ackHeader.mSeqNo);
+		}
+
+		TEST_METHOD(Consumer_BatchCallbackGetsTheRunAFilledGapReleases)
+		{
+			auto network = std::shared_ptr<INetwork>(new IdealNetwork());
+			std::vector<std::vector<int>> batches;
+			DeliveryCallbacks<TestBody> callbacks;
+			callbacks.mOnDeliverBatch = [&](const TestBody* bodies, size_t count)
+			{
+				batches.emplace_back();
+				for (size_t i = 0; i < count; ++i)
+				{
+					batches.back().push_back(bodies[i].mValue);
+				}
+			};
+			auto consumer = std::make_unique<QConsumer<TestBody>>(network, ConsumerConfig(), callbacks);
+
+			network->ProducerEnQ(Frame(Header(1), TestBody{ 10 }).mBytes);
+			network->ProducerEnQ(Frame(Header(3), TestBody{ 30 }).mBytes);
+			network->ProducerEnQ(Frame(Header(4), TestBody{ 40 }).mBytes);
+			network->ProducerEnQ(Frame(Header(2), TestBody{ 20 }).mBytes);
+			std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(500));
+			consumer->Stop();
+
+			Assert::AreEqual(0, (int)consumer->Size());
+			Assert::AreEqual(3, (int)batches.size());
+			Assert::IsTrue(batches[0] == std::vector<int>{ 10 });
+			Assert::IsTrue(batches[1] == std::vector<int>{ 20 });
+			Assert::IsTrue(batches[2] == (std::vector<int>{ 30, 40 }));
+		}
+
 		TEST_METHOD(Consumer_DuplicatePendingFrameIgnored)
 		{
 			auto network = std::shared_ptr<INetwork>(new IdealNetwork());
@@ -294,5 +1033,172 @@ namespace Qtest
 			ackHeader = GetLastAck(network, waitingAckCount);
 			Assert::AreEqual((int)3, (int)ackHeader.mSeqNo);
 		}
+
+		TEST_METHOD(Consumer_UnorderedDeliversOnArrival)
+		{
+			auto network = std::shared_ptr<INetwork>(new IdealNetwork());
+			ConsumerConfig config;
+			config.mDelivery = Delivery::Unordered;
+			auto consumer = std::make_unique<QConsumer<TestBody>>(network, config);
+
+			network->ProducerEnQ(Frame(Header(2), TestBody{ 20 }).mBytes);
+			network->ProducerEnQ(Frame(Header(3), TestBody{ 30 }).mBytes);
+			network->ProducerEnQ(Frame(Header(2), TestBody{ 20 }).mBytes); // duplicate
+			std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(200));
+			Assert::AreEqual(2, (int)consumer->Size());
+			size_t waitingAckCount;
+			auto ackHeader = GetLastAck(network, waitingAckCount);
+			Assert::AreEqual(0, (int)ackHeader.mSeqNo); // still missing 1
+
+			network->ProducerEnQ(Frame(Header(1), TestBody{ 10 }).mBytes);
+			std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(200));
+			for (int expected : { 20, 30, 10 })
+			{
+				TestBody rcvddata;
+				consumer->DeQ(rcvddata);
+				Assert::AreEqual(expected, rcvddata.mValue);
+			}
+			consumer->Stop();
+			ackHeader = GetLastAck(network, waitingAckCount);
+			Assert::AreEqual(3, (int)ackHeader.mSeqNo);
+		}
+
+		TEST_METHOD(Consumer_WindowHoldsProducerBackUntilRead)
+		{
+			std::shared_ptr<INetwork> network(new IdealNetwork());
+			ConsumerConfig consumerConfig;
+			consumerConfig.mMaxBufferedFrames = 32;
+			auto consumer = std::make_unique<QConsumer<TestBody>>(network, consumerConfig);
+			auto producer = std::make_unique<QProducer<TestBody>>(network, ProducerConfig{ 16 });
+			constexpr int frames = 1000;
+			for (int i = 0; i < frames; ++i)
+			{
+				producer->EnQ(TestBody{ i });
+			}
+
+			// nothing is read, so the rest wait with the producer
+			std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(300));
+			Assert::IsTrue(consumer->Size() <= 32);
+			Assert::IsTrue(producer->Size() >= frames - 32 - 16);
+
+			std::vector<TestBody> received(8);
+			std::chrono::duration<int, std::milli> timeout(2000);
+			for (int next = 0; next < frames;)
+			{
+				Assert::IsTrue(consumer->Size() <= 32);
+				const size_t count = consumer->DeQ(&received[0], received.size(), timeout);
+				Assert::IsTrue(count > 0);
+				for (size_t i = 0; i < count; ++i, ++next)
+				{
+					Assert::AreEqual(next, received[i].mValue);
+				}
+			}
+			consumer->Stop();
+			producer->Stop();
+		}
+
+		TEST_METHOD(Consumer_LostReopenAckIsRepeated)
+		{
+			auto lossy = std::make_shared<DropReopenAckNetwork>(32);
+			std::shared_ptr<INetwork> network = lossy;
+			ConsumerConfig consumerConfig;
+			consumerConfig.mMaxBufferedFrames = 32;
+			consumerConfig.mKeepalive = std::chrono::milliseconds(10000);
+			auto consumer = std::make_unique<QConsumer<TestBody>>(network, consumerConfig);
+			auto producer = std::make_unique<QProducer<TestBody>>(network, ProducerConfig{ 16 });
+			constexpr int frames = 200;
+			for (int i = 0; i < frames; ++i)
+			{
+				producer->EnQ(TestBody{ i });
+			}
+			std::this_thread::sleep_for(std::chrono::duration<int, std::milli>(100));
+
+			// well inside the keepalive, which would otherwise be what reopens it
+			std::vector<TestBody> received;
+			std::chrono::duration<int, std::milli> timeout(1000);
+			while (received.size() < frames)
+			{
+				Assert::IsTrue(consumer->DeQAll(received, timeout) > 0);
+			}
+			Assert::IsTrue(lossy->mDropped);
+			for (int i = 0; i < frames; ++i)
+			{
+				Assert::AreEqual(i, received[i].mValue);
+			}
+			consumer->Stop();
+			producer->Stop();
+		}
+
+		TEST_METHOD(Producer_ExpiredFrameIsSkippedByConsumer)
+		{
+			std::shared_ptr<INetwork> network(new DropFrameNetwork(3));
+			ProducerConfig config;
+			config.mTtl = std::chrono::milliseconds(200);
+			auto consumer = std::make_unique<QConsumer<TestBody>>(network);
+			auto producer = std::make_unique<QProducer<TestBody>>(network, config);
+			for (int i = 1; i <= 10; ++i)
+			{
+				producer->EnQ(TestBody{ i });
+			}
+
+			// everything but the lost frame, still in order
+			std::vector<TestBody> received;
+			std::chrono::duration<int, std::milli> timeout(2000);
+			while (received.size() < 9)
+			{
+				Assert::IsTrue(consumer->DeQAll(received, timeout) > 0);
+			}
+			Assert::AreEqual(9, static_cast<int>(received.size()));
+			int expected = 1;
+			for (auto& body : received)
+			{
+				expected += expected == 3 ? 1 : 0;
+				Assert::AreEqual(expected++, body.mValue);
+			}
+			// acks are cumulative, so the frames held behind the gap expire too,
+			// but only the lost one goes undelivered
+			Assert::IsTrue(producer->ExpiredFrames() >= 1);
+			Assert::AreEqual(1, static_cast<int>(consumer->UnrecoverableFrames()));
+			consumer->Stop();
+			producer->Stop();
+		}
+
+		TEST_METHOD(Consumer_TracesFramesAHeartbeatSkipDelivers)
+		{
+			std::shared_ptr<INetwork> network(new DropFrameNetwork(3));
+			auto tracer = std::make_shared<MessageTracer>(TraceConfig{ 1 });
+			ConsumerConfig consumerConfig;
+			consumerConfig.mTracer = tracer;
+			ProducerConfig config;
+			config.mTtl = std::chrono::milliseconds(200);
+			auto consumer = std::make_unique<QConsumer<TestBody>>(network, consumerConfig);
+			auto producer = std::make_unique<QProducer<TestBody>>(network, config);
+			for (int i = 1; i <= 10; ++i)
+			{
+				producer->EnQ(TestBody{ i });
+			}
+
+			std::vector<TestBody> received;
+			std::chrono::duration<int, std::milli> timeout(2000);
+			while (received.size() < 9)
+			{
+				Assert::IsTrue(consumer->DeQAll(received, timeout) > 0);
+			}
+			consumer->Stop();
+			producer->Stop();
+
+			// the frames held behind the lost one are delivered and taken too
+			const auto events = tracer->Events();
+			for (SeqNo seqNo = 4; seqNo <= 10; ++seqNo)
+			{
+				for (auto stage : { TraceStage::Delivered, TraceStage::Taken })
+				{
+					Assert::IsTrue(std::any_of(events.begin(), events.end(), [&](const MessageTracer::Event& event)
+						{
+							return event.mSeqNo == seqNo && event.mStage == stage;
+						}));
+				}
+			}
+		}
 	};
 }
@@ -1,5 +1,6 @@
 #include "QProducer.h"
 #include "QConsumer.h"
+#include "QSharedMemoryNetwork.h"
 
 #include <future>
 #define _USE_MATH_DEFINES
@@ -27,13 +28,17 @@ double GenerateSignal(const microseconds & uSecSinceStart)
 	return signal;
 }
 
-int main()
+// "shm" as the first argument swaps UDP loopback for shared memory
+int main(int argc, char* argv[])
 {
-	auto producer = std::async(std::launch::async, []()
+	const bool sharedMemory = argc > 1 && std::string(argv[1]) == "shm";
+
+	auto producer = std::async(std::launch::async, [sharedMemory]()
 		{
 			auto processStart = system_clock::now();
 			duration<int, std::milli> sleepTime_ms(10);
-			std::shared_ptr<INetwork> qudp(new UdpNetwork("127.0.0.1", 31415));
+			std::shared_ptr<INetwork> qudp(sharedMemory ?
+				static_cast<INetwork*>(new SharedMemoryNetwork("SignalProducer")) : new UdpNetwork("127.0.0.1", 31415));
 			auto qProducer = std::make_unique<QProducer<SignalData>>(qudp);
 			while (true)
 			{
@@ -48,9 +53,10 @@ int main()
 			}
 		});
 
-	auto consumer = std::thread([]()
+	auto consumer = std::thread([sharedMemory]()
 		{
-			std::shared_ptr<INetwork> qudp(new UdpNetwork(31415));
+			std::shared_ptr<INetwork> qudp(sharedMemory ?
+				static_cast<INetwork*>(new SharedMemoryNetwork("SignalProducer")) : new UdpNetwork(31415));
 			auto qConsumer = std::make_unique<QConsumer<SignalData>>(qudp);
 			while (true)
 			{